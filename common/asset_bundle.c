@@ -0,0 +1,167 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "asset_bundle.h"
+
+struct asset_bundle
+{
+	const unsigned char *map;
+	size_t map_size;
+	const struct asset_bundle_header *header;
+	const uint32_t *bucket;
+	const struct asset_entry *entry;
+};
+
+/* FNV-1a */
+uint32_t asset_hash(const char *name)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+uint64_t asset_stamp(uint64_t stamp, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		stamp ^= *p++;
+		stamp *= UINT64_C(0x100000001b3);
+	}
+	return stamp;
+}
+
+/* Is [offset, offset+len) inside the file? */
+static bool in_bundle(const struct asset_bundle *b,
+		      uint64_t offset, uint64_t len)
+{
+	return offset <= b->map_size && len <= b->map_size - offset;
+}
+
+/* Check everything lookups will trust, once, so they needn't */
+static bool check_bundle(const struct asset_bundle *b)
+{
+	const struct asset_bundle_header *h = b->header;
+	uint32_t i;
+
+	if (memcmp(h->magic, ASSET_BUNDLE_MAGIC, sizeof(h->magic)) != 0)
+		return false;
+	if (h->num_buckets == 0 || (h->num_buckets & (h->num_buckets-1)))
+		return false;
+	if (!in_bundle(b, sizeof(*h),
+		       ASSET_BUCKETS_SIZE(h->num_buckets)
+		       + (uint64_t)h->num_assets * sizeof(struct asset_entry)))
+		return false;
+
+	if (b->bucket[0] != 0 || b->bucket[h->num_buckets] != h->num_assets)
+		return false;
+	for (i = 0; i < h->num_buckets; i++)
+		if (b->bucket[i] > b->bucket[i+1])
+			return false;
+
+	for (i = 0; i < h->num_assets; i++) {
+		const struct asset_entry *e = &b->entry[i];
+
+		if (!in_bundle(b, e->name_offset, e->name_length)
+		    || !in_bundle(b, e->offset, e->size))
+			return false;
+	}
+	return true;
+}
+
+struct asset_bundle *asset_bundle_map(const char *path)
+{
+	struct asset_bundle *b;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0
+	    || st.st_size < (off_t)sizeof(struct asset_bundle_header)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	b = malloc(sizeof(*b));
+	if (!b) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	b->map = map;
+	b->map_size = st.st_size;
+	b->header = map;
+	b->bucket = (const uint32_t *)(b->map + sizeof(*b->header));
+	b->entry = (const struct asset_entry *)
+		(b->map + sizeof(*b->header)
+		 + ASSET_BUCKETS_SIZE(b->header->num_buckets));
+
+	if (!check_bundle(b)) {
+		asset_bundle_unmap(b);
+		return NULL;
+	}
+	return b;
+}
+
+uint64_t asset_bundle_stamp(const struct asset_bundle *bundle)
+{
+	return bundle->header->stamp;
+}
+
+const void *asset_bundle_find(const struct asset_bundle *bundle,
+			      const char *name, size_t *size)
+{
+	uint32_t hash, b, i;
+	size_t len;
+
+	hash = asset_hash(name);
+	len = strlen(name);
+	b = hash & (bundle->header->num_buckets - 1);
+
+	for (i = bundle->bucket[b]; i < bundle->bucket[b+1]; i++) {
+		const struct asset_entry *e = &bundle->entry[i];
+
+		if (e->hash == hash
+		    && e->name_length == len
+		    && memcmp(bundle->map + e->name_offset, name, len) == 0) {
+			*size = e->size;
+			return bundle->map + e->offset;
+		}
+	}
+	return NULL;
+}
+
+void asset_bundle_unmap(struct asset_bundle *bundle)
+{
+	munmap((void *)bundle->map, bundle->map_size);
+	free(bundle);
+}
@@ -0,0 +1,108 @@
+#ifndef _ASSET_BUNDLE_H
+#define _ASSET_BUNDLE_H
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* An asset bundle is every image and audio sample the booth would
+   otherwise fetch one by one, in a single file it can map into
+   memory.  make_asset_bundles writes them on the server; the booth
+   fetches them at boot and looks assets up by URL.
+
+   Layout (native byte order: server and booths are the same machines):
+	struct asset_bundle_header
+	uint32_t bucket[num_buckets + 1], zero-padded to a multiple of 8
+	  bytes (ASSET_BUCKETS_SIZE) so the entries are aligned
+	struct asset_entry entry[num_assets]
+	names (not nul-terminated)
+	contents, each aligned to ASSET_ALIGN
+
+   Entries are grouped by bucket (hash & (num_buckets - 1)): those in
+   bucket b are entry[bucket[b]] up to entry[bucket[b+1]]. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ASSET_BUNDLE_MAGIC "EVACSAB2"
+
+/* Where bundles live under the document root, and the index of them */
+#define ASSET_BUNDLE_DIR "/bundles/"
+#define ASSET_BUNDLE_INDEX ASSET_BUNDLE_DIR "index"
+
+/* Alignment of each asset's contents in the file */
+#define ASSET_ALIGN 16
+
+struct asset_bundle_header
+{
+	char magic[8];
+	/* Changes whenever any name or contents change */
+	uint64_t stamp;
+	uint32_t num_assets;
+	/* Always a power of two */
+	uint32_t num_buckets;
+};
+
+/* Bytes taken by the bucket array, padding included */
+#define ASSET_BUCKETS_SIZE(num_buckets) \
+	((((uint64_t)(num_buckets) + 1) * sizeof(uint32_t) + 7) \
+	 & ~(uint64_t)7)
+
+struct asset_entry
+{
+	uint32_t hash;
+	uint32_t name_length;
+	uint64_t name_offset;
+	uint64_t offset;
+	uint64_t size;
+};
+
+/* A PNG the booth will show from an electorate's bundle is stored
+   decoded for its display (see common/rgb565.h), under its URL with
+   ASSET_FRAME_SUFFIX: this header, width*height pixels, then the same
+   pixels highlighted. */
+#define ASSET_FRAME_SUFFIX "#rgb565"
+struct asset_frame
+{
+	uint32_t width;
+	uint32_t height;
+	/* Keeps the pixels aligned */
+	uint64_t reserved;
+};
+
+/* An asset bundle mapped into memory.  It is opaque. */
+struct asset_bundle;
+
+/* Hash of an asset's name (its URL) */
+extern uint32_t asset_hash(const char *name);
+
+/* Fold bytes into a bundle's stamp (start from ASSET_STAMP_INIT) */
+#define ASSET_STAMP_INIT UINT64_C(0xcbf29ce484222325)
+extern uint64_t asset_stamp(uint64_t stamp, const void *data, size_t len);
+
+/* Map a bundle file into memory.  NULL if it can't be read or isn't a
+   complete bundle. */
+extern struct asset_bundle *asset_bundle_map(const char *path);
+
+/* The stamp the bundle was written with */
+extern uint64_t asset_bundle_stamp(const struct asset_bundle *bundle);
+
+/* Find an asset by name: NULL if it isn't in the bundle.  The
+   contents stay valid until the bundle is unmapped. */
+extern const void *asset_bundle_find(const struct asset_bundle *bundle,
+				     const char *name, size_t *size);
+
+/* Unmap a bundle */
+extern void asset_bundle_unmap(struct asset_bundle *bundle);
+#endif /*_ASSET_BUNDLE_H*/
@@ -229,25 +229,11 @@ static enum error unpack_ballot_contents(const struct http_vars *vars)
 	return ERR_OK;
 }
 
-/* DDS3.2.4: Authenticate */
-/* Authenticate barcode: returns electorate (to be freed by caller),
-   or calls display_error() itself */
-enum error authenticate(const struct barcode *bc, struct electorate **elecp)
+enum error unpack_authentication(const struct http_vars *reply,
+				 struct electorate **elecp)
 {
-	struct http_vars *reply;
-	enum error ret;
 	const char *val;
-	const struct http_vars request[]
-		= { { (char *)"barcode", (char *)bc->ascii }, { NULL, NULL } };
 
-	fprintf(stderr,"common/authenticate: HTTP exchange with %s:%u\n",get_server(), get_port());
-	reply = http_exchange(get_server(), get_port(),
-			      AUTHENTICATE_CGI, request);
-	/* Some error occurred? */
-	if (http_error(reply) != ERR_OK)
-		return http_error(reply);
-
-	fprintf(stderr,"common/authenticate: HTTP exchange complete\n");
 	/* We should have an electorate name, electorate code, and
 	   number of seats. */
 	val = http_string(reply, "electorate_name");
@@ -270,9 +256,28 @@ enum error authenticate(const struct barcode *bc, struct electorate **elecp)
 	(*elecp)->num_seats = atoi(val);
 
 	/* We also set the ballot contents from these variables */
-	ret = unpack_ballot_contents(reply);
-	http_free(reply);
-	return ret;
+	return unpack_ballot_contents(reply);
 }
 
+/* DDS3.2.4: Authenticate */
+/* Authenticate barcode: returns electorate (to be freed by caller),
+   or calls display_error() itself */
+enum error authenticate(const struct barcode *bc, struct electorate **elecp)
+{
+	struct http_vars *reply;
+	enum error ret;
+	const struct http_vars request[]
+		= { { (char *)"barcode", (char *)bc->ascii }, { NULL, NULL } };
+
+	fprintf(stderr,"common/authenticate: HTTP exchange with %s:%u\n",get_server(), get_port());
+	reply = http_exchange(get_server(), get_port(),
+			      AUTHENTICATE_CGI, request);
+	/* Some error occurred? */
+	if (http_error(reply) != ERR_OK)
+		return http_error(reply);
 
+	fprintf(stderr,"common/authenticate: HTTP exchange complete\n");
+	ret = unpack_authentication(reply, elecp);
+	http_free(reply);
+	return ret;
+}
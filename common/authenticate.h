@@ -35,4 +35,9 @@ extern uint16_t get_port(void);
 /* Authenticate this barcode: fills in elecp (to be freed by caller),
    or returns != ERR_OK. */
 enum error authenticate(const struct barcode *bc, struct electorate **elecp);
+
+/* The electorate (to be freed by caller) and ballot contents from
+   the authenticate CGI's reply, as authenticate() sets them */
+enum error unpack_authentication(const struct http_vars *reply,
+				 struct electorate **elecp);
 #endif /*_AUTHENTICATE_H*/
@@ -35,5 +35,19 @@ void set_ballot_contents(struct ballot_contents *bc)
 	ballot_contents = bc;
 }
 
+/* Free the ballot contents, so they can be set again (a long-lived
+   server authenticates many voters) */
+void free_ballot_contents(void)
+{
+	if (!ballot_contents)
+		return;
+	free(ballot_contents->num_candidates);
+	free(ballot_contents->map_group_to_physical_column);
+	free(ballot_contents->num_candidates_in_physical_column);
+	free(ballot_contents->map_physical_column_to_grid_block);
+	free(ballot_contents);
+	ballot_contents = NULL;
+}
+
 
 
@@ -93,4 +93,7 @@ extern struct ballot_contents *get_ballot_contents(void);
 /* Set the ballot contents (called from authenticate) */
 extern void set_ballot_contents(struct ballot_contents *bc);
 
+/* Free the ballot contents, leaving none set */
+extern void free_ballot_contents(void);
+
 #endif /* _BALLOT_CONTENTS_H  */
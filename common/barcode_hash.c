@@ -21,32 +21,28 @@
 #include "barcode_hash.h"
 
 /* DDSv1A-3.2.1: Generate Hash */
-/* Hash generated is a bitstring: ie. "010101010111" */
-void gen_hash(char hash[HASH_BITS + 1],
+/* Hash generated is the raw SHA-1 digest.  (It used to be stored as
+   a bitstring, each byte least significant bit first: the barcode
+   hash migration converts those.) */
+void gen_hash(unsigned char hash[HASH_BYTES],
 	      const unsigned char barcode_data[],
 	      size_t size)
 {
-	unsigned char sha_md[SHA_DIGEST_LENGTH];
-	char *hashp = hash;
-	unsigned int i,b;
-
-	assert(HASH_BITS == SHA_DIGEST_LENGTH*CHAR_BIT);
+	assert(HASH_BYTES == SHA_DIGEST_LENGTH);
 
 	/* Call the library routine to do it in one fell swoop */
-	SHA1(barcode_data, size, sha_md);
+	SHA1(barcode_data, size, hash);
+}
 
-	/* Convert to bitstring, eg. 0xfeed to 1111111011101101. */
-	for (i = 0; i < SHA_DIGEST_LENGTH; i++) {
-		for (b = 0; b < CHAR_BIT; b++) {
-			if ((sha_md[i] >> b) & 1)
-				*hashp = '1';
-			else
-				*hashp = '0';
-			hashp++;
-		}
-	}
-	assert(hashp == hash + HASH_BITS);
+void hash_to_hex(char hex[HASH_HEX_CHARS + 1],
+		 const unsigned char hash[HASH_BYTES])
+{
+	static const char digits[] = "0123456789abcdef";
+	unsigned int i;
 
-	/* nul-terminate the string */ 
-	*hashp = '\0';
+	for (i = 0; i < HASH_BYTES; i++) {
+		hex[i * 2] = digits[hash[i] >> 4];
+		hex[i * 2 + 1] = digits[hash[i] & 0xf];
+	}
+	hex[HASH_HEX_CHARS] = '\0';
 }
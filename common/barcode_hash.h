@@ -17,7 +17,7 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
 /* This routine not required by client. */
-/* Generate bitstring of hash from the barcode data */
+/* Generate hash of the barcode data */
 #include <limits.h>
 #include <unistd.h>
 #include <openssl/sha.h>
@@ -25,7 +25,17 @@
 /* Number of bits in the barcode hash */
 #define HASH_BITS 160
 
-extern void gen_hash(char hash[HASH_BITS + 1],
+/* The hash is stored as raw bytes (bytea) in the barcode table */
+#define HASH_BYTES (HASH_BITS / CHAR_BIT)
+
+/* Characters in the hex form of the hash, as decode(..., 'hex') takes */
+#define HASH_HEX_CHARS (HASH_BYTES * 2)
+
+extern void gen_hash(unsigned char hash[HASH_BYTES],
 		     const unsigned char barcode_data[],
 		     size_t size);
+
+/* Write the hash in hex, nul-terminated */
+extern void hash_to_hex(char hex[HASH_HEX_CHARS + 1],
+			const unsigned char hash[HASH_BYTES]);
 #endif /*_BARCODE_HASH_H*/
@@ -147,14 +147,18 @@ struct paper *get_paper(PGconn *conn,
 				     batch_number, paper_index);
 
 	ret = malloc(sizeof(*ret));
+	ret->p.index = paper_index;
+	ret->p.supervisor_tick = false;
+	ret->p.active_entry1 = ret->p.active_entry2 = 0;
 
 	if (paper_id ==(unsigned int) -1) {
 	  /* new paper  */
-	    ret->p.index = paper_index;
-	    ret->p.supervisor_tick = false;
 	    ret->entries = NULL;
 	} else {
-	        ret = malloc(sizeof(*ret));
+	        get_active_entries(conn, electorate_name_normalized,
+				   batch_number, paper_index,
+				   &ret->p.active_entry1,
+				   &ret->p.active_entry2);
 	        ret->entries = get_entries_for_paper(conn, paper_id,
 						     electorate_name_normalized);
 	}
@@ -166,55 +170,92 @@ struct paper *get_paper(PGconn *conn,
 	return ret;
 }
 
+static struct entry *new_entry(unsigned int num_prefs, const char *operid,
+			       unsigned int index, unsigned int pvn)
+{
+	struct entry *ret;
+
+	ret = malloc(sizeof(*ret) + sizeof(ret->preferences[0]) * num_prefs);
+	ret->e.num_preferences = num_prefs;
+	strcpy(ret->e.operator_id, operid);
+	ret->e.paper_version_num = pvn;
+	ret->e.index=index;
+	return ret;
+}
+
 /* SIPL 2015-05-20 electorate_name must already have been normalized. */
 void get_papers_for_batch(PGconn *conn, 
 			  struct batch *batch,
 			  char *electorate_name_normalized)
-/* load the batch structure pointed to by batch with paper data*/
+/* load the batch structure pointed to by batch, which has room for
+   batch->b.num_papers papers, with paper, entry and active entry data.
+   It is all fetched with one query, rather than a query for the
+   entries of each paper. */
 {
-        unsigned int i;
+        unsigned int i, row;
 	PGresult *result;
-	unsigned int num_rows,paper_id;
+	unsigned int num_rows, paper_index;
+	struct paper *paper = NULL;
+	struct entry *tmp;
 
 	result =  SQL_query(conn,
-			    "SELECT id, "
-			    "index, "
-			    "supervisor_tick "
-			    "FROM  %s_paper "
-			    "WHERE batch_number= %u "
-			    "ORDER BY index;", 
-			    electorate_name_normalized, batch->b.batch_number);
+			    "SELECT p.index,"
+			    "p.supervisor_tick,"
+			    "p.entry_id1,"
+			    "p.entry_id2,"
+			    "e.id,"
+			    "e.index,"
+			    "e.operator_id,"
+			    "e.num_preferences,"
+			    "e.paper_version,"
+			    "e.preference_list "
+			    "FROM %s_paper p "
+			    "LEFT JOIN %s_entry e ON e.paper_id = p.id "
+			    "WHERE p.batch_number = %u "
+			    "ORDER BY p.index, e.index DESC;", 
+			    electorate_name_normalized,
+			    electorate_name_normalized,
+			    batch->b.batch_number);
 	
 	num_rows = PQntuples(result);
 
-	/*  build a return structure
+	/*  build a return structure: one row per entry, with the
+	    paper repeated on each (or one row with no entry).
 	 */
-	for (i=0;i<num_rows;i++) {
-		paper_id = atoi(PQgetvalue(result, i, 0));
-		batch->papers[i].p.index = atoi(PQgetvalue(result,i,1));
-		batch->papers[i].p.supervisor_tick =  
-			(*PQgetvalue(result, i, 2) == 't')?true:false;
-
-		/* entries and sub-structures inserted into batch->papers */
-		batch->papers[i].entries = get_entries_for_paper(conn,
-					    paper_id,electorate_name_normalized);
-	
-	}
-	PQclear(result);
-	
-}
+	for (row=0, i=0; row<num_rows; row++) {
+		paper_index = atoi(PQgetvalue(result,row,0));
+		if (!paper || paper->p.index != paper_index) {
+			/* Papers added since they were counted are
+			   left for next time */
+			if (i == batch->b.num_papers)
+				break;
+			paper = &batch->papers[i++];
+			paper->p.index = paper_index;
+			paper->p.supervisor_tick =  
+				(*PQgetvalue(result,row,1) == 't')?true:false;
+			paper->p.active_entry1 = atoi(PQgetvalue(result,row,2));
+			paper->p.active_entry2 = atoi(PQgetvalue(result,row,3));
+			paper->entries = NULL;
+		}
+		if (PQgetisnull(result,row,4))
+			continue;
 
-static struct entry *new_entry(unsigned int num_prefs, const char *operid,
-			       unsigned int index, unsigned int pvn)
-{
-	struct entry *ret;
+		tmp = new_entry(atoi(PQgetvalue(result,row,7)), /* num prefs */
+				PQgetvalue(result,row,6),       /* operator  */
+				atoi(PQgetvalue(result,row,5)), /* entry ix  */
+				atoi(PQgetvalue(result,row,8)));/* pvn       */ 
 
-	ret = malloc(sizeof(*ret) + sizeof(ret->preferences[0]) * num_prefs);
-	ret->e.num_preferences = num_prefs;
-	strcpy(ret->e.operator_id, operid);
-	ret->e.paper_version_num = pvn;
-	ret->e.index=index;
-	return ret;
+      /* link the entries such that the last entry is at the head of the list */
+		tmp->next = paper->entries;
+		paper->entries = tmp;
+
+		get_prefs_for_entry(atoi(PQgetvalue(result,row,4)), /* entry id */
+				    atoi(PQgetvalue(result,row,7)),/* num_prefs */
+				    &tmp->preferences[0],          /* 'out' var */
+				    PQgetvalue(result,row,9));     /* pref list */
+	}
+	PQclear(result);
+	batch->b.num_papers = i;
 }
 
 /* SIPL 2015-05-20 electorate_name must already have been normalized. */
@@ -269,35 +310,19 @@ void get_prefs_for_entry(unsigned int entry_id, unsigned int num_preferences,
 /* load the entry structure pointed to by entry with preference data*/
 
 {
-	unsigned int i, num_prefs;
-	char *pref_ptr;
+	size_t len = strlen(preference_list);
+	unsigned int num_prefs = len / DIGITS_PER_PREF;
 
-	for (pref_ptr=(char *)preference_list,num_prefs=0;
-	     strlen(pref_ptr)>=DIGITS_PER_PREF;
-	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_prefs++);
-	
 	if (num_prefs != num_preferences)
 		bailout("database reports %u preferences for entry_id(%u), "
 			"but found %u instead.",
 			num_preferences, entry_id, num_prefs);
 
-	/* Sanity Check: pref_ptr should be at end of string */
-	if ( strlen(pref_ptr)) 
+	/* Decode preference list into memory structure */
+	if (decode_preferences(preferences, num_preferences,
+			       preference_list, len) < 0)
 		bailout("malformed pref list entry_id(%u)\n'%s'\n",
 			entry_id,preference_list);
-
-	/* Decode preference list into memory structure */
-	for (pref_ptr = preference_list, i = 0;
-	     i < num_prefs; 
-	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
-	{
-		sscanf(pref_ptr,(const char *)"%2u%2u%2u",
-		       &preferences[i].prefnum,
-		       &preferences[i].group_index,
-		       &preferences[i].db_candidate_index
-			);
-	}
-	
 }
 
 
@@ -344,12 +369,11 @@ void append_entry(PGconn *conn,
 	char *electorate_name_normalized, *entry_table_name, *paper_table_name;
         int  paper_id=-1;
         int temp;
-	unsigned int i,entry_index;
+	unsigned int entry_index;
 	/* SIPL 2011-09-26 Increase array size by one to allow
 	   space for null at end, to cope with the case where there
 	   really are PREFNUM_MAX preferences in the vote. */
 	char pref_string[DIGITS_PER_PREF * PREFNUM_MAX + 1];
-	char *pref_ptr, *p;
 	struct predefined_batch *batch;
 
 	/* get electorate code */
@@ -427,18 +451,8 @@ void append_entry(PGconn *conn,
         }
 
 	/* Format the preferences into a string */
-	pref_string[0]='\0';
-	pref_ptr = &pref_string[0];
-	for (i=0;i<newentry->e.num_preferences;i++) {
-		p = sprintf_malloc("%02u%02u%02u",
-				   newentry->preferences[i].prefnum,
-				   newentry->preferences[i].group_index,
-				   newentry->preferences[i].db_candidate_index
-				   );
-		strcpy(pref_ptr,p);
-		pref_ptr +=  (sizeof(char)*(DIGITS_PER_PREF));
-		free(p);
-	}	
+	encode_preferences(pref_string, newentry->preferences,
+			   newentry->e.num_preferences);
         /* Insert new entry into archive */
 	SQL_command(conn,
 		    "INSERT INTO %s(index,operator_id,"
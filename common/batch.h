@@ -95,6 +95,11 @@ struct paper_info
 {
 	unsigned int index;
 	bool supervisor_tick;
+
+	/* Entry indexes of the active entries (entry_id1, entry_id2);
+	   0 if none */
+	int active_entry1;
+	int active_entry2;
 };
 
 struct paper
@@ -45,12 +45,15 @@ void create_barcode_table(PGconn *conn)
         drop_table(conn,"barcode");
 
         create_table(conn, "barcode",
-		     "hash bit("STRINGIZE(HASH_BITS)") NOT NULL PRIMARY KEY,"
+		     "hash bytea NOT NULL PRIMARY KEY,"
 		     "polling_place_code INTEGER NOT NULL "
 		     "REFERENCES polling_place(code),"
 		     "electorate_code INTEGER NOT NULL "
 		     "REFERENCES electorate(code),"
 		     "used BOOL NOT NULL DEFAULT FALSE");
+	/* Barcodes are only ever looked up by equal hash */
+	SQL_command(conn,"CREATE INDEX barcode_hash_idx ON barcode "
+		    "USING hash (hash);");
 	create_index(conn,"barcode","electorate_code",
 		     "barcode_ecode_idx");
 	create_index(conn,"barcode","polling_place_code",
@@ -86,8 +89,26 @@ Precondition: All electorates have been entered.
 	             "batch_number INTEGER NOT NULL "
 	             "REFERENCES batch(number),"
 	             "paper_version INTEGER NOT NULL default -1,"
-	             "time_stamp TEXT NOT NULL default 'unknown',"
-	             "preference_list TEXT default ''";
+	             "time_stamp TIMESTAMP(0) NOT NULL "
+	             "default LOCALTIMESTAMP(0),"
+	             "preference_list TEXT default '',"
+	             /* Set by confirmed_vote_polling_place() */
+	             "polling_place_code INTEGER";
+
+       /* The polling place follows the batch, even when a batch is
+	  renumbered.  Batches missing from the batch table are
+	  electronic ones (EPPP000). */
+       SQL_command(conn,
+		   "CREATE OR REPLACE FUNCTION confirmed_vote_polling_place() "
+		   "RETURNS trigger AS '"
+		   "BEGIN "
+		   "SELECT polling_place_code INTO NEW.polling_place_code "
+		   "FROM batch WHERE number = NEW.batch_number; "
+		   "IF NOT FOUND THEN "
+		   "NEW.polling_place_code := NEW.batch_number / 1000 %% 1000; "
+		   "END IF; "
+		   "RETURN NEW; "
+		   "END;' LANGUAGE plpgsql;");
 
        result = SQL_query(conn,"SELECT name from electorate"); 
        num_rows = PQntuples(result);
@@ -108,6 +129,21 @@ Precondition: All electorates have been entered.
 
 	       index_name=sprintf_malloc("%s_cnfrmd_vt_btch_idx",PQgetvalue(result,i,0));
                create_index(conn,table_name,"batch_number",index_name);
+	       free(index_name);
+
+	       /* For pre-poll/polling day and polling place queries */
+	       index_name=sprintf_malloc("%s_cnfrmd_vt_ts_idx",PQgetvalue(result,i,0));
+               create_index(conn,table_name,"time_stamp",index_name);
+	       free(index_name);
+	       index_name=sprintf_malloc("%s_cnfrmd_vt_pp_idx",PQgetvalue(result,i,0));
+               create_index(conn,table_name,"polling_place_code, time_stamp",
+			    index_name);
+	       SQL_command(conn,
+			   "CREATE TRIGGER %s_cnfrmd_vt_pp_trg "
+			   "BEFORE INSERT OR UPDATE OF batch_number ON %s "
+			   "FOR EACH ROW "
+			   "EXECUTE PROCEDURE confirmed_vote_polling_place();",
+			   PQgetvalue(result,i,0), table_name);
 
 	       free(index_name);
 	       free(sequence_name);
@@ -13,6 +13,7 @@
    You should have received a copy of the GNU General Public License
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
@@ -302,6 +303,169 @@ PGresult *SQL_query(PGconn *conn,const char *fmt, ...)
 	return(result);
 }
 
+PGresult *SQL_prepared(PGconn *conn,const char *name,const char *sql,
+			int num_params,const char *const *params,
+			const int *lengths,const int *formats)
+     /*
+       Run a prepared statement, preparing it first if this
+       connection has not seen it.  Only worth it on a connection
+       that runs the statement many times, and not inside a
+       transaction (the failed first attempt would abort it).  The
+       parameters are text unless formats says binary (1), when
+       lengths gives their sizes (as for PQexecPrepared; both may be
+       NULL).  Return the pointer to the PGresult structure.
+     */
+{
+	PGresult *result;
+	const char *state;
+
+	result = PQexecPrepared(conn,name,num_params,params,
+				lengths,formats,0);
+	state = PQresultErrorField(result,PG_DIAG_SQLSTATE);
+	/* 26000: invalid_sql_statement_name, ie. not prepared yet */
+	if (state && strcmp(state,"26000") == 0) {
+		PQclear(result);
+		result = PQprepare(conn,name,sql,num_params,NULL);
+		if (PQresultStatus(result) != PGRES_COMMAND_OK)
+			bailout("Preparing %s failed: %s\n",
+				sql, PQresultErrorMessage(result));
+		PQclear(result);
+		result = PQexecPrepared(conn,name,num_params,params,
+					lengths,formats,0);
+	}
+	if (PQresultStatus(result) != PGRES_TUPLES_OK
+	    && PQresultStatus(result) != PGRES_COMMAND_OK)
+		bailout("SQL command %s failed: %s (%s)\n",
+			sql, PQresStatus(PQresultStatus(result)),
+			PQresultErrorMessage(result));
+
+	return(result);
+}
+
+unsigned int SQL_copy_out(PGconn *conn,
+			  void (*rowfn)(const char *row, int len, void *data),
+			  void *data, const char *fmt, ...)
+     /*
+       Run a COPY ... TO STDOUT command, and hand each row to rowfn
+       as it arrives, in whatever COPY format was asked for.  Only
+       one row is held in memory at a time.  Return the number of
+       rows.
+     */
+{
+        va_list arglist;
+	PGresult *result;
+	char *sql, *row;
+	int len;
+	unsigned int num_rows = 0;
+
+	va_start(arglist,fmt);
+	sql = vsprintf_malloc(fmt,arglist);
+	va_end(arglist);
+
+	result = PQexec(conn,sql);
+	if (PQresultStatus(result) != PGRES_COPY_OUT)
+	        bailout("SQL command %s failed: %s (%s)\n",
+			sql, PQresStatus(PQresultStatus(result)),
+			PQresultErrorMessage(result));
+	PQclear(result);
+
+	while ((len = PQgetCopyData(conn,&row,0)) > 0) {
+		rowfn(row,len,data);
+		PQfreemem(row);
+		num_rows++;
+	}
+	if (len == -2)
+	        bailout("SQL command %s failed: %s\n",
+			sql, PQerrorMessage(conn));
+
+	/* Collect the final status of the COPY */
+	result = PQgetResult(conn);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	        bailout("SQL command %s failed: %s (%s)\n",
+			sql, PQresStatus(PQresultStatus(result)),
+			PQresultErrorMessage(result));
+	PQclear(result);
+	while ((result = PQgetResult(conn)) != NULL)
+		PQclear(result);
+
+	free(sql);
+	return(num_rows);
+}
+
+void SQL_copy_in(PGconn *conn,const char *fmt, ...)
+     /*
+       Start a COPY ... FROM STDIN command.  Send the rows with
+       SQL_copy_row, and finish with SQL_copy_end.
+     */
+{
+        va_list arglist;
+	PGresult *result;
+	char *sql;
+
+	va_start(arglist,fmt);
+	sql = vsprintf_malloc(fmt,arglist);
+	va_end(arglist);
+
+	result = PQexec(conn,sql);
+	if (PQresultStatus(result) != PGRES_COPY_IN)
+	        bailout("SQL command %s failed: %s (%s)\n",
+			sql, PQresStatus(PQresultStatus(result)),
+			PQresultErrorMessage(result));
+	PQclear(result);
+	free(sql);
+}
+
+void SQL_copy_row(PGconn *conn,const char *fmt, ...)
+     /*
+       Send one row (or several) of COPY data, in the format the
+       COPY asked for: for text, tab separated and newline ended.
+       libpq buffers the data, so this does not wait on the server.
+     */
+{
+        va_list arglist;
+	char buffer[1024], *row = buffer;
+	int len;
+
+	va_start(arglist,fmt);
+	len = vsnprintf(buffer,sizeof(buffer),fmt,arglist);
+	va_end(arglist);
+
+	if (len >= (int)sizeof(buffer)) {
+		va_start(arglist,fmt);
+		row = vsprintf_malloc(fmt,arglist);
+		va_end(arglist);
+	}
+	if (PQputCopyData(conn,row,len) != 1)
+	        bailout("COPY failed: %s\n",PQerrorMessage(conn));
+	if (row != buffer)
+		free(row);
+}
+
+unsigned int SQL_copy_end(PGconn *conn)
+     /*
+       Finish a COPY ... FROM STDIN.  Return the number of rows
+       copied.
+     */
+{
+	PGresult *result;
+	unsigned int num_rows;
+
+	if (PQputCopyEnd(conn,NULL) != 1)
+	        bailout("COPY failed: %s\n",PQerrorMessage(conn));
+
+	result = PQgetResult(conn);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	        bailout("COPY failed: %s (%s)\n",
+			PQresStatus(PQresultStatus(result)),
+			PQresultErrorMessage(result));
+	num_rows = (unsigned int)atoi(PQcmdTuples(result));
+	PQclear(result);
+	while ((result = PQgetResult(conn)) != NULL)
+		PQclear(result);
+
+	return(num_rows);
+}
+
 static char *SQL_single(PGconn *conn,const char *fmt,va_list arglist)
      /*
        Run the SQL query. Return the pointer to the first field of the
@@ -57,6 +57,19 @@ extern int copy_selection(PGresult *result,
 			   const char *table_name,PGconn *target_conn);
 extern PGresult *SQL_query(PGconn *conn,const char *fmt, ...)
      __attribute__ ((format(printf,2,3)));
+extern PGresult *SQL_prepared(PGconn *conn,const char *name,const char *sql,
+			       int num_params,const char *const *params,
+			       const int *lengths,const int *formats);
+extern unsigned int SQL_copy_out(PGconn *conn,
+				 void (*rowfn)(const char *row, int len,
+					       void *data),
+				 void *data, const char *fmt, ...)
+     __attribute__ ((format(printf,4,5)));
+extern void SQL_copy_in(PGconn *conn,const char *fmt, ...)
+     __attribute__ ((format(printf,2,3)));
+extern void SQL_copy_row(PGconn *conn,const char *fmt, ...)
+     __attribute__ ((format(printf,2,3)));
+extern unsigned int SQL_copy_end(PGconn *conn);
 extern unsigned int SQL_command(PGconn *conn,const char *fmt, ...)
      __attribute__ ((format(printf,2,3)));
 extern unsigned int SQL_command_nobail(PGconn *conn,const char *fmt, ...)
@@ -23,6 +23,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include "evacs.h"
+#include "preference_codec.h"
 /*#include "safe.h"*/
 
 /* Place any globals here */
@@ -155,72 +156,87 @@ ssize_t get_next_line(char** line) {
   *line = NULL;
   size_t allocate = 0;
 	int result = getline(line, &allocate, stdin);
+  /* At end of file there is no line */
+  if (result < 0) {
+    free(*line);
+    *line = NULL;
+    return result;
+  }
   strip_nl(*line);
   return result;
 }
 
+int decode_preferences(struct preference preferences[], unsigned int max,
+		       const char *preference_list, size_t len)
+{
+	unsigned int i, num_preferences = len / DIGITS_PER_PREF;
+
+	if (len % DIGITS_PER_PREF || num_preferences > max)
+		return -1;
+
+	for (i = 0; i < num_preferences; i++)
+		if (!decode_preference(preference_list + i * DIGITS_PER_PREF,
+				       &preferences[i].prefnum,
+				       &preferences[i].group_index,
+				       &preferences[i].db_candidate_index))
+			return -1;
+	return num_preferences;
+}
+
+size_t encode_preferences(char *preference_list,
+			  const struct preference preferences[],
+			  unsigned int num_preferences)
+{
+	char *p = preference_list;
+	unsigned int i;
+
+	for (i = 0; i < num_preferences; i++) {
+		/* Two digits each: anything larger would overrun */
+		if (preferences[i].prefnum > 99
+		    || preferences[i].group_index > 99
+		    || preferences[i].db_candidate_index > 99)
+			bailout("Preference %u (group %u, candidate %u) "
+				"does not fit in a preference list\n",
+				preferences[i].prefnum,
+				preferences[i].group_index,
+				preferences[i].db_candidate_index);
+		p = encode_preference(p, preferences[i].prefnum,
+				      preferences[i].group_index,
+				      preferences[i].db_candidate_index);
+	}
+	*p = '\0';
+	return p - preference_list;
+}
+
 extern struct preference_set *unpack_preferences(const char *preference_list)
 {
 	struct preference_set *vote;
-	char *pref_ptr;   
-	unsigned int num_preferences=0,i;
-	unsigned int pref_number, group_index, db_cand_index;
+	size_t len = strlen(preference_list);
+	int num_preferences;
 
-	for (pref_ptr=(char *)preference_list;
-	     strlen(pref_ptr)>=DIGITS_PER_PREF;
-	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_preferences++);
-	
-	if ( strlen(pref_ptr)) 
-		bailout("Malformed preference list: '%s'\n",preference_list);
-	
 	vote = malloc(sizeof(*vote)
-			+ sizeof(vote->candidates[0]) * num_preferences);
-	vote->num_preferences = num_preferences;
-	
+		      + sizeof(vote->candidates[0]) * (len / DIGITS_PER_PREF));
+
 	/* They may not be in order */
-	for (pref_ptr=(char *)preference_list, i = 0;
-	     i < vote->num_preferences; 
-	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
-	{
-		sscanf(pref_ptr,"%2u%2u%2u",&pref_number,&group_index,&db_cand_index);
-		
-		vote->candidates[i]
-			.group_index = group_index;
-		vote->candidates[i]
-			.db_candidate_index = db_cand_index;
-		vote->candidates[i]
-			.prefnum = pref_number;
-	}
-	
+	num_preferences = decode_preferences(vote->candidates,
+					     len / DIGITS_PER_PREF,
+					     preference_list, len);
+	if (num_preferences < 0)
+		bailout("Malformed preference list: '%s'\n",preference_list);
+	vote->num_preferences = num_preferences;
+
 	return vote;
-	
 }
 
 
 char *preference_string(struct preference_set *vote)
 {
-	unsigned int i;
-	/* SIPL 2011-09-26 Increase array size by one to allow
-	   space for null at end, to cope with the case where there
-	   really are PREFNUM_MAX preferences in the vote. */
-	char pref_string[PREFNUM_MAX * DIGITS_PER_PREF + 1];
-	char *return_string, *pref_ptr, *p;
-	
-	pref_string[0]='\0';
-	for (i=0; i <  vote->num_preferences; i++) {
-		/* accumulate new preference */
-		p = sprintf_malloc("%02u%02u%02u",vote->candidates[i].prefnum,
-				   vote->candidates[i].group_index,
-				   vote->candidates[i].db_candidate_index);
-		pref_ptr=&pref_string[0]+sizeof(char)*((i)*DIGITS_PER_PREF);
-		strcpy(pref_ptr,p);
-		free(p);
-	}
-	return_string=malloc(sizeof(char) * (strlen(pref_string) + 1));
-	strcpy(return_string,pref_string);
-	
-	return return_string;
+	char *return_string;
 
+	return_string = malloc(vote->num_preferences * DIGITS_PER_PREF + 1);
+	encode_preferences(return_string, vote->candidates,
+			   vote->num_preferences);
+	return return_string;
 }
 
 char *generate_timestamp(void)
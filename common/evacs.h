@@ -116,12 +116,29 @@ extern void bailout(const char *fmt, ...)
 __attribute__((noreturn, format (printf,1,2)));
 #define vsprintf_malloc g_strdup_vprintf
 #define sprintf_malloc g_strdup_printf
+/* Read a line from stdin into *line (caller frees), without its
+   newline.  At end of file, returns -1 and sets *line to NULL. */
 extern ssize_t get_next_line(char **line);
 
 extern void create_directory(mode_t mode,const char *fmt, ...)
      __attribute__ ((format(printf,2,3)));
 extern void copy_file(const char *source_file,const char *target_file);
 
+/* Decode a preference list LEN characters long (it needn't be
+   terminated) into preferences[], in the order they appear.  Returns
+   how many there are, or -1 if the list is malformed or has more than
+   MAX. */
+extern int decode_preferences(struct preference preferences[],
+			      unsigned int max,
+			      const char *preference_list, size_t len);
+
+/* Encode preferences into preference_list, which must have room for
+   num_preferences * DIGITS_PER_PREF + 1 characters.  Returns its
+   length (it is terminated).  Bails out if any number is above 99. */
+extern size_t encode_preferences(char *preference_list,
+				 const struct preference preferences[],
+				 unsigned int num_preferences);
+
 /* unpack a string of Hexlets into a preference structure */
 extern struct preference_set *unpack_preferences(const char *preference_list);
 
@@ -282,8 +282,6 @@ struct paper_with_error find_errors_in_paper(PGconn *conn,
 	struct paper_with_error pwe;
 	const struct entry *i;
 	struct entry_with_error *ewe = NULL;
-	int active_entry1;
-	int active_entry2;
 	const struct entry *ae1 = NULL;
 	const struct entry *ae2 = NULL;
 
@@ -317,20 +315,14 @@ struct paper_with_error find_errors_in_paper(PGconn *conn,
           The most important error code is the last one determined.
           The following code examines the active entries and sets
           the last error code based on that comparsion.
+          The active entries were loaded with the paper.
         */
 
-        get_active_entries(conn,
-                           electorate_name_normalized,
-                           batch_number,
-                           paper_index,
-                           &active_entry1,
-                           &active_entry2);
+        if (paper->p.active_entry1 > 0)
+          ae1 = get_entry_index(paper->entries, paper->p.active_entry1);
 
-        if (active_entry1 > 0)
-          ae1 = get_entry_index(paper->entries, active_entry1);
-
-        if (active_entry2 > 0)
-          ae2 = get_entry_index(paper->entries, active_entry2);
+        if (paper->p.active_entry2 > 0)
+          ae2 = get_entry_index(paper->entries, paper->p.active_entry2);
 
         if (ae1 && ae2) {
           if (!compare_entry(ae1, ae2)) ewe->error_code = ENTRY_ERR_KEYSTROKE;
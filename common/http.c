@@ -21,8 +21,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <common/evacs.h>
 #include "http.h"
 #include "socket.h"
@@ -229,83 +237,670 @@ struct http_vars *http_urldecode(const char *str)
 	return hvars;
 }
 
-/* Copy body, given HTTP header and total response size.  Update
-   response size to reflect body size, or return NULL. */
-static char *http_parse_header(const char *p, size_t *n)
+/**********************************************************/
+/* kept-alive connections                                 */
+/**********************************************************/
+
+/* Room for a response's headers */
+#define HTTP_BUFFER_SIZE 4096
+
+/* Latency histogram: bucket i counts requests answered in under 2^i
+   ms, and the last one all the rest */
+#define HTTP_LATENCY_BUCKETS 14
+
+/* Log a connection's latencies every this many requests */
+#define HTTP_LATENCY_REPORT 1000
+
+struct http_connection
+{
+	char *servername;
+	uint16_t portnum;
+	/* Looked up once, and again only if connecting fails */
+	struct sockaddr_in addr;
+	bool resolved;
+	/* -1 when not connected */
+	int fd;
+	/* Who opened fd: a child must open its own */
+	pid_t pid;
+	/* Responses read from fd, and when the last one finished */
+	unsigned int requests;
+	double last_used;
+	/* Read from fd but not yet consumed: len bytes from start */
+	char buf[HTTP_BUFFER_SIZE + 1];
+	size_t start, len;
+	/* Every request's latency */
+	unsigned int num_requests, num_connects;
+	double total_ms, max_ms;
+	unsigned int histogram[HTTP_LATENCY_BUCKETS];
+	/* The next of the connections http_connection() shares */
+	struct http_connection *next;
+};
+
+static struct http_connection *connections = NULL;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void conn_close(struct http_connection *c)
 {
-	int major, minor;
-	int icode;
-	char scode[21];
-	char *body, *newbody;
+	if (c->fd >= 0)
+		close(c->fd);
+	c->fd = -1;
+	c->start = c->len = 0;
+}
+
+/* Make sure c is connected.  False if the server can't be reached. */
+static bool conn_open(struct http_connection *c)
+{
+	int one = 1;
+
+	/* A child inherits its parent's socket (and figures), but
+	   mustn't talk over it */
+	if (c->pid != getpid()) {
+		conn_close(c);
+		c->num_requests = c->num_connects = 0;
+		c->total_ms = c->max_ms = 0;
+		memset(c->histogram, 0, sizeof(c->histogram));
+		c->pid = getpid();
+	}
+
+	/* The server is about to close a connection idle this long */
+	if (c->fd >= 0
+	    && now_ms() - c->last_used > (HTTP_KEEPALIVE_TIMEOUT - 1) * 1e3)
+		conn_close(c);
+	if (c->fd >= 0)
+		return true;
+
+	if (!c->resolved)
+		c->resolved = resolve_host(c->servername, c->portnum, &c->addr);
+	if (!c->resolved)
+		return false;
+
+	c->fd = open_socket_to(&c->addr);
+	if (c->fd < 0) {
+		/* It may have moved: look it up again next time */
+		c->resolved = false;
+		return false;
+	}
 
-	if (sscanf(p,"HTTP/%d.%d %3d %20s", 
-		   &major, &minor, &icode, scode) != 4)
+	/* Requests are a single write each: send them at once */
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	c->requests = 0;
+	c->last_used = now_ms();
+	c->num_connects++;
+	return true;
+}
+
+/* Like sprintf, into a malloced string of length *n */
+static char *format_malloc(size_t *n, const char *format, ...)
+__attribute__((format (printf,2,3)));
+
+static char *format_malloc(size_t *n, const char *format, ...)
+{
+	va_list ap;
+	char *p;
+	int len;
+
+	va_start(ap, format);
+	len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	if (len < 0)
 		return NULL;
 
-	if (icode != 200)
+	p = malloc(len + 1);
+	if (!p)
 		return NULL;
+	va_start(ap, format);
+	vsnprintf(p, len + 1, format, ap);
+	va_end(ap);
+	*n = len;
+	return p;
+}
 
-	/* Look for standard "first cr/linefeed pair */
-	body = strstr(p, "\r\n\r\n");
-	if (body) {
-		body += 4;
-	} else {
-		/* Try standard "first cr" pair */
-		body = strstr(p, "\n\n");
-		if (body) body += 2;
-		else
-			/* No body found */
-			return NULL;
+/* Format a request: GET if content is NULL, otherwise a POST of
+   content.  Caller must free it. */
+static char *format_request(const struct http_connection *c,
+			    const char *page, const char *content, size_t *n)
+{
+	if (!content)
+		return format_malloc(n, "GET %s HTTP/1.1\r\n"
+				     "Host: %s\r\n"
+				     "User-Agent: EVACS booth\r\n\r\n",
+				     page, c->servername);
+
+	return format_malloc(n, "POST %s HTTP/1.1\r\n"
+			     "Host: %s\r\n"
+			     "User-Agent: EVACS booth\r\n"
+			     "Content-type: application/x-www-form-urlencoded\r\n"
+			     "Content-length: %lu\r\n\r\n%s",
+			     page, c->servername,
+			     (unsigned long)strlen(content), content);
+}
+
+/* Read a response's headers.  Returns the status code, with *length
+   the Content-length (-1 if none) and *keep_alive whether we may send
+   another request, or -1 if the connection failed: then *received
+   says whether any of the response had arrived. */
+static int read_header(struct http_connection *c, ssize_t *length,
+		       bool *keep_alive, bool *received)
+{
+	int major, minor, status;
+	char *line, *end;
+	size_t header_len;
+
+	*received = (c->len != 0);
+	for (;;) {
+		ssize_t r;
+
+		c->buf[c->start + c->len] = '\0';
+		end = strstr(c->buf + c->start, "\r\n\r\n");
+		if (end)
+			break;
+
+		/* Make room */
+		if (c->start != 0) {
+			memmove(c->buf, c->buf + c->start, c->len);
+			c->start = 0;
+		}
+		if (c->len == HTTP_BUFFER_SIZE)
+			return -1;
+		r = sock_read(c->fd, c->buf + c->len, HTTP_BUFFER_SIZE - c->len,
+			      SOCKET_TIMEOUT * 1000);
+		if (r <= 0)
+			return -1;
+		c->len += r;
+		*received = true;
+	}
+
+	line = c->buf + c->start;
+	if (sscanf(line, "HTTP/%d.%d %3d", &major, &minor, &status) != 3)
+		return -1;
+
+	/* HTTP/1.1 connections stay open unless the server says not */
+	*keep_alive = (major > 1 || (major == 1 && minor >= 1));
+	*length = -1;
+	for (line = strchr(line, '\n'); line && line < end;
+	     line = strchr(line, '\n')) {
+		line++;
+		if (strncasecmp(line, "Content-length:", 15) == 0)
+			*length = strtol(line + 15, NULL, 10);
+		else if (strncasecmp(line, "Connection:", 11) == 0) {
+			line += 11 + strspn(line + 11, " \t");
+			if (strncasecmp(line, "close", 5) == 0)
+				*keep_alive = false;
+			else if (strncasecmp(line, "keep-alive", 10) == 0)
+				*keep_alive = true;
+		} else if (strncasecmp(line, "Transfer-encoding:", 18) == 0)
+			/* We never ask for a chunked response */
+			return -1;
+	}
+
+	/* Consume the headers */
+	header_len = end + 4 - (c->buf + c->start);
+	c->start += header_len;
+	c->len -= header_len;
+	return status;
+}
+
+/* Read n bytes of body into dst: first what we have, then the rest
+   straight from the socket */
+static bool read_body(struct http_connection *c, char *dst, size_t n)
+{
+	size_t done = c->len < n ? c->len : n;
+
+	memcpy(dst, c->buf + c->start, done);
+	c->start += done;
+	c->len -= done;
+	while (done < n) {
+		ssize_t r = sock_read(c->fd, dst + done, n - done,
+				      SOCKET_TIMEOUT * 1000);
+
+		if (r <= 0)
+			return false;
+		done += r;
+	}
+	return true;
+}
+
+/* Throw away n bytes of body we don't want */
+static bool skip_body(struct http_connection *c, size_t n)
+{
+	char scratch[HTTP_BUFFER_SIZE];
+
+	while (n) {
+		size_t chunk = n < sizeof(scratch) ? n : sizeof(scratch);
+
+		if (!read_body(c, scratch, chunk))
+			return false;
+		n -= chunk;
 	}
+	return true;
+}
 
-	/* Update length to reflect body length */
-	*n -= (body - p);
-	newbody = malloc(*n + 1);
+/* A body without a Content-length ends when the server closes the
+   connection (HTTP/1.0).  Returns the malloced body, or NULL. */
+static char *read_to_eof(struct http_connection *c, size_t *size)
+{
+	size_t alloc = c->len + HTTP_BUFFER_SIZE;
+	char *body = malloc(alloc + 1);
 
-	if (!newbody)
+	if (!body)
 		return NULL;
+	memcpy(body, c->buf + c->start, c->len);
+	*size = c->len;
+	for (;;) {
+		ssize_t r;
+
+		if (*size == alloc) {
+			char *newbody = realloc(body, alloc * 2 + 1);
+
+			if (!newbody)
+				break;
+			body = newbody;
+			alloc *= 2;
+		}
+		r = sock_read(c->fd, body + *size, alloc - *size,
+			      SOCKET_TIMEOUT * 1000);
+		if (r == 0)
+			return body;
+		if (r < 0)
+			break;
+		*size += r;
+	}
+	free(body);
+	return NULL;
+}
 
-	memcpy(newbody, body, *n);
+/* Read one response: the body goes into buf (len bytes), or if buf is
+   NULL, into *body (malloced and nul-terminated).  Returns the body's
+   size, -1 if there was no body we can use, or -2 if the connection
+   failed before any of the response arrived, so the request can be
+   sent again. */
+static ssize_t receive_response(struct http_connection *c,
+				char *buf, size_t len, char **body)
+{
+	ssize_t length;
+	bool keep_alive, received;
+	int status;
+	size_t size;
+
+	status = read_header(c, &length, &keep_alive, &received);
+	if (status < 0) {
+		conn_close(c);
+		return received ? -1 : -2;
+	}
+	c->requests++;
 
-	/* The returned body may contain nulls, but for the
-	   convenience of other functions which treat it as a string,
-	   make sure it is null-terminated */
-	newbody[*n] = '\0';
+	if (status != 200 || (buf && length > (ssize_t)len)) {
+		/* Keep the connection if we can get past the body */
+		if (length < 0 || !keep_alive || !skip_body(c, length))
+			conn_close(c);
+		return -1;
+	}
 
-	return newbody;
-}	
+	if (length < 0) {
+		char *all = read_to_eof(c, &size);
 
-/* Performs an HTTP GET operation on a given page and returns the
-   retreived body. */
-char *http_get(const char *servername,
-	       uint16_t portnum,
-	       const char *page,
-	       size_t *size)
+		conn_close(c);
+		if (!all)
+			return -1;
+		if (!buf) {
+			all[size] = '\0';
+			*body = all;
+			return size;
+		}
+		if (size <= len)
+			memcpy(buf, all, size);
+		free(all);
+		return size <= len ? (ssize_t)size : -1;
+	}
+
+	if (!buf) {
+		*body = malloc(length + 1);
+		if (!*body) {
+			conn_close(c);
+			return -1;
+		}
+		(*body)[length] = '\0';
+	}
+	if (!read_body(c, buf ? buf : *body, length)) {
+		conn_close(c);
+		if (!buf) {
+			free(*body);
+			*body = NULL;
+		}
+		return -1;
+	}
+	if (!keep_alive)
+		conn_close(c);
+	return length;
+}
+
+static void record_latency(struct http_connection *c, double ms)
 {
-	int sock;
-	size_t n;
-	char *p, *body;
+	unsigned int b;
+
+	for (b = 0; b < HTTP_LATENCY_BUCKETS - 1 && ms >= (double)(1U << b);
+	     b++);
+	c->histogram[b]++;
+	c->num_requests++;
+	c->total_ms += ms;
+	if (ms > c->max_ms)
+		c->max_ms = ms;
+	c->last_used = now_ms();
+
+	if (c->num_requests % HTTP_LATENCY_REPORT == 0)
+		http_report_latency(c);
+}
 
-	sock = open_socket_out(servername, portnum);
+/* Has the server closed (or written to) an idle connection?  Then it
+   can't carry another request. */
+static bool conn_stale(const struct http_connection *c)
+{
+	struct pollfd pfd = { c->fd, POLLIN, 0 };
 
-	sock_printf(sock, "GET %s HTTP/1.0\r\n", page);
-	sock_printf(sock, "User-Agent: EVACS booth\r\n\r\n");
+	return poll(&pfd, 1, 0) != 0;
+}
 
-	p = sock_load(sock, &n);
-	close(sock);
-	if (!p)
+/* Send a request and read its response (see receive_response).  If
+   a kept-alive connection turns out to have been closed, a GET
+   (repeatable) is sent again on a new one.  Anything else may already
+   have taken effect, so it fails instead; it is only sent on an old
+   connection the server hasn't visibly closed.  Returns the body's
+   size, or -1. */
+static ssize_t transact(struct http_connection *c,
+			const char *request, size_t n,
+			char *buf, size_t len, char **body,
+			bool repeatable)
+{
+	unsigned int attempt;
+
+	for (attempt = 0; attempt < 2; attempt++) {
+		double start;
+		bool reused;
+		ssize_t size;
+
+		if (!conn_open(c))
+			return -1;
+		if (!repeatable && c->requests != 0 && conn_stale(c)) {
+			/* Nothing sent yet: a new connection is safe */
+			conn_close(c);
+			if (!conn_open(c))
+				return -1;
+		}
+		reused = repeatable && c->requests != 0;
+
+		start = now_ms();
+		if (sock_write(c->fd, request, n) != (ssize_t)n) {
+			conn_close(c);
+			if (reused)
+				continue;
+			return -1;
+		}
+
+		size = receive_response(c, buf, len, body);
+		if (size == -2 && reused)
+			continue;
+		if (size < 0)
+			return -1;
+		record_latency(c, now_ms() - start);
+		return size;
+	}
+	return -1;
+}
+
+/* Set up a connection: nothing happens until the first request */
+struct http_connection *http_connect(const char *servername,
+				     uint16_t portnum)
+{
+	struct http_connection *c;
+
+	c = malloc(sizeof(*c));
+	if (!c)
+		return NULL;
+	memset(c, 0, sizeof(*c));
+	c->servername = strdup(servername);
+	if (!c->servername) {
+		free(c);
+		return NULL;
+	}
+	c->portnum = portnum;
+	c->fd = -1;
+	c->pid = getpid();
+	return c;
+}
+
+void http_disconnect(struct http_connection *c)
+{
+	/* A child's copy of its parent's connection has nothing to say */
+	if (c->pid == getpid())
+		http_report_latency(c);
+	conn_close(c);
+	free(c->servername);
+	free(c);
+}
+
+void http_conn_close(struct http_connection *c)
+{
+	conn_close(c);
+}
+
+static void close_connections(void)
+{
+	while (connections) {
+		struct http_connection *next = connections->next;
+
+		http_disconnect(connections);
+		connections = next;
+	}
+}
+
+/* The connection to a server everyone in this process shares */
+struct http_connection *http_connection(const char *servername,
+					uint16_t portnum)
+{
+	struct http_connection *c;
+
+	for (c = connections; c; c = c->next)
+		if (c->portnum == portnum
+		    && strcmp(c->servername, servername) == 0)
+			return c;
+
+	c = http_connect(servername, portnum);
+	if (!c)
 		return NULL;
 
-	body = http_parse_header(p, &n);
-	free(p);
+	/* Log how they went at the end */
+	if (!connections)
+		atexit(close_connections);
+	c->next = connections;
+	connections = c;
+	return c;
+}
+
+void http_report_latency(const struct http_connection *c)
+{
+	unsigned int b;
+
+	if (c->num_requests == 0)
+		return;
+
+	fprintf(stderr, "http: %s:%u: %u requests on %u connections,"
+		" mean %.2f ms, max %.2f ms; histogram (ms)",
+		c->servername, c->portnum, c->num_requests, c->num_connects,
+		c->total_ms / c->num_requests, c->max_ms);
+	for (b = 0; b < HTTP_LATENCY_BUCKETS; b++) {
+		if (!c->histogram[b])
+			continue;
+		if (b < HTTP_LATENCY_BUCKETS - 1)
+			fprintf(stderr, " <%u:%u", 1U << b, c->histogram[b]);
+		else
+			fprintf(stderr, " >=%u:%u", 1U << (b - 1),
+				c->histogram[b]);
+	}
+	fprintf(stderr, "\n");
+}
+
+/* GET a page into the caller's buffer */
+ssize_t http_conn_read(struct http_connection *c, const char *page,
+		       void *buf, size_t len)
+{
+	char *request;
+	ssize_t size;
+	size_t n;
+
+	request = format_request(c, page, NULL, &n);
+	if (!request)
+		return -1;
+	size = transact(c, request, n, buf, len, NULL, true);
+	free(request);
+	return size;
+}
+
+/* GET a page, returning the body */
+char *http_conn_get(struct http_connection *c, const char *page,
+		    size_t *size)
+{
+	char *request, *body = NULL;
+	ssize_t n;
+	size_t len;
+
+	request = format_request(c, page, NULL, &len);
+	if (!request)
+		return NULL;
+	n = transact(c, request, len, NULL, 0, &body, true);
+	free(request);
+	if (n < 0)
+		return NULL;
 
 	/* If they gave us a size, set it */
 	if (size)
 		*size = n;
-
 	return body;
 }
 
+/* GET several pages, sending up to HTTP_PIPELINE_DEPTH requests
+   before waiting for the first response */
+unsigned int http_conn_get_pipelined(struct http_connection *c,
+				     const char *const pages[],
+				     unsigned int num,
+				     http_response_fn done, void *arg)
+{
+	double start[HTTP_PIPELINE_DEPTH];
+	unsigned int sent = 0, answered = 0, succeeded = 0;
+
+	while (answered < num) {
+		char *body = NULL;
+		ssize_t size;
+
+		/* Anything unanswered when a connection closes is sent
+		   again on the next */
+		if (sent == answered && !conn_open(c))
+			break;
+
+		while (sent < num && sent - answered < HTTP_PIPELINE_DEPTH) {
+			char *request;
+			size_t n;
+			bool ok;
+
+			request = format_request(c, pages[sent], NULL, &n);
+			if (!request)
+				break;
+			start[sent % HTTP_PIPELINE_DEPTH] = now_ms();
+			ok = (sock_write(c->fd, request, n) == (ssize_t)n);
+			free(request);
+			if (!ok) {
+				conn_close(c);
+				break;
+			}
+			sent++;
+		}
+		if (c->fd < 0 || sent == answered) {
+			/* Give up unless an old connection just closed */
+			if (c->requests == 0)
+				break;
+			c->requests = 0;
+			sent = answered;
+			continue;
+		}
+
+		size = receive_response(c, NULL, 0, &body);
+		if (size == -2) {
+			if (c->requests == 0)
+				break;
+			sent = answered;
+			continue;
+		}
+		if (size >= 0) {
+			record_latency(c, now_ms()
+				       - start[answered % HTTP_PIPELINE_DEPTH]);
+			succeeded++;
+			done(arg, answered, body, size);
+		} else
+			done(arg, answered, NULL, 0);
+		answered++;
+		if (c->fd < 0)
+			sent = answered;
+	}
+
+	/* Those we never got an answer to */
+	for (; answered < num; answered++)
+		done(arg, answered, NULL, 0);
+	return succeeded;
+}
+
+/* Pass the parameters to a CGI script, get the response. */
+struct http_vars *http_conn_exchange(struct http_connection *c,
+				     const char *scripturl,
+				     const struct http_vars *request_params)
+{
+	char *query_string, *request;
+	char *reply = NULL;
+	struct http_vars *reply_params;
+	size_t n;
+
+	query_string = http_urlencode(request_params);
+	if (!query_string)
+		return NULL;
+	fprintf(stderr,"http_exchange:SERVER %s, PORT: %i, SCRIPTURL: %s, Qstring: %s\n",
+		c->servername, c->portnum, scripturl, query_string);
+	request = format_request(c, scripturl, query_string, &n);
+	free(query_string);
+	if (!request)
+		return NULL;
+
+	if (transact(c, request, n, NULL, 0, &reply, false) < 0) {
+		/* HTTP error */
+		free(request);
+		return NULL;
+	}
+	free(request);
+
+	reply_params = http_urldecode(reply);
+	free(reply);
+
+	return reply_params;
+}
+
+/* Performs an HTTP GET operation on a given page and returns the
+   retreived body. */
+char *http_get(const char *servername,
+	       uint16_t portnum,
+	       const char *page,
+	       size_t *size)
+{
+	struct http_connection *c = http_connection(servername, portnum);
+
+	if (!c)
+		return NULL;
+	return http_conn_get(c, page, size);
+}
+
 /* Performs an HTTP GET operation on a given page, and drop into a
    local (temporary) file.  Returns the filename (to be freed by the
    caller), or NULL. */
@@ -341,69 +936,15 @@ char *http_get_file(const char *servername,
 	return fname;
 }
 
-/* Perform an HTTP POST operation on a given page and returns the
-   retrieved body.  */
-static char *http_post(const char *server,
-		       uint16_t port,
-		       const char *page,
-		       const char *postdata,
-		       size_t *size)
-{
-	int sock;
-	char *p, *body;
-	size_t n;
-
-	sock = open_socket_out(server, port);
-	if (sock < 0)
-		return NULL;
-
-	sock_printf(sock, "POST %s HTTP/1.0\r\n", page);
-	sock_printf(sock, "User-Agent: EVACS booth\r\n");
-	sock_printf(sock,
-		    "Content-type: application/x-www-form-urlencoded\r\n");
-	sock_printf(sock, "Content-length: %d\r\n\r\n",
-		    strlen(postdata));
-	sock_printf(sock, "%s", postdata);
-	
-	p = sock_load(sock, &n);
-	close(sock);
-	if (!p)
-		return NULL;
-
-	body = http_parse_header(p, &n);
-	free(p);
-
-	if (size)
-		*size = n;
-
-	return body;
-}
-
 /* Pass the parameters to a CGI script, get the response. */
 struct http_vars *http_exchange(const char *servername,
 				uint16_t portnum,
 				const char *scripturl,
 				const struct http_vars *request_params)
 {
-	char *query_string;
-	char *reply;
-	struct http_vars *reply_params;
-	/* SIPL 2011: Changed type of n to conform to parameter type. */
-	size_t n;
-
-	query_string = http_urlencode(request_params);
-	if (!query_string)
-		return NULL;
-	fprintf(stderr,"http_exchange:SERVER %s, PORT: %i, SCRIPTURL: %s, Qstring: %s\n",
-		servername, portnum, scripturl, query_string);
-	reply = http_post(servername, portnum, scripturl, query_string, &n);
-	free(query_string);
+	struct http_connection *c = http_connection(servername, portnum);
 
-	if (!reply) /* HTTP error */
+	if (!c)
 		return NULL;
-
-	reply_params = http_urldecode(reply);
-	free(reply);
-
-	return reply_params;		
+	return http_conn_exchange(c, scripturl, request_params);
 }
@@ -16,6 +16,7 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include <stdint.h>
+#include <sys/types.h>
 #include <common/voting_errors.h>
 
 /* an array of these structures is returned and given to a http
@@ -44,6 +45,69 @@ extern struct http_vars *http_exchange(const char *servername,
 				       const char *scripturl,
 				       const struct http_vars *request_params);
 
+/* Seconds the voting daemon keeps an idle connection open.  Clients
+   don't reuse one idle for nearly this long. */
+#define HTTP_KEEPALIVE_TIMEOUT 2
+
+/* Most GETs http_conn_get_pipelined() has waiting for an answer */
+#define HTTP_PIPELINE_DEPTH 16
+
+/* A kept-alive HTTP/1.1 connection to a server.  The server's name is
+   looked up once, and the connection opened (and reopened after the
+   server closes it) as requests need it.  It is opaque. */
+struct http_connection;
+
+/* Set up a connection to a server.  NULL if out of memory. */
+extern struct http_connection *http_connect(const char *servername,
+					    uint16_t portnum);
+
+/* The connection to a server shared by everything in this process,
+   including http_get() and http_exchange().  It logs its latencies
+   and closes at exit.  NULL if out of memory. */
+extern struct http_connection *http_connection(const char *servername,
+					       uint16_t portnum);
+
+/* Log a connection's latencies, close and free it */
+extern void http_disconnect(struct http_connection *conn);
+
+/* Close a connection's socket, keeping its latency figures: the next
+   request opens a new one.  For a server that mustn't be kept
+   waiting for more requests. */
+extern void http_conn_close(struct http_connection *conn);
+
+/* Log the number of requests on a connection, their mean and maximum
+   latency, and a histogram of latencies in powers of two ms */
+extern void http_report_latency(const struct http_connection *conn);
+
+/* Get a URL into buf.  Returns the size of the body, or -1 on error
+   or if it is larger than len. */
+extern ssize_t http_conn_read(struct http_connection *conn,
+			      const char *page, void *buf, size_t len);
+
+/* Get a URL: returns the body (must be freed by caller), which is
+   nul-terminated, or NULL on error */
+extern char *http_conn_get(struct http_connection *conn,
+			   const char *page,
+			   size_t *size);
+
+/* Called for each of a pipeline's pages in turn, with its body (to be
+   freed by the callee) or NULL on error */
+typedef void (*http_response_fn)(void *arg, unsigned int i,
+				 char *body, size_t size);
+
+/* Get several URLs, sending requests without waiting for answers.
+   Returns the number which succeeded. */
+extern unsigned int http_conn_get_pipelined(struct http_connection *conn,
+					    const char *const pages[],
+					    unsigned int num,
+					    http_response_fn done, void *arg);
+
+/* http_exchange() over a connection.  The request is never sent
+   twice: if the connection fails, this returns NULL. */
+extern struct http_vars *http_conn_exchange(struct http_connection *conn,
+					    const char *scripturl,
+					    const struct http_vars *request_params);
+
 /* Extract a variable. from the http vars.  NULL if not found. */
 extern const char *http_string(const struct http_vars *hvars,
 			       const char *name);
@@ -0,0 +1,335 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Microbenchmark for packing and unpacking preference lists, as the
+   server does storing each vote, data entry and the scanned vote
+   loader do for each entry, and counting and the export tools do for
+   every ballot: the old sscanf/sprintf_malloc loops against
+   preference_codec.  Run with "make benchmarks". */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "evacs.h"
+#include "preference_codec.h"
+
+#define ITERATIONS 20
+#define NUM_BALLOTS 2000
+
+/* The old unpack_preferences(), also copied into the export tools */
+static struct preference_set *old_unpack_preferences(const char *preference_list)
+{
+	struct preference_set *vote;
+	char *pref_ptr;
+	unsigned int num_preferences=0,i;
+	unsigned int pref_number, group_index, db_cand_index;
+
+	for (pref_ptr=(char *)preference_list;
+	     strlen(pref_ptr)>=DIGITS_PER_PREF;
+	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_preferences++);
+
+	if ( strlen(pref_ptr))
+		bailout("Malformed preference list: '%s'\n",preference_list);
+
+	vote = malloc(sizeof(*vote)
+			+ sizeof(vote->candidates[0]) * num_preferences);
+	vote->num_preferences = num_preferences;
+
+	for (pref_ptr=(char *)preference_list, i = 0;
+	     i < vote->num_preferences;
+	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
+	{
+		sscanf(pref_ptr,"%2u%2u%2u",&pref_number,&group_index,&db_cand_index);
+
+		vote->candidates[i].group_index = group_index;
+		vote->candidates[i].db_candidate_index = db_cand_index;
+		vote->candidates[i].prefnum = pref_number;
+	}
+
+	return vote;
+}
+
+/* The old preference_string(), also the loop in append_entry() and
+   pack_scanned_prefs() */
+static char *old_preference_string(struct preference_set *vote)
+{
+	unsigned int i;
+	char pref_string[PREFNUM_MAX * DIGITS_PER_PREF + 1];
+	char *return_string, *pref_ptr, *p;
+
+	pref_string[0]='\0';
+	for (i=0; i <  vote->num_preferences; i++) {
+		p = sprintf_malloc("%02u%02u%02u",vote->candidates[i].prefnum,
+				   vote->candidates[i].group_index,
+				   vote->candidates[i].db_candidate_index);
+		pref_ptr=&pref_string[0]+sizeof(char)*((i)*DIGITS_PER_PREF);
+		strcpy(pref_ptr,p);
+		free(p);
+	}
+	return_string=malloc(sizeof(char) * (strlen(pref_string) + 1));
+	strcpy(return_string,pref_string);
+
+	return return_string;
+}
+
+/* The old get_prefs_for_entry() and get_scanned_prefs_for_entry() */
+static unsigned int old_get_prefs(struct preference preferences[],
+				  char *preference_list)
+{
+	unsigned int i, num_prefs;
+	char *pref_ptr;
+
+	for (pref_ptr=(char *)preference_list,num_prefs=0;
+	     strlen(pref_ptr)>=DIGITS_PER_PREF;
+	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_prefs++);
+
+	for (pref_ptr = preference_list, i = 0;
+	     i < num_prefs;
+	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
+		sscanf(pref_ptr,"%2u%2u%2u",
+		       &preferences[i].prefnum,
+		       &preferences[i].group_index,
+		       &preferences[i].db_candidate_index);
+	return num_prefs;
+}
+
+/* What load_vote() in counting and display_first_preferences keep */
+struct counted_pref
+{
+	unsigned char group_index;
+	unsigned char db_candidate_index;
+};
+
+/* The old load_vote() in display_first_preferences */
+static void old_load_vote(struct counted_pref prefs[],
+			  const char *preference_list)
+{
+	char *pref_ptr;
+	unsigned int num_preferences=0,i;
+	unsigned int pref_number, group_index, db_cand_index;
+
+	for (pref_ptr=(char *)preference_list;
+	     strlen(pref_ptr)>=DIGITS_PER_PREF;
+	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_preferences++);
+
+	for (pref_ptr=(char *)preference_list, i = 0;
+	     i < num_preferences;
+	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
+	{
+		sscanf(pref_ptr,"%2u%2u%2u",&pref_number,&group_index,&db_cand_index);
+		prefs[pref_number-1].group_index = group_index;
+		prefs[pref_number-1].db_candidate_index = db_cand_index;
+	}
+}
+
+/* load_vote() as it is now */
+static void load_vote(struct counted_pref prefs[],
+		      const char *preference_list, int len)
+{
+	unsigned int num_preferences = len / DIGITS_PER_PREF, i;
+	unsigned int pref_number, group_index, db_cand_index;
+
+	for (i = 0; i < num_preferences; i++) {
+		if (!decode_preference(preference_list + i * DIGITS_PER_PREF,
+				       &pref_number, &group_index,
+				       &db_cand_index)
+		    || pref_number < 1 || pref_number > num_preferences)
+			bailout("Malformed preference list: '%.*s'\n",
+				len, preference_list);
+		prefs[pref_number-1].group_index = group_index;
+		prefs[pref_number-1].db_candidate_index = db_cand_index;
+	}
+}
+
+/* Ballots the size the ACT sees: mostly a handful of preferences, a
+   few numbering most of the paper, in shuffled order */
+static void make_ballots(struct preference_set ballots[],
+			 char *lists[], size_t lens[])
+{
+	unsigned int b, i;
+
+	srand(2001);
+	for (b = 0; b < NUM_BALLOTS; b++) {
+		struct preference_set *vote = &ballots[b];
+
+		vote->paper_version = 1;
+		vote->num_preferences = (b % 10 == 0)
+			? 40 + rand() % (PREFNUM_MAX - 39)
+			: 1 + rand() % 12;
+		for (i = 0; i < vote->num_preferences; i++) {
+			vote->candidates[i].prefnum = i + 1;
+			vote->candidates[i].group_index = rand() % 20;
+			vote->candidates[i].db_candidate_index = rand() % 12;
+		}
+		for (i = vote->num_preferences - 1; i > 0; i--) {
+			unsigned int j = rand() % (i + 1);
+			struct preference tmp = vote->candidates[i];
+
+			vote->candidates[i] = vote->candidates[j];
+			vote->candidates[j] = tmp;
+		}
+		lists[b] = old_preference_string(vote);
+		lens[b] = strlen(lists[b]);
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start, double end)
+{
+	printf("preference_%-22s %8.1f ns/ballot\n", name,
+	       (end - start) / ITERATIONS / NUM_BALLOTS);
+}
+
+static bool same_preferences(const struct preference a[],
+			     const struct preference b[], unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		if (a[i].prefnum != b[i].prefnum
+		    || a[i].group_index != b[i].group_index
+		    || a[i].db_candidate_index != b[i].db_candidate_index)
+			return false;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct preference_set ballots[NUM_BALLOTS];
+	static char *lists[NUM_BALLOTS];
+	static size_t lens[NUM_BALLOTS];
+	struct preference prefs[PREFNUM_MAX], old_prefs[PREFNUM_MAX];
+	struct counted_pref counted[PREFNUM_MAX], old_counted[PREFNUM_MAX];
+	char buf[PREFNUM_MAX * DIGITS_PER_PREF + 1];
+	unsigned int b, i;
+	int failed = 0;
+	double start;
+
+	make_ballots(ballots, lists, lens);
+
+	/* The codec must agree with the old loops exactly */
+	for (b = 0; b < NUM_BALLOTS; b++) {
+		struct preference_set *vote, *old_vote;
+		char *s;
+
+		s = preference_string(&ballots[b]);
+		if (strcmp(s, lists[b]) != 0
+		    || encode_preferences(buf, ballots[b].candidates,
+					  ballots[b].num_preferences) != lens[b]
+		    || strcmp(buf, lists[b]) != 0) {
+			printf("preference: ballot %u encodes differently!\n", b);
+			failed = 1;
+		}
+		free(s);
+
+		vote = unpack_preferences(lists[b]);
+		old_vote = old_unpack_preferences(lists[b]);
+		if (vote->num_preferences != old_vote->num_preferences
+		    || !same_preferences(vote->candidates, old_vote->candidates,
+					 vote->num_preferences)
+		    || decode_preferences(prefs, PREFNUM_MAX, lists[b],
+					  lens[b]) != (int)vote->num_preferences
+		    || old_get_prefs(old_prefs, lists[b])
+		       != vote->num_preferences
+		    || !same_preferences(prefs, old_prefs,
+					 vote->num_preferences)) {
+			printf("preference: ballot %u decodes differently!\n", b);
+			failed = 1;
+		}
+		free(vote);
+		free(old_vote);
+
+		load_vote(counted, lists[b], lens[b]);
+		old_load_vote(old_counted, lists[b]);
+		if (memcmp(counted, old_counted,
+			   ballots[b].num_preferences * sizeof(counted[0]))) {
+			printf("preference: ballot %u loads differently!\n", b);
+			failed = 1;
+		}
+	}
+
+	/* Storing a vote (save_and_verify), an entry (append_entry) and
+	   a scanned vote (pack_scanned_prefs) */
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			free(old_preference_string(&ballots[b]));
+	report("string(old)", start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			free(preference_string(&ballots[b]));
+	report("string", start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			encode_preferences(buf, ballots[b].candidates,
+					   ballots[b].num_preferences);
+	report("encode", start, now_ns());
+
+	/* Election night summaries and the export tools */
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			free(old_unpack_preferences(lists[b]));
+	report("unpack(old)", start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			free(unpack_preferences(lists[b]));
+	report("unpack", start, now_ns());
+
+	/* Reading back entries (get_prefs_for_entry) and scanned votes */
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			old_get_prefs(old_prefs, lists[b]);
+	report("get_prefs(old)", start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			decode_preferences(prefs, PREFNUM_MAX,
+					   lists[b], lens[b]);
+	report("decode", start, now_ns());
+
+	/* Loading ballots to count */
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			old_load_vote(old_counted, lists[b]);
+	report("load_vote(old)", start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		for (b = 0; b < NUM_BALLOTS; b++)
+			load_vote(counted, lists[b], lens[b]);
+	report("load_vote", start, now_ns());
+
+	for (b = 0; b < NUM_BALLOTS; b++)
+		free(lists[b]);
+	return failed;
+}
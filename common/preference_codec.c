@@ -0,0 +1,74 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <limits.h>
+#include <string.h>
+#include "preference_codec.h"
+
+/* "00" to "99", two characters each, for encoding */
+#define DECADE(t) t"0" t"1" t"2" t"3" t"4" t"5" t"6" t"7" t"8" t"9"
+static const char digit_pairs[] =
+	DECADE("0") DECADE("1") DECADE("2") DECADE("3") DECADE("4")
+	DECADE("5") DECADE("6") DECADE("7") DECADE("8") DECADE("9");
+
+/* The value of each character as a digit, or -1 */
+static const signed char digit_value[UCHAR_MAX + 1] = {
+	[0 ... UCHAR_MAX] = -1,
+	['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+	['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+};
+
+int decode_two_digits(const char *p)
+{
+	int tens, units;
+
+	tens = digit_value[(unsigned char)p[0]];
+	if (tens < 0)
+		return -1;
+	units = digit_value[(unsigned char)p[1]];
+	if (units < 0)
+		return -1;
+	return tens * 10 + units;
+}
+
+bool decode_preference(const char *p,
+		       unsigned int *prefnum,
+		       unsigned int *group_index,
+		       unsigned int *db_candidate_index)
+{
+	int pref, group, cand;
+
+	/* Stop at the first bad field: it may be the end of the string */
+	if ((pref = decode_two_digits(p)) < 0
+	    || (group = decode_two_digits(p + 2)) < 0
+	    || (cand = decode_two_digits(p + 4)) < 0)
+		return false;
+
+	*prefnum = pref;
+	*group_index = group;
+	*db_candidate_index = cand;
+	return true;
+}
+
+char *encode_preference(char *p,
+			unsigned int prefnum,
+			unsigned int group_index,
+			unsigned int db_candidate_index)
+{
+	memcpy(p, digit_pairs + prefnum * 2, 2);
+	memcpy(p + 2, digit_pairs + group_index * 2, 2);
+	memcpy(p + 4, digit_pairs + db_candidate_index * 2, 2);
+	return p + DIGITS_PER_PREF;
+}
@@ -0,0 +1,49 @@
+#ifndef _PREFERENCE_CODEC_H
+#define _PREFERENCE_CODEC_H
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* A preference list, as stored in the database, is DIGITS_PER_PREF
+   characters for each preference: two digits each of preference
+   number, group index and database candidate index.  These convert
+   one preference at a time, in place, without sscanf, sprintf or
+   malloc: lists are decoded for every ballot in a count.
+
+   This header stands alone, so the export tools (which have their own
+   struct preference) can use it too. */
+#include <stdbool.h>
+
+#define DIGITS_PER_PREF 6
+
+/* The two-digit number at p, or -1 if either isn't a digit.  Doesn't
+   look at p[1] if p[0] is the terminating nul. */
+extern int decode_two_digits(const char *p);
+
+/* Decode the preference at p.  False if its DIGITS_PER_PREF
+   characters aren't all digits. */
+extern bool decode_preference(const char *p,
+			      unsigned int *prefnum,
+			      unsigned int *group_index,
+			      unsigned int *db_candidate_index);
+
+/* Write a preference at p: DIGITS_PER_PREF characters, not
+   terminated.  Each number must be below 100.  Returns where the next
+   preference goes. */
+extern char *encode_preference(char *p,
+			       unsigned int prefnum,
+			       unsigned int group_index,
+			       unsigned int db_candidate_index);
+#endif /*_PREFERENCE_CODEC_H*/
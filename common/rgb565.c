@@ -0,0 +1,163 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <png.h>
+#include "rgb565.h"
+
+/* A gray pixel, and four of them in a word */
+#define GRAY_PIXEL ((HIGHLIGHT_GRAY << 11) | (HIGHLIGHT_GRAY << 6) \
+		    | HIGHLIGHT_GRAY)
+#define LANES(x) ((uint64_t)(x) * UINT64_C(0x0001000100010001))
+
+/* Where libpng is reading from */
+struct png_source
+{
+	const unsigned char *data;
+	size_t left;
+};
+
+static void read_png(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	struct png_source *src = png_get_io_ptr(png_ptr);
+
+	if (length > src->left)
+		png_error(png_ptr, "PNG is truncated");
+	memcpy(data, src->data, length);
+	src->data += length;
+	src->left -= length;
+}
+
+uint16_t *rgb565_decode_png(const void *png, size_t size,
+			    unsigned int *width, unsigned int *height)
+{
+	struct png_source src = { png, size };
+	int bit_depth, color_type;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_uint_32 w, h, row, x;
+	/* Volatile: freed after a longjmp from libpng */
+	uint16_t *volatile pixels = NULL;
+	png_bytep volatile rowbuf = NULL;
+
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+					 (png_voidp)NULL, NULL, NULL);
+	if (!png_ptr)
+		return NULL;
+	info_ptr = png_create_info_struct(png_ptr);
+	if (!info_ptr || setjmp(png_jmpbuf(png_ptr))) {
+		free(pixels);
+		free(rowbuf);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return NULL;
+	}
+
+	png_set_read_fn(png_ptr, &src, read_png);
+	png_read_info(png_ptr, info_ptr);
+	png_get_IHDR(png_ptr, info_ptr, &w, &h, &bit_depth, &color_type,
+		     NULL, NULL, NULL);
+	if (color_type != PNG_COLOR_TYPE_RGB
+	    && color_type != PNG_COLOR_TYPE_RGB_ALPHA) {
+		fprintf(stderr, "PNG must be RGB or RGBA!\n");
+		png_error(png_ptr, "not RGB");
+	}
+	if (bit_depth != 8) {
+		fprintf(stderr, "PNG bit depth %i not 24!\n", bit_depth);
+		png_error(png_ptr, "not 24 bit");
+	}
+
+	/* Discard any alpha channels */
+	if (color_type & PNG_COLOR_MASK_ALPHA)
+		png_set_strip_alpha(png_ptr);
+
+	pixels = malloc((size_t)w * h * sizeof(*pixels) + 1);
+	rowbuf = malloc((size_t)w * 3 + 1);
+	if (!pixels || !rowbuf)
+		png_error(png_ptr, "out of memory");
+
+	for (row = 0; row < h; row++) {
+		uint16_t *dst = pixels + (size_t)row * w;
+		const png_byte *rgb = rowbuf;
+
+		png_read_row(png_ptr, rowbuf, NULL);
+		/* Five bits red, six green, five blue. */
+		for (x = 0; x < w; x++, rgb += 3)
+			dst[x] = ((rgb[0] >> 3) << 11)
+				| ((rgb[1] >> 2) << 5)
+				| (rgb[2] >> 3);
+	}
+	free(rowbuf);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+	*width = w;
+	*height = h;
+	return pixels;
+}
+
+static uint16_t highlight_pixel(uint16_t pixel)
+{
+	/* If any color brighter than grey, all grey */
+	if (((pixel >> 11) & 0x1f) > HIGHLIGHT_GRAY
+	    || ((pixel >> 6) & 0x1f) > HIGHLIGHT_GRAY
+	    || (pixel & 0x1f) > HIGHLIGHT_GRAY)
+		return GRAY_PIXEL;
+	return pixel;
+}
+
+void rgb565_highlight(uint16_t *dst, const uint16_t *src, size_t num)
+{
+	const uint64_t gray = LANES(GRAY_PIXEL);
+	const uint64_t bias = LANES(31 - HIGHLIGHT_GRAY);
+	size_t i;
+
+	/* Four pixels to a word, without branches.  Adding
+	   31 - HIGHLIGHT_GRAY to a 5-bit field carries into bit 5 of
+	   its lane exactly when the field is brighter than gray, and
+	   can't carry out of the lane. */
+	for (i = 0; i + 4 <= num; i += 4) {
+		uint64_t pixels, brighter, mask;
+
+		memcpy(&pixels, src + i, sizeof(pixels));
+		brighter = (((pixels >> 11) & LANES(0x1f)) + bias)
+			| (((pixels >> 6) & LANES(0x1f)) + bias)
+			| ((pixels & LANES(0x1f)) + bias);
+		/* A lane of ones wherever it was brighter */
+		mask = ((brighter >> 5) & LANES(1)) * 0xffff;
+		pixels = (pixels & ~mask) | (gray & mask);
+		memcpy(dst + i, &pixels, sizeof(pixels));
+	}
+	for (; i < num; i++)
+		dst[i] = highlight_pixel(src[i]);
+}
+
+void rgb565_rotate(uint16_t *dst, const uint16_t *src, size_t num)
+{
+	size_t i;
+
+	if (dst != src) {
+		for (i = 0; i < num; i++)
+			dst[i] = src[num - 1 - i];
+		return;
+	}
+
+	for (i = 0; i < num / 2; i++) {
+		uint16_t tmp = dst[i];
+
+		dst[i] = dst[num - 1 - i];
+		dst[num - 1 - i] = tmp;
+	}
+}
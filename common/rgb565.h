@@ -0,0 +1,43 @@
+#ifndef _RGB565_H
+#define _RGB565_H
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Images in the booth's 16-bit display format: five bits red, six
+   green, five blue, one uint16_t per pixel, row by row. */
+#include <stdint.h>
+#include <stddef.h>
+
+/* The colour of gray (in 5 bits) */
+/* SIPL 2014-05-23 Increased from 20 to 25.
+   NB Since it is a five-bit value, 31 is the maximum, which corresponds
+   to white.
+ */
+#define HIGHLIGHT_GRAY 25
+
+/* Decode a PNG (8-bit RGB or RGBA) into malloced pixels.  NULL on
+   error. */
+extern uint16_t *rgb565_decode_png(const void *png, size_t size,
+				   unsigned int *width, unsigned int *height);
+
+/* Highlight num pixels: any colour brighter than HIGHLIGHT_GRAY
+   becomes gray.  dst may be src. */
+extern void rgb565_highlight(uint16_t *dst, const uint16_t *src, size_t num);
+
+/* Reverse num pixels, turning an image upside down.  dst may be src,
+   but mustn't otherwise overlap it. */
+extern void rgb565_rotate(uint16_t *dst, const uint16_t *src, size_t num);
+#endif /*_RGB565_H*/
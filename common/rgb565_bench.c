@@ -0,0 +1,201 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Microbenchmark for what the booth does before it can first show an
+   image: decoding the PNG and highlighting it, against using a frame
+   pre-decoded by make_asset_bundles.  Run with "make benchmarks". */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <png.h>
+#include "rgb565.h"
+
+#define ITERATIONS 20
+
+static const struct {
+	const char *name;
+	unsigned int width, height;
+} sizes[] = {
+	{ "screen", 1152, 864 },
+	{ "candidate", 576, 48 },
+};
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+struct png_buffer
+{
+	unsigned char *data;
+	size_t len;
+};
+
+static void write_png(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	struct png_buffer *buf = png_get_io_ptr(png_ptr);
+
+	buf->data = realloc(buf->data, buf->len + length);
+	memcpy(buf->data + buf->len, data, length);
+	buf->len += length;
+}
+
+static void flush_png(png_structp png_ptr)
+{
+}
+
+/* Something like a ballot image: white, with coloured blocks and
+   dark "text" */
+static struct png_buffer make_png(unsigned int width, unsigned int height)
+{
+	struct png_buffer buf = { NULL, 0 };
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_byte row[width * 3];
+	unsigned int x, y;
+
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+					  NULL, NULL, NULL);
+	info_ptr = png_create_info_struct(png_ptr);
+	png_set_write_fn(png_ptr, &buf, write_png, flush_png);
+	png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB,
+		     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		     PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png_ptr, info_ptr);
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			png_byte *p = row + x * 3;
+
+			if ((x / 8 + y / 12) % 7 == 0 && (x * y) % 5 < 2)
+				p[0] = p[1] = p[2] = 0x20;
+			else if (y % 96 < 40)
+				p[0] = 0x99, p[1] = 0xff, p[2] = 0xff;
+			else
+				p[0] = p[1] = p[2] = 0xff;
+		}
+		png_write_row(png_ptr, row);
+	}
+	png_write_end(png_ptr, info_ptr);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	return buf;
+}
+
+/* The highlight as the booth used to do it: column by column */
+static void highlight_by_column(uint16_t *pixels,
+				unsigned int width, unsigned int height)
+{
+	unsigned int x, y;
+
+	for (x = 0; x < width; x++) {
+		for (y = 0; y < height; y++) {
+			uint16_t *ptr = pixels + x + y * width;
+
+			if (((*ptr >> 11) & 0x1f) > HIGHLIGHT_GRAY
+			    || ((*ptr >> 6) & 0x1f) > HIGHLIGHT_GRAY
+			    || (*ptr & 0x1f) > HIGHLIGHT_GRAY)
+				*ptr = (HIGHLIGHT_GRAY << 11)
+					| (HIGHLIGHT_GRAY << 6)
+					| (HIGHLIGHT_GRAY);
+		}
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *size, const char *name,
+		   double start, double end)
+{
+	printf("rgb565_%-9s %-20s %8.3f ms/image\n", size, name,
+	       (end - start) / ITERATIONS / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int s, i, width, height;
+	int failed = 0;
+
+	for (s = 0; s < NUM_SIZES; s++) {
+		struct png_buffer png;
+		uint16_t *pixels, *reference, *highlighted, *frame;
+		size_t num;
+		double start;
+
+		png = make_png(sizes[s].width, sizes[s].height);
+		num = (size_t)sizes[s].width * sizes[s].height;
+		highlighted = malloc(num * sizeof(*highlighted));
+		frame = malloc(2 * num * sizeof(*frame));
+
+		/* The kernel must agree with the old loop exactly */
+		pixels = rgb565_decode_png(png.data, png.len, &width, &height);
+		reference = malloc(num * sizeof(*reference));
+		memcpy(reference, pixels, num * sizeof(*reference));
+		highlight_by_column(reference, width, height);
+		rgb565_highlight(highlighted, pixels, num);
+		if (memcmp(reference, highlighted, num * sizeof(*reference))) {
+			printf("rgb565_%s: highlight differs!\n", sizes[s].name);
+			failed = 1;
+		}
+		memcpy(frame, pixels, num * sizeof(*frame));
+		memcpy(frame + num, highlighted, num * sizeof(*frame));
+		free(reference);
+		free(pixels);
+
+		/* What get_image() did: decode, copy, highlight by column */
+		start = now_ns();
+		for (i = 0; i < ITERATIONS; i++) {
+			pixels = rgb565_decode_png(png.data, png.len,
+						   &width, &height);
+			memcpy(highlighted, pixels, num * sizeof(*pixels));
+			highlight_by_column(highlighted, width, height);
+			free(pixels);
+		}
+		report(sizes[s].name, "png+column", start, now_ns());
+
+		/* An image which isn't bundled as a frame */
+		start = now_ns();
+		for (i = 0; i < ITERATIONS; i++) {
+			pixels = rgb565_decode_png(png.data, png.len,
+						   &width, &height);
+			rgb565_highlight(highlighted, pixels, num);
+			free(pixels);
+		}
+		report(sizes[s].name, "png+kernel", start, now_ns());
+
+		start = now_ns();
+		for (i = 0; i < ITERATIONS; i++)
+			rgb565_highlight(highlighted, frame, num);
+		report(sizes[s].name, "kernel", start, now_ns());
+
+		/* A frame on an upside-down screen: both variants copied
+		   and rotated.  Upright, the frame is used in place. */
+		start = now_ns();
+		for (i = 0; i < ITERATIONS; i++) {
+			pixels = malloc(2 * num * sizeof(*pixels));
+			rgb565_rotate(pixels, frame, num);
+			rgb565_rotate(pixels + num, frame + num, num);
+			free(pixels);
+		}
+		report(sizes[s].name, "frame(inverted)", start, now_ns());
+
+		free(frame);
+		free(highlighted);
+		free(png.data);
+	}
+	return failed;
+}
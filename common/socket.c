@@ -28,6 +28,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 /* SIPL 2011: Additional include required. */
 #include <linux/limits.h>
 
@@ -42,41 +43,52 @@ static void alarm_sig(int signum)
 	alarmed = 1;
 }
 
-/* open_socket_out()
+/* resolve_host()
  *
- * open a socket to a tcp remote host with the specified port.
- * Return the fd (>= 0), or -1 if an error occurs */
-int open_socket_out(const char *host, uint16_t port)
+ * look up a remote host's address, so open_socket_to() can connect to
+ * it again and again without asking the resolver each time.  Return
+ * false if an error occurs */
+bool resolve_host(const char *host, uint16_t port, struct sockaddr_in *addr)
 {
-	struct sockaddr_in sock_out;
 	struct hostent *hp;
-	int res;
-
-	res = socket(PF_INET, SOCK_STREAM, 0);
-	if (res == -1)
-		return -1;
 
 	/* Setup timeout: use half the time for the name lookup. */
 	signal(SIGALRM, alarm_sig);
 	alarm(SOCKET_TIMEOUT/2);
 
 	hp = gethostbyname(host);
-	if (!hp) {
-		/* Terminate signal handler. */
-		alarm(0);
-		return -1;
-	}
+	/* Terminate signal handler. */
+	alarm(0);
+	if (!hp)
+		return false;
+
+	memset(addr, 0, sizeof(*addr));
+	memcpy(&addr->sin_addr, hp->h_addr, hp->h_length);
+	addr->sin_port = htons(port);
+	addr->sin_family = PF_INET;
+	return true;
+}
 
-	memcpy(&sock_out.sin_addr, hp->h_addr, hp->h_length);
-	sock_out.sin_port = htons(port);
-	sock_out.sin_family = PF_INET;
+/* open_socket_to()
+ *
+ * open a socket to a tcp remote host already looked up.
+ * Return the fd (>= 0), or -1 if an error occurs */
+int open_socket_to(const struct sockaddr_in *addr)
+{
+	int res;
+
+	res = socket(PF_INET, SOCK_STREAM, 0);
+	if (res == -1)
+		return -1;
 
 	/* Use "larger"half the time for the connection. */
+	signal(SIGALRM, alarm_sig);
 	alarm((SOCKET_TIMEOUT+1)/2);
 
-	if (connect(res, (struct sockaddr *)&sock_out, sizeof(sock_out))) {
+	if (connect(res, (const struct sockaddr *)addr, sizeof(*addr))) {
 		/* Terminate signal handler. */
 		alarm(0);
+		close(res);
 		return -1;
 	}
 
@@ -85,11 +97,53 @@ int open_socket_out(const char *host, uint16_t port)
 	return res;
 }
 
+/* open_socket_out()
+ *
+ * open a socket to a tcp remote host with the specified port.
+ * Return the fd (>= 0), or -1 if an error occurs */
+int open_socket_out(const char *host, uint16_t port)
+{
+	struct sockaddr_in sock_out;
+
+	if (!resolve_host(host, port, &sock_out))
+		return -1;
+	return open_socket_to(&sock_out);
+}
+
+/* open_socket_in()
+ *
+ * open a socket listening for tcp connections on the specified port
+ * (any interface).  Return the fd (>= 0), or -1 if an error occurs */
+int open_socket_in(uint16_t port)
+{
+	struct sockaddr_in sock_in;
+	int res, one = 1;
+
+	res = socket(PF_INET, SOCK_STREAM, 0);
+	if (res == -1)
+		return -1;
+
+	/* Don't wait for old connections to time out after a restart */
+	setsockopt(res, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sock_in, 0, sizeof(sock_in));
+	sock_in.sin_addr.s_addr = htonl(INADDR_ANY);
+	sock_in.sin_port = htons(port);
+	sock_in.sin_family = PF_INET;
+
+	if (bind(res, (struct sockaddr *)&sock_in, sizeof(sock_in)) == -1
+	    || listen(res, SOMAXCONN) == -1) {
+		close(res);
+		return -1;
+	}
+	return res;
+}
+
 /* sock_write()
  *
  * write all bytes from a buffer to a socket, looping as necessary,
  * with alarm if neccessary.  */
-static ssize_t sock_write(int sock, const void *buf, size_t n)
+ssize_t sock_write(int sock, const void *buf, size_t n)
 {
 	ssize_t total = 0;
 
@@ -156,6 +210,25 @@ int sock_printf(int sock, const char *format, ...)
 	return n;
 }
 
+/* sock_read()
+ *
+ * wait up to timeout milliseconds for bytes, then read what there
+ * is, up to n.  Return bytes read, 0 on EOF, or -1 on error/timeout */
+ssize_t sock_read(int sock, void *buf, size_t n, int timeout)
+{
+	struct pollfd pfd;
+	ssize_t r;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	do {
+		if (poll(&pfd, 1, timeout) != 1)
+			return -1;
+		r = read(sock, buf, n);
+	} while (r < 0 && errno == EINTR);
+	return r;
+}
+
 /* read to EOF on a socket, and return a buffer of bytes and the count */
 void *sock_load(int sock, size_t *n)
 {
@@ -17,6 +17,9 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <netinet/in.h>
 #include <string.h>
 
 /* Time (seconds) to time out operations */ 
@@ -25,10 +28,28 @@
 /* Returns socket fd, or -1 on error/timeout */
 extern int open_socket_out(const char *host, uint16_t port);
 
+/* Look up a host to connect to later.  Returns false on error/timeout */
+extern bool resolve_host(const char *host, uint16_t port,
+			 struct sockaddr_in *addr);
+
+/* Returns socket fd connected to a looked up host, or -1 on
+   error/timeout */
+extern int open_socket_to(const struct sockaddr_in *addr);
+
+/* Returns listening socket fd, or -1 on error */
+extern int open_socket_in(uint16_t port);
+
+/* Write all of buf to a socket.  Returns bytes written, -1 on timeout */
+extern ssize_t sock_write(int sock, const void *buf, size_t n);
+
 /* printf- like function for a socket.  Returns -1 on timeout */
 extern int sock_printf(int sock, const char *format, ...)
 __attribute__((format (printf,2,3)));
 
+/* Wait up to timeout milliseconds, then read up to n bytes.  Returns
+   bytes read, 0 on EOF, -1 on error/timeout */
+extern ssize_t sock_read(int sock, void *buf, size_t n, int timeout);
+
 /* read to EOF on a socket, and return a buffer of bytes and the count.
    (NULL on error).
    Caller must free() returned value. */
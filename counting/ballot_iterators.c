@@ -15,33 +15,64 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
 #include <stdlib.h>
+#include <string.h>
 #include "hare_clark.h"
 #include "ballot_iterators.h"
 
-struct ballot_list *new_ballot_list(struct ballot *ballot,
+/* Make room for at least one more ballot in the list */
+static void grow_ballot_list(struct ballot_list *list)
+{
+	if (list->num_ballots < list->max_ballots)
+		return;
+
+	list->max_ballots = list->max_ballots ? list->max_ballots * 2 : 4;
+	list->ids = realloc(list->ids, sizeof(list->ids[0]) * list->max_ballots);
+	if (!list->ids)
+		bailout("Out of memory growing ballot list\n");
+}
+
+struct ballot_list *new_ballot_list(const struct ballot_store *store,
+				    struct ballot *ballot,
 				    struct ballot_list *next)
 {
-	struct ballot_list *ret;
+	if (!next) {
+		next = malloc(sizeof(*next));
+		if (!next)
+			bailout("Out of memory allocating ballot list\n");
+		next->store = store;
+		next->num_ballots = next->max_ballots = 0;
+		next->ids = NULL;
+	}
 
-	ret = malloc(sizeof(*ret));
+	/* Held back to front, so the new first ballot goes at the end */
+	grow_ballot_list(next);
+	next->ids[next->num_ballots++] = ballot - store->ballots;
+	return next;
+}
 
-	ret->ballot = ballot;
-	ret->next = next;
-	return ret;
+struct ballot *first_ballot(const struct ballot_list *list)
+{
+	return &list->store->ballots[list->ids[list->num_ballots - 1]];
 }
-	
+
 /* Convenience iterators: */
 struct ballot_list *any_ballots(struct ballot_list *from,
 				ballot_selectfn_t selectfn,
 				void *data)
 {
-	struct ballot_list *i, *ret = NULL;
-	unsigned int max_score = 1;
+	struct ballot_list *ret = NULL;
+	struct ballot *ballots;
+	unsigned int i, max_score = 1;
 
-	for (i = from; i; i = i->next) {
+	if (!from)
+		return NULL;
+
+	ballots = from->store->ballots;
+	for (i = from->num_ballots; i > 0; i--) {
+		struct ballot *ballot = &ballots[from->ids[i - 1]];
 		unsigned int score;
 
-		score = selectfn(i->ballot, data);
+		score = selectfn(ballot, data);
 		if (score < max_score)
 			continue;
 
@@ -52,64 +83,144 @@ struct ballot_list *any_ballots(struct ballot_list *from,
 			max_score = score;
 		}
 		/* Prepend new ballot */
-		ret = new_ballot_list(i->ballot, ret);
+		ret = new_ballot_list(from->store, ballot, ret);
 	}
 
 	return ret;
 }
 
-struct func_arg
-{
-	bool (*func)(struct ballot *, void *);
-	void *data;
-};
-
-/* Dummy iterator: puts in the list if func returns true */
-static unsigned int dummy_select(struct ballot *ballot, void *data)
-{
-	struct func_arg *farg = data;
-	if (farg->func(ballot, farg->data)) return 1;
-	else return 0;
-}
-
 /* Returns the number of ballots for whom func returned true */
 unsigned int for_each_ballot(struct ballot_list *from,
 			     bool (*func)(struct ballot *, void *),
 			     void *data)
 {
-	struct ballot_list *list, *i;
-	unsigned int ret;
-	struct func_arg farg;
-
-	farg.func = func;
-	farg.data = data;
-
-	list = any_ballots(from, dummy_select, &farg);
-	/* Now count them */
-	for (ret = 0, i = list; i; i = i->next)
-		ret++;
-	free_ballot_list(list);
+	struct ballot *ballots;
+	unsigned int i, ret = 0;
+
+	if (!from)
+		return 0;
+
+	ballots = from->store->ballots;
+	for (i = from->num_ballots; i > 0; i--)
+		if (func(&ballots[from->ids[i - 1]], data))
+			ret++;
 	return ret;
 }
 
 /* Returns the number of ballots */
 unsigned int number_of_ballots(const struct ballot_list *from)
+{
+	return from ? from->num_ballots : 0;
+}
+
+void free_ballot_list(struct ballot_list *list)
+{
+	if (list) {
+		free(list->ids);
+		free(list);
+	}
+}
+
+void tally_ballot(struct pile_tally *tally, const struct fraction *vote_value)
+{
+	unsigned int i;
+
+	/* Ballots given the same value share the same representation */
+	for (i = 0; i < tally->num_values; i++) {
+		struct value_count *vc = &tally->values[i];
+
+		if (vc->vote_value.numerator == vote_value->numerator
+		    && vc->vote_value.denominator == vote_value->denominator) {
+			vc->num_ballots++;
+			return;
+		}
+	}
+
+	if (tally->num_values == tally->max_values) {
+		tally->max_values = tally->max_values ? tally->max_values * 2
+			: 4;
+		tally->values = realloc(tally->values,
+					sizeof(tally->values[0])
+					* tally->max_values);
+		if (!tally->values)
+			bailout("Out of memory tallying vote values\n");
+	}
+	tally->values[tally->num_values].vote_value = *vote_value;
+	tally->values[tally->num_values].num_ballots = 1;
+	tally->num_values++;
+}
+
+void tally_pile(struct pile_tally *tally, struct ballot_list *pile)
 {
 	unsigned int i;
 
-	for (i = 0; from; from = from->next)
-		i++;
+	tally->num_values = 0;
+	if (!pile)
+		return;
+	for (i = pile->num_ballots; i > 0; i--)
+		tally_ballot(tally,
+			     &pile->store->ballots[pile->ids[i - 1]].vote_value);
+}
+
+unsigned int tally_ballots(const struct pile_tally *tally)
+{
+	unsigned int i, ret = 0;
 
-	return i;
+	for (i = 0; i < tally->num_values; i++)
+		ret += tally->values[i].num_ballots;
+	return ret;
 }
 
-void free_ballot_list(struct ballot_list *list)
+unsigned int tally_truncated_sum(const struct pile_tally *tally)
+{
+	struct fraction sum = fraction_zero;
+	unsigned int i;
+
+	for (i = 0; i < tally->num_values; i++)
+		sum = fraction_add(sum,
+				   fraction_multiply(tally->values[i].vote_value,
+						     tally->values[i].num_ballots));
+
+	return fraction_truncate(sum);
+}
+
+void free_tally(struct pile_tally *tally)
 {
-	struct ballot_list *next;
+	free(tally->values);
+	tally->values = NULL;
+	tally->num_values = tally->max_values = 0;
+}
 
-	while (list) {
-		next = list->next;
-		free(list);
-		list = next;
+struct count_state *history_at(struct count_history *history,
+			       unsigned int count)
+{
+	if (count >= history->num_counts) {
+		unsigned int old = history->num_counts;
+		unsigned int num = old ? old * 2 : 16;
+
+		while (num <= count)
+			num *= 2;
+		history->counts = realloc(history->counts,
+					  sizeof(history->counts[0]) * num);
+		if (!history->counts)
+			bailout("Out of memory extending count history\n");
+		/* Counts not yet reached: no piles, totals of 0 */
+		memset(history->counts + old, 0,
+		       sizeof(history->counts[0]) * (num - old));
+		history->num_counts = num;
+	}
+	return &history->counts[count];
+}
+
+void free_history(struct count_history *history)
+{
+	unsigned int i;
+
+	for (i = 0; i < history->num_counts; i++) {
+		free_ballot_list(history->counts[i].pile);
+		free_tally(&history->counts[i].tally);
 	}
+	free(history->counts);
+	history->counts = NULL;
+	history->num_counts = 0;
 }
@@ -20,7 +20,12 @@
 #include <stdbool.h>
 
 struct ballot_list;
+struct ballot_store;
 struct ballot;
+struct pile_tally;
+struct count_history;
+struct count_state;
+struct fraction;
 
 /* selectfn returns 0 for out of list, or otherwise only the highest
    return(s) will be returned */
@@ -43,7 +48,35 @@ extern unsigned int number_of_ballots(const struct ballot_list *from);
 /* Must call this after any_ballots() */
 extern void free_ballot_list(struct ballot_list *list);
 
-/* Create a new ballot list */
-extern struct ballot_list *new_ballot_list(struct ballot *ballot,
+/* Prepend a ballot from the store to the list (creating it if NULL) */
+extern struct ballot_list *new_ballot_list(const struct ballot_store *store,
+					   struct ballot *ballot,
 					   struct ballot_list *next);
+
+/* Returns the first ballot in a non-empty list */
+extern struct ballot *first_ballot(const struct ballot_list *list);
+
+/* Record one more ballot of this vote value in the tally */
+extern void tally_ballot(struct pile_tally *tally,
+			 const struct fraction *vote_value);
+
+/* Throw away the tally, and rebuild it from the ballots in the pile */
+extern void tally_pile(struct pile_tally *tally, struct ballot_list *pile);
+
+/* Returns the number of ballots in the tally */
+extern unsigned int tally_ballots(const struct pile_tally *tally);
+
+/* Sum all the vote values in the tally, and return the truncated total */
+extern unsigned int tally_truncated_sum(const struct pile_tally *tally);
+
+/* Empty the tally, and free its memory */
+extern void free_tally(struct pile_tally *tally);
+
+/* Returns the state at this count, extending the history if needed.
+   Only valid until a later count is asked for. */
+extern struct count_state *history_at(struct count_history *history,
+				      unsigned int count);
+
+/* Free every pile and tally in the history, leaving it empty */
+extern void free_history(struct count_history *history);
 #endif /*_BALLOT_ITERATORS_H*/
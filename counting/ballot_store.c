@@ -0,0 +1,119 @@
+/* This file is (C) copyright 2001 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdlib.h>
+#include "hare_clark.h"
+#include "ballot_store.h"
+
+struct ballot_store *new_ballot_store(unsigned int num_ballots,
+				      unsigned int num_prefs)
+{
+	struct ballot_store *store;
+
+	store = malloc(sizeof(*store));
+	if (!store)
+		bailout("Out of memory allocating ballot store\n");
+
+	store->num_ballots = 0;
+	store->max_ballots = num_ballots ? num_ballots : 1;
+	store->ballots = malloc(sizeof(store->ballots[0])
+				* store->max_ballots);
+
+	store->num_prefs = 0;
+	store->max_prefs = num_prefs ? num_prefs : 1;
+	store->prefs = malloc(sizeof(store->prefs[0]) * store->max_prefs);
+
+	if (!store->ballots || !store->prefs)
+		bailout("Out of memory allocating ballot store\n");
+	return store;
+}
+
+/* Make room for more preferences.  The pool may move, so every
+   stored ballot's preferences must move with it. */
+static void grow_prefs(struct ballot_store *store, unsigned int needed)
+{
+	struct normalized_pref *old = store->prefs;
+	unsigned int i;
+
+	while (store->max_prefs < needed)
+		store->max_prefs *= 2;
+	store->prefs = realloc(store->prefs,
+			       sizeof(store->prefs[0]) * store->max_prefs);
+	if (!store->prefs)
+		bailout("Out of memory storing preferences\n");
+
+	if (store->prefs != old)
+		for (i = 0; i < store->num_ballots; i++)
+			store->ballots[i].prefs = store->prefs
+				+ (store->ballots[i].prefs - old);
+}
+
+struct ballot *store_ballot(struct ballot_store *store,
+			    unsigned int num_preferences)
+{
+	struct ballot *ballot;
+
+	if (store->num_ballots == store->max_ballots) {
+		store->max_ballots *= 2;
+		store->ballots = realloc(store->ballots,
+					 sizeof(store->ballots[0])
+					 * store->max_ballots);
+		if (!store->ballots)
+			bailout("Out of memory storing ballots\n");
+	}
+	if (store->num_prefs + num_preferences > store->max_prefs)
+		grow_prefs(store, store->num_prefs + num_preferences);
+
+	ballot = &store->ballots[store->num_ballots++];
+	ballot->vote_value = fraction_zero;
+	ballot->count_transferred = 0;
+	ballot->num_preferences = num_preferences;
+	ballot->prefs = store->prefs + store->num_prefs;
+	store->num_prefs += num_preferences;
+
+	return ballot;
+}
+
+struct ballot_list *all_ballots(const struct ballot_store *store)
+{
+	struct ballot_list *list;
+	unsigned int i;
+
+	if (store->num_ballots == 0)
+		return NULL;
+
+	list = malloc(sizeof(*list));
+	if (!list)
+		bailout("Out of memory allocating ballot list\n");
+	list->store = store;
+	list->num_ballots = list->max_ballots = store->num_ballots;
+	list->ids = malloc(sizeof(list->ids[0]) * list->max_ballots);
+	if (!list->ids)
+		bailout("Out of memory allocating ballot list\n");
+	for (i = 0; i < store->num_ballots; i++)
+		list->ids[i] = i;
+
+	return list;
+}
+
+void free_ballot_store(struct ballot_store *store)
+{
+	if (store) {
+		free(store->ballots);
+		free(store->prefs);
+		free(store);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef _BALLOT_STORE_H
+#define _BALLOT_STORE_H
+/* This file is (C) copyright 2001 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Contiguous storage for the ballots being counted */
+struct ballot_store;
+struct ballot_list;
+struct ballot;
+
+/* Create an empty store, with room for this many ballots and
+   preferences (it grows if more are stored). */
+extern struct ballot_store *new_ballot_store(unsigned int num_ballots,
+					     unsigned int num_prefs);
+
+/* Add a ballot with room for num_preferences, and return it for
+   filling in.  Only valid until the next call. */
+extern struct ballot *store_ballot(struct ballot_store *store,
+				   unsigned int num_preferences);
+
+/* Returns a list of every ballot in the store, or NULL if empty */
+/* Caller must call free_ballot_list on return value unless NULL. */
+extern struct ballot_list *all_ballots(const struct ballot_store *store);
+
+/* Free the store and all its ballots */
+extern void free_ballot_store(struct ballot_store *store);
+#endif /*_BALLOT_STORE_H*/
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include "hare_clark.h"
+#include "ballot_iterators.h"
 #include "candidate_iterators.h"
 
 struct cand_list *new_cand_list(struct candidate *cand, struct cand_list *next)
@@ -113,3 +114,64 @@ struct candidate *extract_cand_destroy_list(struct cand_list *candlist)
 	free_cand_list(candlist);
 	return cand;
 }
+
+struct cand_index *new_cand_index(struct cand_list *candidates)
+{
+	struct cand_index *index;
+	struct cand_list *i;
+
+	index = malloc(sizeof(*index));
+	if (!index)
+		bailout("Out of memory allocating candidate index\n");
+	index->num_groups = 0;
+	index->num_cand_indexes = 0;
+	for (i = candidates; i; i = i->next) {
+		if (i->cand->group->group_index >= index->num_groups)
+			index->num_groups = i->cand->group->group_index + 1;
+		if (i->cand->db_candidate_index >= index->num_cand_indexes)
+			index->num_cand_indexes
+				= i->cand->db_candidate_index + 1;
+	}
+
+	/* One more, so an empty index is not mistaken for failure */
+	index->slot = calloc(index->num_groups * index->num_cand_indexes + 1,
+			     sizeof(index->slot[0]));
+	if (!index->slot)
+		bailout("Out of memory allocating candidate index\n");
+	for (i = candidates; i; i = i->next)
+		index->slot[i->cand->group->group_index
+			    * index->num_cand_indexes
+			    + i->cand->db_candidate_index] = i->cand;
+	return index;
+}
+
+struct candidate *lookup_candidate(const struct cand_index *index,
+				   const struct normalized_pref *pref)
+{
+	if (pref->group_index >= index->num_groups
+	    || pref->db_candidate_index >= index->num_cand_indexes)
+		return NULL;
+
+	return index->slot[pref->group_index * index->num_cand_indexes
+			   + pref->db_candidate_index];
+}
+
+void free_cand_index(struct cand_index *index)
+{
+	if (index) {
+		free(index->slot);
+		free(index);
+	}
+}
+
+struct count_state *cand_count(struct candidate *cand, unsigned int count)
+{
+	return history_at(&cand->history, count);
+}
+
+unsigned int cand_total(const struct candidate *cand, unsigned int count)
+{
+	if (count >= cand->history.num_counts)
+		return 0;
+	return cand->history.counts[count].total;
+}
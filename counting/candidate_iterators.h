@@ -21,6 +21,17 @@
 
 struct candidate;
 struct cand_list;
+struct normalized_pref;
+struct count_state;
+
+/* Direct lookup of candidates by preference: slot
+   [group_index * num_cand_indexes + db_candidate_index] */
+struct cand_index
+{
+	unsigned int num_groups;
+	unsigned int num_cand_indexes;
+	struct candidate **slot;
+};
 
 /* selectfn returns 0 for out of list, or otherwise only the highest
    return(s) will be returned */
@@ -46,4 +57,24 @@ extern struct candidate *extract_cand_destroy_list(struct cand_list *candlist);
 /* Allocate a new candidate list node */
 extern struct cand_list *new_cand_list(struct candidate *cand,
 				       struct cand_list *next);
+
+/* Index the candidates in the list by group and candidate index */
+extern struct cand_index *new_cand_index(struct cand_list *candidates);
+
+/* Return the indexed candidate this preference is for, or NULL if
+   they are not in the index */
+extern struct candidate *lookup_candidate(const struct cand_index *index,
+					  const struct normalized_pref *pref);
+
+/* Must call this after new_cand_index() */
+extern void free_cand_index(struct cand_index *index);
+
+/* Returns the candidate's state at this count (empty if not reached).
+   Only valid until a later count is asked for. */
+extern struct count_state *cand_count(struct candidate *cand,
+				      unsigned int count);
+
+/* Returns the candidate's total at this count (0 if not reached) */
+extern unsigned int cand_total(const struct candidate *cand,
+			       unsigned int count);
 #endif /*_CANDIDATE_ITERATORS_H*/
@@ -0,0 +1,542 @@
+/* This file is (C) copyright 2001 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* The checkpoint file is text, one record per line:
+
+   EVACS checkpoint 1
+   H:<ballots>:<candidates>:<fingerprint>
+   then, for every count:
+   C:<count>:<quota>:<number elected so far>
+   P:<scrutiny position>:<count> <ballots>	(a candidate's pile)
+   E:<count> <ballots>				(an exhausted pile)
+   S:<scrutiny position>:<status>:<count quota reached>:<order elected>:
+     <surplus distributed>:<all vacancies filled>:<previous total>:<total>
+   K
+   and, if the count finished:
+   F
+
+   A pile's ballots are written in order, as ranges of consecutive ids
+   ("first-last", or just "id"), each preceded by "=numerator/denominator"
+   when the vote value changes. */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hare_clark.h"
+#include "checkpoint.h"
+#include "count.h"
+#include "ballot_iterators.h"
+#include "candidate_iterators.h"
+
+#define CHECKPOINT_MAGIC "EVACS checkpoint 1"
+
+struct checkpoint
+{
+	FILE *out;
+	unsigned int num_candidates;
+
+	/* Has the candidate's surplus pile been written since its vote
+	   values changed?  By scrutiny position. */
+	bool *surplus_written;
+};
+
+/* What the ballot ids and scrutiny positions in a checkpoint refer to */
+struct fingerprint
+{
+	unsigned int num_ballots;
+	unsigned int num_candidates;
+	uint64_t hash;
+};
+
+/* FNV-1a */
+static void hash_bytes(struct fingerprint *f, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		f->hash ^= *p++;
+		f->hash *= UINT64_C(0x100000001b3);
+	}
+}
+
+static bool hash_candidate(struct candidate *cand, void *fingerprint)
+{
+	struct fingerprint *f = fingerprint;
+
+	hash_bytes(f, &cand->scrutiny_pos, sizeof(cand->scrutiny_pos));
+	hash_bytes(f, &cand->group->group_index,
+		   sizeof(cand->group->group_index));
+	hash_bytes(f, &cand->db_candidate_index,
+		   sizeof(cand->db_candidate_index));
+	f->num_candidates++;
+	return false;
+}
+
+static struct fingerprint fingerprint(const struct election *e,
+				      const struct ballot_list *ballots)
+{
+	struct fingerprint f = { 0, 0, UINT64_C(0xcbf29ce484222325) };
+	const struct ballot_store *store = ballots ? ballots->store : NULL;
+	unsigned int i;
+
+	for_each_candidate(e->candidates, &hash_candidate, &f);
+	if (store) {
+		/* Ids are positions in the store */
+		for (i = 0; i < store->num_ballots; i++) {
+			const struct ballot *ballot = &store->ballots[i];
+
+			hash_bytes(&f, &ballot->num_preferences,
+				   sizeof(ballot->num_preferences));
+			hash_bytes(&f, ballot->prefs,
+				   sizeof(ballot->prefs[0])
+				   * ballot->num_preferences);
+		}
+		f.num_ballots = store->num_ballots;
+	}
+	return f;
+}
+
+/* Is a file or directory only ours to write? */
+static bool private_to_us(const struct stat *st)
+{
+	return st->st_uid == geteuid()
+		&& !(st->st_mode & (S_IWGRP|S_IWOTH));
+}
+
+/* The counting user's own directory for checkpoints, ~/.evacs */
+static char *checkpoint_dir(void)
+{
+	struct passwd *passwd = getpwuid(geteuid());
+	struct stat st;
+	char *dir;
+
+	if (!passwd)
+		bailout("Could not find your home directory\n");
+	dir = sprintf_malloc("%s/.evacs", passwd->pw_dir);
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+		bailout("Could not create %s: %s\n", dir, strerror(errno));
+	if (lstat(dir, &st) != 0)
+		bailout("Could not read %s: %s\n", dir, strerror(errno));
+	if (!S_ISDIR(st.st_mode) || !private_to_us(&st))
+		bailout("%s must be a directory only %s can write to\n",
+			dir, passwd->pw_name);
+	return dir;
+}
+
+char *checkpoint_path(const char *electorate_name)
+{
+	char ename_normalized[strlen(electorate_name) + 1];
+	char *dir, *path;
+
+	normalize_electorate_name(ename_normalized, electorate_name);
+	dir = checkpoint_dir();
+	path = sprintf_malloc("%s/checkpoint.%s.dat", dir, ename_normalized);
+	free(dir);
+	return path;
+}
+
+void checkpoint_start(struct count_context *ctx,
+		      const struct election *e,
+		      struct ballot_list *ballots,
+		      const char *path)
+{
+	struct checkpoint *c;
+	struct fingerprint f = fingerprint(e, ballots);
+	int fd;
+
+	c = malloc(sizeof(*c));
+	if (!c)
+		bailout("Out of memory starting checkpoint\n");
+	c->num_candidates = f.num_candidates;
+	c->surplus_written = calloc(f.num_candidates + 1,
+				    sizeof(c->surplus_written[0]));
+	if (!c->surplus_written)
+		bailout("Out of memory starting checkpoint\n");
+	/* A new file, so no one else can have opened it or linked it
+	   somewhere else */
+	if (unlink(path) != 0 && errno != ENOENT)
+		bailout("Could not remove old %s: %s\n",
+			path, strerror(errno));
+	fd = open(path, O_WRONLY|O_CREAT|O_EXCL, 0600);
+	if (fd < 0 || !(c->out = fdopen(fd, "w")))
+		bailout("Could not open %s for writing: %s\n",
+			path, strerror(errno));
+
+	fprintf(c->out, CHECKPOINT_MAGIC "\nH:%u:%u:%016" PRIx64 "\n",
+		f.num_ballots, f.num_candidates, f.hash);
+	ctx->checkpoint = c;
+}
+
+/* Write the ballots of a pile, and their vote values */
+static void write_pile(FILE *out, const struct ballot_list *pile)
+{
+	const struct ballot *ballots = pile->store->ballots;
+	const uint32_t *ids = pile->ids;
+	struct fraction value = fraction_zero;
+	unsigned int i, j;
+
+	for (i = 0; i < pile->num_ballots; i = j) {
+		int64_t step = 0;
+
+		if (i == 0 || !fraction_equal(ballots[ids[i]].vote_value,
+					      value)) {
+			value = ballots[ids[i]].vote_value;
+			fprintf(out, " =%lu/%lu",
+				value.numerator, value.denominator);
+		}
+		/* Extend the run while the ids go up (or down) by one */
+		for (j = i + 1; j < pile->num_ballots; j++) {
+			int64_t diff = (int64_t)ids[j] - ids[j - 1];
+
+			if (step == 0 && (diff == 1 || diff == -1))
+				step = diff;
+			if (diff != step
+			    || !fraction_equal(ballots[ids[j]].vote_value,
+					       value))
+				break;
+		}
+		if (j == i + 1)
+			fprintf(out, " %u", ids[i]);
+		else
+			fprintf(out, " %u-%u", ids[i], ids[j - 1]);
+	}
+	fputc('\n', out);
+}
+
+/* STEP 24 lowers the vote values of a surplus: write it again */
+static bool write_surplus(struct candidate *cand, void *void_ctx)
+{
+	struct count_context *ctx = void_ctx;
+	struct checkpoint *c = ctx->checkpoint;
+	struct ballot_list *pile;
+
+	assert(cand->scrutiny_pos < c->num_candidates);
+	if (!cand->surplus_distributed || c->surplus_written[cand->scrutiny_pos])
+		return false;
+
+	pile = cand_count(cand, cand->count_when_quota_reached)->pile;
+	if (pile) {
+		fprintf(c->out, "P:%u:%u", cand->scrutiny_pos,
+			cand->count_when_quota_reached);
+		write_pile(c->out, pile);
+	}
+	c->surplus_written[cand->scrutiny_pos] = true;
+	return false;
+}
+
+/* The pile this count gave the candidate, and where they stand */
+static bool write_candidate(struct candidate *cand, void *void_ctx)
+{
+	struct count_context *ctx = void_ctx;
+	FILE *out = ctx->checkpoint->out;
+	unsigned int count = ctx->count;
+	struct ballot_list *pile = cand_count(cand, count)->pile;
+
+	if (pile) {
+		fprintf(out, "P:%u:%u", cand->scrutiny_pos, count);
+		write_pile(out, pile);
+	}
+	fprintf(out, "S:%u:%u:%u:%u:%u:%u:%u:%u\n",
+		cand->scrutiny_pos, cand->status,
+		cand->count_when_quota_reached, cand->order_elected,
+		cand->surplus_distributed, cand->all_vacancies_filled_at_count,
+		cand_count(cand, count - 1)->total,
+		cand_count(cand, count)->total);
+	return false;
+}
+
+void checkpoint_count(struct count_context *ctx,
+		      struct cand_list *candidates,
+		      unsigned int quota)
+{
+	struct checkpoint *c = ctx->checkpoint;
+	unsigned int count = ctx->count;
+	unsigned int i;
+
+	if (!c)
+		return;
+
+	assert(count > 0);
+	fprintf(c->out, "C:%u:%u:%u\n", count, quota, ctx->order_elected);
+
+	/* A ballot's vote value is the one in the last pile written
+	   with it, so older piles go first. */
+	for_each_candidate(candidates, &write_surplus, ctx);
+	/* STEP 28 zeroes the exhausted pile after the count is recorded,
+	   so the previous count's is written again */
+	for (i = count - 1; i <= count; i++) {
+		struct ballot_list *pile = history_at(&ctx->exhausted, i)->pile;
+
+		if (pile) {
+			fprintf(c->out, "E:%u", i);
+			write_pile(c->out, pile);
+		}
+	}
+	for_each_candidate(candidates, &write_candidate, ctx);
+	fputs("K\n", c->out);
+}
+
+void checkpoint_end(struct count_context *ctx)
+{
+	struct checkpoint *c = ctx->checkpoint;
+
+	if (!c)
+		return;
+
+	fputs("F\n", c->out);
+	if (fclose(c->out) != 0)
+		bailout("Could not write checkpoint: %s\n", strerror(errno));
+	free(c->surplus_written);
+	free(c);
+	ctx->checkpoint = NULL;
+}
+
+/* Replace a pile with the one in the rest of the line, giving its
+   ballots their vote values (and, if it is a candidate's, the count
+   they transferred on).  Returns NULL if the line is malformed. */
+static struct ballot_list *read_pile(const char *p,
+				     const struct ballot_store *store,
+				     unsigned int count_transferred)
+{
+	struct ballot_list *pile = NULL;
+	struct fraction value = fraction_one;
+	char *end;
+
+	while (*p == ' ') {
+		unsigned long first, last, id;
+
+		p++;
+		if (*p == '=') {
+			value.numerator = strtoul(p + 1, &end, 10);
+			if (*end != '/')
+				goto bad;
+			value.denominator = strtoul(end + 1, &end, 10);
+			if (value.denominator == 0)
+				goto bad;
+			p = end;
+			continue;
+		}
+		first = last = strtoul(p, &end, 10);
+		if (end == p)
+			goto bad;
+		if (*end == '-')
+			last = strtoul(end + 1, &end, 10);
+		p = end;
+		if (first >= store->num_ballots || last >= store->num_ballots)
+			goto bad;
+
+		for (id = first; ; id += (last > first ? 1 : -1)) {
+			struct ballot *ballot = &store->ballots[id];
+
+			ballot->vote_value = value;
+			if (count_transferred)
+				ballot->count_transferred = count_transferred;
+			pile = new_ballot_list(store, ballot, pile);
+			if (id == last)
+				break;
+		}
+	}
+	if (*p == '\n' || *p == '\0')
+		return pile;
+bad:
+	free_ballot_list(pile);
+	return NULL;
+}
+
+static void replace_pile(struct count_state *state, struct ballot_list *pile)
+{
+	free_ballot_list(state->pile);
+	state->pile = pile;
+	tally_pile(&state->tally, pile);
+}
+
+/* Put the candidate back as fetched */
+static bool forget_candidate(struct candidate *cand, void *unused)
+{
+	free_history(&cand->history);
+	cand->count_when_quota_reached = 0;
+	cand->surplus_distributed = false;
+	cand->all_vacancies_filled_at_count = false;
+	return false;
+}
+
+/* Exactly one of the statuses a count gives a candidate */
+static bool valid_status(unsigned int status)
+{
+	switch (status) {
+	case CAND_CONTINUING:
+	case CAND_ELECTED:
+	case CAND_BEING_EXCLUDED:
+	case CAND_EXCLUDED:
+	case CAND_PENDING:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool index_by_position(struct candidate *cand, void *by_pos)
+{
+	struct candidate **cands = by_pos;
+
+	cands[cand->scrutiny_pos] = cand;
+	return false;
+}
+
+bool checkpoint_resume(struct count_context *ctx,
+		       struct election *e,
+		       struct ballot_list *ballots,
+		       const char *path,
+		       struct candidate *vacating,
+		       unsigned int *quota)
+{
+	struct fingerprint f = fingerprint(e, ballots), saved;
+	struct candidate **cands;
+	struct stat st;
+	char *line = NULL;
+	size_t len = 0;
+	FILE *in;
+	bool done = false, bad = false;
+	int fd;
+
+	if (!ballots)
+		return false;
+	fd = open(path, O_RDONLY|O_NOFOLLOW);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open %s: %s\n", path,
+			strerror(errno));
+		return false;
+	}
+	/* Anyone else could have written anything in it */
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+	    || !private_to_us(&st)) {
+		fprintf(stderr, "%s is not a file only you can write to: "
+			"not resuming from it\n", path);
+		close(fd);
+		return false;
+	}
+	in = fdopen(fd, "r");
+	if (!in)
+		bailout("Could not read %s: %s\n", path, strerror(errno));
+
+	/* Only resume the count of these ballots and candidates */
+	if (getline(&line, &len, in) < 0
+	    || strcmp(line, CHECKPOINT_MAGIC "\n") != 0
+	    || getline(&line, &len, in) < 0
+	    || sscanf(line, "H:%u:%u:%" SCNx64, &saved.num_ballots,
+		      &saved.num_candidates, &saved.hash) != 3
+	    || saved.num_ballots != f.num_ballots
+	    || saved.num_candidates != f.num_candidates
+	    || saved.hash != f.hash) {
+		fprintf(stderr, "%s is not a checkpoint of this count\n",
+			path);
+		free(line);
+		fclose(in);
+		return false;
+	}
+
+	cands = calloc(f.num_candidates + 1, sizeof(cands[0]));
+	if (!cands)
+		bailout("Out of memory resuming count\n");
+	for_each_candidate(e->candidates, &index_by_position, cands);
+
+	reset_count(ctx);
+	set_candidate_index(ctx, e->cand_index);
+	while (!done && !bad && getline(&line, &len, in) >= 0) {
+		unsigned int pos, count, status, cwqr, order, surplus, filled;
+		unsigned int previous, total;
+		struct ballot_list *pile;
+		int n = 0;
+
+		switch (line[0]) {
+		case 'C':
+			bad = (sscanf(line, "C:%u:%u:%u", &ctx->count, quota,
+				      &ctx->order_elected) != 3
+			       || ctx->count == 0);
+			break;
+		case 'P':
+			if (sscanf(line, "P:%u:%u%n", &pos, &count, &n) != 2
+			    || pos >= f.num_candidates || !cands[pos]
+			    || count == 0 || count > ctx->count
+			    || !(pile = read_pile(line + n, ballots->store,
+						  count))) {
+				bad = true;
+				break;
+			}
+			replace_pile(cand_count(cands[pos], count), pile);
+			break;
+		case 'E':
+			if (sscanf(line, "E:%u%n", &count, &n) != 1
+			    || ctx->count == 0 || count > ctx->count
+			    || !(pile = read_pile(line + n, ballots->store, 0))) {
+				bad = true;
+				break;
+			}
+			replace_pile(history_at(&ctx->exhausted, count), pile);
+			break;
+		case 'S':
+			if (sscanf(line, "S:%u:%u:%u:%u:%u:%u:%u:%u", &pos,
+				   &status, &cwqr, &order, &surplus, &filled,
+				   &previous, &total) != 8
+			    || ctx->count == 0
+			    || pos >= f.num_candidates || !cands[pos]
+			    || !valid_status(status)
+			    || cwqr > ctx->count
+			    || order > ctx->order_elected
+			    || surplus > 1 || filled > 1) {
+				bad = true;
+				break;
+			}
+			cands[pos]->status = status;
+			cands[pos]->count_when_quota_reached = cwqr;
+			cands[pos]->order_elected = order;
+			cands[pos]->surplus_distributed = surplus;
+			cands[pos]->all_vacancies_filled_at_count = filled;
+			cand_count(cands[pos], ctx->count - 1)->total = previous;
+			cand_count(cands[pos], ctx->count)->total = total;
+			break;
+		case 'K':
+			/* The count is complete: is it the one we want? */
+			done = (vacating
+				&& (vacating->status
+				    & (CAND_PENDING|CAND_ELECTED)));
+			break;
+		case 'F':
+			done = true;
+			break;
+		default:
+			bad = true;
+		}
+	}
+	free(line);
+	fclose(in);
+	free(cands);
+
+	if (!done) {
+		fprintf(stderr, "%s is %s: not resuming from it\n", path,
+			bad ? "corrupt" : "incomplete");
+		for_each_candidate(e->candidates, &forget_candidate, NULL);
+		reset_count(ctx);
+	}
+	return done;
+}
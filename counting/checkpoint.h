@@ -0,0 +1,67 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+/* This file is (C) copyright 2001 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Checkpoints of a count, so it can be resumed without replaying it.
+
+   After every count, the count writes the candidates' statuses and
+   totals, and the piles that count created, with the ballots as
+   ranges of ids in the ballot store and their vote values.  Piles
+   whose vote values later change are written again.  Resuming reads
+   the records back, in order, up to the count wanted. */
+#include <stdbool.h>
+
+struct count_context;
+struct election;
+struct ballot_list;
+struct cand_list;
+struct candidate;
+
+/* Where the checkpoints of an electorate's count go: in ~/.evacs,
+   which is created if need be, and which only the counting user may
+   write to (caller frees) */
+extern char *checkpoint_path(const char *electorate_name);
+
+/* Start writing checkpoints of the count of these ballots to path,
+   replacing it with a new file only the counting user can read */
+extern void checkpoint_start(struct count_context *ctx,
+			     const struct election *e,
+			     struct ballot_list *ballots,
+			     const char *path);
+
+/* Record the state as at the end of the current count (does nothing
+   if the count is not being checkpointed) */
+extern void checkpoint_count(struct count_context *ctx,
+			     struct cand_list *candidates,
+			     unsigned int quota);
+
+/* Mark the count finished, and stop checkpointing */
+extern void checkpoint_end(struct count_context *ctx);
+
+/* Restore the count of these ballots from the checkpoints at path, as
+   it was when `vacating' reached quota (or, if vacating is NULL or
+   never did, when the count finished), and set quota.  The candidates
+   must be freshly fetched.  Returns false, leaving them as they were,
+   if the checkpoints are missing, could have been written by someone
+   else, are of a different count, are corrupt, or end too soon. */
+extern bool checkpoint_resume(struct count_context *ctx,
+			      struct election *e,
+			      struct ballot_list *ballots,
+			      const char *path,
+			      struct candidate *vacating,
+			      unsigned int *quota);
+#endif /*_CHECKPOINT_H*/
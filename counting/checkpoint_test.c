@@ -0,0 +1,314 @@
+/* This file is (C) copyright 2001 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Resuming a checkpointed count where each elected candidate reached
+   quota must leave exactly the state a fresh count up to that point
+   does, and checkpoints that could have been tampered with must be
+   refused. */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <common/evacs.h>
+#include "hare_clark.h"
+#include "count.h"
+#include "report.h"
+#include "checkpoint.h"
+#include "ballot_iterators.h"
+#include "ballot_store.h"
+#include "candidate_iterators.h"
+
+#define NUM_GROUPS 6
+#define PER_GROUP 3
+#define NUM_CANDIDATES (NUM_GROUPS * PER_GROUP)
+#define NUM_BALLOTS 20000
+#define NUM_SEATS 5
+
+static char tmpdir[] = "/tmp/checkpoint_test_XXXXXX";
+
+/* Reproducible pseudo-random numbers */
+static unsigned int seed = 1;
+static unsigned int rnd(void)
+{
+	seed = seed * 1103515245U + 12345U;
+	return seed >> 8;
+}
+
+/* Fresh candidates, as though just fetched */
+static void make_election(struct election *e, struct candidate **cands)
+{
+	unsigned int i;
+
+	e->electorate = malloc(sizeof(struct electorate)
+			       + sizeof("Checkpoint"));
+	e->electorate->code = 1;
+	e->electorate->num_seats = NUM_SEATS;
+	e->electorate->next = NULL;
+	strcpy(e->electorate->name, "Checkpoint");
+	e->num_groups = NUM_GROUPS;
+	for (i = 0; i < NUM_GROUPS; i++) {
+		e->groups[i].name = sprintf_malloc("Group %c", 'A' + i);
+		e->groups[i].abbrev = sprintf_malloc("G%c", 'A' + i);
+		e->groups[i].group_index = i;
+	}
+	e->candidates = NULL;
+	for (i = 0; i < NUM_CANDIDATES; i++) {
+		cands[i] = calloc(1, sizeof(*cands[i]));
+		cands[i]->name = sprintf_malloc("Candidate %u", i);
+		cands[i]->db_candidate_index = i % PER_GROUP;
+		cands[i]->group = &e->groups[i / PER_GROUP];
+	}
+	for (i = NUM_CANDIDATES; i-- > 0;) {
+		e->candidates = new_cand_list(cands[i], e->candidates);
+		cands[i]->scrutiny_pos = i;
+	}
+	e->cand_index = new_cand_index(e->candidates);
+}
+
+/* Ballots with up to 7 preferences, a third of them first preferences
+   for the first group, and a few informal */
+static struct ballot_list *make_ballots(struct candidate **cands)
+{
+	struct ballot_store *store = new_ballot_store(16, 16);
+	unsigned int i, j;
+
+	for (i = 0; i < NUM_BALLOTS; i++) {
+		unsigned int num_prefs = rnd() % 8;
+		bool used[NUM_CANDIDATES] = { false };
+		struct ballot *ballot;
+
+		if (rnd() % 50 == 0)
+			num_prefs = 0;
+		ballot = store_ballot(store, num_prefs);
+		for (j = 0; j < num_prefs; j++) {
+			unsigned int c;
+
+			do {
+				if (j == 0 && rnd() % 3 == 0)
+					c = rnd() % PER_GROUP;
+				else
+					c = rnd() % NUM_CANDIDATES;
+			} while (used[c]);
+			used[c] = true;
+			ballot->prefs[j].group_index
+				= cands[c]->group->group_index;
+			ballot->prefs[j].db_candidate_index
+				= cands[c]->db_candidate_index;
+		}
+	}
+	return all_ballots(store);
+}
+
+static bool same_pile(struct ballot_list *a, struct ballot_list *b)
+{
+	unsigned int i;
+
+	if ((a ? a->num_ballots : 0) != (b ? b->num_ballots : 0))
+		return false;
+	for (i = 0; a && i < a->num_ballots; i++) {
+		const struct ballot *ba = &a->store->ballots[a->ids[i]];
+		const struct ballot *bb = &b->store->ballots[b->ids[i]];
+
+		if (a->ids[i] != b->ids[i]
+		    || !fraction_equal(ba->vote_value, bb->vote_value))
+			return false;
+	}
+	return true;
+}
+
+/* Do two counts stand in the same place? */
+static bool same_count(struct count_context *ctx_a, struct candidate **a,
+		       struct count_context *ctx_b, struct candidate **b)
+{
+	unsigned int count = get_count_number(ctx_a);
+	unsigned int i, k;
+
+	if (get_count_number(ctx_b) != count
+	    || get_order_elected(ctx_a) != get_order_elected(ctx_b))
+		return false;
+
+	for (k = 0; k <= count; k++)
+		if (!same_pile(history_at(&ctx_a->exhausted, k)->pile,
+			       history_at(&ctx_b->exhausted, k)->pile))
+			return false;
+
+	for (i = 0; i < NUM_CANDIDATES; i++) {
+		if (a[i]->status != b[i]->status
+		    || a[i]->count_when_quota_reached
+		    != b[i]->count_when_quota_reached
+		    || a[i]->order_elected != b[i]->order_elected
+		    || a[i]->surplus_distributed != b[i]->surplus_distributed
+		    || a[i]->all_vacancies_filled_at_count
+		    != b[i]->all_vacancies_filled_at_count)
+			return false;
+		for (k = 0; k <= count; k++) {
+			struct count_state *sa = cand_count(a[i], k);
+			struct count_state *sb = cand_count(b[i], k);
+
+			if (sa->total != sb->total
+			    || !same_pile(sa->pile, sb->pile))
+				return false;
+		}
+	}
+	return true;
+}
+
+/* Copy a checkpoint, replacing the first status written with this */
+static void corrupt_status(const char *from, const char *to,
+			   unsigned int status)
+{
+	FILE *in = fopen(from, "r"), *out = fopen(to, "w");
+	char *line = NULL;
+	size_t len = 0;
+	bool done = false;
+
+	if (!in || !out)
+		exit(1);
+	while (getline(&line, &len, in) >= 0) {
+		unsigned int pos, old_status;
+		int n = 0;
+
+		if (!done && sscanf(line, "S:%u:%u:%n", &pos, &old_status,
+				    &n) == 2 && n > 0) {
+			fprintf(out, "S:%u:%u:%s", pos, status, line + n);
+			done = true;
+		} else
+			fputs(line, out);
+	}
+	free(line);
+	fclose(in);
+	fclose(out);
+}
+
+int main(int argc, char *argv[])
+{
+	struct election e;
+	struct candidate *cands[NUM_CANDIDATES];
+	struct ballot_list *ballots;
+	struct count_context ctx;
+	unsigned int i, quota, num_elected = 0;
+	char *path, *bad_path;
+
+	if (!mkdtemp(tmpdir))
+		exit(1);
+	path = sprintf_malloc("%s/checkpoint.dat", tmpdir);
+	bad_path = sprintf_malloc("%s/bad.dat", tmpdir);
+
+	/* A full count, checkpointed */
+	make_election(&e, cands);
+	ballots = make_ballots(cands);
+	init_count_context(&ctx);
+	checkpoint_start(&ctx, &e, ballots, path);
+	do_count(&ctx, &e, ballots, NULL);
+	checkpoint_end(&ctx);
+
+	/* Checkpoints are only ours to read */
+	{
+		struct stat st;
+
+		if (stat(path, &st) != 0 || (st.st_mode & 0777) != 0600)
+			exit(1);
+	}
+
+	/* Each elected candidate vacates in turn */
+	for (i = 0; i < NUM_CANDIDATES; i++) {
+		struct election fresh_e, resumed_e;
+		struct candidate *fresh[NUM_CANDIDATES];
+		struct candidate *resumed[NUM_CANDIDATES];
+		struct count_context fresh_ctx, resumed_ctx;
+		unsigned int fresh_quota, resumed_quota;
+
+		if (!(cands[i]->status & (CAND_ELECTED|CAND_PENDING)))
+			continue;
+		num_elected++;
+
+		make_election(&fresh_e, fresh);
+		init_count_context(&fresh_ctx);
+		report_start(&fresh_ctx, &fresh_e, NULL, tmpdir);
+		do_count(&fresh_ctx, &fresh_e, ballots, fresh[i]);
+		fresh_quota = report_get_quota(&fresh_ctx);
+		report_end(&fresh_ctx, get_count_number(&fresh_ctx), "");
+
+		make_election(&resumed_e, resumed);
+		init_count_context(&resumed_ctx);
+		if (!checkpoint_resume(&resumed_ctx, &resumed_e, ballots, path,
+				       resumed[i], &resumed_quota))
+			exit(1);
+		if (resumed_quota != fresh_quota
+		    || !same_count(&fresh_ctx, fresh, &resumed_ctx, resumed))
+			exit(1);
+	}
+	if (num_elected != NUM_SEATS)
+		exit(1);
+
+	/* Without a vacating candidate, resume where the count finished */
+	{
+		struct election resumed_e;
+		struct candidate *resumed[NUM_CANDIDATES];
+		struct count_context resumed_ctx;
+
+		make_election(&resumed_e, resumed);
+		init_count_context(&resumed_ctx);
+		if (!checkpoint_resume(&resumed_ctx, &resumed_e, ballots, path,
+				       NULL, &quota)
+		    || !same_count(&ctx, cands, &resumed_ctx, resumed))
+			exit(1);
+	}
+
+	/* Statuses that are not one of the candidate statuses */
+	for (i = 0; i < 3; i++) {
+		static const unsigned int bad_status[]
+			= { 0, CAND_ELECTED|CAND_EXCLUDED, 1000 };
+		struct election resumed_e;
+		struct candidate *resumed[NUM_CANDIDATES];
+		struct count_context resumed_ctx;
+
+		corrupt_status(path, bad_path, bad_status[i]);
+		chmod(bad_path, 0600);
+		make_election(&resumed_e, resumed);
+		init_count_context(&resumed_ctx);
+		if (checkpoint_resume(&resumed_ctx, &resumed_e, ballots,
+				      bad_path, NULL, &quota))
+			exit(1);
+	}
+
+	/* A checkpoint anyone else could have written */
+	{
+		struct election resumed_e;
+		struct candidate *resumed[NUM_CANDIDATES];
+		struct count_context resumed_ctx;
+
+		chmod(path, 0622);
+		make_election(&resumed_e, resumed);
+		init_count_context(&resumed_ctx);
+		if (checkpoint_resume(&resumed_ctx, &resumed_e, ballots, path,
+				      NULL, &quota))
+			exit(1);
+	}
+
+	unlink(path);
+	unlink(bad_path);
+	free(path);
+	path = sprintf_malloc("%s/table1.ps", tmpdir);
+	unlink(path);
+	free(path);
+	path = sprintf_malloc("%s/table2.ps", tmpdir);
+	unlink(path);
+	rmdir(tmpdir);
+	exit(0);
+}
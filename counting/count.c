@@ -19,6 +19,8 @@
   for a detailed description of the Hare Clarke algorithm.
  ***************************************************************/
 
+/* For qsort_r */
+#define _GNU_SOURCE
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
@@ -28,17 +30,17 @@
 #include "hare_clark.h"
 #include "count.h"
 #include "report.h"
+#include "checkpoint.h"
 #include "ballot_iterators.h"
 #include "candidate_iterators.h"
 
-/* Stuff we need for every count: starts empty */
-static struct ballot_list *exhausted_ballots[MAX_COUNTS];
-
-/* current count */
-static unsigned int count;
-
-/* count under consideration for comparison of total votes */
-static unsigned int compare_count;
+/* The candidate and ballot callbacks get the count they are part
+   of, along with their own data. */
+struct count_arg
+{
+	struct count_context *ctx;
+	void *data;
+};
 
 static unsigned int is_formal(struct ballot *ballot, void *ninf_void)
 {
@@ -51,20 +53,23 @@ static unsigned int is_formal(struct ballot *ballot, void *ninf_void)
 	return 1;
 }
 
-static struct ballot_list *discard_informals(struct ballot_list *list)
+static struct ballot_list *discard_informals(struct count_context *ctx,
+					     struct ballot_list *list,
+					     unsigned int *num_informals)
 {
-	unsigned int num_informals = 0;
 	struct ballot_list *formals;
 
-	formals = any_ballots(list, &is_formal, &num_informals);
-	report_informals(num_informals);
+	*num_informals = 0;
+	formals = any_ballots(list, &is_formal, num_informals);
+	report_informals(ctx, *num_informals);
 
 	/*	fprintf(stderr, "Freeing temp list\n");
 		free_ballot_list(list);*/
 	return formals;
 }
 
-static unsigned int calculate_quota(const struct electorate *elec,
+static unsigned int calculate_quota(struct count_context *ctx,
+				    const struct electorate *elec,
 				    const struct ballot_list *ballots)
 {
 	unsigned int quota;
@@ -73,18 +78,30 @@ static unsigned int calculate_quota(const struct electorate *elec,
 	num = number_of_ballots(ballots);
         /* hare-clarke */
 	quota = (num / (elec->num_seats + 1)) + 1;
-	report_quota(num, elec->num_seats, quota);
+	report_quota(ctx, num, elec->num_seats, quota);
 
 	return quota;
 }
 
+/* Add votes for this count for the candidate to total. */
+static bool sum_total(struct candidate *cand, void *void_arg)
+{
+	const struct count_arg *arg = void_arg;
+	unsigned int *total = arg->data;
+
+	*total += cand_count(cand, arg->ctx->count)->total;
+	return false;
+}
+
 /* Calculate what a majority of votes is */
-unsigned int calc_majority(struct cand_list *standing)
+unsigned int calc_majority(const struct count_context *ctx,
+			   struct cand_list *standing)
 {
 	unsigned int tva = 0;
+	struct count_arg arg = { (struct count_context *)ctx, &tva };
 
 	/* Calculate total votes available */
-	for_each_candidate(standing, &sum_total, &tva);
+	for_each_candidate(standing, &sum_total, &arg);
 
 	/* Majority is TVA/2 + 1 */
 	return tva / 2 + 1;
@@ -96,7 +113,8 @@ static bool maybe_exclude(struct candidate *cand, void *unused)
 
 	printf("Candidate `%s' from `%s' [y/N]: ",
 	       cand->name, cand->group->name);
-	get_next_line(&answer);
+	if (get_next_line(&answer) < 0)
+		return false;
 
 	c = answer[0]; 
 	free(answer);
@@ -111,7 +129,9 @@ static void prompt_for_deceased(struct cand_list *candidates)
 	char *answer;
 
 	printf("Are any candidates deceased? [y/N]: ");
-	get_next_line(&answer);
+	/* No answer (e.g. no answers file): none are */
+	if (get_next_line(&answer) < 0)
+		return;
 
 	/* Nothing to do if no candidates deceased. */
 	if (answer[0] != 'y' && answer[0] != 'Y') {
@@ -137,34 +157,18 @@ static bool set_vote_value(struct ballot *ballot, void *value)
 	return false;
 }
 
-/* Return 1 if this candidate is the one mentioned in the preference */
-static unsigned int match_pref(struct candidate *cand, void *void_npref)
-{
-	struct normalized_pref *npref = void_npref;
-
-	if (npref->group_index == cand->group->group_index
-	    && npref->db_candidate_index == cand->db_candidate_index)
-		return 1;
-	return 0;
-}
-
-bool sum_total(struct candidate *cand, void *void_total)
-{
-	unsigned int *total = void_total;
-
-	*total += cand->c[get_count_number()].total;
-	return false;
-}
-
 /* Routine to sum all the vote values in a pile, and return the
    truncated total */
 unsigned int truncated_vote_sum(struct ballot_list *ballots)
 {
 	struct fraction sum = fraction_zero;
-	struct ballot_list *i;
+	unsigned int i;
 
-	for (i = ballots; i; i = i->next) {
-		sum = fraction_add(sum, i->ballot->vote_value);
+	if (!ballots)
+		return 0;
+	for (i = ballots->num_ballots; i > 0; i--) {
+		sum = fraction_add(sum, ballots->store->ballots
+				   [ballots->ids[i - 1]].vote_value);
 	}
 
 	return fraction_truncate(sum);
@@ -175,126 +179,156 @@ unsigned int truncated_vote_sum(struct ballot_list *ballots)
    been brought to the top level and modified appropriately. */
 /* This function is used by distribute_ballots()
    as a callback from for_each_ballot().
-   The second parameter is the list of candidates. */
-static bool distribute(struct ballot *ballot, void *candidates_pointer)
+   The second parameter is the count and the ballot store. */
+static bool distribute(struct ballot *ballot, void *void_arg)
 {
 	unsigned int i,j=0;
-	struct cand_list *candlist;
 	struct candidate *cand;
-
-	struct cand_list *candidates = (struct cand_list *)candidates_pointer;
+	struct count_state *now;
+	const struct count_arg *arg = void_arg;
+	struct count_context *ctx = arg->ctx;
+	const struct ballot_store *store = arg->data;
 
         for (i = j; i < ballot->num_preferences; i++) {
-		/* There should be only one which matches this */
-		candlist = any_candidates(candidates, &match_pref,
-					  &ballot->prefs[i]);
+		/* The candidate list is indexed in cand_index */
+		cand = lookup_candidate(ctx->cand_index, &ballot->prefs[i]);
 		/* if preference is for a non-standing candidate, skip it
 		 (required for casual vacancy) */
-		if (!candlist) continue;
-		cand = extract_cand_destroy_list(candlist);
+		if (!cand) continue;
 
 		if (cand->status == CAND_CONTINUING) {
 			/* Prepend ballot to their pile */
-			cand->c[count].pile
-				= new_ballot_list(ballot,
-						  cand->c[count].pile);
-			ballot->count_transferred = count;
+			now = cand_count(cand, ctx->count);
+			now->pile = new_ballot_list(store, ballot, now->pile);
+			tally_ballot(&now->tally, &ballot->vote_value);
+			ballot->count_transferred = ctx->count;
 			return false;
 		}
 	}
 
 	/* Vote is exhausted: prepend to exhausted pile */
-	exhausted_ballots[count]
-		= new_ballot_list(ballot,
-				  exhausted_ballots[count]);
+	now = history_at(&ctx->exhausted, ctx->count);
+	now->pile = new_ballot_list(store, ballot, now->pile);
+	tally_ballot(&now->tally, &ballot->vote_value);
 	return false;
 }
 
-static void distribute_ballots(struct ballot_list *ballots,
-			       struct cand_list *candidates,
-			       struct candidate *vacating)
+static void distribute_ballots(struct count_context *ctx,
+			       struct ballot_list *ballots)
 {
+	struct count_arg arg = { ctx, NULL };
 
-	for_each_ballot(ballots, &distribute, (void *) candidates);
+	if (ballots) {
+		arg.data = (void *)ballots->store;
+		for_each_ballot(ballots, &distribute, &arg);
+	}
 }
 
-/* Update totals for this count for the candidate, unless it's "not_me". */
-static bool update_total(struct candidate *cand, void *not_me)
+/* Update totals for this count for the candidate, unless it's the
+   one in the argument. */
+static bool update_total(struct candidate *cand, void *void_arg)
 {
+	const struct count_arg *arg = void_arg;
+	struct count_context *ctx = arg->ctx;
 	unsigned int sum;
+	struct count_state *now;
 
 	/* Skip the candidate they specify */
-	if (cand == not_me)
+	if (cand == arg->data)
 		return false;
 
-	sum = truncated_vote_sum(cand->c[count].pile);
+	now = cand_count(cand, ctx->count);
+	sum = tally_truncated_sum(&now->tally);
 	/* If count is 1, total at count = 0 was 0, so this still
            works */
-	cand->c[count].total = cand->c[count-1].total + sum;
+	now->total = cand_count(cand, ctx->count-1)->total + sum;
 
-	report_ballots_transferred(count, cand->scrutiny_pos, cand->status,
-				   number_of_ballots(cand->c[count].pile));
-	report_votes_transferred(count, cand->scrutiny_pos, cand->status,
-				 sum, cand->c[count].total);
+	report_ballots_transferred(ctx, ctx->count, cand->scrutiny_pos,
+				   cand->status, tally_ballots(&now->tally));
+	report_votes_transferred(ctx, ctx->count, cand->scrutiny_pos,
+				 cand->status, sum, now->total);
 	return false;
 }
 
-static void distribute_first_prefs(struct ballot_list *ballots,
+static void update_totals(struct count_context *ctx,
+			  struct cand_list *candidates,
+			  struct candidate *not_me)
+{
+	struct count_arg arg = { ctx, not_me };
+
+	for_each_candidate(candidates, &update_total, &arg);
+}
+
+static void distribute_first_prefs(struct count_context *ctx,
+				   struct ballot_list *ballots,
 				   struct cand_list *candidates,
 				   struct candidate *vacating)
 {
-	report_transfer(count, fraction_one, number_of_ballots(ballots));
-	distribute_ballots(ballots, candidates,vacating);
-	if (! vacating) report_exhausted(count, 0, 0);
-	for_each_candidate(candidates, &update_total, NULL);
-	if (! vacating) report_lost_or_gained(count, 0);
+	report_transfer(ctx, ctx->count, fraction_one,
+			number_of_ballots(ballots));
+	distribute_ballots(ctx, ballots);
+	if (! vacating) report_exhausted(ctx, ctx->count, 0, 0);
+	update_totals(ctx, candidates, NULL);
+	if (! vacating) report_lost_or_gained(ctx, ctx->count, 0);
 }
 
-static unsigned int made_quota(struct candidate *candidate, void *quota)
+static unsigned int made_quota(struct candidate *candidate, void *void_arg)
 {
+	const struct count_arg *arg = void_arg;
+	unsigned int total = cand_count(candidate, arg->ctx->count)->total;
+
 	/* If they are continuing and on or over quota, return total */
 	if (candidate->status == CAND_CONTINUING
-	    && candidate->c[count].total >= (unsigned int)quota)
-		return candidate->c[count].total;
+	    && total >= (unsigned int)arg->data)
+		return total;
 	else return 0;
 }
 
 /* Return true if this is the vacating candidate */
-static bool mark_pending(struct candidate *candidate, void *vacating)
+static bool mark_pending(struct candidate *candidate, void *void_arg)
 {
+	const struct count_arg *arg = void_arg;
+	struct count_context *ctx = arg->ctx;
+
 	candidate->status = CAND_PENDING;
-	candidate->count_when_quota_reached = count;
-	candidate->order_elected = increment_order_elected();
+	candidate->count_when_quota_reached = ctx->count;
+	candidate->order_elected = increment_order_elected(ctx);
 	/* if this is a casual vacancy, don't report them twice! */
-	if (!vacating) report_pending(count, candidate->name);
+	if (!arg->data) report_pending(ctx, ctx->count, candidate->name);
 
-	return (candidate == vacating);
+	return (candidate == arg->data);
 }
 
 /* Candidates need to be marked pending in order from HIGHEST down, so
    that report ordering is correct.
    Returns true if the candidate "vacating" has passed quota.
 */
-bool mark_pending_candidates(struct cand_list *candidates,
-									  unsigned int quota,
-									  struct candidate *vacating)
+bool mark_pending_candidates(struct count_context *ctx,
+			     struct cand_list *candidates,
+			     unsigned int quota,
+			     struct candidate *vacating)
 {
 	struct cand_list *pending;
+	struct count_arg quota_arg = { ctx, (void *)quota };
+	struct count_arg vacating_arg = { ctx, vacating };
+	bool vacating_pending = false;
 
 	/* This will return the highest total CONTINUING candidate(s)
 	   over quota */
-	while ((pending = any_candidates(candidates, made_quota, (void*)quota))
-	       != NULL) {
-		/* Mark them pending */
-		if (for_each_candidate(pending, mark_pending, vacating)) {
-			/* Vacating candidate went over quota */
-			free_cand_list(pending);
-			return true;
-		}
+	while (!vacating_pending
+	       && (pending = any_candidates(candidates, made_quota,
+					    &quota_arg)) != NULL) {
+		/* Mark them pending: stop if the vacating candidate
+		   went over quota */
+		vacating_pending = for_each_candidate(pending, mark_pending,
+						      &vacating_arg) != 0;
 		free_cand_list(pending);
 		/* Now loop and look for more */
 	}
-	return false;
+
+	/* Every count ends here, with its quotas reached */
+	checkpoint_count(ctx, candidates, quota);
+	return vacating_pending;
 }
 
 static bool check_status(struct candidate *candidate, void *mask)
@@ -302,27 +336,37 @@ static bool check_status(struct candidate *candidate, void *mask)
 	return candidate->status & (unsigned)mask;
 }
 
-static unsigned int on_quota(struct candidate *candidate, void *quota)
+static unsigned int on_quota(struct candidate *candidate, void *void_arg)
 {
+	const struct count_arg *arg = void_arg;
+
 	if (candidate->status == CAND_PENDING
-	    && candidate->c[count].total == (unsigned int)quota) return 1;
+	    && cand_count(candidate, arg->ctx->count)->total
+	       == (unsigned int)arg->data) return 1;
 	else return 0;
 }
 
-/* Mark the candidate elected at the given count */
-static bool mark_elected(struct candidate *candidate, void *count_elected)
+/* Mark the candidate elected at the count in the argument */
+static bool mark_elected(struct candidate *candidate, void *void_arg)
 {
+	const struct count_arg *arg = void_arg;
+
 	candidate->status = CAND_ELECTED;
-	report_elected((unsigned int)count_elected, candidate->scrutiny_pos);
+	report_elected(arg->ctx, (unsigned int)arg->data,
+		       candidate->scrutiny_pos);
 	return false;
 }
 
 /* Mark the continuing candidates successful immediately in order of total votes*/
-static bool elect_immediately(struct cand_list *candidates, unsigned int count_elected)
+static bool elect_immediately(struct count_context *ctx,
+			      struct cand_list *candidates,
+			      unsigned int count_elected)
 {
 	unsigned int m,n=0;
 	struct cand_list *i;
 	struct candidate *elected[PREFNUM_MAX] = { NULL };
+	struct count_arg elected_arg = { ctx, (void *)count_elected };
+	struct count_arg pending_arg = { ctx, NULL };
 
 	/* build an array of successful candidates for sorting */
         for (i=candidates; i; i=i->next) {
@@ -331,13 +375,12 @@ static bool elect_immediately(struct cand_list *candidates, unsigned int count_e
 	}
 
 	/* Sort the successful candidates in descending order of total votes */
-	compare_count = get_count_number();
-	qsort(elected, n, sizeof(elected[0]), &compare_candidate_totals);
+	qsort_r(elected, n, sizeof(elected[0]), &compare_candidate_totals, ctx);
 
 	for (m=0; m < n ; m++) {
 		/* Go throught the motions so reporting is correct */
-		mark_pending(elected[m], NULL);
-		mark_elected(elected[m], &count_elected);
+		mark_pending(elected[m], &pending_arg);
+		mark_elected(elected[m], &elected_arg);
 		/* If this candidate has a surplus, it will not be distributed
 		   due to end of the election. ie. all vacancies filled */
 		elected[m]->all_vacancies_filled_at_count=true;
@@ -346,9 +389,12 @@ static bool elect_immediately(struct cand_list *candidates, unsigned int count_e
 }
 
 static unsigned int over_quota_earliest(struct candidate *candidate,
-					void *quota)
+					void *void_arg)
 {
- 	if (candidate->c[count].total > (unsigned int)quota) {
+	const struct count_arg *arg = void_arg;
+
+ 	if (cand_count(candidate, arg->ctx->count)->total
+	    > (unsigned int)arg->data) {
 		assert(candidate->status == CAND_PENDING);
 		/* Now, highest number wins, so invert value. */
 		return INT_MAX - candidate->count_when_quota_reached;
@@ -369,24 +415,28 @@ static bool print_candidate(struct candidate *candidate, void *unused)
 	return false;
 }
 
-static struct candidate *prompt_for_tie(const char *reason,
+static struct candidate *prompt_for_tie(const struct count_context *ctx,
+					const char *reason,
 					struct cand_list *candidates)
 {
 	struct cand_list *chosen_list;
 	char *candname;
 
 	printf("\nCandidate tiebreak required for %s at count %u:\n",
-		reason, count);
+		reason, ctx->count);
 
 	for_each_candidate(candidates, &print_candidate, NULL);
 
 	do {
 		printf("\nEnter name of candidate to select: ");
-		get_next_line(&candname);
+		/* No more answers (e.g. counting from an answers file) */
+		if (get_next_line(&candname) < 0)
+			bailout("No answer for tiebreak for %s at count %u\n",
+				reason, ctx->count);
 		chosen_list = any_candidates(candidates, &match_name,candname);
+		free(candname);
 	} while (!chosen_list);
 
-	free(candname);
 	return extract_cand_destroy_list(chosen_list);
 }
 
@@ -394,11 +444,12 @@ static unsigned int total_at_count(struct candidate *candidate,
 				   void *at_count)
 {
 	assert(candidate->status == CAND_PENDING);
-	return candidate->c[(unsigned int)at_count].total;
+	return cand_count(candidate, (unsigned int)at_count)->total;
 }
 
 /* Of these candidates, figure out whose surplus to distribute first */
-static struct candidate *surplus_tiebreak(struct cand_list *candidates)
+static struct candidate *surplus_tiebreak(struct count_context *ctx,
+					  struct cand_list *candidates)
 {
 	unsigned int c;
 	struct cand_list *winners;
@@ -408,7 +459,7 @@ static struct candidate *surplus_tiebreak(struct cand_list *candidates)
 	assert(candidates->next);
 
 	/* STEP 13 */
-	for (c = count-1; c >= 1; c--) {
+	for (c = ctx->count-1; c >= 1; c--) {
 		winners = any_candidates(candidates, &total_at_count,
 					 (void *)c);
 
@@ -437,16 +488,17 @@ static struct candidate *surplus_tiebreak(struct cand_list *candidates)
 	}
 
 	/* STEP 14 */
-	ret = prompt_for_tie("surplus distribution", candidates);
+	ret = prompt_for_tie(ctx, "surplus distribution", candidates);
 	free_cand_list(candidates);
-	report_tiebreak(count, "surplus distribution", ret->name);
+	report_tiebreak(ctx, ctx->count, "surplus distribution", ret->name);
 
 	/* STEP 15 */
 	return ret;
 }
 
 /* Return the single "best" candidate for distribution */
-static struct candidate *find_best(struct cand_list *candidates)
+static struct candidate *find_best(struct count_context *ctx,
+				   struct cand_list *candidates)
 {
 	struct cand_list *winners;
 	unsigned int count_when_quota_reached;
@@ -461,7 +513,7 @@ static struct candidate *find_best(struct cand_list *candidates)
 	if (winners->next) {
 		/* More than one: take to surplus_tiebreak. */
 		/* surplus_tiebreak frees winners */
-		return surplus_tiebreak(winners);
+		return surplus_tiebreak(ctx, winners);
 	}
 	return extract_cand_destroy_list(winners);
 }
@@ -475,12 +527,13 @@ static unsigned int lowest_at_count(struct candidate *candidate,
 		return 0;
 
 	/* We want to return a positive number, but highest for lowest total */
-	return INT_MAX - candidate->c[(unsigned int)at_count].total;
+	return INT_MAX - cand_count(candidate, (unsigned int)at_count)->total;
 }
 
 /* Return the single "worst" candidate for elimination.  Frees
    candidate list. */
-static struct candidate *exclude_tiebreak(struct cand_list *candidates)
+static struct candidate *exclude_tiebreak(struct count_context *ctx,
+					  struct cand_list *candidates)
 {
 	unsigned int c;
 	struct cand_list *losers;
@@ -490,7 +543,7 @@ static struct candidate *exclude_tiebreak(struct cand_list *candidates)
 	assert(candidates->next);
 
 	/* STEP 16 */
-	for (c = count-1; c >= 1; c--) {
+	for (c = ctx->count-1; c >= 1; c--) {
 		losers = any_candidates(candidates, &lowest_at_count,
 					(void *)c);
 		/* SIPL 2014-06-02 (No change was applied here; this
@@ -513,25 +566,24 @@ static struct candidate *exclude_tiebreak(struct cand_list *candidates)
 	}
 
 	/* STEP 17 */
-	ret = prompt_for_tie("exclusion", candidates);
+	ret = prompt_for_tie(ctx, "exclusion", candidates);
 	free_cand_list(candidates);
-	report_tiebreak(count, "exclusion", ret->name);
+	report_tiebreak(ctx, ctx->count, "exclusion", ret->name);
 
 	/* STEP 18 */
 	return ret;
 }
 
-static bool is_exhausted(struct ballot *ballot, void *candidates)
+static bool is_exhausted(struct ballot *ballot, void *void_ctx)
 {
+	const struct count_context *ctx = void_ctx;
 	unsigned int i;
 	struct candidate *cand;
 
 	for (i = 0; i < ballot->num_preferences; i++) {
-		/* There should be only one which matches this */
-		cand = extract_cand_destroy_list
-			(any_candidates(candidates,
-					&match_pref,
-					&ballot->prefs[i]));
+		/* The candidate list is indexed in cand_index */
+		cand = lookup_candidate(ctx->cand_index, &ballot->prefs[i]);
+		assert(cand);
 
 		/* Continuing candidate?  Not exhausted */
 		if (cand->status == CAND_CONTINUING)
@@ -565,78 +617,102 @@ static void update_vote_values(struct ballot_list *ballots,
 	for_each_ballot(ballots, update_vote_value, &new_vote_value);
 }
 
-void reset_count(void)
+void init_count_context(struct count_context *ctx)
 {
-	unsigned int i;
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+void free_count_context(struct count_context *ctx)
+{
+	free_history(&ctx->exhausted);
+}
 
-	count = 1;
-	reset_order_elected();
+void reset_count(struct count_context *ctx)
+{
+	ctx->count = 1;
+	reset_order_elected(ctx);
 
 	/* Also ensure that exhausted ballot piles are all empty */
-	for (i = 0; i < MAX_COUNTS; i++) {
-		free_ballot_list(exhausted_ballots[i]);
-		exhausted_ballots[i] = NULL;
-	}
+	free_history(&ctx->exhausted);
 }
 
-unsigned int get_count_number(void)
+void set_candidate_index(struct count_context *ctx,
+			 const struct cand_index *index)
 {
-	return count;
+	ctx->cand_index = index;
 }
 
-void increment_count(void)
+unsigned int get_count_number(const struct count_context *ctx)
 {
-	count++;
-	fprintf(stderr,"\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b"
-		"Starting Count %u",count);
+	return ctx->count;
 }
 
-/* Figure out how many votes this round (should always be same) */
-static bool sum_totals(struct candidate *candidate, void *void_sum)
+void increment_count(struct count_context *ctx)
 {
-	unsigned int *votes_sum = void_sum;
-
-	*votes_sum += candidate->c[count].total;
-	return false;
+	ctx->count++;
+	fprintf(stderr,"\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b"
+		"Starting Count %u",ctx->count);
 }
 
 /* Figure out how many ballots dealt with this round */
-static bool sum_ballots(struct candidate *candidate, void *void_sum)
+static bool sum_ballots(struct candidate *candidate, void *void_arg)
 {
-	unsigned int *ballots_sum = void_sum;
+	const struct count_arg *arg = void_arg;
+	unsigned int *ballots_sum = arg->data;
 
-	*ballots_sum += number_of_ballots(candidate->c[count].pile);
+	*ballots_sum += tally_ballots(&cand_count(candidate, arg->ctx->count)
+				      ->tally);
 	return false;
 }
 
 /* Calculate and report the total votes and total ballots at this count */
-static void calculate_totals(struct cand_list *candidates)
+static void calculate_totals(struct count_context *ctx,
+			     struct cand_list *candidates)
 {
 	unsigned int total_sum = 0, ballot_sum;
+	struct count_arg arg = { ctx, &total_sum };
 
-	for_each_candidate(candidates, &sum_totals, &total_sum);
-	ballot_sum = number_of_ballots(exhausted_ballots[count]);
-	for_each_candidate(candidates, &sum_ballots, &ballot_sum);
+	/* How many votes this round (should always be same) */
+	for_each_candidate(candidates, &sum_total, &arg);
+	ballot_sum = tally_ballots(&history_at(&ctx->exhausted, ctx->count)
+				   ->tally);
+	arg.data = &ballot_sum;
+	for_each_candidate(candidates, &sum_ballots, &arg);
 
 	/* Reporting keeps track of totals lost/gained by fraction,
            and the total exhausted votes, so it adds them in for us */
-	report_totals(count, total_sum, ballot_sum);
+	report_totals(ctx, ctx->count, total_sum, ballot_sum);
 }
 
 
 /* Figure out how many votes gained this round: (-ve if we're on the
    one who was just elected) */
-static bool sum_gains(struct candidate *candidate, void *void_sum)
+static bool sum_gains(struct candidate *candidate, void *void_arg)
 {
-	int *votes_sum = void_sum;
+	const struct count_arg *arg = void_arg;
+	unsigned int count = arg->ctx->count;
+	int *votes_sum = arg->data;
+	unsigned int total;
 
 	assert(count > 0);
-	*votes_sum += candidate->c[count].total - candidate->c[count-1].total;
+	total = cand_count(candidate, count)->total;
+	*votes_sum += total - cand_count(candidate, count-1)->total;
 	return false;
 }
 
+static int total_gains(struct count_context *ctx,
+		       struct cand_list *candidates)
+{
+	int gain = 0;
+	struct count_arg arg = { ctx, &gain };
+
+	for_each_candidate(candidates, &sum_gains, &arg);
+	return gain;
+}
+
 /* Returns true as soon as the vacating candidate is over quota */
-static void distribute_surplus(struct cand_list *candidates,
+static void distribute_surplus(struct count_context *ctx,
+			       struct cand_list *candidates,
 			       struct candidate *cand,
 			       unsigned int quota,
 			       struct candidate *vacating)
@@ -646,22 +722,24 @@ static void distribute_surplus(struct cand_list *candidates,
 	int gain;
 	struct fraction new_vote_value;
 	struct ballot_list *pile;
+	/* We haven't incremented count yet, so this applies to NEXT count */
+	struct count_arg elected_arg = { ctx, (void *)(ctx->count+1) };
+	struct count_history *exhausted = &ctx->exhausted;
 
 	/* STEP 19 */
-	/* We haven't incremented count yet, so this applies to NEXT count */
-	mark_elected(cand, (void *)(count+1));
+	mark_elected(cand, &elected_arg);
 
 	/* STEP 20 */
-	vote_value_of_surplus = cand->c[count].total - quota;
+	vote_value_of_surplus = cand_count(cand, ctx->count)->total - quota;
 
 	/* STEP 21 */
-	increment_count();
+	increment_count(ctx);
 
 	/* STEP 22 */
-	pile = cand->c[cand->count_when_quota_reached].pile;
+	pile = cand_count(cand, cand->count_when_quota_reached)->pile;
 	non_exhausted_ballots
-		= (number_of_ballots(pile)
-		   - for_each_ballot(pile, &is_exhausted, candidates));
+		= (tally_ballots(&cand_count(cand, cand->count_when_quota_reached)->tally)
+		   - for_each_ballot(pile, &is_exhausted, ctx));
 
 	/* STEP 23 */
 	if (non_exhausted_ballots == 0)
@@ -672,44 +750,49 @@ static void distribute_surplus(struct cand_list *candidates,
 
 	/* STEP 24 */
 	update_vote_values(pile, new_vote_value);
+	tally_pile(&cand_count(cand, cand->count_when_quota_reached)->tally, pile);
 
 	/* STEP 24b */
 	/* Report actual value (may be capped) */
-	report_transfer(count,
-			pile->ballot->vote_value,
+	report_transfer(ctx, ctx->count,
+			first_ballot(pile)->vote_value,
 			vote_value_of_surplus);
-	distribute_ballots(pile, candidates,vacating);
+	distribute_ballots(ctx, pile);
 	cand->surplus_distributed = true;
-	report_distribution(count, cand->name);
-	report_distrib_from_count(count, cand->count_when_quota_reached);
-	counting_raw_newline();
+	report_distribution(ctx, ctx->count, cand->name);
+	report_distrib_from_count(ctx, ctx->count,
+				  cand->count_when_quota_reached);
+	counting_raw_newline(ctx);
 
 
 	/* STEP 25 */
-	for_each_candidate(candidates, &update_total, cand);
+	update_totals(ctx, candidates, cand);
 
 	/* STEP 25a */
-	if (mark_pending_candidates(candidates, quota, vacating))
+	if (mark_pending_candidates(ctx, candidates, quota, vacating))
 		/* Vacating over quota: return immediately */
 		return;
 
 	/* STEP 26 */
-	cand->c[count].total = quota;
-	report_votes_transferred(count, cand->scrutiny_pos, cand->status,
-				 quota - cand->c[count-1].total,
-				 cand->c[count].total);
+	cand_count(cand, ctx->count)->total = quota;
+	report_votes_transferred(ctx, ctx->count, cand->scrutiny_pos,
+				 cand->status,
+				 quota - cand_count(cand, ctx->count-1)->total,
+				 cand_count(cand, ctx->count)->total);
 
 	/* STEP 27 */
-	gain = 0;
-	for_each_candidate(candidates, &sum_gains, &gain);
-	report_lost_or_gained(count, gain);
+	gain = total_gains(ctx, candidates);
+	report_lost_or_gained(ctx, ctx->count, gain);
 
 	/* STEP 28 */
-	for_each_ballot(exhausted_ballots[count], set_vote_value,
-			(void *)&fraction_zero);
-	report_exhausted(count,
-			 number_of_ballots(exhausted_ballots[count]), 0);
-	calculate_totals(candidates);
+	for_each_ballot(history_at(exhausted, ctx->count)->pile,
+			set_vote_value, (void *)&fraction_zero);
+	tally_pile(&history_at(exhausted, ctx->count)->tally,
+		   history_at(exhausted, ctx->count)->pile);
+	report_exhausted(ctx, ctx->count,
+			 tally_ballots(&history_at(exhausted, ctx->count)
+				       ->tally), 0);
+	calculate_totals(ctx, candidates);
 }
 
 /* Compare vote values between two piles */
@@ -719,41 +802,47 @@ int compare_vote_values(const void *ppile1, const void *ppile2)
 	const struct ballot_list *const *pp2 = ppile2;
 
 	/* None of these piles should be empty */
-	assert((*pp1)->ballot);
-	assert((*pp2)->ballot);
+	assert((*pp1)->num_ballots);
+	assert((*pp2)->num_ballots);
 
 	/* qsort sorts in ascending order: we want descending order */
-	return -fraction_compare((*pp1)->ballot->vote_value,
-				 (*pp2)->ballot->vote_value);
+	return -fraction_compare(first_ballot(*pp1)->vote_value,
+				 first_ballot(*pp2)->vote_value);
 }
 
 /* Compare Total number of votes between two Candidates at Count */
-/* Recurse (clumsily) if equal   */
-int compare_candidate_totals(const void *candidate1, const void *candidate2)
+/* Go back a count at a time if equal */
+int compare_candidate_totals(const void *candidate1, const void *candidate2,
+			     void *void_ctx)
 {
+	const struct count_context *ctx = void_ctx;
 	const struct candidate *const *cand1 = candidate1;
 	const struct candidate *const *cand2 = candidate2;
-	unsigned int t1 = (*cand1)->c[compare_count].total;
-	unsigned int t2 = (*cand2)->c[compare_count].total;
+	unsigned int compare_count = ctx->count;
+	unsigned int t1, t2;
 
+	for (;;) {
+		t1 = cand_total(*cand1, compare_count);
+		t2 = cand_total(*cand2, compare_count);
 
-	/* qsort sorts in ascending order: we want descending order */
-	if (t1 > t2) return -1;
-	if (t1 < t2) return 1;
+		/* qsort sorts in ascending order: we want descending order */
+		if (t1 > t2) return -1;
+		if (t1 < t2) return 1;
 
-	/* candidates equal at this count */
-	if (compare_count ==0)
-	/* candidates equal throughout scrutiny */
-		return 0;
+		/* candidates equal at this count */
+		if (compare_count == 0)
+			/* candidates equal throughout scrutiny */
+			return 0;
 
-	/* compare previous count */
-	compare_count--;
-	return compare_candidate_totals(candidate1,candidate2);
+		/* compare previous count */
+		compare_count--;
+	}
 }
 
 /* Returns true if enough candidates over quota (ie. election finished),
    or vacating is successful. */
-bool partial_exclusion(struct cand_list *candidates,
+bool partial_exclusion(struct count_context *ctx,
+		       struct cand_list *candidates,
 		       struct candidate *cand,
 		       struct ballot_list *pile,
 		       unsigned int num_seats,
@@ -763,40 +852,43 @@ bool partial_exclusion(struct cand_list *candidates,
 		       bool is_last)
 {
 	int gain;
+	struct count_state *now;
+	unsigned int count = ctx->count;
+	struct count_history *exhausted = &ctx->exhausted;
 
 	/* STEP 36b */
-	cand->c[count].total = cand->c[count-1].total -  pile_sum;
-	report_votes_transferred(count, cand->scrutiny_pos, cand->status,
-				 -pile_sum,  cand->c[count].total);
+	now = cand_count(cand, count);
+	now->total = cand_count(cand, count-1)->total -  pile_sum;
+	report_votes_transferred(ctx, count, cand->scrutiny_pos, cand->status,
+				 -pile_sum,  now->total);
 
 	/* STEP 37 */
-	report_transfer(count, pile->ballot->vote_value, pile_sum);
-	distribute_ballots(pile, candidates,vacating);
-	report_exhausted(count,
-			 number_of_ballots(exhausted_ballots[count]),
-			 truncated_vote_sum(exhausted_ballots[count]));
-	report_distribution(count, cand->name);
+	report_transfer(ctx, count, first_ballot(pile)->vote_value, pile_sum);
+	distribute_ballots(ctx, pile);
+	report_exhausted(ctx, count,
+			 tally_ballots(&history_at(exhausted, count)->tally),
+			 tally_truncated_sum(&history_at(exhausted, count)->tally));
+	report_distribution(ctx, count, cand->name);
 
 	/* STEP 38 */
-	for_each_candidate(candidates, &update_total, cand);
+	update_totals(ctx, candidates, cand);
 
 	/* STEP 39 */
-	gain = 0;
-	for_each_candidate(candidates, &sum_gains, &gain);
+	gain = total_gains(ctx, candidates);
 
 	/* STEP 40, STEP 41 */
-	gain += truncated_vote_sum(exhausted_ballots[count]);
-	report_lost_or_gained(count, gain);
+	gain += tally_truncated_sum(&history_at(exhausted, count)->tally);
+	report_lost_or_gained(ctx, count, gain);
 
 	if (is_last)
-		report_fully_excluded(count, cand->name);
+		report_fully_excluded(ctx, count, cand->name);
 	else
-		report_partially_excluded(count, cand->name);
+		report_partially_excluded(ctx, count, cand->name);
 
-	calculate_totals(candidates);
+	calculate_totals(ctx, candidates);
 
 	/* STEP 42 */
-	if (mark_pending_candidates(candidates, quota, vacating))
+	if (mark_pending_candidates(ctx, candidates, quota, vacating))
 		return true;
 
 	if (for_each_candidate(candidates, &check_status,
@@ -810,42 +902,54 @@ bool partial_exclusion(struct cand_list *candidates,
 
 /* For every count, if vote value is the same, report that as one of
    the sources of the votes being distrbuted */
-static void calculate_ballot_source(struct fraction vote_value,
+static void calculate_ballot_source(struct count_context *ctx,
+				    struct fraction vote_value,
 				    struct candidate *cand)
 {
 	unsigned int i;
+	unsigned int count = ctx->count;
+	struct ballot_list *pile;
 
 	// For TIR 32, count has not been incremented yet, so we iterate to
 	// count + 1
 	for (i = 1; i < count+1; i++) {
-		if (cand->c[i].pile
-		    && (cand->c[i].pile->ballot->vote_value.numerator
+		pile = cand_count(cand, i)->pile;
+		if (pile
+		    && (first_ballot(pile)->vote_value.numerator
 			== vote_value.numerator)
-		    && (cand->c[i].pile->ballot->vote_value.denominator
+		    && (first_ballot(pile)->vote_value.denominator
 			== vote_value.denominator)) {
 			/* Assign to *next* count: this is what we are
                            about to do */
-			report_distrib_from_count(count+1, i);
+			report_distrib_from_count(ctx, count+1, i);
 		}
 	}
-	counting_raw_newline();
+	counting_raw_newline(ctx);
 }
 
 /* Join pile A and pile B */
 struct ballot_list *join_piles(struct ballot_list *a,
 			       struct ballot_list *b)
 {
-	struct ballot_list *i;
-
 	if (!a)
 		return b;
+	if (!b)
+		return a;
+
+	/* Lists are held back to front, so B's ids go first: copy A's
+	   ids onto the end of B's. */
+	if (b->num_ballots + a->num_ballots > b->max_ballots) {
+		b->max_ballots = b->num_ballots + a->num_ballots;
+		b->ids = realloc(b->ids, sizeof(b->ids[0]) * b->max_ballots);
+		if (!b->ids)
+			bailout("Out of memory joining piles\n");
+	}
+	memcpy(b->ids + b->num_ballots, a->ids,
+	       sizeof(a->ids[0]) * a->num_ballots);
+	b->num_ballots += a->num_ballots;
 
-	/* Find last element */
-	for (i = a; i->next; i = i->next);
-
-	/* Join B to the end */
-	i->next = b;
-	return a;
+	free_ballot_list(a);
+	return b;
 }
 
 /* SIPL 2011: The following was a nested function.
@@ -853,21 +957,29 @@ struct ballot_list *join_piles(struct ballot_list *a,
    been brought to the top level and modified appropriately. */
 /* This function is used by exclude_one_candidate()
    as a callback from for_each_ballot().
-   The second parameter is the list of piles. */
-static bool place_in_pile(struct ballot *ballot, void *piles_pointer)
+   The second parameter is the piles and their ballot store. */
+struct pile_set
+{
+	const struct ballot_store *store;
+	unsigned int max_piles;
+	struct ballot_list **piles;
+};
+
+static bool place_in_pile(struct ballot *ballot, void *pile_set_pointer)
 {
   unsigned int i;
   bool new_pile = true;
 
-  struct ballot_list **piles = (struct ballot_list **)piles_pointer;
+  struct pile_set *set = pile_set_pointer;
+  struct ballot_list **piles = set->piles;
   
   assert(ballot->count_transferred > 0);
   /* Find first empty pile, or that came in on same count. */
   
   for (i = 0; piles[i]; i++) {
-    assert(i < (MAX_COUNTS));
+    assert(i < set->max_piles);
     
-    if (piles[i]->ballot->count_transferred
+    if (first_ballot(piles[i])->count_transferred
 	== ballot->count_transferred) {
       new_pile = false;
       break;
@@ -875,14 +987,24 @@ static bool place_in_pile(struct ballot *ballot, void *piles_pointer)
   }
 
   /* Prepend to this pile */
-  piles[i] = new_ballot_list(ballot, piles[i]);
+  piles[i] = new_ballot_list(set->store, ballot, piles[i]);
   return new_pile;
 }
 
+/* Sum one of the piles built by place_in_pile().  They hold exactly
+   the ballots the candidate received at one count, so the tally for
+   that count already has the answer. */
+static unsigned int pile_truncated_sum(struct candidate *cand,
+				       const struct ballot_list *pile)
+{
+	return tally_truncated_sum(&cand_count(cand, first_ballot(pile)
+					       ->count_transferred)->tally);
+}
 
 /* Returns true if vacating is over quota, or finished because enough
    people are over quota to fill num_seats */
-static bool exclude_one_candidate(struct cand_list *candidates,
+static bool exclude_one_candidate(struct count_context *ctx,
+				  struct cand_list *candidates,
 				  struct candidate *cand,
 				  unsigned int num_seats,
 				  unsigned int quota,
@@ -891,11 +1013,18 @@ static bool exclude_one_candidate(struct cand_list *candidates,
 	unsigned int i;
 	unsigned int used_piles;
 	unsigned int pile_sum;
-	/* Maximum number of vote piles == PREFNUM_MAX * MAX_COUNT
-	 assuming PREFNUM_MAX candidates and a different vote_value
-	at each count and all candidates continue until the last count.
-	In practice there will be duplicate vote_values.*/
-	struct ballot_list *piles[MAX_COUNTS] = { NULL };
+	/* Ballots are piled by the count they arrived on, so there
+	   can be no more piles than counts (plus a NULL terminator). */
+	struct ballot_list **piles;
+	struct pile_set set;
+	bool finished = false;
+
+	piles = calloc(ctx->count + 3, sizeof(piles[0]));
+	if (!piles)
+		bailout("Out of memory excluding candidate\n");
+	set.store = NULL;
+	set.max_piles = ctx->count + 2;
+	set.piles = piles;
 
 	/* STEP 30b */
 	cand->status = CAND_BEING_EXCLUDED;
@@ -904,28 +1033,35 @@ static bool exclude_one_candidate(struct cand_list *candidates,
 	used_piles = 0;
 	// For TIR 32, count has not been incremented yet, so we iterate to
 	// count + 1
-	for (i = 1; i <= count+1; i++)
-		used_piles += for_each_ballot(cand->c[i].pile, place_in_pile,
-					      piles);
+	for (i = 1; i <= ctx->count+1; i++) {
+		struct ballot_list *pile = cand_count(cand, i)->pile;
+
+		if (!pile)
+			continue;
+		set.store = pile->store;
+		used_piles += for_each_ballot(pile, place_in_pile, &set);
+	}
 
 	/* STEP 32 */
 	qsort(piles, used_piles, sizeof(piles[0]), &compare_vote_values);
 	for (i = 0; i < used_piles; i++) {
 		/* Figure out where these ballots came from. */
-		calculate_ballot_source(piles[i]->ballot->vote_value, cand);
+		calculate_ballot_source(ctx, first_ballot(piles[i])->vote_value,
+					cand);
 		/* STEP 35 */
-		increment_count();
-		if (i == 0) report_excluded(count, cand->scrutiny_pos);
+		increment_count(ctx);
+		if (i == 0) report_excluded(ctx, ctx->count,
+					    cand->scrutiny_pos);
 
 		/* All the piles with same vote value will now be
 		   consecutive.  Add totals separately, and collapse
 		   into one big pile for distribution. */
 		/* STEP 36 */
-		pile_sum = truncated_vote_sum(piles[i]);
+		pile_sum = pile_truncated_sum(cand, piles[i]);
 		while (i + 1 < used_piles
-		       && fraction_equal(piles[i]->ballot->vote_value,
-					 piles[i+1]->ballot->vote_value)) {
-			pile_sum += truncated_vote_sum(piles[i+1]);
+		       && fraction_equal(first_ballot(piles[i])->vote_value,
+					 first_ballot(piles[i+1])->vote_value)) {
+			pile_sum += pile_truncated_sum(cand, piles[i+1]);
 			piles[i+1] = join_piles(piles[i], piles[i+1]);
 			piles[i] = NULL;
 			i++;
@@ -933,15 +1069,21 @@ static bool exclude_one_candidate(struct cand_list *candidates,
 
 		/* If we're finished, returning here will cause STEP 8
                    to finish the election. */
-		if (partial_exclusion(candidates, cand, piles[i],
+		if (partial_exclusion(ctx, candidates, cand, piles[i],
 				      num_seats, quota, pile_sum, vacating,
-				      i == used_piles-1))
-			return true;
+				      i == used_piles-1)) {
+			finished = true;
+			break;
+		}
 	}
+	free(piles);
+	if (finished)
+		return true;
+
 	/* Catch corner case: no votes to distribute */
 	if (used_piles == 0) {
-		report_excluded(count+1, cand->scrutiny_pos);
-		report_fully_excluded(count, cand->name);
+		report_excluded(ctx, ctx->count+1, cand->scrutiny_pos);
+		report_fully_excluded(ctx, ctx->count, cand->name);
 	}
 
 	/* STEP 33 */
@@ -951,7 +1093,8 @@ static bool exclude_one_candidate(struct cand_list *candidates,
 }
 
 /* Exclude the lowest candidate, maybe do tiebreak */
-void exclude_candidate(struct cand_list *candidates,
+void exclude_candidate(struct count_context *ctx,
+		       struct cand_list *candidates,
 		       unsigned int num_seats,
 		       unsigned int quota,
 		       struct candidate *vacating)
@@ -960,51 +1103,86 @@ void exclude_candidate(struct cand_list *candidates,
 	struct candidate *worst;
 
 	/* Must return one candidate */
-	list = any_candidates(candidates, &lowest_at_count, (void *)count);
+	list = any_candidates(candidates, &lowest_at_count,
+			      (void *)ctx->count);
 	if (list->next != NULL)
 		/* More than one: exclude_tiebreak frees list. */
-		worst = exclude_tiebreak(list);
+		worst = exclude_tiebreak(ctx, list);
 	else
 		worst = extract_cand_destroy_list(list);
 
-	exclude_one_candidate(candidates, worst, num_seats, quota, vacating);
+	exclude_one_candidate(ctx, candidates, worst, num_seats, quota,
+			      vacating);
+}
+
+/* STEPS 4 to 6: the first count */
+static void first_count(struct count_context *ctx,
+			struct election *e,
+			struct ballot_list *ballots,
+			struct candidate *vacating)
+{
+	/* STEP 4 */
+	for_each_ballot(ballots, &set_vote_value, (void *)&fraction_one);
+
+	/* STEP 5 */
+	reset_count(ctx);
+
+	/* STEP 6 */
+	distribute_first_prefs(ctx, ballots, e->candidates, vacating);
+	calculate_totals(ctx, e->candidates);
+}
+
+unsigned int count_first_preferences(struct count_context *ctx,
+				     struct election *e,
+				     struct ballot_list *ballots)
+{
+	unsigned int num_informals;
+
+	/* STEP 1 */
+	ballots = discard_informals(ctx, ballots, &num_informals);
+
+	/* STEP 3 */
+	set_candidate_index(ctx, e->cand_index);
+	for_each_candidate(e->candidates, &mark_continuing, NULL);
+
+	first_count(ctx, e, ballots, NULL);
+	free_ballot_list(ballots);
+	return num_informals;
 }
 
 /* Return final count, or when vacating reaches quota */
-void do_count(struct election *e,
+void do_count(struct count_context *ctx,
+	      struct election *e,
 	      struct ballot_list *ballots,
 	      struct candidate *vacating)
 {
 	unsigned int quota;
+	unsigned int num_informals;
+	struct count_arg quota_arg;
 
 	/* STEP 1 */
 	fprintf(stderr, "Discarding Informals:\t");
-	ballots = discard_informals(ballots);
+	ballots = discard_informals(ctx, ballots, &num_informals);
 
 	/* STEP 2 */
 
 	fprintf(stderr, "Calculating Quota\n");
-	quota = calculate_quota(e->electorate, ballots);
+	quota = calculate_quota(ctx, e->electorate, ballots);
 	fprintf(stderr, "Quota is %u\n", quota);
+	quota_arg.ctx = ctx;
+	quota_arg.data = (void *)quota;
 
 	/* STEP 3 */
+	set_candidate_index(ctx, e->cand_index);
 	for_each_candidate(e->candidates, &mark_continuing, NULL);
 	prompt_for_deceased(e->candidates);
 
-	/* STEP 4 */
-	fprintf(stderr, "Setting initial vote_values\n");
-	for_each_ballot(ballots, &set_vote_value, (void *)&fraction_one);
-
-	/* STEP 5 */
-	reset_count();
-
-	/* STEP 6 */
+	/* STEPS 4 to 6 */
 	fprintf(stderr,"Distributing First Preferences\n");
-	distribute_first_prefs(ballots, e->candidates, vacating);
-	calculate_totals(e->candidates);
+	first_count(ctx, e, ballots, vacating);
 
 	/* STEP 7 */
-	if (mark_pending_candidates(e->candidates, quota, vacating))
+	if (mark_pending_candidates(ctx, e->candidates, quota, vacating))
 		/* Vacating candidate over quota */
 		return;
 
@@ -1025,31 +1203,35 @@ void do_count(struct election *e,
 			    == e->electorate->num_seats) {
 
 
-				elect_immediately(e->candidates,get_count_number());
+				elect_immediately(ctx, e->candidates,
+						  ctx->count);
 				/* Finish election */
 				break;
 			}
 		}
 
 		/* STEP 10 */
-		list = any_candidates(e->candidates, &on_quota, (void *)quota);
+		list = any_candidates(e->candidates, &on_quota, &quota_arg);
 		if (list != NULL) {
 			/* Mark them elected on the NEXT count. */
-			for_each_candidate(list, &mark_elected,
-					   (void *)(count+1));
+			struct count_arg elected_arg
+				= { ctx, (void *)(ctx->count+1) };
+
+			for_each_candidate(list, &mark_elected, &elected_arg);
 			free_cand_list(list);
 			continue;
 		}
 
 		/* STEP 11 */
 		list = any_candidates(e->candidates, &over_quota_earliest,
-				      (void*)quota);
+				      &quota_arg);
 		if (list != NULL) {
 			struct candidate *best;
 
-			best = find_best(list);
+			best = find_best(ctx, list);
 			/* Hand best to distribute surplus. */
-			distribute_surplus(e->candidates, best,quota,vacating);
+			distribute_surplus(ctx, e->candidates, best, quota,
+					   vacating);
 			if (vacating && vacating->status == CAND_PENDING)
 				return;
 			free_cand_list(list);
@@ -1058,7 +1240,7 @@ void do_count(struct election *e,
 		}
 
 		/* STEP 12 */
-		exclude_candidate(e->candidates,
+		exclude_candidate(ctx, e->candidates,
 				  e->electorate->num_seats,
 				  quota, vacating);
 
@@ -1068,4 +1250,5 @@ void do_count(struct election *e,
 	}
 
 	/* Finished */
+	checkpoint_count(ctx, e->candidates, quota);
 }
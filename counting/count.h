@@ -16,31 +16,57 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
+/* Prepare a context for a new count */
+void init_count_context(struct count_context *ctx);
+
+/* Free the exhausted piles held by the context */
+void free_count_context(struct count_context *ctx);
+
 /* Do a hare-clark scrutiny, until the candidate `vacating' reaches
    quota (if it's NULL, it will be a full scrutiny). */
-void do_count(struct election *e,
+void do_count(struct count_context *ctx,
+	      struct election *e,
 	      struct ballot_list *ballots,
 	      struct candidate *vacating);
 
+/* Distribute the first preferences of the formal ballots, as the
+   first count of a scrutiny does (no candidates are deceased).  The
+   candidates' totals at count 1 are then their first preference
+   totals.  Returns the number of informal ballots. */
+unsigned int count_first_preferences(struct count_context *ctx,
+				     struct election *e,
+				     struct ballot_list *ballots);
+
 /* Get the count number */
-unsigned int get_count_number(void);
+unsigned int get_count_number(const struct count_context *ctx);
 
 /* These are used by casual vacancy module */
 /* Reset count number */
-void reset_count(void);
+void reset_count(struct count_context *ctx);
 
 /* Increment count number by one */
-void increment_count(void);
+void increment_count(struct count_context *ctx);
+
+struct cand_index;
+
+/* Set the index of the candidates being counted: ballots are only
+   distributed to candidates in this index */
+void set_candidate_index(struct count_context *ctx,
+			 const struct cand_index *index);
 
 /* Compare vote values between two piles */
 int compare_vote_values(const void *ppile1, const void *ppile2);
 
-/* Compare Total number of votes between two Candidates at Count */
-int compare_candidate_totals(const void *candidate1, const void *candidate2);
+/* Compare Total number of votes between two Candidates, from the
+   current count back (for qsort_r: the third argument is the count
+   context) */
+int compare_candidate_totals(const void *candidate1, const void *candidate2,
+			     void *ctx);
 
 /* Returns true if enough candidates over quota (ie. election finished),
    or vacating is successful. */
-bool partial_exclusion(struct cand_list *candidates,
+bool partial_exclusion(struct count_context *ctx,
+		       struct cand_list *candidates,
 		       struct candidate *cand,
 		       struct ballot_list *pile,
 		       unsigned int num_seats,
@@ -50,13 +76,15 @@ bool partial_exclusion(struct cand_list *candidates,
 		       bool is_last);
 
 /* Excludes lowest candidate, maybe doing tiebreak. */
-void exclude_candidate(struct cand_list *candidates,
+void exclude_candidate(struct count_context *ctx,
+		       struct cand_list *candidates,
 		       unsigned int num_seats,
 		       unsigned int quota,
 		       struct candidate *vacating);
 
 /* calculate the quota (majority) for a casual vacancy */
-unsigned int calc_majority(struct cand_list *standing);
+unsigned int calc_majority(const struct count_context *ctx,
+			   struct cand_list *standing);
 
 /* Join pile A and pile B */
 struct ballot_list *join_piles(struct ballot_list *a,
@@ -66,14 +94,12 @@ struct ballot_list *join_piles(struct ballot_list *a,
    truncated total */
 unsigned int truncated_vote_sum(struct ballot_list *ballots);
 
-/* Add votes for this count for the candidate to total. */
-bool sum_total(struct candidate *cand, void *void_total);
-
 /* Marks all candidates in 'candidates' as pending if they exceed quota.
 	If 'vacating' is !NULL, and over quota, then it will return after marking
-	'vacating' as pending. */
-bool mark_pending_candidates(struct cand_list *candidates,
-									  unsigned int quota,
-									  struct candidate *vacating);
+	'vacating' as pending.  This ends a count, so it is checkpointed. */
+bool mark_pending_candidates(struct count_context *ctx,
+			     struct cand_list *candidates,
+			     unsigned int quota,
+			     struct candidate *vacating);
 
 #endif /* _COUNT_H */
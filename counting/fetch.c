@@ -18,7 +18,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <common/database.h>
+#include <common/preference_codec.h>
 #include "ballot_iterators.h"
+#include "ballot_store.h"
 #include "candidate_iterators.h"
 #include "fetch.h"
 
@@ -114,7 +116,8 @@ struct cand_list *fetch_candidates(PGconn *conn,
 		/* We are PREpending to list, so count is backwards */
 		list->cand->scrutiny_pos = PQntuples(result) - i - 1;
 		/* All piles empty, all totals 0 */
-		memset(list->cand->c, 0, sizeof(list->cand->c));
+		list->cand->history.num_counts = 0;
+		list->cand->history.counts = NULL;
 		/* surplus distributed flag: init false */
 		list->cand->surplus_distributed=false;
 
@@ -126,42 +129,41 @@ struct cand_list *fetch_candidates(PGconn *conn,
 	return list;
 }
 
-/* Load a single vote */
-static struct ballot *load_vote(PGconn *conn, const char *preference_list)
+struct ballot *load_vote(struct ballot_store *store,
+			 const char *preference_list, int len)
 {
 	struct ballot *ballot;
-	char *pref_ptr;   
-	unsigned int num_preferences=0,i;
+	const char *pref_ptr;
+	unsigned int num_preferences,i;
 	unsigned int pref_number, group_index, db_cand_index;
 
-	for (pref_ptr=(char *)preference_list;
-	     strlen(pref_ptr)>=DIGITS_PER_PREF;
-	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_preferences++);
-	
-	if ( strlen(pref_ptr)) 
-		bailout("Malformed preference list: '%s'\n",preference_list);
-	
-	ballot = malloc(sizeof(*ballot)
-			+ sizeof(ballot->prefs[0])*num_preferences);
-	ballot->num_preferences = num_preferences;
-	ballot->count_transferred = 0;
+	if (len % DIGITS_PER_PREF)
+		bailout("Malformed preference list: '%.*s'\n",
+			len, preference_list);
+	num_preferences = len / DIGITS_PER_PREF;
+
+	ballot = store_ballot(store, num_preferences);
 	
 	/* They many not be in order */
-	for (pref_ptr=(char *)preference_list, i = 0;
+	for (pref_ptr=preference_list, i = 0;
 	     i < ballot->num_preferences; 
-	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
+	     i++,pref_ptr += DIGITS_PER_PREF)
 	{
-		sscanf(pref_ptr,"%2u%2u%2u",&pref_number,&group_index,&db_cand_index);
-		
-		ballot->prefs[pref_number-1]
-			.group_index = group_index;
-		ballot->prefs[pref_number-1]
-			.db_candidate_index = db_cand_index;
+		if (!decode_preference(pref_ptr, &pref_number,
+				       &group_index, &db_cand_index)
+		    || pref_number < 1 || pref_number > num_preferences)
+			bailout("Malformed preference list: '%.*s'\n",
+				len, preference_list);
+
+		ballot->prefs[pref_number-1].group_index = group_index;
+		ballot->prefs[pref_number-1].db_candidate_index
+			= db_cand_index;
 	}
 	
 	return ballot;
 	
 }
+
 /* Get all the ballots for this electorate */
 /* SIPL 2014-02-06
    A progress bar is printed while loading votes.
@@ -199,11 +201,90 @@ static struct ballot *load_vote(PGconn *conn, const char *preference_list)
    therefore, the number of hashes to be printed. */
 #define HASHES_TO_PRINT 20
 
+/* Signature at the start of COPY BINARY output */
+static const char copy_signature[11] = "PGCOPY\n\377\r\n";
+
+/* State carried between rows of the COPY */
+struct vote_loader
+{
+	struct ballot_store *store;
+	bool seen_header;
+
+	/* The progress bar */
+	unsigned int num_votes, votes_loaded, five_percent;
+	int hashes_printed;
+	int next_count_at_which_to_print_hash;
+};
+
+/* COPY BINARY integers are big-endian */
+static int32_t copy_int32(const unsigned char *p)
+{
+	return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+			 | ((uint32_t)p[2] << 8) | p[3]);
+}
+
+static int16_t copy_int16(const unsigned char *p)
+{
+	return (int16_t)((p[0] << 8) | p[1]);
+}
+
+/* Called by SQL_copy_out for each row of COPY BINARY output: a field
+   count, then each field's length and bytes.  The file header comes
+   in front of the first row, and a -1 field count ends the data. */
+static void load_copy_row(const char *row, int len, void *data)
+{
+	struct vote_loader *loader = data;
+	const unsigned char *p = (const unsigned char *)row;
+	const unsigned char *end = p + len;
+	int32_t field_len;
+
+	if (!loader->seen_header) {
+		if (len < sizeof(copy_signature) + 8
+		    || memcmp(p, copy_signature, sizeof(copy_signature)) != 0)
+			bailout("Unexpected COPY BINARY header\n");
+		p += sizeof(copy_signature) + 4;
+		/* Skip the header extension */
+		p += 4 + copy_int32(p);
+		loader->seen_header = true;
+	}
+
+	if (end - p < 2 || copy_int16(p) == -1)
+		return;
+	if (copy_int16(p) != 1 || end - p < 6)
+		bailout("Unexpected COPY BINARY row\n");
+	p += 2;
+	field_len = copy_int32(p);
+	p += 4;
+
+	/* A NULL preference list is an informal vote, like an empty one */
+	if (field_len < 0)
+		field_len = 0;
+	if (field_len > end - p)
+		bailout("Truncated COPY BINARY row\n");
+	load_vote(loader->store, (const char *)p, field_len);
+
+	if (loader->five_percent != 0) {
+
+	  /* SIPL 2014-02-06 Fix printing of hashes */
+	  if (loader->votes_loaded
+	      == loader->next_count_at_which_to_print_hash) {
+	    fprintf(stderr, "#");
+	    loader->hashes_printed++;
+	    /* Subtract 1, because counting of votes starts at 0. */
+	    loader->next_count_at_which_to_print_hash =
+		    loader->five_percent * (loader->hashes_printed + 1) - 1;
+	  }
+	}
+	loader->votes_loaded++;
+}
+
+/* The votes are streamed with COPY BINARY straight into the ballot
+   store, so the whole table is never held in memory as a PGresult. */
 struct ballot_list *fetch_ballots(PGconn *conn, const struct electorate *elec)
 {
-	struct ballot_list *list = NULL;
+	struct vote_loader loader;
 	PGresult *result;
-	unsigned int i,num_votes,five_percent;
+	unsigned int num_prefs;
 	/* SIPL 2014-03-25 Need to back up 24 spaces. */
 	const char backspace_by_24[] = {
 	"\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b"
@@ -211,59 +292,55 @@ struct ballot_list *fetch_ballots(PGconn *conn, const struct electorate *elec)
 	/* SIPL 2014-05-20 Support electorate names with spaces. */
 	char elec_name_normalized[strlen(elec->name) + 1];
 
-	/* SIPL 2014-02-06
-	   Additional variables needed to get progress bar correct. */
-	int hashes_printed = 0;
-	int next_count_at_which_to_print_hash;
-
 	normalize_electorate_name(elec_name_normalized, elec->name);
+
+	/* Size the store up front, so loading never reallocates */
 	result = SQL_query(conn,
-			   "SELECT preference_list " 
+			   "SELECT COUNT(*), "
+			   "COALESCE(SUM(LENGTH(preference_list)), 0) "
 			   "FROM %s_confirmed_vote; "
 			   , elec_name_normalized);
+	loader.num_votes = atoi(PQgetvalue(result, 0, 0));
+	num_prefs = atoi(PQgetvalue(result, 0, 1)) / DIGITS_PER_PREF;
+	PQclear(result);
+
+	loader.store = new_ballot_store(loader.num_votes, num_prefs);
+	loader.seen_header = false;
+	loader.votes_loaded = 0;
 
-	num_votes =  PQntuples(result);
 	/* SIPL 2014-02-06 This is a convenient way of computing
 	   five_percent = ceiling (num_votes / HASHES_TO_PRINT).
 	   Now, five_percent will be zero only if num_votes is zero.
 	*/
-	five_percent = ((num_votes + HASHES_TO_PRINT - 1) / HASHES_TO_PRINT);
-	if (five_percent != 0) {
+	loader.five_percent = ((loader.num_votes + HASHES_TO_PRINT - 1)
+			       / HASHES_TO_PRINT);
+	loader.hashes_printed = 0;
+	if (loader.five_percent != 0) {
 	  /* SIPL 2014-02-07 Initialization of counters
 	     for the progress bar. */
-	  hashes_printed = 0;
 	  /* Subtract 1, because counting of votes starts at 0. */
-	  next_count_at_which_to_print_hash =
-	    five_percent * (hashes_printed + 1) - 1;
+	  loader.next_count_at_which_to_print_hash =
+	    loader.five_percent * (loader.hashes_printed + 1) - 1;
 	  /* SIPL 2014-02-06 Actually print 20 spaces, not 21. */
 	  fprintf(stderr,"%s", (const char *) "0|                    |100");
 	  fprintf(stderr,"%s",backspace_by_24);
 	}
 
-	for (i = 0; i < num_votes; i++) {
-	        list = new_ballot_list( load_vote(conn,PQgetvalue(result, i, 0)),list);
-		if (five_percent != 0) {
-
-		  /* SIPL 2014-02-06 Fix printing of hashes */
-		  if (i ==  next_count_at_which_to_print_hash) {
-		    fprintf(stderr, "#");
-		    hashes_printed++;
-		    /* Subtract 1, because counting of votes starts at 0. */
-		    next_count_at_which_to_print_hash =
-			    five_percent * (hashes_printed + 1) - 1;
-		  }
-		}
-	}
-	if (five_percent != 0) {
+	SQL_copy_out(conn, &load_copy_row, &loader,
+		     "COPY (SELECT preference_list "
+		     "FROM %s_confirmed_vote) TO STDOUT (FORMAT binary);",
+		     elec_name_normalized);
+
+	if (loader.five_percent != 0) {
 		/* For a small number of ballots, the progress bar
 		   may finish short of the end. So print as many extra
 		   hashes as needed to fill it up. */
-		while (hashes_printed < HASHES_TO_PRINT) {
+		while (loader.hashes_printed < HASHES_TO_PRINT) {
 			fprintf(stderr, "#");
-			hashes_printed++;
+			loader.hashes_printed++;
 		}
 		fprintf(stderr, "\n");
 	}
-	PQclear(result);
-	return list;
+	/* The store lives as long as the count: it is never freed */
+	return all_ballots(loader.store);
 }
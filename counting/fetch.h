@@ -36,6 +36,11 @@ extern struct cand_list *fetch_candidates(PGconn *conn,
 					  const struct electorate *elec,
 					  struct group *groups);
 
+/* Load a single vote into the store from its preference list: LEN
+   characters, not terminated */
+extern struct ballot *load_vote(struct ballot_store *store,
+				const char *preference_list, int len);
+
 /* Get all the ballots for this electorate */
 extern struct ballot_list *fetch_ballots(PGconn *conn, 
 					 const struct electorate *elec);
@@ -16,17 +16,37 @@
 
 /* Fraction handling */
 #include <limits.h>
+#include <common/evacs.h>
 #include "fraction.h"
 
 const struct fraction fraction_zero = { .numerator = 0, .denominator = 1 };
 const struct fraction fraction_one = { .numerator = 1, .denominator = 1 };
 
-/* Find the Greatest Common Divisor: thanks Euclid! */
-static long unsigned int gcd(unsigned long int a, unsigned long int b)
+/* Find the Greatest Common Divisor.  This is Stein's binary
+   algorithm: iterative, and each step strips at least one bit, so it
+   can neither recurse deeply nor loop for long when one argument is
+   much larger than the other (eg. 1/41233). */
+static unsigned long int gcd(unsigned long int a, unsigned long int b)
 {
-	if (a == b) return a;
-	if (a > b) return gcd(a-b, b);
-	else return gcd(a, b-a);
+	int shift;
+
+	if (a == 0) return b;
+	if (b == 0) return a;
+
+	/* Common factors of two */
+	shift = __builtin_ctzl(a | b);
+	a >>= __builtin_ctzl(a);
+	do {
+		b >>= __builtin_ctzl(b);
+		if (a > b) {
+			unsigned long int t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	} while (b != 0);
+
+	return a << shift;
 }
 
 /* Reduce to simplest form */
@@ -34,81 +54,97 @@ static void normalize(struct fraction *f)
 {
 	unsigned long int common_divisor;
 
-	/* Avoid potential gcd loop */
+	/* Zero is left alone (as it always has been) */
 	if (f->numerator == 0) return;
 
 	/* Find GCD. */
-	common_divisor = gcd((unsigned long int) f->numerator,
-			     (unsigned long int) f->denominator);
+	common_divisor = gcd(f->numerator, f->denominator);
 	f->numerator /= common_divisor;
 	f->denominator /= common_divisor;
 }
 
-static void same_denominator(struct fraction *a, struct fraction *b)
+static void __attribute__((noreturn)) fraction_overflow(struct fraction a,
+							 struct fraction b)
 {
-	unsigned long int common_divisor, a_multiplier, b_multiplier;
-
-/* Find GCD. */
-	common_divisor = gcd( a->denominator,
-			      b->denominator);
-
-	a_multiplier = b->denominator/common_divisor;
-	b_multiplier = a->denominator/common_divisor;
-	a->denominator *= a_multiplier ; 
-	a->numerator *=  a_multiplier ;
-	b->denominator *= b_multiplier;
-	b->numerator *= b_multiplier;
-
-	/* Multiply out */
-	/*a->denominator *= b->denominator;
-	a->numerator *= b->denominator;
-	b->denominator *= old_a.denominator;
-	b->numerator *= old_a.denominator; */
-
+	bailout("Fraction overflow adding %lu/%lu to %lu/%lu\n",
+		b.numerator, b.denominator, a.numerator, a.denominator);
 }
 
 /* a + b */
 struct fraction fraction_add(struct fraction a, struct fraction b)
 {
 	struct fraction ret;
-	if (a.denominator !=  b.denominator) {
-	  same_denominator(&a, &b);
+
+	if (a.denominator == b.denominator) {
+		ret.denominator = a.denominator;
+		if (__builtin_add_overflow(a.numerator, b.numerator,
+					   &ret.numerator))
+			fraction_overflow(a, b);
+	} else {
+		unsigned long int common_divisor, a_multiplier, b_multiplier;
+		unsigned long int a_numerator, b_numerator;
+
+		/* Convert to lowest common denominator */
+		common_divisor = gcd(a.denominator, b.denominator);
+		a_multiplier = b.denominator / common_divisor;
+		b_multiplier = a.denominator / common_divisor;
+		if (__builtin_mul_overflow(a.denominator, a_multiplier,
+					   &ret.denominator)
+		    || __builtin_mul_overflow(a.numerator, a_multiplier,
+					      &a_numerator)
+		    || __builtin_mul_overflow(b.numerator, b_multiplier,
+					      &b_numerator)
+		    || __builtin_add_overflow(a_numerator, b_numerator,
+					      &ret.numerator))
+			fraction_overflow(a, b);
 	}
-	ret.denominator = a.denominator;
-	ret.numerator = a.numerator + b.numerator;
 	normalize(&ret);
 
 	return ret;
 }
 
+/* f * n */
+struct fraction fraction_multiply(struct fraction f, unsigned int n)
+{
+	struct fraction ret;
+
+	ret.denominator = f.denominator;
+	if (__builtin_mul_overflow(f.numerator, n, &ret.numerator))
+		bailout("Fraction overflow multiplying %lu/%lu by %u\n",
+			f.numerator, f.denominator, n);
+	return ret;
+}
+
 /* (unsigned int)f */
 unsigned int fraction_truncate(struct fraction f)
 {
 	return f.numerator / f.denominator;
 }
 
-/* a > b ? */
-bool fraction_greater(struct fraction a, struct fraction b)
+/* a - b.  Cross-multiplying in 128 bits cannot overflow, so there is
+   no need to find a common denominator first. */
+int fraction_compare(struct fraction a, struct fraction b)
 {
-	/* Convert to same denominator */	
-	same_denominator(&a, &b);
-	return (a.numerator > b.numerator);
+	unsigned __int128 a_scaled, b_scaled;
+
+	a_scaled = (unsigned __int128)a.numerator * b.denominator;
+	b_scaled = (unsigned __int128)b.numerator * a.denominator;
+	if (a_scaled > b_scaled) return 1;
+	else if (a_scaled < b_scaled) return -1;
+	return 0;
 }
 
-/* a - b */
-int fraction_compare(struct fraction a, struct fraction b)
+/* a > b ? */
+bool fraction_greater(struct fraction a, struct fraction b)
 {
-	/* Convert to same denominator */	
-	same_denominator(&a, &b);
-	if (a.numerator > b.numerator) return 1;
-	else if (a.numerator < b.numerator) return -1;
-	return 0;
+	return fraction_compare(a, b) > 0;
 }
 
 /* a == b ? */
 bool fraction_equal(struct fraction a, struct fraction b)
 {
-	/* Convert to same denominator */	
-	same_denominator(&a, &b);
-	return (a.numerator == b.numerator);
+	/* Same representation: no need to multiply */
+	if (a.numerator == b.numerator && a.denominator == b.denominator)
+		return true;
+	return fraction_compare(a, b) == 0;
 }
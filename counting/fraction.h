@@ -28,9 +28,12 @@ struct fraction
 
 extern const struct fraction fraction_zero, fraction_one;
 
-/* a + b */
+/* a + b: bails out if the result cannot be represented */
 extern struct fraction fraction_add(struct fraction a, struct fraction b);
 
+/* f * n: bails out if the result cannot be represented */
+extern struct fraction fraction_multiply(struct fraction f, unsigned int n);
+
 /* (unsigned int)f */
 extern unsigned int fraction_truncate(struct fraction f);
 
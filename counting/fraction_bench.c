@@ -0,0 +1,85 @@
+/* This file is (C) copyright 2001 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Microbenchmark for the fraction routines used while counting.
+   Run with "make benchmarks". */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fraction.h"
+
+/* Enough iterations to swamp the timer resolution */
+#define ITERATIONS 10000000
+
+/* Typical transfer values seen during surplus distribution */
+static const struct fraction values[] = {
+	{ 1, 1 }, { 3719, 41233 }, { 512, 2049 }, { 77, 8191 },
+	{ 1250, 6917 }, { 3719, 41233 }, { 1, 1 }, { 40, 1623 },
+};
+#define NUM_VALUES (sizeof(values) / sizeof(values[0]))
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start, double end)
+{
+	printf("fraction_%-10s %8.2f ns/op\n", name,
+	       (end - start) / ITERATIONS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fraction sum;
+	unsigned int i, truncated;
+	int cmp;
+	double start;
+
+	/* Summing piles, as truncated_vote_sum() does: every ballot in
+	   a pile came in on the same count, so has the same value. */
+	start = now_ns();
+	sum = fraction_zero;
+	for (i = 0; i < ITERATIONS; i++) {
+		if (i % 4096 == 0)
+			sum = fraction_zero;
+		sum = fraction_add(sum, values[(i / 4096) % NUM_VALUES]);
+	}
+	report("add", start, now_ns());
+
+	start = now_ns();
+	cmp = 0;
+	for (i = 0; i < ITERATIONS; i++)
+		cmp += fraction_compare(values[i % NUM_VALUES],
+					values[(i + 3) % NUM_VALUES]);
+	report("compare", start, now_ns());
+
+	start = now_ns();
+	truncated = 0;
+	for (i = 0; i < ITERATIONS; i++) {
+		struct fraction f = values[i % NUM_VALUES];
+
+		f.numerator += i;
+		truncated += fraction_truncate(f);
+	}
+	report("truncate", start, now_ns());
+
+	/* Stop the compiler discarding the loops */
+	return (sum.denominator == 0 && cmp == 0 && truncated == 0);
+}
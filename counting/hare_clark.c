@@ -15,6 +15,9 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <common/database.h>
 #include <common/evacs.h>
 /*#include <common/safe.h>*/
@@ -24,6 +27,7 @@
 #include "ballot_iterators.h"
 #include "candidate_iterators.h"
 #include "count.h"
+#include "checkpoint.h"
 
 static struct electorate *prompt_for_electorate(PGconn *conn)
 {
@@ -32,7 +36,8 @@ static struct electorate *prompt_for_electorate(PGconn *conn)
 
 	do {
 		printf("Please enter the electorate name to count: ");
-		fscanf(stdin, "%ms",&name);
+		if (fscanf(stdin, "%ms",&name) != 1)
+			bailout("No electorate name given\n");
 		//name = fgets_malloc(stdin);
 		elec = fetch_electorate(conn, name);
 		if (!elec)
@@ -46,11 +51,7 @@ static struct electorate *prompt_for_electorate(PGconn *conn)
 
 static bool free_piles(struct candidate *cand, void *unused)
 {
-	unsigned int i;
-
-	for (i = 0; i < MAX_COUNTS; i++)
-		if (cand->c[i].pile)
-			free_ballot_list(cand->c[i].pile);
+	free_history(&cand->history);
 
 	return false;
 }
@@ -71,15 +72,215 @@ static void free_group_names(struct group *groups, unsigned int num_groups)
 }
 
 
-int main(int argc, char *argv[])
+/* Count one electorate and write its scrutiny sheets to output_dir
+   (and, if checkpoint, checkpoints of every count for vacancy).
+   Returns false if there were no ballots to count. */
+static bool count_electorate(PGconn *conn, struct electorate *electorate,
+			     const char *election_title,
+			     const char *output_dir,
+			     bool checkpoint)
 {
 	struct ballot_list *ballots;
-	PGconn *conn;
 	struct election e;
+	struct count_context ctx;
+
+	e.electorate = electorate;
+	e.num_groups = fetch_groups(conn, e.electorate, e.groups);
+	e.candidates = fetch_candidates(conn, e.electorate, e.groups);
+	e.cand_index = new_cand_index(e.candidates);
+	fprintf(stderr,"Fetching Ballots:\t");
+	ballots = fetch_ballots(conn, e.electorate);
+
+        /* 2008-07-29 Abort if there are no ballots to count. */
+        if (ballots == NULL) {
+          fprintf(stderr,"\nThere are no ballots to be counted "
+                  "for this electorate.\n");
+          return false;
+        }
+
+  
+	/* Start the reporting for a regular Hare Clark count*/
+	init_count_context(&ctx);
+	report_start(&ctx, &e, NULL, output_dir);
+	if (checkpoint) {
+		char *path = checkpoint_path(e.electorate->name);
+
+		checkpoint_start(&ctx, &e, ballots, path);
+		free(path);
+	}
+
+	do_count(&ctx, &e, ballots, NULL);
+	checkpoint_end(&ctx);
+
+	/* We've finished! */
+	fprintf(stderr,"\nFinished Count; Cleaning up\n");
+	report_end(&ctx, get_count_number(&ctx), election_title);
+	free_count_context(&ctx);
+
+	/* free allocated memory */
+	/* SIPL 2014-03-25 Swapped the following two lines,
+	   so as to free the candidate structs only after they
+	   are not needed for dereferencing.
+	*/
+	for_each_candidate(e.candidates, &free_piles, NULL);
+	for_each_candidate(e.candidates, &free_candidate, NULL);
+	free_group_names(e.groups, e.num_groups);
+	free_cand_list(e.candidates);
+	free_cand_index(e.cand_index);
+	return true;
+}
+
+/* Count one electorate in a child process, as though hare_clark had
+   been run for it alone.  The answers to its deceased candidate and
+   tiebreak prompts are read from answers_dir/<electorate>.txt (if
+   there is no such file, there are no deceased candidates, and a
+   tiebreak stops the count).  Its scrutiny sheets and log go in
+   /tmp/<electorate>/. */
+static pid_t start_count(const char *electorate_name,
+			 const char *answers_dir,
+			 const char *election_title,
+			 bool checkpoint)
+{
+	/* SIPL 2014-05-20 Support electorate names with spaces. */
+	char ename_normalized[strlen(electorate_name) + 1];
+	char *output_dir, *path;
+	struct electorate *electorate;
+	PGconn *conn;
+	pid_t pid;
+	bool counted;
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid != 0) {
+		if (pid < 0)
+			bailout("Could not start count for %s: %s\n",
+				electorate_name, strerror(errno));
+		return pid;
+	}
+
+	normalize_electorate_name(ename_normalized, electorate_name);
+	output_dir = sprintf_malloc("/tmp/%s", ename_normalized);
+	create_directory(0755, "%s", output_dir);
+
+	path = sprintf_malloc("%s/count.log", output_dir);
+	if (!freopen(path, "w", stdout) || dup2(fileno(stdout), 2) < 0)
+		bailout("Could not write %s: %s\n", path, strerror(errno));
+	free(path);
+	path = sprintf_malloc("%s/%s.txt", answers_dir, ename_normalized);
+	if (!freopen(path, "r", stdin) && !freopen("/dev/null", "r", stdin))
+		bailout("Could not read %s: %s\n", path, strerror(errno));
+	free(path);
+
+	/* Our own connection: the parent's is not shared */
+	conn = connect_db(DATABASE_NAME);
+	if (conn == NULL) bailout("Can't connect to database:%s\n",
+				   DATABASE_NAME);
+	electorate = fetch_electorate(conn, electorate_name);
+	if (!electorate)
+		bailout("Electorate `%s' not found!\n", electorate_name);
+
+	counted = count_electorate(conn, electorate, election_title,
+				   output_dir, checkpoint);
+	free_electorates(electorate);
+	PQfinish(conn);
+	fflush(stdout);
+	exit(counted ? 0 : 1);
+}
+
+/* Count every electorate at once, each in its own process.  Returns
+   the number of counts that failed. */
+static unsigned int count_all_electorates(PGconn *conn,
+					  const char *answers_dir,
+					  const char *election_title,
+					  bool checkpoint)
+{
+	struct electorate *electorates, *elec;
+	unsigned int i, num_electorates = 0, num_running, num_failed = 0;
+	pid_t pid, *pids;
+	int status;
+
+	electorates = get_electorates(conn);
+	for (elec = electorates; elec; elec = elec->next)
+		num_electorates++;
+
+	pids = malloc(sizeof(pid_t) * num_electorates);
+	if (!pids)
+		bailout("Out of memory starting counts\n");
+	for (i = 0, elec = electorates; elec; elec = elec->next, i++) {
+		pids[i] = start_count(elec->name, answers_dir,
+				      election_title, checkpoint);
+		fprintf(stderr, "Counting %s\n", elec->name);
+	}
+
+	for (num_running = num_electorates; num_running > 0; ) {
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			bailout("wait failed: %s\n", strerror(errno));
+		}
+		for (elec = electorates, i = 0;
+		     elec && pids[i] != pid;
+		     elec = elec->next, i++);
+		if (!elec)
+			continue;
+		num_running--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			fprintf(stderr, "Finished counting %s\n", elec->name);
+		else {
+			char ename_normalized[strlen(elec->name) + 1];
+
+			normalize_electorate_name(ename_normalized,
+						  elec->name);
+			fprintf(stderr, "Count for %s failed: see "
+				"/tmp/%s/count.log\n",
+				elec->name, ename_normalized);
+			num_failed++;
+		}
+	}
+
+	free(pids);
+	free_electorates(electorates);
+	return num_failed;
+}
+
+static void usage(const char *name)
+{
+	bailout("Usage: %s [--checkpoint] [--all [answers-directory]]\n"
+		"  With --checkpoint, record every count in "
+		"~/.evacs/checkpoint.<electorate>.dat,\n"
+		"  so vacancy --resume can pick up the count instead of "
+		"repeating it.\n"
+		"  With --all, count every electorate concurrently, "
+		"reading the answers to\n"
+		"  each one's prompts from "
+		"answers-directory/<electorate>.txt\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	PGconn *conn;
+	struct electorate *electorate;
         char *election_name,*election_date,*election_title;
         /* What to insert between election name and date to
            give the title to print on scrutiny sheets */
         static char election_title_joiner[] = " - ";
+	bool all = false, checkpoint = false;
+	const char *answers_dir = ".";
+	int arg = 1, ret = 0;
+
+	if (arg < argc && strcmp(argv[arg], "--checkpoint") == 0) {
+		checkpoint = true;
+		arg++;
+	}
+	if (arg < argc) {
+		if (strcmp(argv[arg], "--all") != 0 || argc > arg + 2)
+			usage(argv[0]);
+		all = true;
+		if (argc == arg + 2)
+			answers_dir = argv[arg + 1];
+	}
 
 	/* Get the information we need */
 	conn = connect_db(DATABASE_NAME);
@@ -113,52 +314,22 @@ int main(int argc, char *argv[])
         strcat(election_title,election_title_joiner);
         strcat(election_title,election_date);
 
-	e.electorate = prompt_for_electorate(conn);
-	e.num_groups = fetch_groups(conn, e.electorate, e.groups);
-	e.candidates = fetch_candidates(conn, e.electorate, e.groups);
-	fprintf(stderr,"Fetching Ballots:\t");
-	ballots = fetch_ballots(conn, e.electorate);
-
-        /* 2008-07-29 Abort if there are no ballots to count. */
-        if (ballots == NULL) {
-          fprintf(stderr,"\nThere are no ballots to be counted "
-                  "for this electorate.\n");
-          return -1;
-        }
-
-  
-	/* Start the reporting for a regular Hare Clark count*/
-	report_start(&e, NULL);
-
-	do_count(&e, ballots, NULL);
-
-	/* We've finished! */
-	fprintf(stderr,"\nFinished Count; Cleaning up\n");
-	report_end(get_count_number(), election_title);
-
-	/* free allocated memory */
-	/* SIPL 2014-03-25 Swapped the following two lines,
-	   so as to free the candidate structs only after they
-	   are not needed for dereferencing.
-	*/
-	for_each_candidate(e.candidates, &free_piles, NULL);
-	for_each_candidate(e.candidates, &free_candidate, NULL);
-	free_group_names(e.groups, e.num_groups);
-	free_cand_list(e.candidates);
-	free_electorates(e.electorate);
+	if (all) {
+		if (count_all_electorates(conn, answers_dir, election_title,
+					  checkpoint))
+			ret = -1;
+	} else {
+		electorate = prompt_for_electorate(conn);
+		if (!count_electorate(conn, electorate, election_title,
+				      "/tmp", checkpoint))
+			ret = -1;
+		free_electorates(electorate);
+	}
 
         free(election_name);
         free(election_date);
         free(election_title);
 
 	PQfinish(conn);
-	return 0;
+	return ret;
 }
-
-
-
-
-
-
-
-
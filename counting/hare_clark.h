@@ -15,6 +15,7 @@
    You should have received a copy of the GNU General Public License
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <stdint.h>
 #include <common/evacs.h>
 #include "fraction.h"
 
@@ -44,11 +45,11 @@ enum cand_status
 };
 
 /* These preferences are implicitly indexed: ie. first is 1, second is
-   2, etc */
+   2, etc.  Both indexes are at most two digits, so a byte each. */
 struct normalized_pref
 {
-	unsigned int group_index;
-	unsigned int db_candidate_index;
+	unsigned char group_index;
+	unsigned char db_candidate_index;
 };
 
 /* A single ballot paper */
@@ -60,18 +61,71 @@ struct ballot
 	/* The count at which this ballot last transferred */
 	unsigned int count_transferred;
 
-	/* Preferences hang off end. */
+	/* Preferences live in the ballot store's preference pool. */
 	unsigned int num_preferences;
-	struct normalized_pref prefs[0];
+	struct normalized_pref *prefs;
 };
 
-/* List/pile of ballot papers */
+/* Every ballot paper being counted, in two contiguous arrays: one of
+   ballots, and one of all their preferences. */
+struct ballot_store
+{
+	unsigned int num_ballots;
+	unsigned int max_ballots;
+	struct ballot *ballots;
+
+	unsigned int num_prefs;
+	unsigned int max_prefs;
+	struct normalized_pref *prefs;
+};
+
+/* List/pile of ballot papers, as indexes into the ballot store.  The
+   list is held back to front, so the first ballot is the last id and
+   prepending a ballot is appending an id. */
 struct ballot_list
 {
-	struct ballot_list *next;
+	const struct ballot_store *store;
 
-	/* The ballot */
-	struct ballot *ballot;
+	unsigned int num_ballots;
+	unsigned int max_ballots;
+	uint32_t *ids;
+};
+
+/* How many ballots in a pile have a given vote value */
+struct value_count
+{
+	struct fraction vote_value;
+	unsigned int num_ballots;
+};
+
+/* Summary of a pile: one entry per distinct vote value.  There are
+   only ever a handful, so sums over the pile are cheap. */
+struct pile_tally
+{
+	unsigned int num_values;
+	unsigned int max_values;
+	struct value_count *values;
+};
+
+/* A candidate's (or the exhausted papers') state at one count */
+struct count_state
+{
+	/* The pile of votes received at this count */
+	struct ballot_list *pile;
+
+	/* Summary of that pile, by vote value */
+	struct pile_tally tally;
+
+	/* The total at this count */
+	unsigned int total;
+};
+
+/* State for every count so far, grown as counts are reached: counts
+   past the end are empty, with a total of 0. */
+struct count_history
+{
+	unsigned int num_counts;
+	struct count_state *counts;
 };
 
 struct group
@@ -107,13 +161,8 @@ struct candidate
 	/* When elected, were all vacancies filled on that count? */
 	bool all_vacancies_filled_at_count;
 
-	struct {
-		/* My pile of votes, for every count. */
-		struct ballot_list *pile;
-
-		/* My totals, for every count */
-		unsigned int total;
-	} c[MAX_COUNTS];
+	/* My piles and totals, for every count: use cand_count() */
+	struct count_history history;
 };
 
 struct cand_list
@@ -138,10 +187,39 @@ struct election
 	/* The canonical candidates */
 	struct cand_list *candidates;
 
+	/* The same candidates, indexed for lookup by preference */
+	struct cand_index *cand_index;
+
 	/* The actual number of groups */
 	unsigned int num_groups;
 
 	/* Room for one per preference */
 	struct group groups[PREFNUM_MAX];
 };
+
+struct report;
+struct checkpoint;
+
+/* Everything one count keeps between steps.  Each count has its own,
+   so several can be run at once. */
+struct count_context
+{
+	/* current count */
+	unsigned int count;
+
+	/* the exhausted papers at each count: starts empty */
+	struct count_history exhausted;
+
+	/* the candidates being counted, indexed by preference */
+	const struct cand_index *cand_index;
+
+	/* incremented each time someone is elected */
+	unsigned int order_elected;
+
+	/* the scrutiny sheets: NULL if none are being drawn */
+	struct report *report;
+
+	/* where each count is recorded: NULL if it is not */
+	struct checkpoint *checkpoint;
+};
 #endif /*_HARE_CLARK_H*/
@@ -39,13 +39,6 @@
 #define COUNT_NUMBER_FONT "Helvetica-Bold"
 #define SMIDGE 2
 
-/* simple counter incremented each time someone is elected */
-static unsigned int order_elected = 0;
-
-/* Keep track of previous majority in order to report twice on same count ONLY when changed*/
-static unsigned int previous_count = 0;
-static unsigned int previous_majority=0;
-
 enum orientation {
 	ORIENT_HORIZONTAL,
 	ORIENT_VERTICAL,
@@ -53,7 +46,8 @@ enum orientation {
 
 #define TOP 0
 #define BOTTOM 1
-struct
+/* Table I: counting of the choices */
+struct counting_sheet
 {
 	FILE *out;
 	FILE *raw;
@@ -70,9 +64,10 @@ struct
 	char *ename_normalized;
 	/* The descriptions for each count */
 	char *count_descrip[2][MAX_COUNTS];
-} counting;
+};
 
-struct
+/* Table II: distribution of the effective votes */
+struct distribution_sheet
 {
 	FILE *out;
 	FILE *raw;
@@ -99,34 +94,49 @@ struct
 	int total_loss;
 	/* The remarks for each count */
 	char *remarks[2][MAX_COUNTS];
-} distribution;
+};
 
-void reset_order_elected(void) {
-        order_elected = 0;
+/* The scrutiny sheets of one count */
+struct report
+{
+	struct counting_sheet counting;
+	struct distribution_sheet distribution;
+
+	/* Keep track of previous majority in order to report twice on same count ONLY when changed*/
+	unsigned int previous_count;
+	unsigned int previous_majority;
+};
+
+void reset_order_elected(struct count_context *ctx) {
+        ctx->order_elected = 0;
 }
 
-unsigned int increment_order_elected(void) {
-	return ++order_elected; 
+unsigned int increment_order_elected(struct count_context *ctx) {
+	return ++ctx->order_elected; 
 }
 
-unsigned int  get_order_elected(void) {
-	return order_elected; 
+unsigned int  get_order_elected(const struct count_context *ctx) {
+	return ctx->order_elected; 
 }
-static FILE *create_postscript(const char *name)
+static FILE *create_postscript(const char *output_dir, const char *name)
 {
 	FILE *ret;
 	time_t now;
+	char date[26];
+	char *path = sprintf_malloc("%s/%s", output_dir, name);
 
-	ret = fopen(name, "w");
+	ret = fopen(path, "w");
 	if (!ret) bailout("Could not open %s for writing: %s\n",
-			  name, strerror(errno));
+			  path, strerror(errno));
+	free(path);
 	fputs("%!PS-Adobe-1.0\n", ret);
 	fputs("%%DocumentFonts: Helvetica Helvetica-Bold\n", ret);
 	fputs("%%Title: Scrutiny Sheet\n", ret);
 	fputs("%%Creator: counting (GPL)\n", ret);
 	fputs("%%CreationDate: ", ret);
 	time(&now);
-	fprintf(ret, "%s\n", ctime(&now));
+	/* ctime_r: several counts may be reported at once */
+	fprintf(ret, "%s\n", ctime_r(&now, date));
 	fputs("%%EndComments\n", ret);
 	fputs("%%EndProlog\n", ret);
 	fputs("%%Page: 0 1\n", ret);
@@ -195,6 +205,7 @@ static unsigned int draw_box(FILE *out,
 }
 
 static unsigned int draw_candidate_headings(FILE *out,
+					    FILE *raw_stream,
 					    struct cand_list *candidates)
 {
 	unsigned int ret;
@@ -202,12 +213,6 @@ static unsigned int draw_candidate_headings(FILE *out,
 	struct group *group;
 	struct cand_list *i;
 	unsigned int count = 0;
-	FILE *raw_stream;
-	
-	if (out == counting.out) 
-		raw_stream = counting.raw;
-	else
-		raw_stream = distribution.raw;
 
 	fputs("0 0 moveto\n", out);
 
@@ -252,35 +257,38 @@ static unsigned int draw_candidate_headings(FILE *out,
 	return ret;
 }
 
-static void draw_counting_columns(struct cand_list *candidates)
+static void draw_counting_columns(struct counting_sheet *counting,
+				  struct cand_list *candidates)
 {
-	counting.exhausted = draw_candidate_headings(counting.out, candidates);
-	counting.counted
-		= counting.exhausted 
-		+ draw_box(counting.out,
+	counting->exhausted = draw_candidate_headings(counting->out,
+						      counting->raw,
+						      candidates);
+	counting->counted
+		= counting->exhausted 
+		+ draw_box(counting->out,
 			   NORMAL_COLUMN_WIDTH,
 			   TOP_BOX_HEIGHT,
 			   "Papers Exhausted at Count",
 			   COLUMN_TITLE_FONT_SIZE,
 			   ORIENT_VERTICAL,true);
-	counting.transfer_value
-		= counting.counted
-		+ draw_box(counting.out,
+	counting->transfer_value
+		= counting->counted
+		+ draw_box(counting->out,
 			   NORMAL_COLUMN_WIDTH,
 			   TOP_BOX_HEIGHT,
 			   "Total Papers Counted",
 			   COLUMN_TITLE_FONT_SIZE,
 			   ORIENT_VERTICAL, true);
-	counting.to_table2
-		= counting.transfer_value
-		+ draw_box(counting.out,
+	counting->to_table2
+		= counting->transfer_value
+		+ draw_box(counting->out,
 			   FRACTION_COLUMN_WIDTH,
 			   TOP_BOX_HEIGHT,
 			   "Transfer Value",
 			   COLUMN_TITLE_FONT_SIZE,
 			   ORIENT_VERTICAL, true);
 
-	draw_box(counting.out,
+	draw_box(counting->out,
 		 NORMAL_COLUMN_WIDTH,
 		 TOP_BOX_HEIGHT,
 		 "Votes transferred to Table II",
@@ -288,29 +296,31 @@ static void draw_counting_columns(struct cand_list *candidates)
 		 ORIENT_VERTICAL, true);
 }
 
-static void draw_distribution_columns(struct cand_list *candidates)
+static void draw_distribution_columns(struct distribution_sheet *distribution,
+				      struct cand_list *candidates)
 {
-	distribution.exhausted = draw_candidate_headings(distribution.out,
-							 candidates);
-	distribution.loss_gain
-		= distribution.exhausted
-		+ draw_box(distribution.out,
+	distribution->exhausted = draw_candidate_headings(distribution->out,
+							  distribution->raw,
+							  candidates);
+	distribution->loss_gain
+		= distribution->exhausted
+		+ draw_box(distribution->out,
 			   NORMAL_COLUMN_WIDTH,
 			   TOP_BOX_HEIGHT,
 			   "Votes Exhausted at Count",
 			   COLUMN_TITLE_FONT_SIZE,
 			   ORIENT_VERTICAL, true);
-	distribution.total
-		= distribution.loss_gain
-		+ draw_box(distribution.out,
+	distribution->total
+		= distribution->loss_gain
+		+ draw_box(distribution->out,
 			   NORMAL_COLUMN_WIDTH,
 			   TOP_BOX_HEIGHT,
 			   "Loss by fraction",
 			   COLUMN_TITLE_FONT_SIZE,
 			   ORIENT_VERTICAL, true);
-	distribution.remark
-		= distribution.total
-		+ draw_box(distribution.out,
+	distribution->remark
+		= distribution->total
+		+ draw_box(distribution->out,
 			   NORMAL_COLUMN_WIDTH,
 			   TOP_BOX_HEIGHT,
 			   "Total votes at End of the Count",
@@ -318,66 +328,76 @@ static void draw_distribution_columns(struct cand_list *candidates)
 			   ORIENT_VERTICAL, true);
 }
 
-void report_start(const struct election *e, const struct candidate *vacating)
+void report_start(struct count_context *ctx,
+		  const struct election *e,
+		  const struct candidate *vacating,
+		  const char *output_dir)
 {
 	unsigned int i;
 	char * table1_name;
 	char * table2_name;
-
-	memset(&counting, 0, sizeof(counting));
-	memset(&distribution, 0, sizeof(distribution));
-
-	counting.ename = strdup(e->electorate->name);
-	counting.ename_normalized = malloc(strlen(e->electorate->name) + 1);
-	normalize_electorate_name(counting.ename_normalized, counting.ename);
-	counting.out = create_postscript("/tmp/table1.ps");
-	fflush(counting.out);
-	table1_name = malloc(sizeof(char) * (strlen("/tmp/table1.dat") + strlen(counting.ename_normalized) + 2));
-	sprintf(table1_name, "%s%s%s", "/tmp/table1.", counting.ename_normalized, ".dat");
-	counting.raw = fopen(table1_name, "w");
+	struct report *r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		bailout("Out of memory starting report\n");
+	ctx->report = r;
+
+	r->counting.ename = strdup(e->electorate->name);
+	r->counting.ename_normalized = malloc(strlen(e->electorate->name) + 1);
+	normalize_electorate_name(r->counting.ename_normalized, r->counting.ename);
+	r->counting.out = create_postscript(output_dir, "table1.ps");
+	fflush(r->counting.out);
+	table1_name = malloc(sizeof(char) * (strlen("/tmp/table1.dat") + strlen(r->counting.ename_normalized) + 2));
+	sprintf(table1_name, "%s%s%s", "/tmp/table1.", r->counting.ename_normalized, ".dat");
+	r->counting.raw = fopen(table1_name, "w");
 	free(table1_name);
-	if (!counting.raw) 
+	if (!r->counting.raw) 
 		bailout("Could not open /tmp/table1.dat for writing: %s\n",
 			strerror(errno));
 
-	distribution.ename = strdup(e->electorate->name);
-	distribution.ename_normalized = malloc(strlen(e->electorate->name) + 1);
-	normalize_electorate_name(distribution.ename_normalized, distribution.ename);
-	distribution.total_exhausted = 0;
-	distribution.total_loss = 0;
-	distribution.out = create_postscript("/tmp/table2.ps");
-	table2_name = malloc(sizeof(char) * (strlen("/tmp/table2.dat") + strlen(distribution.ename_normalized) + 2));
-	sprintf(table2_name, "%s%s%s", "/tmp/table2.", distribution.ename_normalized, ".dat");
-        distribution.raw = fopen(table2_name, "w");
+	r->distribution.ename = strdup(e->electorate->name);
+	r->distribution.ename_normalized = malloc(strlen(e->electorate->name) + 1);
+	normalize_electorate_name(r->distribution.ename_normalized, r->distribution.ename);
+	r->distribution.total_exhausted = 0;
+	r->distribution.total_loss = 0;
+	r->distribution.out = create_postscript(output_dir, "table2.ps");
+	table2_name = malloc(sizeof(char) * (strlen("/tmp/table2.dat") + strlen(r->distribution.ename_normalized) + 2));
+	sprintf(table2_name, "%s%s%s", "/tmp/table2.", r->distribution.ename_normalized, ".dat");
+        r->distribution.raw = fopen(table2_name, "w");
 	free(table2_name);
-	if (!distribution.raw) 
+	if (!r->distribution.raw) 
 		bailout("Could not open /tmp/table2.dat for writing: %s\n",
 			strerror(errno));
 
 	/* Start with empty remarks and counts */
 	for (i = 0; i < MAX_COUNTS; i++) {
-		distribution.remarks[TOP][i] = NULL;
-		distribution.remarks[BOTTOM][i] = NULL;
-		counting.count_descrip[TOP][i] = NULL;
-		counting.count_descrip[BOTTOM][i] = NULL;
+		r->distribution.remarks[TOP][i] = NULL;
+		r->distribution.remarks[BOTTOM][i] = NULL;
+		r->counting.count_descrip[TOP][i] = NULL;
+		r->counting.count_descrip[BOTTOM][i] = NULL;
 	}
 	/* Fixed remarks for first count */
 	if (! vacating)
-		counting.count_descrip[BOTTOM][0] 
+		r->counting.count_descrip[BOTTOM][0] 
 			= strdup("First choice of all papers");
-	draw_counting_columns(e->candidates);
-	draw_distribution_columns(e->candidates);
+	draw_counting_columns(&r->counting, e->candidates);
+	draw_distribution_columns(&r->distribution, e->candidates);
 }
 
 /* externally visible routine to append a new line to counting raw data*/
-void counting_raw_newline() {
-	fprintf(counting.raw,"\n");
+void counting_raw_newline(struct count_context *ctx) {
+	if (!ctx->report)
+		return;
+	fprintf(ctx->report->counting.raw,"\n");
 }
 
 /* Get the quota (for casual vacancy) */
-unsigned int report_get_quota(void)
+unsigned int report_get_quota(const struct count_context *ctx)
 {
-	return distribution.quota;
+	if (!ctx->report)
+		return 0;
+	return ctx->report->distribution.quota;
 }
 
 /* Leave the length of the longest string on the stack */
@@ -571,177 +591,181 @@ static char *get_time_string()
 	time_t now;
 	char *ret=malloc(sizeof(char) * 50);
 
+	if (!ret)
+		bailout("Out of memory getting the time\n");
 	time(&now);
 	
-	sprintf(ret, "%s", ctime(&now));
+	ctime_r(&now, ret);
 	
 	return ret;
 }
 	
 #define COUNT_DESCRIP \
 	"Description of Choices Counted (NAC = Next Available Candidate)"
-static void garnish_counting(unsigned int num_counts, const char *title)
+static void garnish_counting(struct report *r,
+			     unsigned int num_counts, const char *title)
 {
 	unsigned int i;
 
-	fprintf(counting.out, "/Helvetica findfont ");
-	fprintf(counting.out, "%u scalefont setfont ", DESCRIP_FONT_SIZE);
+	fprintf(r->counting.out, "/Helvetica findfont ");
+	fprintf(r->counting.out, "%u scalefont setfont ", DESCRIP_FONT_SIZE);
 	/* Figure out max string length: answer on stack */
-	max_length(counting.out,
+	max_length(r->counting.out,
 		   COUNT_DESCRIP,
-		   counting.count_descrip[TOP],
-		   counting.count_descrip[BOTTOM],
+		   r->counting.count_descrip[TOP],
+		   r->counting.count_descrip[BOTTOM],
 		   num_counts);
 
 	/* Move to origin. */
-	fprintf(counting.out, "0 0 moveto\n");
+	fprintf(r->counting.out, "0 0 moveto\n");
 
 	/* Takes column width from the stack, moves cursor LEFT. */
 	/* Note that draw_column considers pairs above and below the line,
 	   and Table 1 considers the pairs to be those within a "box".
 	   So TOP and BOTTOM are reversed, and TOP is move "up" one */
-	draw_column(counting.out, COUNT_DESCRIP,
-		    counting.count_descrip[BOTTOM],
-		    counting.count_descrip[TOP]+1,
+	draw_column(r->counting.out, COUNT_DESCRIP,
+		    r->counting.count_descrip[BOTTOM],
+		    r->counting.count_descrip[TOP]+1,
 		    DESCRIP_FONT_SIZE,
 		    num_counts,
 		    true);
 	/* Moves cursor left again */
-	draw_numbers(counting.out, num_counts, true);
+	draw_numbers(r->counting.out, num_counts, true);
 
 	/* Draw table title */
-	fprintf(counting.out, "/Helvetica findfont ");
-	fprintf(counting.out, "%u scalefont setfont ",
+	fprintf(r->counting.out, "/Helvetica findfont ");
+	fprintf(r->counting.out, "%u scalefont setfont ",
 		TOP_LEFT_INFO_FONT_SIZE);
 
 	/* Move up a little */
-	fprintf(counting.out, "0 %u rmoveto\n", TOP_LEFT_INFO_FONT_SIZE);
-	fprintf(counting.out,"gsave (Table I - Counting of the Choices - %s) show grestore\n",
+	fprintf(r->counting.out, "0 %u rmoveto\n", TOP_LEFT_INFO_FONT_SIZE);
+	fprintf(r->counting.out,"gsave (Table I - Counting of the Choices - %s) show grestore\n",
 	      get_time_string());
 
 	/* Draw number of votes */
 	
-	fprintf(counting.out,
+	fprintf(r->counting.out,
 		"0 %u rmoveto\n", TOP_LEFT_INFO_FONT_SIZE*3);
 	/* mod for cas vac */
-	if (counting.num_formals == 0) counting.num_formals = distribution.vacancy_total_ballots;
-	fprintf(counting.out,
+	if (r->counting.num_formals == 0) r->counting.num_formals = r->distribution.vacancy_total_ballots;
+	fprintf(r->counting.out,
 		"gsave (Number of formal papers: %u."
 		"  Number of informal papers: %u.) show grestore\n",
-		counting.num_formals, counting.num_informals);
+		r->counting.num_formals, r->counting.num_informals);
 
 	/* Draw title */
-	fprintf(counting.out, "/Helvetica findfont ");
-	fprintf(counting.out, "%u scalefont setfont ", TITLE_FONT_SIZE);
-	fprintf(counting.out,
+	fprintf(r->counting.out, "/Helvetica findfont ");
+	fprintf(r->counting.out, "%u scalefont setfont ", TITLE_FONT_SIZE);
+	fprintf(r->counting.out,
 		"0 %u rmoveto\n",
 		TOP_LEFT_INFO_FONT_SIZE + TITLE_FONT_SIZE*2);
-	fprintf(counting.out,
+	fprintf(r->counting.out,
 		"gsave"
 		" (Scrutiny Sheet for %s - Division of %s) "
 		"show grestore\n",
-		title, counting.ename);
+		title, r->counting.ename);
 
 	for (i = 0; i < num_counts; i++) {
-		free(counting.count_descrip[TOP][i]);
-		counting.count_descrip[TOP][i] = NULL;
-		free(counting.count_descrip[BOTTOM][i]);
-		counting.count_descrip[BOTTOM][i] = NULL;
+		free(r->counting.count_descrip[TOP][i]);
+		r->counting.count_descrip[TOP][i] = NULL;
+		free(r->counting.count_descrip[BOTTOM][i]);
+		r->counting.count_descrip[BOTTOM][i] = NULL;
 	}
 }
 
 #define REMARKS "Remarks"
-static void garnish_distibution(unsigned int num_counts, const char *title)
+static void garnish_distibution(struct report *r,
+				unsigned int num_counts, const char *title)
 {
 	unsigned int i;
 
 	/* Set normal font */
-	fprintf(distribution.out, "/Helvetica findfont ");
-	fprintf(distribution.out, "%u scalefont setfont ", NORMAL_FONT_SIZE);
+	fprintf(r->distribution.out, "/Helvetica findfont ");
+	fprintf(r->distribution.out, "%u scalefont setfont ", NORMAL_FONT_SIZE);
 
 	/* Figure out max string length: answer on stack */
-	max_length(distribution.out, 
+	max_length(r->distribution.out, 
 		   REMARKS,
-		   distribution.remarks[TOP],
-		   distribution.remarks[BOTTOM],
+		   r->distribution.remarks[TOP],
+		   r->distribution.remarks[BOTTOM],
 		   num_counts);
 
 	/* We need to be at far right + width of remarks column (on stack) */
-	fprintf(distribution.out, "dup %u add 0 moveto\n",
-		distribution.remark);
+	fprintf(r->distribution.out, "dup %u add 0 moveto\n",
+		r->distribution.remark);
 	/* Takes column width from the stack, moves cursor LEFT. */
-	draw_column(distribution.out, REMARKS,
-		    distribution.remarks[TOP],
-		    distribution.remarks[BOTTOM],
+	draw_column(r->distribution.out, REMARKS,
+		    r->distribution.remarks[TOP],
+		    r->distribution.remarks[BOTTOM],
 		    NORMAL_FONT_SIZE,
 		    num_counts,
 		    false);
 
 	/* Move to origin. */
-	fprintf(distribution.out, "0 0 moveto\n");
+	fprintf(r->distribution.out, "0 0 moveto\n");
 
 	/* Moves cursor left */
-	draw_numbers(distribution.out, num_counts, false);
+	draw_numbers(r->distribution.out, num_counts, false);
 
 	/* Draw table title */
-	fprintf(distribution.out, "/Helvetica findfont ");
-	fprintf(distribution.out, "%u scalefont setfont ",
+	fprintf(r->distribution.out, "/Helvetica findfont ");
+	fprintf(r->distribution.out, "%u scalefont setfont ",
 		TOP_LEFT_INFO_FONT_SIZE);
 	/* Move up a little */
-	fprintf(distribution.out, "0 %u rmoveto\n", TOP_LEFT_INFO_FONT_SIZE);
-	fprintf(distribution.out,"gsave (Table II - Distribution of the Effective Votes - %s)"
+	fprintf(r->distribution.out, "0 %u rmoveto\n", TOP_LEFT_INFO_FONT_SIZE);
+	fprintf(r->distribution.out,"gsave (Table II - Distribution of the Effective Votes - %s)"
 	      " show grestore\n",
 	      get_time_string());
 
 	/* Draw quota calculation */
-	if (distribution.quota != 0) {
-		fprintf(distribution.out,
+	if (r->distribution.quota != 0) {
+		fprintf(r->distribution.out,
 			"0 %u rmoveto gsave\n", TOP_LEFT_INFO_FONT_SIZE*3);
-		fprintf(distribution.out, "(Quota = ) show\n");
-		fprintf(distribution.out,
+		fprintf(r->distribution.out, "(Quota = ) show\n");
+		fprintf(r->distribution.out,
 			"gsave 0 %u rmoveto (   %u) show grestore\n",
 			TOP_LEFT_INFO_FONT_SIZE/2+3,
-			distribution.num_formals);
-		fprintf(distribution.out,
+			r->distribution.num_formals);
+		fprintf(r->distribution.out,
 			"gsave  0 -%u rmoveto ( %u+1) show grestore\n",
 			TOP_LEFT_INFO_FONT_SIZE/2+3,
-			distribution.num_seats);
-		fprintf(distribution.out,
+			r->distribution.num_seats);
+		fprintf(r->distribution.out,
 			"gsave %u 0 rlineto stroke grestore\n",
 			TOP_LEFT_INFO_FONT_SIZE * 5);
-		fprintf(distribution.out,
+		fprintf(r->distribution.out,
 			"%u 0 rmoveto (  + 1 = %u) show grestore\n",
-			TOP_LEFT_INFO_FONT_SIZE * 5, distribution.quota);
+			TOP_LEFT_INFO_FONT_SIZE * 5, r->distribution.quota);
 	}
 
 	/* Draw total for casual vacancy. */
-	if (distribution.vacancy_total_votes != 0) {
-		fprintf(distribution.out,
+	if (r->distribution.vacancy_total_votes != 0) {
+		fprintf(r->distribution.out,
 			"0 %u rmoveto gsave"
 			" (Total votes to be distributed = %u)"
 			" show grestore\n",
 			TOP_LEFT_INFO_FONT_SIZE*3,
-			distribution.vacancy_total_votes);
+			r->distribution.vacancy_total_votes);
 	}
 
 	/* Draw title */
-	fprintf(distribution.out, "/Helvetica findfont ");
-	fprintf(distribution.out, "%u scalefont setfont ", TITLE_FONT_SIZE);
+	fprintf(r->distribution.out, "/Helvetica findfont ");
+	fprintf(r->distribution.out, "%u scalefont setfont ", TITLE_FONT_SIZE);
 
-	fprintf(distribution.out,
+	fprintf(r->distribution.out,
 		"0 %u rmoveto\n",
 		TOP_LEFT_INFO_FONT_SIZE + TITLE_FONT_SIZE*2);
-	fprintf(distribution.out,
+	fprintf(r->distribution.out,
 		"gsave"
 		" (Scrutiny Sheet for %s - Division of %s) "
 		"show grestore\n",
-		title, distribution.ename);
+		title, r->distribution.ename);
 
 	for (i = 0; i < num_counts; i++) {
-		free(distribution.remarks[TOP][i]);
-		distribution.remarks[TOP][i] = NULL;
-		free(distribution.remarks[BOTTOM][i]);
-		distribution.remarks[BOTTOM][i] = NULL;
+		free(r->distribution.remarks[TOP][i]);
+		r->distribution.remarks[TOP][i] = NULL;
+		free(r->distribution.remarks[BOTTOM][i]);
+		r->distribution.remarks[BOTTOM][i] = NULL;
 	}
 }
 
@@ -752,20 +776,27 @@ static void close_postscript(FILE *out)
 	fclose(out);
 }
 
-void report_end(unsigned int num_counts, const char *title)
+void report_end(struct count_context *ctx,
+		unsigned int num_counts, const char *title)
 {
-	garnish_counting(num_counts, title);
-	close_postscript(counting.out);
-	free(counting.ename);
-	free(counting.ename_normalized);
-
-	garnish_distibution(num_counts, title);
-	close_postscript(distribution.out);
-	free(distribution.ename);
-	free(distribution.ename_normalized);
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	garnish_counting(r, num_counts, title);
+	close_postscript(r->counting.out);
+	free(r->counting.ename);
+	free(r->counting.ename_normalized);
+
+	garnish_distibution(r, num_counts, title);
+	close_postscript(r->distribution.out);
+	free(r->distribution.ename);
+	free(r->distribution.ename_normalized);
 	
-	fclose(distribution.raw);
-	fclose(counting.raw);
+	fclose(r->distribution.raw);
+	fclose(r->counting.raw);
+	free(r);
+	ctx->report = NULL;
 }
 
 static void append_report(char **string, const char *format, ...)
@@ -779,18 +810,28 @@ static void append_report(char **string, const char *format, ...)
 	va_end(arglist);
 }
 
-void report_informals(unsigned int num_informals)
+void report_informals(struct count_context *ctx,
+		      unsigned int num_informals)
 {
-	counting.num_informals = num_informals;
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	r->counting.num_informals = num_informals;
 }
 
-void report_quota(unsigned int num_formals,
+void report_quota(struct count_context *ctx,
+		  unsigned int num_formals,
 		  unsigned int num_seats,
 		  unsigned int quota)
 {
-	counting.num_formals = distribution.num_formals = num_formals;
-	distribution.num_seats = num_seats;
-	distribution.quota = quota;
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	r->counting.num_formals = r->distribution.num_formals = num_formals;
+	r->distribution.num_seats = num_seats;
+	r->distribution.quota = quota;
 }
 
 static void draw_number_box(FILE *out, unsigned int count, unsigned int xpos,
@@ -826,24 +867,29 @@ static void draw_dual_number_box(FILE *out,
 }
 #endif
 
-void report_exhausted(unsigned int count,
+void report_exhausted(struct count_context *ctx,
+		      unsigned int count,
 		      unsigned int ballots_exhausted,
 		      unsigned int votes_exhausted)
 {
-	distribution.total_exhausted += votes_exhausted;
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	r->distribution.total_exhausted += votes_exhausted;
 
 	/* if this is the first distribution of vacating candidates votes .
 	   (i.e. count 0, don't draw the postscript  */ 
 	if (count > 0 ) {
-		draw_number_box(counting.out, count-1, counting.exhausted,
+		draw_number_box(r->counting.out, count-1, r->counting.exhausted,
 				ballots_exhausted);
 		
-		draw_number_pair(distribution.out,
-				 distribution.exhausted,
+		draw_number_pair(r->distribution.out,
+				 r->distribution.exhausted,
 				 count-1,
-				 votes_exhausted, distribution.total_exhausted);
-		fprintf(counting.raw,"EX:%u:%u\n",count,ballots_exhausted);
-		fprintf(distribution.raw,"EX:%u:%u:%u\n",count,votes_exhausted,distribution.total_exhausted);	
+				 votes_exhausted, r->distribution.total_exhausted);
+		fprintf(r->counting.raw,"EX:%u:%u\n",count,ballots_exhausted);
+		fprintf(r->distribution.raw,"EX:%u:%u:%u\n",count,votes_exhausted,r->distribution.total_exhausted);	
 	}
 }
 
@@ -888,7 +934,7 @@ static void draw_empty(FILE *out, unsigned int line, unsigned int candpos,
 		NORMAL_COLUMN_WIDTH, NORMAL_COLUMN_HEIGHT);
 
 	/* Move to centre */
-	fprintf(counting.out, "%u -%u rmoveto\n",
+	fprintf(out, "%u -%u rmoveto\n",
 		NORMAL_COLUMN_WIDTH/2,
 		NORMAL_COLUMN_HEIGHT/2);
 
@@ -901,16 +947,21 @@ static void draw_empty(FILE *out, unsigned int line, unsigned int candpos,
 	fprintf(out, "show\n");
 }
 
-void report_ballots_transferred(unsigned int count,
+void report_ballots_transferred(struct count_context *ctx,
+				unsigned int count,
 				unsigned int candpos,
 				enum cand_status status,
 				unsigned int ballots_added)
 {
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
 	if (status == CAND_ELECTED || status == CAND_EXCLUDED)
-		draw_line(counting.out, count-1, candpos);
+		draw_line(r->counting.out, count-1, candpos);
 	else {
-		fprintf(counting.raw,"BT:%u:%u:%u\n",count,candpos,ballots_added);
-		draw_number_box(counting.out, count-1,
+		fprintf(r->counting.raw,"BT:%u:%u:%u\n",count,candpos,ballots_added);
+		draw_number_box(r->counting.out, count-1,
 				candpos*NORMAL_COLUMN_WIDTH,
 				ballots_added);
 	}
@@ -929,15 +980,20 @@ void report_ballots_transferred(unsigned int count,
 /*  		NORMAL_COLUMN_WIDTH, NORMAL_COLUMN_HEIGHT); */
 /*  } */
 
-void report_votes_transferred(unsigned int count,
+void report_votes_transferred(struct count_context *ctx,
+			      unsigned int count,
 			      unsigned int candpos,
 			      enum cand_status status,
 			      int added,
 			      unsigned int new_total)
 {
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
 	/* No box if they're excluded */
 	if (status == CAND_EXCLUDED) {
-		draw_empty(distribution.out, count-1, candpos, "", 0);
+		draw_empty(r->distribution.out, count-1, candpos, "", 0);
 		return;
 	}
 	/* ACT EC 19/09/01   No Shading   */
@@ -946,50 +1002,58 @@ void report_votes_transferred(unsigned int count,
 /*  	        draw_shading(distribution.out, count-1, candpos); */
 /*  	} */
 	 
-	fprintf(distribution.raw,"VT:%u:%u:%i:%u\n",count,candpos,added,new_total);
-	draw_number_pair(distribution.out,
+	fprintf(r->distribution.raw,"VT:%u:%u:%i:%u\n",count,candpos,added,new_total);
+	draw_number_pair(r->distribution.out,
 			 candpos*NORMAL_COLUMN_WIDTH,
 			 count-1,
 			 added, new_total);
 }
 
-void report_totals(unsigned int count,
+void report_totals(struct count_context *ctx,
+		   unsigned int count,
 		   unsigned int votes,
 		   unsigned int ballots)
 {
 	char string[INT_CHARS+1];
+	struct report *r = ctx->report;
 
-	draw_number_box(counting.out, count-1, counting.counted, ballots);
+	if (!r)
+		return;
+	draw_number_box(r->counting.out, count-1, r->counting.counted, ballots);
 	/* output raw data */
-	fprintf(counting.raw,"TT:%u:%u\n",count,  ballots);
+	fprintf(r->counting.raw,"TT:%u:%u\n",count,  ballots);
 
 	sprintf(string, "%u",
-		votes + distribution.total_loss +distribution.total_exhausted);
+		votes + r->distribution.total_loss +r->distribution.total_exhausted);
 	/* Move to start position */
-	fprintf(distribution.out, "%u -%u moveto\n",
-		distribution.total,
+	fprintf(r->distribution.out, "%u -%u moveto\n",
+		r->distribution.total,
 		TOP_BOX_HEIGHT + (count-1)*NORMAL_COLUMN_HEIGHT);
 
 	/* Set font */
-	fprintf(distribution.out, "/Helvetica findfont ");
-	fprintf(distribution.out, "%u scalefont setfont ", NORMAL_FONT_SIZE);
+	fprintf(r->distribution.out, "/Helvetica findfont ");
+	fprintf(r->distribution.out, "%u scalefont setfont ", NORMAL_FONT_SIZE);
 
 	/* Set width */
-	fprintf(distribution.out, "%u\n", NORMAL_COLUMN_WIDTH);
-	draw_pair(distribution.out, "", string, NORMAL_FONT_SIZE, true);
+	fprintf(r->distribution.out, "%u\n", NORMAL_COLUMN_WIDTH);
+	draw_pair(r->distribution.out, "", string, NORMAL_FONT_SIZE, true);
 	/* output raw data */
-	fprintf(distribution.raw,"TT:%u:%s\n",count, string);
+	fprintf(r->distribution.raw,"TT:%u:%s\n",count, string);
 
 
 	
 }
 
-void report_transfer(unsigned int count,
+void report_transfer(struct count_context *ctx,
+		     unsigned int count,
 		     struct fraction value,
 		     unsigned int votes_transferred)
 {
 	char valstring[INT_CHARS + sizeof(" / ") + INT_CHARS];
+	struct report *r = ctx->report;
 
+	if (!r)
+		return;
 	/* If denominator == 1, skip it */
 	if (value.denominator == 1)
 		sprintf(valstring, "%lu", value.numerator);
@@ -997,125 +1061,185 @@ void report_transfer(unsigned int count,
 		sprintf(valstring, "%lu / %lu",
 			value.numerator, value.denominator);
 
-	fprintf(counting.out, "%u -%u moveto\n",
-		counting.transfer_value,
+	fprintf(r->counting.out, "%u -%u moveto\n",
+		r->counting.transfer_value,
 		TOP_BOX_HEIGHT + (count-1)*NORMAL_COLUMN_HEIGHT);
-	draw_box(counting.out, FRACTION_COLUMN_WIDTH, NORMAL_COLUMN_HEIGHT,
+	draw_box(r->counting.out, FRACTION_COLUMN_WIDTH, NORMAL_COLUMN_HEIGHT,
 		 valstring, NUMBER_FONT_SIZE, ORIENT_HORIZONTAL, true);
 
-	draw_number_box(counting.out, count-1, counting.to_table2, 
+	draw_number_box(r->counting.out, count-1, r->counting.to_table2, 
 			votes_transferred);
 	/* report transfer value to raw data stream */
-	fprintf(counting.raw,"TV:%u:%s\n",count,valstring);
+	fprintf(r->counting.raw,"TV:%u:%s\n",count,valstring);
 	/* report votes transferred to table 2 to raw data stream */
-	fprintf(counting.raw,"VT:%u:%u\n",count,votes_transferred);
+	fprintf(r->counting.raw,"VT:%u:%u\n",count,votes_transferred);
 }
 
-void report_distribution(unsigned int count, const char *name)
+void report_distribution(struct count_context *ctx,
+			 unsigned int count, const char *name)
 {
-	append_report(&distribution.remarks[TOP][count-1],
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	append_report(&r->distribution.remarks[TOP][count-1],
 		      "%s's votes distributed.  ", name);
-	append_report(&counting.count_descrip[BOTTOM][count-1],
+	append_report(&r->counting.count_descrip[BOTTOM][count-1],
 		      "NAC after %s", name);
 	/* SIPL 2011-06-16 Added count to output, and also
 	   output to table 1. */
-	fprintf(counting.raw,"DS:%u:%s\n",count,name);
-	fprintf(distribution.raw,"DS:%u:%s\n",count,name);
+	fprintf(r->counting.raw,"DS:%u:%s\n",count,name);
+	fprintf(r->distribution.raw,"DS:%u:%s\n",count,name);
 }
 
-void report_majority(unsigned int count, unsigned int majority)
+void report_majority(struct count_context *ctx,
+		     unsigned int count, unsigned int majority)
 {
-	if (previous_count != count ||
-	    previous_majority != majority) {
-		append_report(&distribution.remarks[BOTTOM][count-1],
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	if (r->previous_count != count ||
+	    r->previous_majority != majority) {
+		append_report(&r->distribution.remarks[BOTTOM][count-1],
 			      "Majority %u.  ", majority);
 		/* SIPL 2011-06-16 Added count to output. */
-		fprintf(distribution.raw,"MJ:%u:%u\n",count,majority);
+		fprintf(r->distribution.raw,"MJ:%u:%u\n",count,majority);
 	
 	}
-	previous_count = count;
-	previous_majority = majority;
+	r->previous_count = count;
+	r->previous_majority = majority;
 }
 
 /* populate relevant data structure (garnish will do the actual reporting) */
-void report_vacancy_total_votes(unsigned int total)
+void report_vacancy_total_votes(struct count_context *ctx,
+				unsigned int total)
 {
-	distribution.vacancy_total_votes = total;
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	r->distribution.vacancy_total_votes = total;
 }
 
 /* populate relevant data structure (garnish will do the actual reporting) */
-void report_vacancy_total_ballots(unsigned int total)
+void report_vacancy_total_ballots(struct count_context *ctx,
+				  unsigned int total)
 {
-	distribution.vacancy_total_ballots = total;
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	r->distribution.vacancy_total_ballots = total;
 }
 
 /* What previous count did these papers come from? */
-void report_distrib_from_count(unsigned int count, unsigned int prev_count)
+void report_distrib_from_count(struct count_context *ctx,
+			       unsigned int count, unsigned int prev_count)
 {
-	if (counting.count_descrip[TOP][count-1] == NULL) {
-		append_report(&counting.count_descrip[TOP][count-1],
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	if (r->counting.count_descrip[TOP][count-1] == NULL) {
+		append_report(&r->counting.count_descrip[TOP][count-1],
 			      "On Papers at Count %u", prev_count);
-		fprintf(counting.raw,"PS:%u:",count);
+		fprintf(r->counting.raw,"PS:%u:",count);
 			
 	} else 
-		append_report(&counting.count_descrip[TOP][count-1],
+		append_report(&r->counting.count_descrip[TOP][count-1],
 			      ",%u", prev_count);
 	
-	fprintf(counting.raw,"%u,",prev_count);
+	fprintf(r->counting.raw,"%u,",prev_count);
 
 }
 
-void report_lost_or_gained(unsigned int count, int gained)
+void report_lost_or_gained(struct count_context *ctx,
+			   unsigned int count, int gained)
 {
-	distribution.total_loss -= gained;
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	r->distribution.total_loss -= gained;
 	/* We report the number LOST, not gained */
-	draw_number_pair(distribution.out,
-			 distribution.loss_gain,
+	draw_number_pair(r->distribution.out,
+			 r->distribution.loss_gain,
 			 count-1,
 			 -gained,
-			 distribution.total_loss);
-	fprintf(distribution.raw,"LG:%u:%i:%i\n",count,-gained, distribution.total_loss);
+			 r->distribution.total_loss);
+	fprintf(r->distribution.raw,"LG:%u:%i:%i\n",count,-gained, r->distribution.total_loss);
 }
 
-void report_elected(unsigned int count, unsigned int candpos)
+void report_elected(struct count_context *ctx,
+		    unsigned int count, unsigned int candpos)
 {
-	draw_empty(counting.out, count-1, candpos, "ELECTED",
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	draw_empty(r->counting.out, count-1, candpos, "ELECTED",
 		   NORMAL_FONT_SIZE/2);
 }
 
-void report_excluded(unsigned int count, unsigned int candpos)
+void report_excluded(struct count_context *ctx,
+		     unsigned int count, unsigned int candpos)
 {
-	draw_empty(counting.out, count-1, candpos, "EXCLUDED",
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	draw_empty(r->counting.out, count-1, candpos, "EXCLUDED",
 		   NORMAL_FONT_SIZE/2);
 }
 
-void report_pending(unsigned int count, const char *name)
+void report_pending(struct count_context *ctx,
+		    unsigned int count, const char *name)
 {
-	append_report(&distribution.remarks[BOTTOM][count-1],
-		      " %s elected %u.  ", name, get_order_elected());
-	fprintf(distribution.raw,"EL:%u:%s:%u\n",count,name, get_order_elected());
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	append_report(&r->distribution.remarks[BOTTOM][count-1],
+		      " %s elected %u.  ", name, get_order_elected(ctx));
+	fprintf(r->distribution.raw,"EL:%u:%s:%u\n",count,name, get_order_elected(ctx));
 }
 
-void report_tiebreak(unsigned int count, const char *reason, const char *name)
+void report_tiebreak(struct count_context *ctx,
+		     unsigned int count, const char *reason, const char *name)
 {
-	append_report(&distribution.remarks[BOTTOM][count-1],
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	append_report(&r->distribution.remarks[BOTTOM][count-1],
 		      "%s chosen for %s tiebreak.  ", name, reason);
-	fprintf(distribution.raw,"TB:%u:%s:%s\n",count,reason, name);
+	fprintf(r->distribution.raw,"TB:%u:%s:%s\n",count,reason, name);
 }
 
-void report_partially_excluded(unsigned int count, const char *name)
+void report_partially_excluded(struct count_context *ctx,
+			       unsigned int count, const char *name)
 {
-	append_report(&distribution.remarks[BOTTOM][count-1],
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	append_report(&r->distribution.remarks[BOTTOM][count-1],
 		      "%s partially excluded.  ", name);
 	
-	fprintf(distribution.raw,"PE:%u:%s\n",count, name);
+	fprintf(r->distribution.raw,"PE:%u:%s\n",count, name);
 }
 
-void report_fully_excluded(unsigned int count, const char *name)
+void report_fully_excluded(struct count_context *ctx,
+			   unsigned int count, const char *name)
 {
-	append_report(&distribution.remarks[BOTTOM][count-1],
+	struct report *r = ctx->report;
+
+	if (!r)
+		return;
+	append_report(&r->distribution.remarks[BOTTOM][count-1],
 		      "%s fully excluded.  ", name);
-	fprintf(distribution.raw,"FE:%u:%s\n",count, name);
+	fprintf(r->distribution.raw,"FE:%u:%s\n",count, name);
 }
 
 
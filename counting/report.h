@@ -18,86 +18,111 @@
 #include "hare_clark.h"
 #include "fraction.h"
 
-/* Reporting interface: start, abandon (no result), end. */
-extern void report_start(const struct election *, const struct candidate *vacating);
-extern void report_end(unsigned int count, const char *title);
+/* Reporting interface: start, abandon (no result), end.  The scrutiny
+   sheets (table1.ps, table2.ps) are written to output_dir.  Until
+   report_start, and after report_end, the count is not reported. */
+extern void report_start(struct count_context *ctx,
+			 const struct election *,
+			 const struct candidate *vacating,
+			 const char *output_dir);
+extern void report_end(struct count_context *ctx,
+		       unsigned int count, const char *title);
 
 /* reset the value of the order of election of the next electee */
-extern void reset_order_elected(void);
+extern void reset_order_elected(struct count_context *ctx);
 
 /* return value of counter */
-extern unsigned int  get_order_elected(void);
+extern unsigned int  get_order_elected(const struct count_context *ctx);
 
-/* increment counter, return unincremented value */
-extern unsigned int  increment_order_elected(void);
+/* increment counter, return incremented value */
+extern unsigned int  increment_order_elected(struct count_context *ctx);
 
 /* Report operations */
 
 /* Report the number of informals at start */
-extern void report_informals(unsigned int num_informals);
+extern void report_informals(struct count_context *ctx,
+			     unsigned int num_informals);
 /* Report the quota calculation at start for Table II */
-extern void report_quota(unsigned int num_formals,
+extern void report_quota(struct count_context *ctx,
+			 unsigned int num_formals,
 			 unsigned int num_seats,
 			 unsigned int quota);
 /* Report the ballots and votes exhausted at a given count */
-extern void report_exhausted(unsigned int count,
+extern void report_exhausted(struct count_context *ctx,
+			     unsigned int count,
 			     unsigned int ballots_exhausted,
 			     unsigned int votes_exhausted);
 /* Report the number of ballots transferred to a candidate at a given
    count */
-extern void report_ballots_transferred(unsigned int count,
+extern void report_ballots_transferred(struct count_context *ctx,
+				       unsigned int count,
 				       unsigned int candidx,
 				       enum cand_status status,
 				       unsigned int ballots_added);
 /* Report the number of votes transferred to a candidate at a given
    count */
-extern void report_votes_transferred(unsigned int count,
+extern void report_votes_transferred(struct count_context *ctx,
+				     unsigned int count,
 				     unsigned int candpos,
 				     enum cand_status status,
 				     int added,
 				     unsigned int new_total);
 /* Report total number of votes and ballots after a given count */
-extern void report_totals(unsigned int count,
+extern void report_totals(struct count_context *ctx,
+			  unsigned int count,
 			  unsigned int votes,
 			  unsigned int ballots);
 /* Report transfer value, and votes transferred to table II at a given count */
-extern void report_transfer(unsigned int count,
+extern void report_transfer(struct count_context *ctx,
+			    unsigned int count,
 			    struct fraction value,
 			    unsigned int votes_transferred);
 /* Whose papers are we distributing at the given count? */
-extern void report_distribution(unsigned int count, const char *name);
+extern void report_distribution(struct count_context *ctx,
+				unsigned int count, const char *name);
 /* What previous count did the papers at this count come from? */
-extern void report_distrib_from_count(unsigned int count,
+extern void report_distrib_from_count(struct count_context *ctx,
+				      unsigned int count,
 				      unsigned int prev_count);
 /* Report loss/gain by fraction at a given count */
-extern void report_lost_or_gained(unsigned int count, int gained);
+extern void report_lost_or_gained(struct count_context *ctx,
+				  unsigned int count, int gained);
 /* Report that a candidate has met/passed quota */
-extern void report_pending(unsigned int count, const char *name);
+extern void report_pending(struct count_context *ctx,
+			   unsigned int count, const char *name);
 /* Report that a tiebreak decision was needed */
-extern void report_tiebreak(unsigned int count, const char *reason,
+extern void report_tiebreak(struct count_context *ctx,
+			    unsigned int count, const char *reason,
 			    const char *name);
 /* Report that a candidate is elected */
-extern void report_elected(unsigned int count, unsigned int candpos);
+extern void report_elected(struct count_context *ctx,
+			   unsigned int count, unsigned int candpos);
 /* Report that a candidate is first excluded */
-extern void report_excluded(unsigned int count, unsigned int candpos);
+extern void report_excluded(struct count_context *ctx,
+			    unsigned int count, unsigned int candpos);
 /* Report that a candidate is partially excluded */
-extern void report_partially_excluded(unsigned int count, const char *name);
+extern void report_partially_excluded(struct count_context *ctx,
+				      unsigned int count, const char *name);
 /* Report that a candidate is fully excluded */
-extern void report_fully_excluded(unsigned int count, const char *name);
+extern void report_fully_excluded(struct count_context *ctx,
+				  unsigned int count, const char *name);
 
 /* Get the quota (for casual vacancy) */
-extern unsigned int report_get_quota(void);
+extern unsigned int report_get_quota(const struct count_context *ctx);
 
 /* Report majority (for casual vacancy) */
-extern void report_majority(unsigned int count, unsigned int majority);
+extern void report_majority(struct count_context *ctx,
+			    unsigned int count, unsigned int majority);
 
 /* Report the vacating members vote total */
-extern void report_vacancy_total_votes(unsigned int total);
+extern void report_vacancy_total_votes(struct count_context *ctx,
+				       unsigned int total);
 
 /* Report the vacating members ballot  total */
-extern void report_vacancy_total_ballots(unsigned int total);
+extern void report_vacancy_total_ballots(struct count_context *ctx,
+					 unsigned int total);
 
 /* print a newline to the raw data file for table 1 (counting)*/
-void counting_raw_newline(void);
+void counting_raw_newline(struct count_context *ctx);
 
 #endif /*_REPORT_H*/
@@ -22,6 +22,7 @@
 
 #include <common/database.h>
 #include <common/evacs.h>
+#include <common/preference_codec.h>
 #include "report_common_routines.h"
 
 // The size of the fonts used for the rports
@@ -259,7 +260,8 @@ static void open_raw_file(const char *electorate_name) {
   The routine 'get_first_preference' is used to return an identifier
    to a candidate with the first preference.
   The routines parameters are:
-   preference_list - a string containing the preferences, in numerical order
+   preference_list - the preferences, in numerical order (not terminated)
+   length          - the number of characters in preference_list
    candidate_index - returns the identifier to the candidate with the first
                       preference for a formal vote.
    party_index     - returns the identifer to the party of the candidate with
@@ -267,60 +269,125 @@ static void open_raw_file(const char *electorate_name) {
    informal        - set to True if the vote is informal; i.e. the number of
                       preferences = 0. Otherwise a value of False is returned.
 */
-static void  get_first_preference(char         *preference_list,
+static void  get_first_preference(const char   *preference_list,
+                                  unsigned int  length,
                                   unsigned int *candidate_index,
                                   unsigned int *party_index,
                                   bool         *informal) {
 
-   unsigned int       i, num_prefs;
-   char              *pref_ptr;
-   struct preference *preference_data;
-
-   // fprintf(stderr, "\nEntered get_first_preference\n");
-   // fprintf(stderr, "   preference_list: '%s'\n", preference_list);
+   const char   *pref_ptr;
+   unsigned int  prefnum, group_index, db_candidate_index;
 
    *candidate_index = 0;
    *party_index     = 0;
    *informal        = true;
 
-   preference_data  = malloc(sizeof(struct preference));
-   for (pref_ptr = (char *)preference_list, num_prefs = 0;
-        strlen(pref_ptr) >= DIGITS_PER_PREF;
-        pref_ptr += DIGITS_PER_PREF*sizeof(char), num_prefs++);
-
-   /* Sanity Check: pref_ptr should be at end of string */
-   if (strlen(pref_ptr))
-      bailout("malformed pref list '%s'\n",
-              preference_list);
-
-
-   /* Decode preference list into memory structure */
-   for (pref_ptr = preference_list, i = 0;
-        i < num_prefs;
-        i++, pref_ptr += DIGITS_PER_PREF*sizeof(char)) {
+   /* Sanity Check: whole number of preferences */
+   if (length % DIGITS_PER_PREF)
+      bailout("malformed pref list '%.*s'\n",
+              (int)length, preference_list);
 
-      sscanf(pref_ptr, (const char *)"%2u%2u%2u",
-             &preference_data->prefnum,
-             &preference_data->group_index,
-             &preference_data->db_candidate_index);
+   /* Find the first preference */
+   for (pref_ptr = preference_list;
+        pref_ptr < preference_list + length;
+        pref_ptr += DIGITS_PER_PREF) {
 
-      // fprintf(stderr, "i=%u\n", i);
-      // fprintf(stderr, "prefnum: .......... %u\n", preference_data->prefnum);
-      // fprintf(stderr, "group_index: ...... %u\n", preference_data->group_index);
-      // fprintf(stderr, "db_candidate_index: %u\n", preference_data->db_candidate_index);
+      if (!decode_preference(pref_ptr, &prefnum,
+                             &group_index, &db_candidate_index))
+         bailout("malformed pref list '%.6s'\n", pref_ptr);
 
-      if (preference_data->prefnum == 1) {
-         *candidate_index = preference_data->db_candidate_index;
-         *party_index     = preference_data->group_index;
+      if (prefnum == 1) {
+         *party_index     = group_index;
+         *candidate_index = db_candidate_index;
          *informal        = false;
-         free(preference_data);
-         // fprintf(stderr, "Leaving get_first_preference\n");
          return;
          }
    }
-   free(preference_data);
-   // fprintf(stderr, "ERROR: Leaving get_first_preference - didn't find 1st preference\n");
-} //get_prefs_for_entry
+} //get_first_preference
+
+// ===========================================================================
+/*
+  The structure 'preference_tally' carries what 'tally_paper' needs to
+   bucket each paper streamed from the database into 'preferences[][]'.
+  pp_column maps a polling place code to its column (or -1), and
+   cand_row maps [party][candidate] indexes to a candidate's row (or -1),
+   so that no searching is done per paper.
+*/
+#define MAX_INDEX 100
+
+struct preference_tally {
+   unsigned int  col_size;
+   unsigned int *preferences;        // [row_size][col_size]
+   unsigned int  row_pp_total;
+   unsigned int  row_pp_informal;
+   unsigned int  max_pp_code;
+   int          *pp_column;          // [max_pp_code + 1]
+   int           cand_row[MAX_INDEX][MAX_INDEX];
+};
+
+// ---------------------------------------------------------------------------
+/*
+  The routine 'read_number' reads a decimal number from the text COPY
+   row, and leaves the pointer at the character after it.
+*/
+static unsigned int read_number(const char **pp, const char *end) {
+
+   unsigned int value = 0;
+   const char  *p     = *pp;
+
+   if (p == end || *p < '0' || *p > '9')
+      bailout("malformed COPY row for polling place report\n");
+   while (p < end && *p >= '0' && *p <= '9')
+      value = value * 10 + (*p++ - '0');
+   *pp = p;
+   return value;
+} // read_number()
+
+// ---------------------------------------------------------------------------
+/*
+  The routine 'tally_paper' is called by SQL_copy_out for each paper in
+   the electorate: a text COPY row of polling place code, a tab, and the
+   preference list.
+*/
+static void tally_paper(const char *row, int len, void *data) {
+
+   struct preference_tally *tally = data;
+   const char   *p   = row;
+   const char   *end = row + len;
+   unsigned int  pp_code, candidate_number, party_number;
+   int           column, cand_row;
+   bool          informal;
+
+   if (end > p && end[-1] == '\n')
+      end--;
+
+   pp_code = read_number(&p, end);
+   if (p == end || *p++ != '\t')
+      bailout("malformed COPY row for polling place report\n");
+
+   // Only the polling places in the report are counted
+
+   if (pp_code > tally->max_pp_code || tally->pp_column[pp_code] < 0)
+      return;
+   column = tally->pp_column[pp_code];
+
+   tally->preferences[tally->row_pp_total * tally->col_size + column]++;
+
+   // A NULL preference list comes through as \N: count it as informal
+
+   if (end - p == 2 && p[0] == '\\' && p[1] == 'N')
+      p = end;
+   get_first_preference(p, end - p, &candidate_number, &party_number,
+                        &informal);
+
+   if (informal) {
+      tally->preferences[tally->row_pp_informal * tally->col_size + column]++;
+   } else if (party_number < MAX_INDEX && candidate_number < MAX_INDEX) {
+      cand_row = tally->cand_row[party_number][candidate_number];
+      if (cand_row >= 0)
+         tally->preferences[cand_row * tally->col_size + column]++;
+   }
+} // tally_paper()
 
 /* SIPL 2014-05-20 Now require electorate names in normalized form, so
    they can be used in a database query.  */
@@ -332,6 +399,8 @@ static void  get_first_preference(char         *preference_list,
   The routine also calculate the number of formal, informal, and total votes for
    each polling place, as well as the number of first preferences received by each
    candidate from all polling places.
+  Each confirmed votes table is read once, with its papers bucketed by
+   polling place as they are streamed, rather than queried per polling place.
 */
 static void get_preference_information (      PGconn        *conn,
                                               unsigned int  number_of_electorates,
@@ -343,13 +412,12 @@ static void get_preference_information (      PGconn        *conn,
                                         const unsigned int  col_size,
                                               unsigned int  preferences[row_size][col_size]) {
 
-   PGresult     *result_preference_list;
+   struct preference_tally tally;
 
-   unsigned int number_of_papers;
    unsigned int candidate_index;
    unsigned int electorate_index;
-   unsigned int paper_index;
    unsigned int polling_place_index;
+   unsigned int pp_code, party, candidate;
 
    unsigned int row_polling_place_index    = row_data[RPP_CODES_INDEX];
    unsigned int row_first_candidate        = row_data[RFIRST_CANDIDATE_INDEX];
@@ -362,102 +430,62 @@ static void get_preference_information (      PGconn        *conn,
    unsigned int col_count_1st_preferences  = col_data[CCNT_1ST_PREF_INDEX];
    unsigned int number_of_polling_places   = col_data[CNUM_PPLACES];
 
-   unsigned int *candidate_number = malloc(sizeof(unsigned int));
-   unsigned int *party_number     = malloc(sizeof(unsigned int));
-   bool         *informal         = malloc(sizeof(bool));
+   // Build the lookups used to bucket each paper
 
-   // fprintf(stderr, "\nEntered get_preference_information\n");
-   // fprintf(stderr, "   number_of_electorates: ... %u\n", number_of_electorates);
-   // fprintf(stderr, "   electorate_code: ......... %u\n", electorate_code);
-   // fprintf(stderr, "   number_of_candidates: .... %u\n", number_of_candidates);
-   // fprintf(stderr, "   number_of_polling_places:  %u\n", number_of_polling_places);
-   // fprintf(stderr, "   row_size: ................ %u\n", row_size);
-   // fprintf(stderr, "   col_size: ................ %u\n", col_size);
+   tally.col_size        = col_size;
+   tally.preferences     = &preferences[0][0];
+   tally.row_pp_total    = row_data[RPP_TOTAL_INDEX];
+   tally.row_pp_informal = row_data[RCNT_INFORMAL_VOTES_INDEX];
 
-   // fprintf(stderr, "row_polling_place_index is . %u\n", row_polling_place_index);
-   // fprintf(stderr, "row_first_candidate is ..... %u\n", row_first_candidate);
-   // fprintf(stderr, "row_pp_count_formal_votes is %u\n", row_pp_count_formal_votes);
-   // fprintf(stderr, "col_candidate_index is ..... %u\n", col_candidate_index);
-   // fprintf(stderr, "col_party_index is ......... %u\n", col_party_index);
-   // fprintf(stderr, "col_first_polling_place is . %u\n", col_first_polling_place);
-   // fprintf(stderr, "col_count_1st_preferences is %u\n", col_count_1st_preferences);
+   tally.max_pp_code = 0;
+   for (polling_place_index = col_first_polling_place;
+        polling_place_index < col_first_polling_place + number_of_polling_places;
+        polling_place_index++) {
+      pp_code = preferences[row_polling_place_index][polling_place_index];
+      if (pp_code > tally.max_pp_code)
+         tally.max_pp_code = pp_code;
+   }
+   tally.pp_column = malloc(sizeof(int) * (tally.max_pp_code + 1));
+   if (!tally.pp_column)
+      bailout("Out of memory building polling place lookup\n");
+   memset(tally.pp_column, -1, sizeof(int) * (tally.max_pp_code + 1));
+   for (polling_place_index = col_first_polling_place;
+        polling_place_index < col_first_polling_place + number_of_polling_places;
+        polling_place_index++) {
+      pp_code = preferences[row_polling_place_index][polling_place_index];
+      if (tally.pp_column[pp_code] < 0)
+         tally.pp_column[pp_code] = polling_place_index;
+   }
 
-   *candidate_number = 0;
-   *party_number     = 0;
-   *informal         = true;
+   memset(tally.cand_row, -1, sizeof(tally.cand_row));
+   for (candidate_index = row_first_candidate;
+        candidate_index < row_first_candidate + number_of_candidates;
+        candidate_index++) {
+      candidate = preferences[candidate_index][col_candidate_index];
+      party     = preferences[candidate_index][col_party_index];
+      if (party < MAX_INDEX && candidate < MAX_INDEX)
+         tally.cand_row[party][candidate] = candidate_index;
+   }
 
-   // check the confirmed votes table for each elecorate
+   // check the confirmed votes table for each elecorate: one pass over
+   //  each, with every polling place bucketed as the papers stream in
 
    for (electorate_index = 0; electorate_index < number_of_electorates; electorate_index++) {
 
-      // for each polling place
-
-      for (polling_place_index = col_first_polling_place;
-           polling_place_index < col_first_polling_place + number_of_polling_places;
-           polling_place_index++) {
-
-         // fprintf(stderr,
-         //         "Issue sql query: SELECT c.preference_list FROM %s_confirmed_vote c, batch b\n"
-         //                                    "WHERE c.batch_number = b.number "
-         //                                       "AND b.polling_place_code = %u "
-         //                                       "AND b.electorate_code = %u;\n",
-         //                                    electorate_names[electorate_index],
-         //                                    preferences[row_polling_place_index][polling_place_index],
-         //                                    current_electorates_code);
-
-         // Obtain the preferences for the current electorate
-
 	      /* SIPL 2014-05-20 Note the requirement to pass in electorate
 		 names in normalized form, so they can be used in this query.
 	      */
-         result_preference_list = SQL_query(conn,
-                                            "SELECT c.preference_list FROM %s_confirmed_vote c, batch b "
-                                            "WHERE c.batch_number = b.number "
-                                               "AND b.polling_place_code = %u "
-                                               "AND b.electorate_code = %u;",
-                                            electorate_names[electorate_index],
-                                            preferences[row_polling_place_index][polling_place_index],
-                                            current_electorates_code);
-
-         number_of_papers = PQntuples(result_preference_list);
-
-         // fprintf(stderr, "number_of_papers is %u\n", number_of_papers);
-         preferences[row_data[RPP_TOTAL_INDEX]][polling_place_index] += number_of_papers;
-
-         // fprintf(stderr, "Total votes preferences[%u][%u] is %u\n",
-         //         row_data[RPP_TOTAL_INDEX], polling_place_index,
-         //         preferences[row_data[RPP_TOTAL_INDEX]][polling_place_index]);
-
-         for (paper_index = 0; paper_index < number_of_papers; paper_index++) {
-            get_first_preference(PQgetvalue(result_preference_list, paper_index, 0),
-                                 candidate_number,
-                                 party_number,
-                                 informal);
-            if (*informal) {
-               preferences[row_data[RCNT_INFORMAL_VOTES_INDEX]][polling_place_index]++;
-
-            } else {
-
-                 // Need to match up the entry in preferences[][] for the candidate returned by
-                 //  'get_first_preference'.
-
-                 for (candidate_index = row_first_candidate;
-                      candidate_index < row_first_candidate + number_of_candidates;
-                      candidate_index++) {
-
-                    if ((preferences[candidate_index][col_candidate_index] == *candidate_number)
-                         && (preferences[candidate_index][col_party_index] == *party_number) ) {
-                        preferences[candidate_index][polling_place_index]++;
-                        // fprintf(stderr, "inc preferences[%u][%u] to %u\n",
-                        //      candidate_index, polling_place_index,
-                        //      preferences[candidate_index][polling_place_index]);
-                    }
-                 }
-              }
-         } //for paper_index
-      } //for polling_place_index
+      SQL_copy_out(conn, &tally_paper, &tally,
+                   "COPY (SELECT b.polling_place_code, c.preference_list "
+                         "FROM %s_confirmed_vote c, batch b "
+                         "WHERE c.batch_number = b.number "
+                            "AND b.electorate_code = %u) TO STDOUT;",
+                   electorate_names[electorate_index],
+                   current_electorates_code);
    }//for electorate_index
 
+   free(tally.pp_column);
+
    // fprintf(stderr, "count for polling place\n");
 
    for (polling_place_index = col_first_polling_place;
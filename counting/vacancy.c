@@ -30,6 +30,7 @@
 #include "ballot_iterators.h"
 #include "candidate_iterators.h"
 #include "count.h"
+#include "checkpoint.h"
 
 /* Get electorate */
 static struct electorate *prompt_for_electorate(PGconn *conn)
@@ -39,7 +40,8 @@ static struct electorate *prompt_for_electorate(PGconn *conn)
 
 	do {
 		printf("Please enter the electorate name to count: ");
-		get_next_line(&name);
+		if (get_next_line(&name) < 0)
+			bailout("No electorate name given\n");
 		elec = fetch_electorate(conn, name);
 		if (!elec)
 			printf("Electorate `%s' not found!\n", name);
@@ -54,7 +56,9 @@ static bool prompt_for_new_vacancy()
 	char *answer;
 
 	printf("Another Casual Vacancy for this electorate? [n/Y]: ");
-	get_next_line(&answer);
+	/* No more answers: no more vacancies */
+	if (get_next_line(&answer) < 0)
+		return false;
 
 	/* Nothing to do if no candidates deceased. */
 	if (answer[0] != 'n' && answer[0] != 'N') {
@@ -82,7 +86,8 @@ static struct candidate *vacating_candidate(struct cand_list *candidates)
 
 	do {
 		printf("Please enter the vacating candidate name: ");
-		get_next_line(&name);
+		if (get_next_line(&name) < 0)
+			bailout("No vacating candidate given\n");
 		printf("%s\n",name);
 
 		ret = any_candidates(candidates, &match_name, name);
@@ -96,11 +101,7 @@ static struct candidate *vacating_candidate(struct cand_list *candidates)
 
 static bool free_piles(struct candidate *cand, void *unused)
 {
-	unsigned int i;
-
-	for (i = 0; i < MAX_COUNTS; i++)
-		if (cand->c[i].pile)
-			free_ballot_list(cand->c[i].pile);
+	free_history(&cand->history);
 
 	return false;
 }
@@ -133,7 +134,8 @@ static unsigned int selected(struct candidate *cand, void *vacating)
 
 	printf("Candidate `%s' from `%s' [y/N]: ",
 	       cand->name, cand->group->name);
-	get_next_line(&answer);
+	if (get_next_line(&answer) < 0)
+		return 0;
 	if (toupper(answer[0]) == 'Y') {
 		free(answer);
 		/* Reset their status to CONTINUING */
@@ -167,7 +169,6 @@ static struct cand_list *get_standings(struct cand_list *all,
 
 static bool clear_candidate(struct candidate *candidate, void *vacating)
 {
-	unsigned int i;
 	if (candidate == vacating) return false;
 	printf("Position %u: %s                                 "
 	       "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b"
@@ -179,11 +180,7 @@ static bool clear_candidate(struct candidate *candidate, void *vacating)
 	candidate->status = CAND_CONTINUING;
 	candidate->count_when_quota_reached = 0;
 	/* Clear totals and ballot piles */
-	for (i = 0; i < MAX_COUNTS; i++) {
-		candidate->c[i].total = 0;
-		free_ballot_list(candidate->c[i].pile);
-		candidate->c[i].pile = NULL;
-	}
+	free_history(&candidate->history);
 	return false;
 }
 
@@ -230,18 +227,20 @@ static void dump_prefs(struct ballot *ballot,
 }
 */
 
+/* The candidates still standing during H-C, and the vacating one */
+struct standing
+{
+	struct candidate *vacating;
+	struct cand_index *index;
+};
+
 /* Return true if the ballot is exhausted */
 static bool is_exhausted(struct ballot *ballot,
-			 void *candidates)
+			 void *standing_void)
 {
 	unsigned int h,i;
-	struct candidate *vacating;
-	struct cand_list *j,*k,*candidate_list;
-
-	candidate_list = candidates;
-	/* retrieve vacating candidate (last on list)*/
-	for (j=candidates; j->next ;j=j->next,k=j);
-	vacating = j->cand;
+	struct standing *standing = standing_void;
+	struct candidate *vacating = standing->vacating;
 
 	/* First find candidate on ballot */
 	for (i = 0; !matches(vacating, &ballot->prefs[i]); i++) {
@@ -255,9 +254,7 @@ static bool is_exhausted(struct ballot *ballot,
 
   /* is there a later choice for a candidate still standing (during H-C)??  */
 	for(h=i+1; h <  ballot->num_preferences ; h++) {
-		if ( any_candidates(candidates,
-				    (selectfn_t)&matches,
-				    &ballot->prefs[h]))
+		if (lookup_candidate(standing->index, &ballot->prefs[h]))
 			/* Yes, so ballot not exhausted */
 			return false;
 	}
@@ -270,19 +267,22 @@ static bool is_exhausted(struct ballot *ballot,
 static struct fraction vote_sum(struct ballot_list *ballots)
 {
 	struct fraction sum = fraction_zero;
-	struct ballot_list *i;
+	unsigned int i;
 
-	for (i = ballots; i; i = i->next) {
-		sum = fraction_add(sum, i->ballot->vote_value);
+	if (!ballots)
+		return sum;
+	for (i = ballots->num_ballots; i > 0; i--) {
+		sum = fraction_add(sum, ballots->store->ballots
+				   [ballots->ids[i - 1]].vote_value);
 	}
 
 	return sum;
 }
 
 /* Return true if the ballot is not exhausted */
-static bool not_exhausted(struct ballot *ballot, void *vacating)
+static bool not_exhausted(struct ballot *ballot, void *standing)
 {
-	return !is_exhausted(ballot, vacating);
+	return !is_exhausted(ballot, standing);
 }
 
 static bool set_vote_value(struct ballot *ballot, void *value)
@@ -295,7 +295,8 @@ static bool set_vote_value(struct ballot *ballot, void *value)
    return the non-exhausted ones, with their value altered.
  */
 static struct ballot_list *
-alter_value_nonexhausted(struct ballot_list *piles[0],
+alter_value_nonexhausted(struct count_context *ctx,
+			 struct ballot_list *piles[0],
 			 unsigned int *num_piles,
 			 struct cand_list *candidates,
 			 unsigned int count,
@@ -306,6 +307,7 @@ alter_value_nonexhausted(struct ballot_list *piles[0],
 	unsigned int ncp, n, ncp_by_tv;
 	struct candidate *vacating;
 	struct cand_list *i;
+	struct standing standing;
 
 	struct ballot_list *exhausted, *nonexhausted;
 	struct fraction tv;
@@ -313,13 +315,16 @@ alter_value_nonexhausted(struct ballot_list *piles[0],
 	/* vacating candidate last in linked list */
 	for (i=candidates; i->next ;i=i->next);
 	vacating = i->cand;
+	standing.vacating = vacating;
+	standing.index = new_cand_index(candidates);
 
 	/* STEP 4 */
-	nonexhausted = any_ballots(ballots, (void *)&not_exhausted, candidates);
-	exhausted = any_ballots(ballots, (void *)&is_exhausted, candidates);
+	nonexhausted = any_ballots(ballots, (void *)&not_exhausted, &standing);
+	exhausted = any_ballots(ballots, (void *)&is_exhausted, &standing);
+	free_cand_index(standing.index);
 
 	/* N: number of votes at previous count (if any)*/
-	n = vacating->c[count-1].total;
+	n = cand_count(vacating, count-1)->total;
 
 
 	/* In the case where the vacating candidate was elected over quota,
@@ -338,7 +343,7 @@ alter_value_nonexhausted(struct ballot_list *piles[0],
 	ncp = number_of_ballots(exhausted);
 
 	/* TV: transfer value of ballots */
-	tv = ballots->ballot->vote_value;
+	tv = first_ballot(ballots)->vote_value;
 
 	/* STEP 5 */
 	/* NCP x TV (truncated, but doesn't matter) */
@@ -354,7 +359,7 @@ alter_value_nonexhausted(struct ballot_list *piles[0],
 		value = ((struct fraction){ quota - n,
 					    ncp });
 		for_each_ballot(exhausted, &set_vote_value, &value);
-		report_exhausted(0, number_of_ballots(exhausted),
+		report_exhausted(ctx, 0, number_of_ballots(exhausted),
 				 fraction_truncate(vote_sum(exhausted)));
 		if (exhausted)
 			piles[(*num_piles)++] = exhausted;
@@ -368,7 +373,7 @@ alter_value_nonexhausted(struct ballot_list *piles[0],
 
 		/* STEP 8 */
 		/* Exhausted ballots unchanged value */
-		report_exhausted(0, number_of_ballots(exhausted),
+		report_exhausted(ctx, 0, number_of_ballots(exhausted),
 				 fraction_truncate(vote_sum(exhausted)));
 		if (exhausted)
 			piles[(*num_piles)++] = exhausted;
@@ -394,14 +399,22 @@ static bool set_scrutiny_pos(struct candidate *cand, void *pos)
 }
 
 
-static bool has_majority(struct candidate *cand, void *standing)
+/* The candidates still standing, in the count */
+struct majority_arg
+{
+	const struct count_context *ctx;
+	struct cand_list *standing;
+};
+
+static unsigned int has_majority(struct candidate *cand, void *void_arg)
 {
+	const struct majority_arg *arg = void_arg;
 	unsigned int majority;
 
-	majority = calc_majority(standing);
+	majority = calc_majority(arg->ctx, arg->standing);
 
 	/* On or equal to majority */
-	if (cand->c[get_count_number()].total >= majority)
+	if (cand_count(cand, get_count_number(arg->ctx))->total >= majority)
 		return true;
 	return false;
 }
@@ -417,6 +430,16 @@ static bool is_continuing(struct candidate *cand, void *vacating)
 		return false;
 }
 
+static void usage(const char *name)
+{
+	bailout("Usage: %s [--resume [checkpoint-file]]\n"
+		"  With --resume, pick up the count recorded by "
+		"hare_clark --checkpoint\n"
+		"  (in ~/.evacs/checkpoint.<electorate>.dat, unless "
+		"checkpoint-file is given)\n"
+		"  instead of repeating it.\n", name);
+}
+
 int main(int argc, char *argv[])
 {
 	struct ballot_list *ballots;
@@ -426,9 +449,20 @@ int main(int argc, char *argv[])
 	unsigned int ballots_counted;
 	struct candidate *vacating;
 	struct cand_list *standing, *hc_standing, *winner, *cands_plus_vac;
-	char *title;
-	struct ballot_list *piles[MAX_COUNTS] = { NULL };
+	char *title, *checkpoint = NULL;
+	struct ballot_list **piles;
 	bool overquota;
+	struct count_context ctx;
+	struct majority_arg majority_arg;
+	bool resume = false;
+
+	if (argc > 1) {
+		if (strcmp(argv[1], "--resume") != 0 || argc > 3)
+			usage(argv[0]);
+		resume = true;
+		if (argc == 3)
+			checkpoint = strdup(argv[2]);
+	}
 
 	/* Get the information we need */
 	conn = connect_db(DATABASE_NAME);
@@ -436,6 +470,8 @@ int main(int argc, char *argv[])
 			   DATABASE_NAME,PQerrorMessage(conn));
 
 	e.electorate = prompt_for_electorate(conn);
+	if (resume && !checkpoint)
+		checkpoint = checkpoint_path(e.electorate->name);
 
 	fprintf(stderr,"Fetching Ballots: ");
 	ballots = fetch_ballots(conn, e.electorate);
@@ -443,17 +479,29 @@ int main(int argc, char *argv[])
 	do {
 		e.num_groups = fetch_groups(conn, e.electorate, e.groups);
 		e.candidates = fetch_candidates(conn, e.electorate, e.groups);
+		e.cand_index = new_cand_index(e.candidates);
 		vacating = vacating_candidate(e.candidates);
 
-		/* Start the reporting (we will discard these) */
 		/* STEP 1 */
-		report_start(&e, NULL);
-		fprintf(stderr,"Running Hare-Clark count for %s\n",e.electorate->name);
-		do_count(&e, ballots, vacating);
-		quota = report_get_quota();
-		final_count = get_count_number();
-
-		report_end(final_count, "");
+		init_count_context(&ctx);
+		/* If asked to, pick up the count hare_clark --checkpoint
+		   recorded where the vacating candidate reached quota */
+		if (resume && checkpoint_resume(&ctx, &e, ballots, checkpoint,
+						vacating, &quota)) {
+			fprintf(stderr, "Resuming Hare-Clark count for %s "
+				"from %s at count %u\n", e.electorate->name,
+				checkpoint, get_count_number(&ctx));
+			final_count = get_count_number(&ctx);
+		} else {
+			/* Start the reporting (we will discard these) */
+			report_start(&ctx, &e, NULL, "/tmp");
+			fprintf(stderr,"Running Hare-Clark count for %s\n",e.electorate->name);
+			do_count(&ctx, &e, ballots, vacating);
+			quota = report_get_quota(&ctx);
+			final_count = get_count_number(&ctx);
+
+			report_end(&ctx, final_count, "");
+		}
 
 		if (vacating->status != CAND_PENDING
 		    && vacating->status != CAND_ELECTED)
@@ -467,7 +515,7 @@ int main(int argc, char *argv[])
 			transfer value is calculated - do_count bails when vacating goes
 			over quota.  If another candidate goes over quota on the same count, but with
 			a lower total he/she will not be marked as pending. */
-		mark_pending_candidates(cands_plus_vac, quota, NULL);
+		mark_pending_candidates(&ctx, cands_plus_vac, quota, NULL);
 
 		hc_standing = any_candidates(cands_plus_vac,(void *)&is_continuing,vacating);
 
@@ -475,9 +523,14 @@ int main(int argc, char *argv[])
 		   sum them while we're at it. */
 		/* STEP 3 */
 		printf("\nCollecting Ballots\n");
+		/* One pile per count, and the final count's may be split in
+		   two (exhausted and not) */
+		piles = calloc(final_count + 2, sizeof(piles[0]));
+		if (!piles)
+			bailout("Out of memory collecting ballots\n");
 		total = 0;
 		for (i = 0; i <= final_count; i++)
-			total += fraction_truncate(vote_sum(vacating->c[i].pile));
+			total += fraction_truncate(vote_sum(cand_count(vacating, i)->pile));
 		overquota=false;
 		if (total > quota) {
 			overquota=true;
@@ -490,33 +543,34 @@ int main(int argc, char *argv[])
 		if (overquota == true) {
 			/* Leave the final pile to be altered */
 			for (num_piles = i = 0; i < final_count; i++) {
-				if (vacating->c[i].pile) {
-					piles[num_piles++] = vacating->c[i].pile;
-					vacating->c[i].pile = NULL;
+				if (cand_count(vacating, i)->pile) {
+					piles[num_piles++] = cand_count(vacating, i)->pile;
+					cand_count(vacating, i)->pile = NULL;
 				}
 			}
 
 			/*  *MAY* separate exhausteds into their own pile */
 			temp=num_piles; num_piles++;
 			piles[temp]
-				=alter_value_nonexhausted(piles,
+				=alter_value_nonexhausted(&ctx,
+							  piles,
 							  &num_piles,
 							  hc_standing,
 							  final_count,
 							  quota,
-							  vacating->c[final_count].pile,
+							  cand_count(vacating, final_count)->pile,
 							  e.electorate->num_seats);
 			if (number_of_ballots(piles[temp]) == 0) {
 				/* All ballots exhausted, remove pile*/
 				piles[temp]=piles[--num_piles];
 			}
-			vacating->c[final_count].pile = NULL;
+			cand_count(vacating, final_count)->pile = NULL;
 		} else {
 			/* get ALL piles, including the final count pile*/
 			for (num_piles = i = 0; i <= final_count; i++) {
-				if (vacating->c[i].pile) {
-					piles[num_piles++] = vacating->c[i].pile;
-					vacating->c[i].pile = NULL;
+				if (cand_count(vacating, i)->pile) {
+					piles[num_piles++] = cand_count(vacating, i)->pile;
+					cand_count(vacating, i)->pile = NULL;
 				}
 			}
 		}
@@ -533,13 +587,15 @@ int main(int argc, char *argv[])
 		printf("Resetting Scrutiny\n");
 		free_cand_list(e.candidates);
 		e.candidates = standing;
+		free_cand_index(e.cand_index);
+		e.cand_index = new_cand_index(standing);
 
 		/* Reset positions on scrutiny sheet.*/
 		i=0;
 		for_each_candidate(standing, &set_scrutiny_pos, &i);
 
 		/* Start a new report */
-		report_start(&e, vacating);
+		report_start(&ctx, &e, vacating, "/tmp");
 
 		/* STEP 9 */
 		/* Sort piles into vote value order */
@@ -547,7 +603,8 @@ int main(int argc, char *argv[])
 		qsort(piles, num_piles, sizeof(piles[0]), &compare_vote_values);
 
 		/* STEP 10 */
-		reset_count();
+		reset_count(&ctx);
+		set_candidate_index(&ctx, e.cand_index);
 
 		/* STEP 11 */
 		printf("Freeing ballot memory from Hare Clark counts\n");
@@ -555,10 +612,10 @@ int main(int argc, char *argv[])
 		printf("\nDone\n");
 		/* Complete the partial exclusions for the vacating candidate */
 		/* STEP 12 */
-		vacating->c[0].total = total;
+		cand_count(vacating, 0)->total = total;
 		/* STEP 13 */
 		vacating->status = CAND_BEING_EXCLUDED;
-		report_vacancy_total_votes(total);
+		report_vacancy_total_votes(&ctx, total);
 
 		/* STEP 14 */
 		ballots_counted = 0;
@@ -568,45 +625,52 @@ int main(int argc, char *argv[])
 			   value into one big pile for distribution. */
 			pile_sum = truncated_vote_sum(piles[i]);
 			while (i + 1 < num_piles
-			       && fraction_equal(piles[i]->ballot->vote_value,
-						 piles[i+1]->ballot->vote_value)) {
+			       && fraction_equal(first_ballot(piles[i])->vote_value,
+						 first_ballot(piles[i+1])->vote_value)) {
 				pile_sum += truncated_vote_sum(piles[i+1]);
 				piles[i+1] = join_piles(piles[i], piles[i+1]);
 				piles[i] = NULL;
 				i++;
 			}
 			ballots_counted += number_of_ballots(piles[i]);
-			report_vacancy_total_ballots(ballots_counted);
+			report_vacancy_total_ballots(&ctx, ballots_counted);
 			/* Do the partial exclusion (infinite quota: we always
 			   finish this exclusion process) */
-			partial_exclusion(standing, vacating, piles[i],
+			partial_exclusion(&ctx, standing, vacating, piles[i],
 									1, UINT_MAX, pile_sum, vacating,
 									i == num_piles-1);
 			/* Don't increment count the last time:
 			   exclude_candidate does that */
-			if (i != num_piles - 1) increment_count();
+			if (i != num_piles - 1) increment_count(&ctx);
 			free_ballot_list(piles[i]);
 		}
+		free(piles);
 
 		/* If noone has a majority... */
-		report_majority(get_count_number(), calc_majority(standing));
+		report_majority(&ctx, get_count_number(&ctx),
+				calc_majority(&ctx, standing));
 
 		/* STEP 15 */
-		while (!(winner = any_candidates(standing, (void *)&has_majority, standing))) {
-			exclude_candidate(standing, 1, UINT_MAX, vacating);
-			report_majority(get_count_number(), calc_majority(standing));
+		majority_arg.ctx = &ctx;
+		majority_arg.standing = standing;
+		while (!(winner = any_candidates(standing, &has_majority,
+						 &majority_arg))) {
+			exclude_candidate(&ctx, standing, 1, UINT_MAX, vacating);
+			report_majority(&ctx, get_count_number(&ctx),
+					calc_majority(&ctx, standing));
 		}
 
 		/* STEP 16 */
 		/* Report who was elected (can only be one) */
 		assert(winner->next == NULL);
-		reset_order_elected();
-		increment_order_elected();
-		report_pending(get_count_number(), winner->cand->name);
+		reset_order_elected(&ctx);
+		increment_order_elected(&ctx);
+		report_pending(&ctx, get_count_number(&ctx), winner->cand->name);
 		title = sprintf_malloc("the Casual Vacancy of %s",
 				       vacating->name);
 
-		report_end(get_count_number(), title);
+		report_end(&ctx, get_count_number(&ctx), title);
+		free_count_context(&ctx);
 
 		/* SIPL 2014-03-25 Swapped the following two lines,
 		   so as to free the candidate structs only after they
@@ -615,6 +679,7 @@ int main(int argc, char *argv[])
 		for_each_candidate(e.candidates, &free_piles, NULL);
 		for_each_candidate(e.candidates, &free_candidate, NULL);
 		free_group_names(e.groups, e.num_groups);
+		free_cand_index(e.cand_index);
 		/*  free_electorates(e.electorate);*/
 
 		fprintf(stderr,"\nPrinting Scrutiny\n");
@@ -622,6 +687,7 @@ int main(int argc, char *argv[])
 
 	} while (prompt_for_new_vacancy() == true);
 
+	free(checkpoint);
 	PQfinish(conn);
 
 	return 0;
@@ -104,16 +104,13 @@ static void print_paper(PGconn *conn,
   Print the entries for a paper.
 */
 {
-	PGresult *result;
 	struct entry_with_error *e, *a1={ NULL }, *a2={ NULL };
 	char *candidate_name, *candidate_name1, *candidate_name2;
 	unsigned int i,pref_limit=0;
 	unsigned int temp = 0;
-	int entry_id1=0, entry_id2=0, paper_id;
+	int entry_id1, entry_id2;
 	unsigned int entry_index=num_entries(p);
 	char *electorate_name=resolve_electorate_name(conn,e_code);
-	/* SIPL 2014-05-20 Support electorate names with spaces. */
-	char *electorate_name_normalized=resolve_electorate_name_normalized(conn,e_code);
 	char *active_flag;
 	const char *tab         = (char *) "\t";
 	const char *dbltab      = (char *) "\t\t";	
@@ -130,42 +127,9 @@ static void print_paper(PGconn *conn,
 	fprintf(stderr, "    batch_number %u\n", batch_number);
 	fprintf(stderr, "PP: electorate_name is '%s'\n", electorate_name);
 
-	/* retrieve active entries */
-	fprintf(stderr,
-		"\nPP: Issue sql query: SELECT id FROM %s_paper "
-		"WHERE batch_number = %u AND index = %u;\n",
-		electorate_name_normalized,
-		batch_number, p->p.index);
-
-	paper_id = SQL_singleton_int(conn,
-				     "SELECT id "
-				     "FROM %s_paper "
-				     "WHERE batch_number = %u "
-				     "AND index = %u;",
-				     electorate_name_normalized, 
-				     batch_number,p->p.index);
-
-	fprintf(stderr, "PP: paper_id is %u\n", paper_id);
-
-	fprintf(stderr,
-		"\nPP: Issue sql query: "
-		"SELECT entry_id1, entry_id2 "
-		"FROM %s_paper WHERE id = %u;\n",
-		electorate_name_normalized,
-		paper_id);
-
-	result = SQL_query(conn,
-			   "SELECT entry_id1, entry_id2 "
-			   "FROM %s_paper WHERE id = %u;",
-			   electorate_name_normalized, paper_id
-		);
-	
-	if (PQntuples(result) > 0 ) { 
-		entry_id1 = atoi(PQgetvalue(result,0,0));
-		entry_id2 = atoi(PQgetvalue(result,0,1));
-	} 
-	
-	PQclear(result);
+	/* active entries were loaded with the paper */
+	entry_id1 = p->p.active_entry1;
+	entry_id2 = p->p.active_entry2;
 
 	/* iterate through every entry of this paper */
 
@@ -414,7 +378,6 @@ static void print_paper(PGconn *conn,
 	/* SIPL 2014-05-20 Free these strings. (Why wasn't electorate_name)
 	   freed before?) */
 	free(electorate_name);
-	free(electorate_name_normalized);
 
    fprintf(stderr, "PP: Leaving print_paper\n");
 }
@@ -1178,28 +1141,47 @@ static void store_comm_batch_num(PGconn *conn,unsigned int batch_number)
 }
 
 
+/* First preferences for one candidate in the batch being committed */
+struct first_preference_tally {
+	unsigned int group_index;
+	unsigned int db_candidate_index;
+	unsigned int count;
+};
+
+/* Milliseconds on a monotonic clock, for timing the commit */
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
 /* DDS3.28: Commit Votes */
 static void commit_votes(PGconn *conn,unsigned int batch_number,
 			   struct normalised_preference *np)
 /*
   Saves the Normalised Preferences to the Confirmed Vote details store
   and adds the batch number to the confirmed votes store.
+  The votes and the batch's election night summaries are worked out
+  first, so the summary tables are locked only for one statement
+  each.
 */
 {
 	struct electorate *electorate = 
 		(struct electorate *)  get_voter_electorate();
-	int polling_place_code, i;
+	int polling_place_code;
+	unsigned int i, j, num_votes = 0, informal_count = 0, num_tallies = 0;
 	unsigned int electorate_code = electorate->code;
 	char *electorate_name = electorate->name;
+	struct normalised_preference *vote;
+	struct first_preference_tally *tallies = NULL;
+	char *rows, *row, *values, *v;
+	double lock_start;
 
 	/* SIPL 2014-05-20 Support electorate names with spaces. */
 	char electorate_name_normalized[strlen(electorate->name) + 1];
 
-	/* SIPL 2011-09-26 Increase array size by one to allow
-	   space for null at end, to cope with the case where there
-	   really are PREFNUM_MAX preferences in the vote. */
-	char preference_string[PREFNUM_MAX * DIGITS_PER_PREF + 1],
-		*pref_ptr, *p;
 	char  *timestamp = generate_sortable_timestamp();
 
 	fprintf(stderr, "\nEntered commit_votes\n");
@@ -1222,67 +1204,140 @@ static void commit_votes(PGconn *conn,unsigned int batch_number,
 	if (polling_place_code == -1)
 		bailout("Can't resolve polling place for batch %u\n", 
 			batch_number);
+
+	for (vote=np; vote; vote=vote->next)
+		num_votes++;
+
+	/* Build a <elec>_confirmed_vote row for each set of prefs in
+	   normalised preferences list, and summarise them for election
+	   night */
+	rows = row = malloc(num_votes * (2 * INT_CHARS + strlen(timestamp)
+					 + PREFNUM_MAX * DIGITS_PER_PREF + 4)
+			    + 1);
+	if (!rows)
+		bailout("Out of memory committing batch %u\n", batch_number);
+	*row = '\0';
+	for (vote=np; vote; vote=vote->next) {
+		row += sprintf(row, "%u\t%s\t%u\t",
+			       batch_number, timestamp,
+			       vote->n.paper_version);
+		for (i=0;i < vote->n.num_preferences;i++) {
+			const struct preference *pref = &vote->preferences[i];
+
+			row += sprintf(row, "%02u%02u%02u",
+				       pref->prefnum,
+				       pref->group_index,
+				       pref->db_candidate_index);
+			if (pref->prefnum != 1)
+				continue;
+
+			for (j=0; j < num_tallies; j++)
+				if (tallies[j].group_index == pref->group_index
+				    && tallies[j].db_candidate_index
+				       == pref->db_candidate_index)
+					break;
+			if (j == num_tallies) {
+				tallies = realloc(tallies, sizeof(*tallies)
+						  * (num_tallies + 1));
+				if (!tallies)
+					bailout("Out of memory committing "
+						"batch %u\n", batch_number);
+				tallies[j].group_index = pref->group_index;
+				tallies[j].db_candidate_index
+					= pref->db_candidate_index;
+				tallies[j].count = 0;
+				num_tallies++;
+			}
+			tallies[j].count++;
+		}
+		*row++ = '\n';
+		*row = '\0';
+		if (vote->n.num_preferences == 0)
+			informal_count++;
+	}
+
+	values = v = malloc(num_tallies * (sizeof("(,,,,0,,0),")
+					   + 5 * INT_CHARS) + 1);
+	if (!values)
+		bailout("Out of memory committing batch %u\n", batch_number);
+	*v = '\0';
+	for (i=0; i < num_tallies; i++)
+		v += sprintf(v, "%s(%u,%u,%u,%u,0,%u,0)",
+			     i ? "," : "",
+			     electorate_code, polling_place_code,
+			     tallies[i].group_index,
+			     tallies[i].db_candidate_index,
+			     tallies[i].count);
+
 	/* Begin the transaction */
 	begin(conn);
-	
-	/* Prevent race condition in SELECT - INSERT or UPDATE code */
-	SQL_command(conn,"LOCK TABLE vote_summary IN EXCLUSIVE MODE;");
-	SQL_command(conn,"LOCK TABLE preference_summary IN EXCLUSIVE MODE;");
 
-	/* Build vote for each set of prefs in normalised preferences list */
-	for(np=np; np; np=np->next) {
-		update_vote_summary(conn,np,polling_place_code, electorate_code);
-		/* Store preferences for vote in <elec>_confirmed_vote  table */
-		/* first build up preference string */
-		pref_ptr = &preference_string[0];
-
-		/* start with empty preference string */
-		strcpy(pref_ptr,(const char *) "");
-		for (i=0;i < np->n.num_preferences;i++) {
-			p = sprintf_malloc("%02u%02u%02u",
-					   np->preferences[i].prefnum,
-					   np->preferences[i].group_index,
-					   np->preferences[i].db_candidate_index
-				);
-			strcpy(pref_ptr,p);
-			pref_ptr +=  (sizeof(char)*(DIGITS_PER_PREF));
-			free(p);
-			
-			/* Summarise first preferences for election night */
-			update_preference_summary(conn,
-						  &np->preferences[i],
-						  polling_place_code, 
-						  electorate_code);
-		}
-	
-	/* Store vote in confirmed vote table */
-		fprintf(stderr,
-			"\nIssue sql command: INSERT INTO "
-			"%s_confirmed_vote (batch_number, time_stamp, "
-			"paper_version, preference_list) "
-			"VALUES(%u, '%s', %u, '%s');",
-			electorate_name_normalized,
-			batch_number,
-			timestamp,
-			np->n.paper_version,
-			&preference_string[0]);
+	/* Store votes in confirmed vote table */
+	fprintf(stderr,
+		"\nIssue sql command: COPY %s_confirmed_vote "
+		"(batch_number, time_stamp, paper_version, "
+		"preference_list) FROM STDIN; (%u votes)\n",
+		electorate_name_normalized, num_votes);
+
+	SQL_copy_in(conn,
+		    "COPY %s_confirmed_vote "
+		    "(batch_number, time_stamp, paper_version, "
+		    "preference_list) "
+		    "FROM STDIN;",
+		    electorate_name_normalized);
+	if (num_votes > 0)
+		SQL_copy_row(conn, "%s", rows);
+	if (SQL_copy_end(conn) != num_votes)
+		bailout("Batch %u: not all votes were stored\n", batch_number);
 
-		SQL_command(conn,
-			    "INSERT INTO %s_confirmed_vote "
-			    "(batch_number, time_stamp, paper_version, "
-			    "preference_list) "
-			    "VALUES(%u,'%s',%u,'%s');",
-			    electorate_name_normalized,
-			    batch_number,
-			    timestamp,
-			    np->n.paper_version,
-			    &preference_string[0]);
-	
-	}
 	/* Store committed batch number */
 	store_comm_batch_num(conn,batch_number);
+
+	/* Prevent race condition in UPDATE - INSERT of vote_summary */
+	lock_start = now_ms();
+	SQL_command(conn,"LOCK TABLE vote_summary IN EXCLUSIVE MODE;");
+	SQL_command(conn,"LOCK TABLE preference_summary IN EXCLUSIVE MODE;");
+
+	SQL_command(conn,
+		    "WITH updated AS ("
+		    "UPDATE vote_summary "
+		    "SET informal_count = informal_count + %u,"
+		        "entered_by = 'EVACS',"
+		        "entered_at = 'NOW' "
+		    "WHERE electorate_code = %u "
+		    "AND polling_place_code = %d "
+		    "RETURNING 1) "
+		    "INSERT INTO vote_summary "
+		    "(electorate_code,polling_place_code,"
+		    "entered_by,entered_at,informal_count) "
+		    "SELECT %u,%d,'EVACS','NOW',%u "
+		    "WHERE NOT EXISTS (SELECT 1 FROM updated);",
+		    informal_count, electorate_code, polling_place_code,
+		    electorate_code, polling_place_code, informal_count);
+
+	/* Summarise first preferences for election night */
+	if (num_tallies > 0)
+		SQL_command(conn,"INSERT INTO preference_summary"
+			    "(electorate_code,"
+			    "polling_place_code,party_index,"
+			    "candidate_index,phoned_primary,"
+			    "evacs_primary,final_count) "
+			    "VALUES %s "
+			    "ON CONFLICT (electorate_code,polling_place_code,"
+			    "party_index,candidate_index) "
+			    "DO UPDATE SET evacs_primary = "
+			    "preference_summary.evacs_primary "
+			    "+ EXCLUDED.evacs_primary;",
+			    values);
+
 	/* End the transaction */
 	commit(conn);
+	fprintf(stderr, "Summary tables locked for %.2f ms\n",
+		now_ms() - lock_start);
+
+	free(values);
+	free(tallies);
+	free(rows);
 	free(timestamp);
 
 	printf("Batch %u committed for counting.\n", batch_number);
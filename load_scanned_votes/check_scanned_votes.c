@@ -16,8 +16,6 @@
 
 /* Check scanned votes */
 
-/* For isdigit() */
-#include <ctype.h>
 #include <signal.h>
 /* For varargs */
 #include <stdarg.h>
@@ -27,6 +25,7 @@
 #include <string.h>
 
 #include <common/evacs.h>
+#include <common/preference_codec.h>
 #include <common/ballot_contents.h>
 #include <common/database.h>
 #include <common/get_electorate_ballot_contents.h>
@@ -291,23 +290,10 @@ static unsigned int check_batch(PGconn *conn,unsigned int where_to_start)
                       this_paper_version);
 
     /* Check one preference list.  First check it is the
-       right length, and contains only digits. */
+       right length; decode_preference() checks the digits. */
     this_preference_list = PQgetvalue(all_votes_to_be_checked,
                                       vote_cursor, 2);
-    this_preference_list_cursor = this_preference_list;
-    while (*this_preference_list_cursor) {
-      if (!isdigit(*this_preference_list_cursor)) {
-        report_an_error("\nIn batch %u, this preference string has a "
-                        "character '%c'\nwhich is not a digit:\n%s\n",
-                        batch_to_check,
-                        *this_preference_list_cursor,this_preference_list);
-        goto end_outer_loop;
-      }
-      /* SIPL 2011: Changed type to conform. */
-      /* this_preference_list_cursor += sizeof(unsigned char); */
-      this_preference_list_cursor += sizeof(char);
-    }
-    if ((this_preference_list_cursor - this_preference_list) %
+    if (strlen(this_preference_list) %
 	/* SIPL 2011: Changed type to conform. */
         /* (DIGITS_PER_PREF * sizeof(unsigned char)) != 0) { */
 	(DIGITS_PER_PREF * sizeof(char)) != 0) {
@@ -324,8 +310,14 @@ static unsigned int check_batch(PGconn *conn,unsigned int where_to_start)
     CLEAR_PREFERENCE_BITSETS;
     this_preference_list_cursor = this_preference_list;
     while (*this_preference_list_cursor) {
-      sscanf(this_preference_list_cursor, (const char *)"%2u%2u%2u",
-             &prefnum,&group,&candidate);
+      if (!decode_preference(this_preference_list_cursor,
+                             &prefnum,&group,&candidate)) {
+        report_an_error("\nIn batch %u, this preference string has a "
+                        "preference '%.*s'\nwhich is not all digits:\n%s\n",
+                        batch_to_check, DIGITS_PER_PREF,
+                        this_preference_list_cursor,this_preference_list);
+        goto end_outer_loop;
+      }
       if (prefnum == 0) {
         report_an_error("\nIn batch %u, this preference string has a "
                         "preference numbered 0;\nsuch preferences are "
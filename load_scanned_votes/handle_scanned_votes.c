@@ -52,29 +52,26 @@ static int max_num_groups=0;
 /* Highest number of candidates in any group in any electorate */
 static int max_num_candidates=0;
 
-/* It's too slow to increment first preference summaries
-   for every single vote, so we do our own counting along
-   the way and update the summaries whenever we see a new
-   electorate/polling place in the data.
-   Use first_preferences as though it were a two-dimensional
-   array.  Access it thus:
-   FIRST_PREFERENCES(group,candidate)
+/* It's too slow to update the summary tables for every single
+   vote, so we do our own counting for the whole import, one
+   place_summary per electorate/polling place, and write them all
+   out at the end (see write_summaries()).
+   Access the first preference counts of a summary thus:
+   FIRST_PREFERENCES(summary,group,candidate)
    Note: groups and candidates are indexed from 0.
-   Use CLEAR_FIRST_PREFERENCES to reset the array.
 */
+static struct place_summary {
+  int electorate_code;
+  int polling_place_code;
+  unsigned int informal_count;
+  /* max_num_groups * max_num_candidates counts */
+  unsigned int *first_preferences;
+} *place_summaries;
 
-unsigned int *first_preferences;
-unsigned int first_preferences_length;
+static unsigned int num_place_summaries=0;
 
-#define FIRST_PREFERENCES(group,candidate) \
-  first_preferences[(group*max_num_candidates)+candidate]
-#define CLEAR_FIRST_PREFERENCES \
-  memset(first_preferences,0,first_preferences_length)
-
-/* Keep track of informal_count by electorate/polling place.
-   Reset each time electorate/polling place is changed during
-   filtering. */
-unsigned int informal_count=0;
+#define FIRST_PREFERENCES(summary,group,candidate) \
+  (summary)->first_preferences[((group)*max_num_candidates)+(candidate)]
 
 
 /* Temporary files containing the votes that will be
@@ -138,12 +135,6 @@ static void setup_electorate_and_ballot_data(PGconn *conn) {
     memset(reporting_data[elec_ptr->code],0,sizeof(struct reporting_data));
   }
 
-  /* Now we can create the first_preferences array.
-   Don't forget to leave space for the electorate 0. */
-  first_preferences_length = sizeof(unsigned int)
-    * max_num_groups * max_num_candidates;
-  first_preferences = malloc(first_preferences_length);
-
 
   /* Now setup temporary files to store votes */
   vote_filenames = malloc(sizeof(char *) * (max_electorate + 1));
@@ -170,113 +161,134 @@ static void setup_electorate_and_ballot_data(PGconn *conn) {
 }
 
 
-/* Call this function before starting processing a new
-   electorate/polling place to "flush" the summaries
-   for the previous electorate/polling place.
-   Call with electorate_code and polling_place_code both
-   -1 to flush the last summaries. */
-static void update_summaries(PGconn *conn,
-                             int electorate_code,
-                             int polling_place_code) {
-  int g,c;
-  int fp;
+/* Find the summary for this electorate/polling place, starting
+   a new one if it hasn't been seen before.  Consecutive batches
+   are nearly always from the same place, so try the last one
+   found first. */
+static struct place_summary *find_place_summary(int electorate_code,
+                                                int polling_place_code) {
+  static struct place_summary *last_found = NULL;
+  struct place_summary *summary;
+  unsigned int i;
 
-  static int previous_electorate_code = -1,
-    previous_polling_place_code = -1;
+  if (last_found &&
+      (last_found->electorate_code == electorate_code) &&
+      (last_found->polling_place_code == polling_place_code))
+    return last_found;
+
+  for (i = 0; i < num_place_summaries; i++)
+    if ((place_summaries[i].electorate_code == electorate_code) &&
+        (place_summaries[i].polling_place_code == polling_place_code))
+      return last_found = &place_summaries[i];
+
+  place_summaries = realloc(place_summaries,
+                            sizeof(struct place_summary)
+                            * (num_place_summaries + 1));
+  if (!place_summaries)
+    bailout("Out of memory while allocating space for summaries!\n");
+  summary = &place_summaries[num_place_summaries++];
+  summary->electorate_code = electorate_code;
+  summary->polling_place_code = polling_place_code;
+  summary->informal_count = 0;
+  summary->first_preferences = calloc(max_num_groups * max_num_candidates,
+                                      sizeof(unsigned int));
+  if (!summary->first_preferences)
+    bailout("Out of memory while allocating space for summaries!\n");
+  return last_found = summary;
+}
+
+/* Add the summaries of the whole import to the vote_summary and
+   preference_summary tables, one statement per table.
+   preference_summary is keyed on electorate/polling place/candidate,
+   so it is a plain upsert; vote_summary has no key, so its rows
+   are updated, and those not there inserted, in one statement. */
+static void write_summaries(PGconn *conn) {
+  struct place_summary *summary;
+  unsigned int i, num_first_preferences = 0;
+  int g,c;
+  char *values, *p;
 
-  /* Check if still collecting data for the same
-     electorate/polling place */
-  if ((electorate_code == previous_electorate_code) &&
-      (polling_place_code == previous_polling_place_code))
+  if (num_place_summaries == 0)
     return;
 
-  /* Check if this is the first time we've been called */
-  if ((previous_electorate_code == -1) &&
-      (previous_polling_place_code == -1)) {
-    /* Only have to note that we changed code; nothing
-       to be stored. */
-    previous_electorate_code = electorate_code;
-    previous_polling_place_code = polling_place_code;
-    CLEAR_FIRST_PREFERENCES;
+  values = p = malloc(num_place_summaries
+                      * (sizeof("(,,),") + 3 * INT_CHARS));
+  if (!values)
+    bailout("Out of memory while writing summaries!\n");
+  for (i = 0; i < num_place_summaries; i++)
+    p += sprintf(p, "%s(%d,%d,%u)",
+                 i ? "," : "",
+                 place_summaries[i].electorate_code,
+                 place_summaries[i].polling_place_code,
+                 place_summaries[i].informal_count);
+
+  SQL_command(conn,"WITH summary(electorate_code,polling_place_code,"
+              "informal_count) AS (VALUES %s),"
+              "updated AS ("
+              "UPDATE vote_summary "
+              "SET informal_count = vote_summary.informal_count "
+              "+ summary.informal_count,"
+              "entered_by = 'EVACS scanned',"
+              "entered_at = 'NOW' "
+              "FROM summary "
+              "WHERE vote_summary.electorate_code = summary.electorate_code "
+              "AND vote_summary.polling_place_code "
+              "= summary.polling_place_code "
+              "RETURNING vote_summary.electorate_code,"
+              "vote_summary.polling_place_code) "
+              "INSERT INTO vote_summary "
+              "(electorate_code,polling_place_code,"
+              "entered_by,entered_at,informal_count) "
+              "SELECT electorate_code,polling_place_code,"
+              "'EVACS scanned','NOW',informal_count "
+              "FROM summary "
+              "WHERE NOT EXISTS (SELECT 1 FROM updated "
+              "WHERE updated.electorate_code = summary.electorate_code "
+              "AND updated.polling_place_code "
+              "= summary.polling_place_code);",
+              values);
+  free(values);
+
+  for (i = 0; i < num_place_summaries; i++)
+    for (g = 0; g < max_num_groups; g++)
+      for (c = 0; c < max_num_candidates; c++)
+        if (FIRST_PREFERENCES(&place_summaries[i],g,c) > 0)
+          num_first_preferences++;
+  if (num_first_preferences == 0)
     return;
-  }
 
-  /* Update vote summary table */
-  if ( SQL_singleton_int(conn,"SELECT COUNT(*) "
-                         "FROM vote_summary "
-                         "WHERE electorate_code = %d "
-                         "AND polling_place_code = %d;",
-                         previous_electorate_code,previous_polling_place_code)
-       == 0)
-    SQL_command(conn,"INSERT INTO vote_summary "
-                "(electorate_code,polling_place_code,"
-                "entered_by,entered_at,informal_count) "
-                "VALUES (%d,%d,'EVACS scanned','NOW',%u);",
-                previous_electorate_code,previous_polling_place_code,
-                informal_count);
-  else
-    SQL_command(conn,"UPDATE vote_summary "
-                "SET informal_count = informal_count + %u,"
-                "entered_by = 'EVACS scanned',"
-                "entered_at = 'NOW' "
-                "WHERE electorate_code = %d "
-                "AND polling_place_code = %d;",
-                informal_count,
-                previous_electorate_code,
-                previous_polling_place_code);
-  /* Must also update reporting data now. */
-  reporting_data[previous_electorate_code]->informal_papers +=
-    informal_count;
-  informal_count = 0;
-
-  /* Update first preference summary table */
-  for (g = 0; g < max_num_groups; g++)
-    for (c = 0; c < max_num_candidates; c++) {
-      fp = FIRST_PREFERENCES(g,c);
-      if (fp > 0) {
-        if (SQL_singleton_int(conn,"SELECT COUNT(*) "
-                              "FROM preference_summary "
-                              "WHERE electorate_code = %d "
-                              "AND polling_place_code = %d "
-                              "AND party_index = %d "
-                              "AND candidate_index = %d;",
-                              previous_electorate_code,
-                              previous_polling_place_code,
-                              g,
-                              c)
-            == 0)
-          SQL_command(conn,"INSERT INTO "
-                      "preference_summary"
-                      "(electorate_code,"
-                      "polling_place_code,party_index,"
-                      "candidate_index,phoned_primary,"
-                      "evacs_primary,final_count) "
-                      "VALUES(%d,%d,%d,%d,0,%d,0);",
-                      previous_electorate_code,
-                      previous_polling_place_code,
-                      g,
-                      c,
-                      fp);
-        else
-          SQL_command(conn,"UPDATE "
-                      "preference_summary "
-                      "SET evacs_primary = "
-                      "evacs_primary + %d "
-                      "WHERE electorate_code = %d "
-                      "AND polling_place_code = %d "
-                      "AND party_index = %d "
-                      "AND candidate_index = %d;",
-                      fp,
-                      previous_electorate_code,
-                      previous_polling_place_code,
-                      g,
-                      c);
-      }
-    }
-  CLEAR_FIRST_PREFERENCES;
+  values = p = malloc(num_first_preferences
+                      * (sizeof("(,,,,0,,0),") + 5 * INT_CHARS));
+  if (!values)
+    bailout("Out of memory while writing summaries!\n");
+  for (i = 0; i < num_place_summaries; i++) {
+    summary = &place_summaries[i];
+    for (g = 0; g < max_num_groups; g++)
+      for (c = 0; c < max_num_candidates; c++)
+        if (FIRST_PREFERENCES(summary,g,c) > 0)
+          p += sprintf(p, "%s(%d,%d,%d,%d,0,%u,0)",
+                       p == values ? "" : ",",
+                       summary->electorate_code,
+                       summary->polling_place_code,
+                       g,
+                       c,
+                       FIRST_PREFERENCES(summary,g,c));
+  }
 
-  previous_electorate_code = electorate_code;
-  previous_polling_place_code = polling_place_code;
+  SQL_command(conn,"INSERT INTO "
+              "preference_summary"
+              "(electorate_code,"
+              "polling_place_code,party_index,"
+              "candidate_index,phoned_primary,"
+              "evacs_primary,final_count) "
+              "VALUES %s "
+              "ON CONFLICT (electorate_code,polling_place_code,"
+              "party_index,candidate_index) "
+              "DO UPDATE SET evacs_primary = "
+              "preference_summary.evacs_primary "
+              "+ EXCLUDED.evacs_primary;",
+              values);
+  free(values);
 }
 
 static void insert_scanned_vote(PGconn *conn,
@@ -314,7 +326,9 @@ static void insert_scanned_vote(PGconn *conn,
           preference_list);
 
   if (num_preferences != 0)
-    FIRST_PREFERENCES(preferences[0].group_index,
+    FIRST_PREFERENCES(find_place_summary(electorate_code,
+                                         polling_place_code),
+                      preferences[0].group_index,
                       preferences[0].db_candidate_index)++;
 }
 
@@ -329,6 +343,23 @@ static PGresult *all_votes_to_be_imported;
 
 static int num_of_all_votes_to_be_imported;
 
+/* The details of every batch, looked up once rather than for each
+   batch imported.
+   Column 0 = batch number;
+   column 1 = electorate code,
+   column 2 = polling place code.
+   Both this and all_votes_to_be_imported are ordered by batch
+   number, so batch_cursor only ever moves forward. */
+static PGresult *all_batches;
+
+static int num_of_all_batches;
+
+static int batch_cursor;
+
+/* The numbers of the batches imported, as a comma separated list,
+   for marking them committed, and where to add the next one */
+static char *batches_imported, *batches_imported_end;
+
 static unsigned int import_batch(PGconn *conn_evacs,
                                  unsigned int where_to_start)
 {
@@ -347,42 +378,33 @@ static unsigned int import_batch(PGconn *conn_evacs,
   /* unsigned char */
   char
     this_preference_list_normalized[DIGITS_PER_PREF * PREFNUM_MAX + 1];
-  int num_rows;
+  struct place_summary *summary;
   
   batch_to_import =
     atoi(PQgetvalue(all_votes_to_be_imported,where_to_start,0));
-  this_electorate_code = SQL_singleton_int(conn_evacs,
-                                           "SELECT electorate_code "
-                                           "FROM batch "
-                                           "WHERE number = %u;",
-                                           batch_to_import);
-  if (this_electorate_code < 0) {
+  while ((batch_cursor < num_of_all_batches) &&
+         (atoi(PQgetvalue(all_batches,batch_cursor,0)) < batch_to_import))
+    batch_cursor++;
+  if ((batch_cursor == num_of_all_batches) ||
+      (atoi(PQgetvalue(all_batches,batch_cursor,0)) != batch_to_import)) {
     rollback(conn_evacs);
     PQfinish(conn_evacs);
     bailout("\nDatabase error while retrieving details for batch %d\n",
             batch_to_import);
   }
-  this_polling_place_code = SQL_singleton_int(conn_evacs,
-                                           "SELECT polling_place_code "
-                                           "FROM batch "
-                                           "WHERE number = %u;",
-                                           batch_to_import);
-  if (this_polling_place_code < 0) {
+  /* Sanity check - check that there is only one entry for the batch */
+  if ((batch_cursor + 1 < num_of_all_batches) &&
+      (atoi(PQgetvalue(all_batches,batch_cursor + 1,0)) == batch_to_import)) {
     rollback(conn_evacs);
     PQfinish(conn_evacs);
-    bailout("\nDatabase error while retrieving polling place "
-            "details for batch %d\n",
-            batch_to_import);
+    bailout("More than one entry exists for batch %u.\n",batch_to_import);
   }
-
-  /* Call update_summaries here, i.e., before examining the votes,
-     because it is used to "flush"
-     data from a previous electorate/polling place. */
-  update_summaries(conn_evacs,
-                   this_electorate_code,this_polling_place_code);
-
+  this_electorate_code = atoi(PQgetvalue(all_batches,batch_cursor,1));
+  this_polling_place_code = atoi(PQgetvalue(all_batches,batch_cursor,2));
 
   this_electorate = electorates[this_electorate_code];
+  summary = find_place_summary(this_electorate_code,
+                               this_polling_place_code);
   
   vote_cursor = where_to_start;
   
@@ -402,8 +424,10 @@ static unsigned int import_batch(PGconn *conn_evacs,
     pack_scanned_prefs(this_preference_list_normalized,
                        preferences_out,
                        num_preferences_out);
-    if (num_preferences_out == 0)
-      informal_count++;
+    if (num_preferences_out == 0) {
+      summary->informal_count++;
+      reporting_data[this_electorate_code]->informal_papers++;
+    }
     insert_scanned_vote(conn_evacs,
                         batch_to_import,
                         /* paper_version */
@@ -422,24 +446,15 @@ static unsigned int import_batch(PGconn *conn_evacs,
     vote_cursor++;
   }
 
-  /* Mark batch as committed */
-  num_rows = SQL_command(conn_evacs,"UPDATE batch "
-                         "SET committed = true "
-                         "WHERE number = %u;",
-                         batch_to_import);
+  /* Note batch to be marked as committed */
+  batches_imported_end += sprintf(batches_imported_end, "%s%u",
+                                  batches_imported_end == batches_imported
+                                  ? "" : ",",
+                                  batch_to_import);
   /* Do reporting. */
   reporting_data[this_electorate_code]->batches_imported++;
   reporting_data[this_electorate_code]->papers_imported +=
     (vote_cursor - where_to_start);
-  /* Sanity check - check that only one row was updated */
-  if ( num_rows != 1 ) {
-    rollback(conn_evacs);
-    PQfinish(conn_evacs);
-    if (num_rows == 0)
-      bailout("Batch %u has already been committed!\n",batch_to_import);
-    else
-      bailout("More than one entry exists for batch %u.\n",batch_to_import);
-  }
   return vote_cursor;
 }
 
@@ -447,7 +462,8 @@ static unsigned int import_batch(PGconn *conn_evacs,
 static void import_all_papers(PGconn *conn_evacs,PGconn *conn_scanned)
 {
    int num_batches;
-   unsigned int batch_cursor;
+   unsigned int num_rows;
+   unsigned int batches_done;
    unsigned int vote_cursor;
    /* Progress bar based on 20 5-percent increments;
       displayed only if 20 or more batches  */
@@ -482,6 +498,19 @@ static void import_all_papers(PGconn *conn_evacs,PGconn *conn_scanned)
 
    num_of_all_votes_to_be_imported = PQntuples(all_votes_to_be_imported);
 
+   all_batches = SQL_query(conn_evacs,
+                           "SELECT number,electorate_code,polling_place_code "
+                           "FROM batch "
+                           "ORDER BY number;");
+   num_of_all_batches = PQntuples(all_batches);
+   batch_cursor = 0;
+
+   batches_imported = batches_imported_end =
+     malloc(num_batches * (INT_CHARS + 1));
+   if (!batches_imported)
+     bailout("Out of memory while allocating space for batch numbers!\n");
+   batches_imported[0] = '\0';
+
    fprintf(stderr,"  Filtering %d paper(s) by electorate "
            "and updating summaries . . .\n",
            num_of_all_votes_to_be_imported);
@@ -498,7 +527,7 @@ static void import_all_papers(PGconn *conn_evacs,PGconn *conn_scanned)
    }
 
    vote_cursor = 0;
-   for (batch_cursor = 0; batch_cursor < num_batches; batch_cursor++) {
+   for (batches_done = 0; batches_done < num_batches; batches_done++) {
      vote_cursor = import_batch(conn_evacs,vote_cursor);
 
      /* Update progress bar (if there is one) */
@@ -511,8 +540,23 @@ static void import_all_papers(PGconn *conn_evacs,PGconn *conn_scanned)
      }
    }
 
-   /* Flush the summary for the last electorate/polling place. */
-   update_summaries(conn_evacs,-1,-1);
+   /* Mark all the batches as committed */
+   num_rows = SQL_command(conn_evacs,"UPDATE batch "
+                          "SET committed = true "
+                          "WHERE number IN (%s);",
+                          batches_imported);
+   /* Sanity check - check that each batch was updated once */
+   if ( num_rows != num_batches ) {
+     rollback(conn_evacs);
+     PQfinish(conn_evacs);
+     bailout("Marked %u batch(es) committed, expected %d!\n",
+             num_rows,num_batches);
+   }
+   free(batches_imported);
+   PQclear(all_batches);
+
+   /* Write the summaries for every electorate/polling place. */
+   write_summaries(conn_evacs);
 
    /* Complete progress bar (if there was one) */
    if (progress_point_increment != 0) {
@@ -527,7 +571,10 @@ static void import_all_papers(PGconn *conn_evacs,PGconn *conn_scanned)
 
 static void bulk_import_papers(PGconn *conn) {
   int i;
-  int num_rows;
+  unsigned int num_rows;
+  FILE *votes_in;
+  char buffer[8192];
+  size_t len;
 
   /* SIPL 2014-05-20 Support electorate names with spaces. */
   char *electorate_name_normalized;
@@ -544,22 +591,35 @@ static void bulk_import_papers(PGconn *conn) {
 		bailout("Out of memory while allocating space for electorate name!\n");
 	normalize_electorate_name(electorate_name_normalized, electorates[i]->name);
 
-        num_rows = SQL_command(conn,
-                               "COPY %s_confirmed_vote "
-                               "(batch_number,paper_version,"
-                               "time_stamp,preference_list) "
-                               "FROM '%s';",
-                               electorate_name_normalized,
-                               vote_filenames[i]);
+        /* Send the file from here, so the database server
+           needn't be able to read it */
+        votes_in = fopen(vote_filenames[i],"r");
+        if (!votes_in)
+          bailout("Couldn't open temporary file!\n");
+        SQL_copy_in(conn,
+                    "COPY %s_confirmed_vote "
+                    "(batch_number,paper_version,"
+                    "time_stamp,preference_list) "
+                    "FROM STDIN;",
+                    electorate_name_normalized);
 	free(electorate_name_normalized);
-        if (num_rows < 0)
-          bailout("Error bulk loading %s votes!\n",
-                  electorates[i]->name);
+        while ((len = fread(buffer,1,sizeof(buffer),votes_in)) > 0)
+          if (PQputCopyData(conn,buffer,len) != 1)
+            bailout("Error bulk loading %s votes: %s\n",
+                    electorates[i]->name,PQerrorMessage(conn));
+        if (ferror(votes_in))
+          bailout("Error reading temporary file!\n");
+        fclose(votes_in);
+        num_rows = SQL_copy_end(conn);
         unlink(vote_filenames[i]);
         fprintf(stderr,"    Batches:  %u\n",
                 reporting_data[i]->batches_imported);
         fprintf(stderr,"    Papers:   %u\n",
                 reporting_data[i]->papers_imported);
+        if (num_rows != reporting_data[i]->papers_imported)
+          bailout("Loaded %u %s votes, expected %u!\n",
+                  num_rows,electorates[i]->name,
+                  reporting_data[i]->papers_imported);
         fprintf(stderr,"    Informal: %u\n",
                 reporting_data[i]->informal_papers);
         fprintf(stderr,"  . . . %s votes loaded.\n",
@@ -608,7 +668,7 @@ bool handle_scanned_votes(void) {
   /* Start the transaction */
   begin(conn_evacs);
 
-  /* Prevent race condition in SELECT - INSERT or UPDATE code */
+  /* Prevent race condition in the UPDATE - INSERT of vote_summary */
   /* This won't block readers - only other writers */
   SQL_command(conn_evacs,"LOCK TABLE vote_summary IN EXCLUSIVE MODE;");
   SQL_command(conn_evacs,"LOCK TABLE preference_summary IN EXCLUSIVE MODE;");
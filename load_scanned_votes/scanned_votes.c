@@ -35,19 +35,14 @@ void get_scanned_prefs_for_entry(struct preference preferences[],
                                  unsigned int      *num_preferences,
                                  char              *preference_list)
 {
-  unsigned int  i;
-  char         *pref_ptr;
+  int num;
 
   /* Decode preference list into memory structure */
-  for (i = 0, pref_ptr = preference_list;
-       *pref_ptr;
-       i++, pref_ptr += DIGITS_PER_PREF*sizeof(char)) {
-    sscanf(pref_ptr, (const char *)"%2u%2u%2u",
-           &preferences[i].prefnum,
-           &preferences[i].group_index,
-           &preferences[i].db_candidate_index);
-  }
-  *num_preferences = i;
+  num = decode_preferences(preferences, PREFNUM_MAX,
+                           preference_list, strlen(preference_list));
+  if (num < 0)
+    bailout("Malformed preference list: '%s'\n", preference_list);
+  *num_preferences = num;
 } //get_scanned_prefs_for_entry
 
 
@@ -92,17 +87,5 @@ void pack_scanned_prefs(char              *preference_list_out,
                         struct preference preferences_in[],
                         unsigned int      num_preferences_in)
 {
-  unsigned int i;
-  char *pref_ptr;
-
-  *preference_list_out = '\0';
-  
-  for (i = 0,pref_ptr=preference_list_out;
-       i < num_preferences_in;
-       i++,pref_ptr += (sizeof(char)*(DIGITS_PER_PREF)))
-    sprintf(pref_ptr,
-            "%02u%02u%02u",
-            preferences_in[i].prefnum,
-            preferences_in[i].group_index,
-            preferences_in[i].db_candidate_index);
+  encode_preferences(preference_list_out, preferences_in, num_preferences_in);
 }
@@ -26,6 +26,7 @@
 #define LOADDB_NAME "evacs1"
 
 
+/* preferences[] has room for PREFNUM_MAX */
 extern void get_scanned_prefs_for_entry(struct preference preferences[],
                                         unsigned int      *num_preferences,
                                         char              *preference_list);
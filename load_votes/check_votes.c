@@ -14,228 +14,326 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <common/database.h>
 #include <common/evacs.h>
 #include "check_votes.h"
-#include "compare_votes.h"
 
-struct vote_list *table1_votes=NULL, *table2_votes=NULL;
+/* Rows fetched from each database at a time */
+#define CHECK_VOTES_FETCH 1000
 
+/* Number of differing votes described in detail */
+#define CHECK_VOTES_MAX_REPORTED 10
 
-/*
-  Compare two integers. Return +ve one if a greater, -ve one if b greater,
-  otherwise return zero. This is used by cmp_votes. 
-*/
-static int compare_int(int a, int b)
+/* Fingerprint of a vote: a 128-bit hash of the fields compare_votes()
+   compares */
+struct vote_fingerprint {
+	uint64_t h1, h2;
+};
+
+/* A vote seen on one disk and not (yet) on the other.  count is the
+   number of copies on the first disk less the number on the second. */
+struct unmatched_vote {
+	struct vote_fingerprint fp;
+	int count;
+	unsigned int batch_number;
+	unsigned int paper_version;
+	char *preference_list;
+};
+
+/* The unmatched votes of the electorate being compared, as an open
+   addressing hash table.  As both disks are read in the same order,
+   it only ever holds the votes one disk has got ahead of the other
+   by, plus any real differences. */
+static struct unmatched_vote *unmatched;
+static unsigned int unmatched_size, num_unmatched;
+
+static uint64_t rotl64(uint64_t x, int r)
 {
-	if (a>b)
-		return 1;
-	if (a<b)
-		return -1;
-	return 0;
+	return (x << r) | (x >> (64 - r));
 }
 
-/*
-  Compare 2 votes.
-  Return +ve one if the first vote is higher, return -ve one if the second
-  is higher, otherwise return 0.
-  This function is used by qsort.
-*/
-static int cmp_votes(const void *a,const void *b)
+static uint64_t fmix64(uint64_t k)
 {
-	struct vote *a_vote,*b_vote;
-	int res;
-
-	a_vote = (struct vote *)a;
-	b_vote = (struct vote *)b;
-
-	if ((res = compare_int(a_vote->batch_number,
-			       b_vote->batch_number)))
-		return res;
-	if ((res = compare_int(a_vote->paper_version,
-			       b_vote->paper_version)))
-		return res;
-
-	if ((res = strcmp(a_vote->preference_list,
-			  b_vote->preference_list)))
-		return res;
-	
-	return 0;
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
 }
 
-/*
-  Load the votes from the 2 databases for comparison
-*/
-static unsigned int get_votes_from_db(void)
+/* MurmurHash3 (x64, 128 bit) of len bytes of data */
+static struct vote_fingerprint murmur3_128(const void *data, size_t len)
 {
-	PGconn *conn;
-	PGresult *result1, *result2;
-	unsigned int num_rows, num_rows1=0,num_rows2=0,i;
-	struct electorate *electorates;
-	struct electorate *current_electorate;
-	
-	/* SIPL 2014-05-20 Support electorate names with spaces. */
-	char *electorate_name_normalized;
+	const unsigned char *bytes = data;
+	const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = 0, h2 = 0, k1, k2;
+	size_t i, nblocks = len / 16;
+	struct vote_fingerprint fp;
 
-	/* get electorate list from evacs*/
-	conn=connect_db(DATABASE_NAME);
-	electorates=get_electorates(conn);
-	if (!electorates) bailout("No Electorates found in %s\n",DATABASE_NAME);
-	PQfinish(conn);
-	
-	conn = connect_db(LOAD1DB_NAME);	
-	
-	for (current_electorate=electorates;
-	     current_electorate;
-	     current_electorate=current_electorate->next) {
-		
-		electorate_name_normalized = malloc(strlen(current_electorate->name) + 1);
-		if (!electorate_name_normalized)
-			bailout("Out of memory while allocating space for electorate name!\n");
-		normalize_electorate_name(electorate_name_normalized, current_electorate->name);
-
-		/* Fill out list of votes from table1 */
-		result1 = SQL_query(conn,
-				    "SELECT batch_number,paper_version,"
-				    "time_stamp,preference_list "
-				    "FROM %s_confirmed_vote "
-				    "ORDER BY preference_list;",
-				    electorate_name_normalized);
-		free(electorate_name_normalized);
-		num_rows = PQntuples(result1);
-
-		/* (re)allocate memory for table 1 votes */
-		if (!table1_votes)
-			table1_votes= malloc(sizeof(*table1_votes) +
-					     sizeof(table1_votes->vote[0])*num_rows);
-		
-		else
-			table1_votes = realloc(table1_votes,sizeof(*table1_votes) +
-					       sizeof(table1_votes->vote[0])*(num_rows1+num_rows));
-		
-		for (i=0; i<num_rows; i++) {
-			table1_votes->vote[i+num_rows1].batch_number 
-				= atoi(PQgetvalue(result1, i, 0));
-			table1_votes->vote[i+num_rows1].paper_version 
-				= atoi(PQgetvalue(result1,i,1));
-			table1_votes->vote[i+num_rows1].timestamp
-				= malloc(sizeof(char) * (strlen(PQgetvalue(result1,i,2))+1));
-			strcpy(table1_votes->vote[i+num_rows1].timestamp,
-				(char *)PQgetvalue(result1,i,2));
-			table1_votes->vote[i+num_rows1].preference_list 
-				=malloc(sizeof(char ) * (strlen(PQgetvalue(result1,i,3))+1));
-			strcpy(table1_votes->vote[i+num_rows1].preference_list,
-				(char *)PQgetvalue(result1,i,3));
-		
+	for (i = 0; i < nblocks; i++) {
+		memcpy(&k1, bytes + i*16, 8);
+		memcpy(&k2, bytes + i*16 + 8, 8);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1*5 + 0x52dce729;
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2*5 + 0x38495ab5;
+	}
+
+	k1 = k2 = 0;
+	bytes += nblocks * 16;
+	for (i = len & 15; i > 8; i--)
+		k2 |= (uint64_t)bytes[i-1] << ((i-9) * 8);
+	if (k2) {
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	}
+	for (; i > 0; i--)
+		k1 |= (uint64_t)bytes[i-1] << ((i-1) * 8);
+	if (len & 15) {
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len; h2 ^= len;
+	h1 += h2; h2 += h1;
+	h1 = fmix64(h1); h2 = fmix64(h2);
+	h1 += h2; h2 += h1;
+
+	fp.h1 = h1;
+	fp.h2 = h2;
+	return fp;
+}
+
+static void insert_unmatched(const struct unmatched_vote *vote);
+
+/* Double the size of the unmatched vote table */
+static void grow_unmatched(void)
+{
+	struct unmatched_vote *old = unmatched;
+	unsigned int i, old_size = unmatched_size;
+
+	unmatched_size = old_size ? old_size * 2 : 1024;
+	unmatched = calloc(unmatched_size, sizeof(*unmatched));
+	if (!unmatched)
+		bailout("Out of memory comparing votes\n");
+	for (i = 0; i < old_size; i++)
+		if (old[i].count)
+			insert_unmatched(&old[i]);
+	free(old);
+}
+
+/* Put a vote in the first free slot from its home slot */
+static void insert_unmatched(const struct unmatched_vote *vote)
+{
+	unsigned int i = vote->fp.h1 & (unmatched_size - 1);
+
+	while (unmatched[i].count)
+		i = (i + 1) & (unmatched_size - 1);
+	unmatched[i] = *vote;
+}
+
+/* Empty slot i, moving back any later votes that would then not be
+   found from their home slot */
+static void remove_unmatched(unsigned int i)
+{
+	unsigned int j = i, home, mask = unmatched_size - 1;
+
+	free(unmatched[i].preference_list);
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!unmatched[j].count)
+			break;
+		home = unmatched[j].fp.h1 & mask;
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		unmatched[i] = unmatched[j];
+		i = j;
+	}
+	unmatched[i].count = 0;
+	num_unmatched--;
+}
+
+/* Add one vote from disk 1 (delta 1) or disk 2 (delta -1): it cancels
+   out a copy seen on the other disk, or is noted as unmatched */
+static void add_vote(unsigned int batch_number, unsigned int paper_version,
+		     const char *preference_list, int delta)
+{
+	char key[2 * INT_CHARS + PREFNUM_MAX * DIGITS_PER_PREF + 3];
+	struct unmatched_vote vote;
+	unsigned int i;
+	int len;
+
+	len = snprintf(key, sizeof(key), "%u\t%u\t%s",
+		       batch_number, paper_version, preference_list);
+	if (len >= (int)sizeof(key))
+		len = sizeof(key) - 1;
+	vote.fp = murmur3_128(key, len);
 
+	if (unmatched_size) {
+		for (i = vote.fp.h1 & (unmatched_size - 1);
+		     unmatched[i].count;
+		     i = (i + 1) & (unmatched_size - 1)) {
+			if (unmatched[i].fp.h1 == vote.fp.h1
+			    && unmatched[i].fp.h2 == vote.fp.h2) {
+				unmatched[i].count += delta;
+				if (!unmatched[i].count)
+					remove_unmatched(i);
+				return;
+			}
 		}
-		
-		PQclear(result1);
-		num_rows1 += num_rows;
-			
 	}
-	PQfinish(conn);
-	
-	conn = connect_db(LOAD2DB_NAME);	
-	
-	for (current_electorate=electorates;
-	     current_electorate;
-	     current_electorate=current_electorate->next) {
-		
-		
-		electorate_name_normalized = malloc(strlen(current_electorate->name) + 1);
-		if (!electorate_name_normalized)
-			bailout("Out of memory while allocating space for electorate name!\n");
-		normalize_electorate_name(electorate_name_normalized, current_electorate->name);
-
-		result2 = SQL_query(conn,
-				    "SELECT batch_number,paper_version,"
-				    "time_stamp,preference_list "
-				    "FROM %s_confirmed_vote "
-				    "ORDER BY preference_list;",
-				    electorate_name_normalized);
-		free(electorate_name_normalized);
-		
-		/* Fill out list of votes from table2 */
-		num_rows = PQntuples(result2);
-		
-				
-		/* (re)allocate memory for table 2 votes */
-		if (!table2_votes)
-			table2_votes= malloc(sizeof(*table2_votes) +
-					     sizeof(table2_votes->vote[0])*num_rows);
-		
-		else
-			table2_votes = realloc(table2_votes,sizeof(*table2_votes) +
-					       sizeof(table2_votes->vote[0])*(num_rows+num_rows2));
-		
-		
-		for (i=0; i<num_rows; i++) {
-			table2_votes->vote[i+num_rows2].batch_number 
-				= atoi(PQgetvalue(result2, i, 0));
-			table2_votes->vote[i+num_rows2].paper_version 
-				= atoi(PQgetvalue(result2,i,1));
-			table2_votes->vote[i+num_rows2].timestamp
-				= malloc(sizeof(char) * strlen(PQgetvalue(result2,i,2))+1);
-			strcpy(table2_votes->vote[i+num_rows2].timestamp,
-				PQgetvalue(result2,i,2));
-			table2_votes->vote[i+num_rows2].preference_list 
-				=malloc(sizeof(char ) * strlen(PQgetvalue(result2,i,3))+1);
-			strcpy(table2_votes->vote[i+num_rows2].preference_list,
-				PQgetvalue(result2,i,3));
+
+	if ((num_unmatched + 1) * 4 > unmatched_size * 3)
+		grow_unmatched();
+	vote.count = delta;
+	vote.batch_number = batch_number;
+	vote.paper_version = paper_version;
+	vote.preference_list = strdup(preference_list);
+	insert_unmatched(&vote);
+	num_unmatched++;
+}
+
+/* Send the next FETCH of the cursor, without waiting for it */
+static void send_fetch(PGconn *conn)
+{
+	if (!PQsendQuery(conn, "FETCH " STRINGIZE(CHECK_VOTES_FETCH)
+			 " FROM votes;"))
+		bailout("FETCH failed: %s\n", PQerrorMessage(conn));
+}
+
+/* Add the votes of the FETCH sent on conn, returning how many; if
+   there were any, the next FETCH has been sent */
+static unsigned int add_fetched_votes(PGconn *conn, int delta)
+{
+	PGresult *result, *next;
+	unsigned int i, num_rows;
+
+	result = PQgetResult(conn);
+	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+		bailout("FETCH failed: %s\n", PQresultErrorMessage(result));
+	while ((next = PQgetResult(conn)) != NULL)
+		PQclear(next);
+
+	/* The database fetches the next rows while these are added (an
+	   empty result means the cursor is done) */
+	num_rows = PQntuples(result);
+	if (num_rows)
+		send_fetch(conn);
+	for (i = 0; i < num_rows; i++)
+		add_vote(atoi(PQgetvalue(result, i, 0)),
+			 atoi(PQgetvalue(result, i, 1)),
+			 PQgetvalue(result, i, 2),
+			 delta);
+	PQclear(result);
+	return num_rows;
+}
+
+/* Whatever is left in the table did not match: count it, describe
+   the first few, and empty the table */
+static unsigned int report_unmatched(const char *electorate_name,
+				     unsigned int *num_reported)
+{
+	unsigned int i, num_differing = 0;
+
+	for (i = 0; i < unmatched_size; i++) {
+		if (!unmatched[i].count)
+			continue;
+		num_differing += abs(unmatched[i].count);
+		if (*num_reported < CHECK_VOTES_MAX_REPORTED) {
+			fprintf(stderr, "%s: batch %u paper version %u "
+				"preferences '%s': %u more on disk %u\n",
+				electorate_name,
+				unmatched[i].batch_number,
+				unmatched[i].paper_version,
+				unmatched[i].preference_list,
+				abs(unmatched[i].count),
+				unmatched[i].count > 0 ? 1 : 2);
+			(*num_reported)++;
 		}
-		num_rows2 += num_rows;
-		PQclear(result2);
+		free(unmatched[i].preference_list);
+		unmatched[i].count = 0;
 	}
-	PQfinish(conn);
-	
-	/* If different number of rows - may as well pull out now */
-	if ( num_rows1 != num_rows2 ) {
-		free(table1_votes);
-		free(table2_votes);
-		/* SIPL 2014-05-21 Need to reset the values, as they
-		   are tested later by check_votes(). */
-		table1_votes = NULL;
-		table2_votes = NULL;
-		return 0;
+	num_unmatched = 0;
+	return num_differing;
+}
+
+/* Compare one electorate's votes on the two disks, reporting the
+   first few differences.  Returns the number of differing votes. */
+static unsigned int compare_electorate_votes(PGconn *conn1, PGconn *conn2,
+					     const char *electorate_name,
+					     unsigned int *num_reported)
+{
+	/* SIPL 2014-05-20 Support electorate names with spaces. */
+	char electorate_name_normalized[strlen(electorate_name) + 1];
+	unsigned int rows1 = 1, rows2 = 1;
+
+	normalize_electorate_name(electorate_name_normalized, electorate_name);
+
+	/* Both disks in the same order, so the votes pair off as they
+	   arrive */
+	begin(conn1);
+	begin(conn2);
+	SQL_command(conn1, "DECLARE votes NO SCROLL CURSOR FOR "
+		    "SELECT batch_number,paper_version,preference_list "
+		    "FROM %s_confirmed_vote "
+		    "ORDER BY batch_number,paper_version;",
+		    electorate_name_normalized);
+	SQL_command(conn2, "DECLARE votes NO SCROLL CURSOR FOR "
+		    "SELECT batch_number,paper_version,preference_list "
+		    "FROM %s_confirmed_vote "
+		    "ORDER BY batch_number,paper_version;",
+		    electorate_name_normalized);
+
+	/* Both databases work on their next rows while we compare */
+	send_fetch(conn1);
+	send_fetch(conn2);
+	while (rows1 || rows2) {
+		if (rows1)
+			rows1 = add_fetched_votes(conn1, 1);
+		if (rows2)
+			rows2 = add_fetched_votes(conn2, -1);
 	}
+	rollback(conn1);
+	rollback(conn2);
 
-	/* Sort the first table */
-	qsort(&table1_votes->vote[0],num_rows1,sizeof(table1_votes->vote[0]),
-	      cmp_votes);
-	
-	/* Sort the second table */
-	qsort(&table2_votes->vote[0],num_rows1,sizeof(table2_votes->vote[0]),
-	      cmp_votes);
-	
-	
-	return num_rows2;
+	return report_unmatched(electorate_name, num_reported);
 }
 
 /* DDS3.4: Check Votes */
 bool check_votes (void)
 {
-	bool equal=false;
-	unsigned int number_of_votes, i;
+	PGconn *conn, *conn1, *conn2;
+	struct electorate *electorates;
+	struct electorate *current_electorate;
+	unsigned int num_differing = 0, num_reported = 0;
 
-	number_of_votes = get_votes_from_db();
-	
-	for (i=0; i<number_of_votes; i++) {
-		equal = compare_votes(&table1_votes->vote[i], 
-				      &table2_votes->vote[i]);
+	/* get electorate list from evacs*/
+	conn=connect_db(DATABASE_NAME);
+	electorates=get_electorates(conn);
+	if (!electorates) bailout("No Electorates found in %s\n",DATABASE_NAME);
+	PQfinish(conn);
 
+	conn1 = connect_db(LOAD1DB_NAME);
+	conn2 = connect_db(LOAD2DB_NAME);
 
-		if (!equal)
-			break;
-	}
+	for (current_electorate=electorates;
+	     current_electorate;
+	     current_electorate=current_electorate->next)
+		num_differing += compare_electorate_votes(conn1, conn2,
+						current_electorate->name,
+						&num_reported);
 
-	if (table1_votes != NULL)
-		free(table1_votes);
-	if (table2_votes != NULL)
-		free(table2_votes);
+	PQfinish(conn1);
+	PQfinish(conn2);
+	free(unmatched);
+	unmatched = NULL;
+	unmatched_size = 0;
 
-	if (!equal) {
+	if (num_differing) {
+		fprintf(stderr, "%u vote(s) differ between the disks\n",
+			num_differing);
 		printf("Second Disk is not in agreement with "
 		       "the First. Please start again.\n");
 		return false;
@@ -104,6 +104,9 @@ static struct vote_list *get_votes(PGconn *conn_master,
 		if (!electorate_name_normalized)
 			bailout("Out of memory while allocating space for electorate name!\n");
 		normalize_electorate_name(electorate_name_normalized, current_electorate->name);
+		/* Ballot boxes from servers set up before time_stamp
+		   became a timestamp still hold it as text: the cast
+		   reads either. */
 		j = SQL_command(conn,
 				"UPDATE %s_confirmed_vote "
 				"SET batch_number = %s "
@@ -115,13 +118,11 @@ static struct vote_list *get_votes(PGconn *conn_master,
 				      "WHERE batch_number = "
 				      "cv.batch_number "
 				      "AND "
-				      "to_date(time_stamp, "
-				      "'YYYY-MM-DD HH24:MI:SS') "
-				      "< to_date('%s', 'YYYY-MM-DD')))"
+				      "time_stamp::timestamp "
+				      "< DATE '%s'))"
 				"AND "
-				"to_date(time_stamp, "
-				"'YYYY-MM-DD HH24:MI:SS') "
-				"< to_date('%s', 'YYYY-MM-DD');",
+				"time_stamp::timestamp "
+				"< DATE '%s';",
 				electorate_name_normalized,
 				new_batch_number,
 				electorate_name_normalized,
@@ -140,13 +141,11 @@ static struct vote_list *get_votes(PGconn *conn_master,
 				      "WHERE batch_number = "
 				      "cv.batch_number "
 				      "AND "
-				      "to_date(time_stamp, "
-				      "'YYYY-MM-DD HH24:MI:SS') "
-				      ">= to_date('%s', 'YYYY-MM-DD')))"
+				      "time_stamp::timestamp "
+				      ">= DATE '%s'))"
 				"AND "
-				"to_date(time_stamp, "
-				"'YYYY-MM-DD HH24:MI:SS') "
-				">= to_date('%s', 'YYYY-MM-DD');",
+				"time_stamp::timestamp "
+				">= DATE '%s';",
 				electorate_name_normalized,
 				new_batch_number,
 				electorate_name_normalized,
@@ -169,9 +168,8 @@ static struct vote_list *get_votes(PGconn *conn_master,
 				  "SET batch_number = %s "
 				  "WHERE batch_number = %s "
 				  "AND "
-				  "to_date(time_stamp, "
-				  "'YYYY-MM-DD HH24:MI:SS') "
-				  "< to_date('%s', 'YYYY-MM-DD');",
+				  "time_stamp::timestamp "
+				  "< DATE '%s';",
 				  electorate_name_normalized,
 				  pre_polling_batch_number,
 				  old_batch_number,
@@ -231,102 +229,151 @@ static struct vote_list *get_votes(PGconn *conn_master,
 	return votes;
 }
 
+/* First preferences for one candidate at this polling place */
+struct first_preference_tally {
+	unsigned int group_index;
+	unsigned int db_candidate_index;
+	unsigned int count;
+};
+
+/* Add a vote's first preference (if any) to the tallies */
+static void tally_first_preference(struct first_preference_tally **tallies,
+				   unsigned int *num_tallies,
+				   const struct preference_set *preferences)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < preferences->num_preferences; i++) {
+		const struct preference *pref = &preferences->candidates[i];
+
+		if (pref->prefnum != 1)
+			continue;
+
+		for (j = 0; j < *num_tallies; j++)
+			if ((*tallies)[j].group_index == pref->group_index
+			    && (*tallies)[j].db_candidate_index
+			       == pref->db_candidate_index)
+				break;
+		if (j == *num_tallies) {
+			*tallies = realloc(*tallies,
+					   sizeof(**tallies) * (j + 1));
+			if (!*tallies)
+				bailout("Out of memory tallying first "
+					"preferences\n");
+			(*tallies)[j].group_index = pref->group_index;
+			(*tallies)[j].db_candidate_index
+				= pref->db_candidate_index;
+			(*tallies)[j].count = 0;
+			(*num_tallies)++;
+		}
+		(*tallies)[j].count++;
+	}
+}
+
 /* DDS3.8: Copy Vote */
-static void copy_vote(PGconn *conn, struct vote vote, 
-		      unsigned int polling_place_code, 
-		      struct electorate *electorate)
+/* Copy this electorate's votes into the counting database with one
+   COPY, then add them to the election night summaries: the
+   informal and first preference counts are summed here, and each
+   summary table is written with one statement. */
+static void copy_votes(PGconn *conn, const struct vote_list *votes,
+		       unsigned int num_votes,
+		       unsigned int polling_place_code,
+		       const struct electorate *electorate)
 {
-	unsigned int i;
+	unsigned int i, num_copied = 0, informal_count = 0, num_tallies = 0;
+	struct first_preference_tally *tallies = NULL;
+	char *values, *p;
 	/* SIPL 2014-05-20 Support electorate names with spaces. */
 	char electorate_name_normalized[strlen(electorate->name) + 1];
-	struct preference_set *preferences=unpack_preferences(vote.preference_list);
 
 	normalize_electorate_name(electorate_name_normalized,
 				  electorate->name);
 
-	SQL_command(conn,
-		    "INSERT INTO %s_confirmed_vote"
+	SQL_copy_in(conn,
+		    "COPY %s_confirmed_vote"
 		    "(batch_number,paper_version,time_stamp,preference_list) "
-		    "VALUES(%u,%u,'%s','%s');",
-		    electorate_name_normalized,
-		    vote.batch_number,
-		    vote.paper_version, 
-		    vote.timestamp,
-		    vote.preference_list);
-
-	/* And in the confirmed vote table summary if required */
-	if ( SQL_singleton_int(conn,"SELECT COUNT(*) "
-			       "FROM vote_summary "
-			       "WHERE electorate_code = %d "
-			       "AND polling_place_code = %d;",
-			       vote.electorate_code,polling_place_code)
-	     == 0)
-		SQL_command(conn,"INSERT INTO vote_summary "
-			    "(electorate_code,polling_place_code,"
-			    "entered_by,entered_at,informal_count) "
-			    "VALUES (%d,%d,'EVACS','NOW',0);",
-			    vote.electorate_code,polling_place_code);
-
-	/* If no preferences - increment number of informal votes */
-	if (!strlen(vote.preference_list))
-		SQL_command(conn,"UPDATE vote_summary "
-			    "SET informal_count = informal_count + 1,"
-			        "entered_by = 'EVACS',"
-			        "entered_at = 'NOW' "
-			    "WHERE electorate_code = %d "
-			    "AND polling_place_code = %d;",
-			    vote.electorate_code,polling_place_code);
+		    "FROM STDIN;",
+		    electorate_name_normalized);
+	for (i = 0; i < num_votes; i++) {
+		const struct vote *vote = &votes->vote[i];
+		struct preference_set *preferences;
+
+		if (vote->electorate_code != electorate->code)
+			continue;
+
+		SQL_copy_row(conn, "%u\t%u\t%s\t%s\n",
+			     vote->batch_number,
+			     vote->paper_version,
+			     vote->timestamp,
+			     vote->preference_list);
+		num_copied++;
+
+		/* If no preferences - increment number of informal votes */
+		if (!strlen(vote->preference_list)) {
+			informal_count++;
+			continue;
+		}
 
-	
-	for(i=0;i<preferences->num_preferences; i++)
-	{
 		/* Summarise first preferences for election night */
-		if ( preferences->candidates[i].prefnum == 1) {
-			if (SQL_singleton_int(conn,"SELECT COUNT(*) "
-					      "FROM preference_summary "
-					      "WHERE electorate_code = %d "
-					      "AND polling_place_code = %d "
-					      "AND party_index = %d "
-					      "AND candidate_index = %d;",
-					      vote.electorate_code,
-					      polling_place_code,
-					      preferences->candidates[i].group_index,
-					      preferences->candidates[i].db_candidate_index)
-			    == 0)
-				SQL_command(conn,"INSERT INTO "
-					    "preference_summary"
-					    "(electorate_code,"
-					    "polling_place_code,party_index,"
-					    "candidate_index,phoned_primary,"
-					    "evacs_primary,final_count) "
-					    "VALUES(%d,%d,%d,%d,0,1,0);",
-					    vote.electorate_code,
-					    polling_place_code,
-					    preferences->candidates[i].group_index,
-					    preferences->candidates[i].db_candidate_index);
-			else
-				SQL_command(conn,"UPDATE "
-					    "preference_summary "
-					    "SET evacs_primary = "
-					    "evacs_primary + 1 "
-					    "WHERE electorate_code = %d "
-					    "AND polling_place_code = %d "
-					    "AND party_index = %d "
-					    "AND candidate_index = %d;",
-					    vote.electorate_code,
-					    polling_place_code,
-					    preferences->candidates[i].group_index,
-					    preferences->candidates[i].db_candidate_index);
-			SQL_command(conn,"UPDATE vote_summary "
-				    "SET entered_by = 'EVACS',"
-				    "entered_at = 'NOW' "
-				    "WHERE electorate_code = %d "
-				    "AND polling_place_code = %d;",
-				    vote.electorate_code,
-				    polling_place_code);
-		}
+		preferences = unpack_preferences(vote->preference_list);
+		tally_first_preference(&tallies, &num_tallies, preferences);
+		free(preferences);
 	}
-	free(preferences);
+	SQL_copy_end(conn);
+
+	if (num_copied == 0)
+		return;
+
+	/* And in the confirmed vote table summary.  It has no key to
+	   upsert on, so update the row, inserting it if there was none
+	   (we hold the table lock). */
+	SQL_command(conn,
+		    "WITH updated AS ("
+		    "UPDATE vote_summary "
+		    "SET informal_count = informal_count + %u,"
+		        "entered_by = 'EVACS',"
+		        "entered_at = 'NOW' "
+		    "WHERE electorate_code = %u "
+		    "AND polling_place_code = %u "
+		    "RETURNING 1) "
+		    "INSERT INTO vote_summary "
+		    "(electorate_code,polling_place_code,"
+		    "entered_by,entered_at,informal_count) "
+		    "SELECT %u,%u,'EVACS','NOW',%u "
+		    "WHERE NOT EXISTS (SELECT 1 FROM updated);",
+		    informal_count, electorate->code, polling_place_code,
+		    electorate->code, polling_place_code, informal_count);
+
+	if (num_tallies == 0)
+		return;
+
+	/* One row of VALUES per candidate with first preferences */
+	values = p = malloc(num_tallies * (sizeof("(,,,,0,,0),")
+					   + 5 * INT_CHARS));
+	if (!values)
+		bailout("Out of memory summarising first preferences\n");
+	for (i = 0; i < num_tallies; i++)
+		p += sprintf(p, "%s(%u,%u,%u,%u,0,%u,0)",
+			     i ? "," : "",
+			     electorate->code, polling_place_code,
+			     tallies[i].group_index,
+			     tallies[i].db_candidate_index,
+			     tallies[i].count);
+
+	SQL_command(conn,"INSERT INTO preference_summary"
+		    "(electorate_code,"
+		    "polling_place_code,party_index,"
+		    "candidate_index,phoned_primary,"
+		    "evacs_primary,final_count) "
+		    "VALUES %s "
+		    "ON CONFLICT (electorate_code,polling_place_code,"
+		    "party_index,candidate_index) "
+		    "DO UPDATE SET evacs_primary = "
+		    "preference_summary.evacs_primary "
+		    "+ EXCLUDED.evacs_primary;",
+		    values);
+	free(values);
+	free(tallies);
 }
 
 /* DDS3.8: Handle Few Votes */
@@ -381,7 +428,7 @@ void handle_few_votes(void)
 	/* Start the transaction */
 	begin(conn);
 
-	/* Prevent race condition in SELECT - INSERT or UPDATE code */
+	/* Prevent race condition in the UPDATE - INSERT of vote_summary */
 	/* This won't block readers - only other writers */
 	SQL_command(conn,"LOCK TABLE vote_summary IN EXCLUSIVE MODE;");
  	SQL_command(conn,"LOCK TABLE preference_summary IN EXCLUSIVE MODE;");
@@ -389,9 +436,9 @@ void handle_few_votes(void)
 	
 	fflush(stderr);
 	/* Insert votes into counting database */
-	for (i=0; i<num_votes; i++)
-		copy_vote(conn, votes->vote[i],polling_place_code,
-			  electorates[votes->vote[i].electorate_code]);
+	for (elec_ptr=elec_ptr_start; elec_ptr; elec_ptr=elec_ptr->next)
+		copy_votes(conn, votes, num_votes, polling_place_code,
+			   elec_ptr);
 	
 	for (i=0; i<num_votes; i++) {
 		free(votes->vote[i].timestamp);
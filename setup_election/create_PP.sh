@@ -295,6 +295,11 @@ case $TYPE in
     *) bailout "ERROR: Unknown polling place type.";;
 esac
 
+# The booths fetch these once at boot, rather than each image and
+# sample as the first voter needs it.
+echo Bundling images and audio, please wait...
+$BASE_DIR/bin/make_asset_bundles /var/www/html >/dev/null || bailout "Could not bundle images and audio."
+
 echo Updating database, please wait...  
 su postgres -c "psql evacs 2>/dev/null <<EOF
 delete from server_parameter;
@@ -66,15 +66,7 @@
       (Name to print) 171 shrinktofit
    It draws the text argument at the current position, shrinking
    it horizontally (only if necessary) to fit in the specified width. */
-/* Postscript headers and tailers */
-#define FILE_HEADER							\
-	"%%!PS-Adobe-2.0 EPSF-2.0\n"					\
-	"%%%%Creator: Software Improvements: draw_barcode (GPL)\n"	\
-	"%%%%Orientation: Portrait\n"					\
-	"%%%%BoundingBox: %u %u %u %u\n"				\
-	"%%%%Pages: 0\n"						\
-	"%%%%Magnification: 1.0000\n"					\
-	"%%%%EndComments\n"						\
+#define SHRINKTOFIT							\
 	"%% text width --\n"						\
 	"/shrinktofit {\n"						\
 	"  0 begin\n"							\
@@ -89,10 +81,36 @@
 	"  end } def\n"						\
 	"/shrinktofit load 0 2 dict put\n"
 
+/* Postscript headers and tailers */
+#define FILE_HEADER							\
+	"%%!PS-Adobe-2.0 EPSF-2.0\n"					\
+	"%%%%Creator: Software Improvements: draw_barcode (GPL)\n"	\
+	"%%%%Orientation: Portrait\n"					\
+	"%%%%BoundingBox: %u %u %u %u\n"				\
+	"%%%%Pages: 0\n"						\
+	"%%%%Magnification: 1.0000\n"					\
+	"%%%%EndComments\n"						\
+	SHRINKTOFIT
+
+/* A document of many barcodes, one to a page */
+#define DOCUMENT_HEADER							\
+	"%%!PS-Adobe-2.0\n"						\
+	"%%%%Creator: Software Improvements: draw_barcode (GPL)\n"	\
+	"%%%%Orientation: Portrait\n"					\
+	"%%%%BoundingBox: %u %u %u %u\n"				\
+	"%%%%Pages: %u\n"						\
+	"%%%%EndComments\n"						\
+	SHRINKTOFIT							\
+	"%%%%EndProlog\n"
+
 #define FILE_TAILER							\
 	"showpage\n"							\
 	"%%Trailer\n"
 
+#define DOCUMENT_TAILER							\
+	"%%Trailer\n"							\
+	"%%EOF\n"
+
 /* DDS3.2.1: Draw Polling Place Label */
 /* Returns Polling Place Label to be inserted (must be freed by caller) */
 /* SIPL 2014-05-27 The label has been moved to the left-hand side,
@@ -149,21 +167,13 @@ static char *draw_ascii_label(struct barcode *bc)
 			      + BARCODE_TOP_MARGIN + BARCODE_BOTTOM_MARGIN);
 }
 
-/* Do the actual drawing */
-static void child_draw_barcode(int pipe_to_parent,
-			       struct barcode *bc)
+/* Draw the bars of a barcode whose ASCII value is filled in */
+static void print_barcode_bars(FILE *out, const struct barcode *bc)
 {
-	FILE *toparent;
-
-	toparent = fdopen(pipe_to_parent, "w");
-	if (!toparent)
-		bailout("Child could not fdopen to parent: %s\n",
-			strerror(errno));
-
 	/* Library call to encode ASCII value: seems to have built-in
            margin of 10. */
-	if (Barcode_Encode_and_Print(bc->ascii,
-				     toparent, 
+	if (Barcode_Encode_and_Print((char *)bc->ascii,
+				     out, 
 				     BARCODE_PAGE_WIDTH
 				     - 2*BARCODE_SIDE_MARGIN,
 				     BARCODE_HEIGHT,
@@ -174,6 +184,20 @@ static void child_draw_barcode(int pipe_to_parent,
 				     | BARCODE_NO_ASCII
 				     | BARCODE_OUT_NOHEADERS) != 0)
 		bailout("Encoding of barcode for %s failed\n", bc->ascii);
+}
+
+/* Do the actual drawing */
+static void child_draw_barcode(int pipe_to_parent,
+			       struct barcode *bc)
+{
+	FILE *toparent;
+
+	toparent = fdopen(pipe_to_parent, "w");
+	if (!toparent)
+		bailout("Child could not fdopen to parent: %s\n",
+			strerror(errno));
+
+	print_barcode_bars(toparent, bc);
 	/* This also closes the underlying "pipe_to_parent" descriptor */
 	fclose(toparent);
 }
@@ -283,3 +307,37 @@ void print_full_page(const char *image, int bcfile)
 	/* Write tailer */
 	write(bcfile, FILE_TAILER, strlen(FILE_TAILER));
 }
+
+void start_barcode_document(FILE *out, unsigned int num_pages)
+{
+	fprintf(out, DOCUMENT_HEADER,
+		0, 0, BARCODE_PAGE_WIDTH, BARCODE_PAGE_HEIGHT, num_pages);
+}
+
+void print_barcode_page(FILE *out, unsigned int page, struct barcode *bc,
+			const char *ppname, const char *ename)
+{
+	char *label;
+
+	/* Fill in ASCII code for barcode */
+	bar_encode_ascii(bc);
+
+	fprintf(out, "%%%%Page: %u %u\n/pagesave save def\n", page, page);
+	/* The same drawing as draw_barcode(), straight to the file */
+	print_barcode_bars(out, bc);
+	label = draw_pp_label(ppname);
+	fputs(label, out);
+	free(label);
+	label = draw_ascii_label(bc);
+	fputs(label, out);
+	free(label);
+	label = draw_elec_label(ename);
+	fputs(label, out);
+	free(label);
+	fputs("pagesave restore showpage\n", out);
+}
+
+void end_barcode_document(FILE *out)
+{
+	fputs(DOCUMENT_TAILER, out);
+}
@@ -15,6 +15,7 @@
    You should have received a copy of the GNU General Public License
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <stdio.h>
 #include <common/barcode.h>
 
 /* Returns barcode image (PostScript) ready for assembling into sheet
@@ -25,4 +26,17 @@ extern char *draw_barcode(struct barcode *bc,
 
 /* Print out a full page of barcodes */
 extern void print_full_page(const char *image, int bcfile);
+
+/* Start a PostScript document of num_pages barcodes, one to a page */
+extern void start_barcode_document(FILE *out, unsigned int num_pages);
+
+/* Draw the barcode (checksum filled in) as the given page of the
+   document.  This draws in-process, so is much cheaper than
+   draw_barcode() for many barcodes. */
+extern void print_barcode_page(FILE *out, unsigned int page,
+			       struct barcode *bc,
+			       const char *ppname, const char *ename);
+
+/* Finish the document */
+extern void end_barcode_document(FILE *out);
 #endif /*_DRAW_BARCODE_H*/
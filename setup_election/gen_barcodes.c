@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -40,6 +41,10 @@
 
 #define BARCODES_PER_DIRECTORY 160
 
+/* How many barcodes' random data to read from /dev/urandom at once,
+   when generating in bulk */
+#define BARCODES_PER_BLOCK 1024
+
 /* DDSv1A-3.2.1: Generate Random Number */
 static void gen_random(unsigned char randnum[], size_t size)
 {
@@ -49,8 +54,16 @@ static void gen_random(unsigned char randnum[], size_t size)
 	if (fd == 0)
 		fd = open("/dev/urandom", O_RDONLY, 0);
 
-	/* Each read *may* return short, but read wrapper loops for us. */
-	read(fd, randnum, size);
+	/* Each read *may* return short, so loop until it is all there */
+	while (size > 0) {
+		ssize_t ret = read(fd, randnum, size);
+
+		if (ret <= 0)
+			bailout("Could not read /dev/urandom: %s\n",
+				ret < 0 ? strerror(errno) : "end of file");
+		randnum += ret;
+		size -= ret;
+	}
 }
 
 /* DDSv1A-3.2.1: Generate Table Entry */ 
@@ -59,16 +72,20 @@ static void gen_entry(PGconn *conn,
 		      unsigned int ppcode,
 		      unsigned int ecode)
 {
-	char hash[HASH_BITS + 1];
+	unsigned char hash[HASH_BYTES];
+	char hex[HASH_HEX_CHARS + 1];
 
 	/* Create SHA hash of the barcode random data */
 	gen_hash(hash, bc->data, sizeof(bc->data));
+	hash_to_hex(hex, hash);
 
 	/* Create and execute SQL command */
 	/* DDSv1A-3.2.1: Store Table Entry */
 	SQL_command(conn,
-		    "INSERT INTO barcode VALUES ( B'%s', %u, %u );",
-		    hash, ppcode, ecode);
+		    "INSERT INTO barcode "
+		    "(hash, polling_place_code, electorate_code) "
+		    "VALUES ( decode('%s', 'hex'), %u, %u );",
+		    hex, ppcode, ecode);
 }
 
 /* DDSv1A-3.2.1: Generate Barcode Image */
@@ -255,6 +272,86 @@ static void barcodes_pp_elec(PGconn *conn,
 	}
 }
 
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec)
+		+ (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Barcodes for Polling Place and Electorate, in bulk: the random
+   data is read a block at a time, the hashes go into the barcode
+   table with one COPY, and the barcodes are drawn one to a page of a
+   single PostScript file, dirname/<electorate>-<pp code>-<elec code>.ps */
+static void bulk_barcodes_pp_elec(PGconn *conn,
+				  const struct polling_place *pp,
+				  const struct electorate *elec,
+				  const char *dirname)
+{
+	unsigned char randnum[BARCODES_PER_BLOCK][BYTES(BARCODE_DATA_BITS)];
+	unsigned char hash[HASH_BYTES];
+	char hex[HASH_HEX_CHARS + 1];
+	char elec_name_normalized[strlen(elec->name) + 1];
+	struct barcode bc;
+	struct timespec start;
+	unsigned int i, j, num, block;
+	char *filename;
+	FILE *out;
+	int fd;
+
+	normalize_electorate_name(elec_name_normalized, elec->name);
+
+	/* make sure there's a batch to put the electronic votes in */
+	check_electronic_batch(conn, pp->code, elec->code);
+
+	num = get_num_barcodes(pp->name, elec->name);
+	if (num == 0)
+		return;
+
+	filename = sprintf_malloc("%s/%s-%u-%u.ps", dirname,
+				  elec_name_normalized, pp->code, elec->code);
+	fd = open(filename, O_WRONLY|O_CREAT|O_EXCL, 0600);
+	if (fd < 0 || !(out = fdopen(fd, "w")))
+		bailout("Could not open %s: %s\n", filename, strerror(errno));
+	start_barcode_document(out, num);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	/* DDSv1A-3.2.1: Store Table Entry */
+	SQL_copy_in(conn, "COPY barcode (hash, polling_place_code, "
+		    "electorate_code) FROM STDIN;");
+	for (i = 0; i < num; i += block) {
+		block = num - i < BARCODES_PER_BLOCK
+			? num - i : BARCODES_PER_BLOCK;
+		gen_random(randnum[0], block * sizeof(randnum[0]));
+
+		for (j = 0; j < block; j++) {
+			memcpy(bc.data, randnum[j], sizeof(bc.data));
+			gen_hash(hash, bc.data, sizeof(bc.data));
+			hash_to_hex(hex, hash);
+			/* bytea in hex: the backslash is escaped for COPY */
+			SQL_copy_row(conn, "\\\\x%s\t%u\t%u\n",
+				     hex, pp->code, elec->code);
+			bc.checksum = gen_csum(&bc);
+			print_barcode_page(out, i + j + 1, &bc,
+					   pp->name, elec->name);
+		}
+		fprintf(stderr, "\r%u of %u barcodes (%.0f per second)",
+			i + block, num, (i + block) / seconds_since(&start));
+	}
+	if (SQL_copy_end(conn) != num)
+		bailout("Storing barcodes for %s/%s failed\n",
+			pp->name, elec->name);
+
+	end_barcode_document(out);
+	if (fclose(out) != 0)
+		bailout("Could not write %s: %s\n", filename, strerror(errno));
+	fprintf(stderr, "\nWrote %s in %.1f seconds\n",
+		filename, seconds_since(&start));
+	free(filename);
+}
+
 /* DDSv1A-3.2.1: Barcodes for Polling Place */
 void barcodes_pp(PGconn *conn,
 		 const struct polling_place *pp,
@@ -269,10 +366,14 @@ void barcodes_pp(PGconn *conn,
 	free_electorates(elecs);
 }
 
+void bulk_barcodes_pp(PGconn *conn,
+		      const struct polling_place *pp,
+		      const char *dirname)
+{
+	struct electorate *elecs, *elec;
 
-
-
-
-
-
-
+	elecs = get_electorates(conn);
+	for (elec = elecs; elec; elec = elec->next)
+		bulk_barcodes_pp_elec(conn, pp, elec, dirname);
+	free_electorates(elecs);
+}
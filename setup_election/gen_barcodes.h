@@ -20,4 +20,10 @@
 extern void barcodes_pp(PGconn *conn,
 			const struct polling_place *pp,
 			const char *dirname);
+
+/* The same barcodes, generated in bulk: each electorate's go in one
+   multi-page PostScript file rather than a file per barcode. */
+extern void bulk_barcodes_pp(PGconn *conn,
+			     const struct polling_place *pp,
+			     const char *dirname);
 #endif /*_GEN_BARCODES_H*/
@@ -14,6 +14,7 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include <stdlib.h>
+#include <string.h>
 #include <common/evacs.h>
 #include "gen_barcodes.h"
 
@@ -22,11 +23,19 @@ int main(int argc, const char *argv[])
 {
 	PGconn *conn;
 	struct polling_place *pp;
+	bool bulk = false;
 
+	if (argc == 4 && strcmp(argv[1], "--bulk") == 0) {
+		bulk = true;
+		argv++;
+		argc--;
+	}
 	if (argc != 3)
-		bailout("Usage: gen_barcodes_bin <polling place> <dir>\n"
+		bailout("Usage: gen_barcodes_bin [--bulk] <polling place> <dir>\n"
 			"(must be run in Election Setup Information"
-			" directory)\n");
+			" directory)\n"
+			"With --bulk, each electorate's barcodes are written"
+			" as one multi-page file.\n");
 
 	/* Open a connection to a builtin database */
 	conn = connect_db(DATABASE_NAME);
@@ -38,7 +47,10 @@ int main(int argc, const char *argv[])
 	pp = get_polling_place(conn, argv[1]);
 	if (!pp)
 		bailout("Polling place `%s' not found!\n", argv[1]);
-	barcodes_pp(conn, pp, argv[2]);
+	if (bulk)
+		bulk_barcodes_pp(conn, pp, argv[2]);
+	else
+		barcodes_pp(conn, pp, argv[2]);
 
 	free(pp);
 	PQfinish(conn);
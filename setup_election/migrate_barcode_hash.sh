@@ -0,0 +1,62 @@
+#! /bin/sh
+
+# This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+# Convert the barcode table of an existing database from the old
+# bit(160) hash to the raw SHA-1 digest (bytea) that gen_barcodes_bin,
+# authenticate and save_and_verify now use.  The old bitstring holds
+# each byte of the digest least significant bit first, so each group
+# of 8 bits is reversed back into a byte.  Safe to run more than once.
+
+DATABASE=${1:-evacs}
+
+bailout()
+{
+    echo "$@" >&2
+    exit 1
+}
+
+type=`su postgres -c "psql -At $DATABASE" <<EOF
+SELECT data_type FROM information_schema.columns
+ WHERE table_name = 'barcode' AND column_name = 'hash';
+EOF`
+[ -n "$type" ] || bailout "No barcode table in database $DATABASE"
+if [ "$type" = "bytea" ]; then
+    echo "Barcode hashes in $DATABASE are already stored as bytea."
+    exit 0
+fi
+
+echo "Converting barcode hashes in $DATABASE, please wait..."
+su postgres -c "psql -v ON_ERROR_STOP=1 $DATABASE" <<EOF || bailout "Barcode hash conversion failed: $DATABASE is unchanged"
+BEGIN;
+ALTER TABLE barcode ADD COLUMN hash_bytes bytea;
+UPDATE barcode SET hash_bytes = decode(
+  (SELECT string_agg(lpad(to_hex(reverse(substring(hash::text
+                                                   FROM i * 8 + 1 FOR 8))
+                                 ::bit(8)::integer), 2, '0'),
+                     '' ORDER BY i)
+     FROM generate_series(0, 19) AS i), 'hex');
+ALTER TABLE barcode DROP CONSTRAINT barcode_pkey;
+ALTER TABLE barcode DROP COLUMN hash;
+ALTER TABLE barcode RENAME COLUMN hash_bytes TO hash;
+ALTER TABLE barcode ALTER COLUMN hash SET NOT NULL;
+ALTER TABLE barcode ADD CONSTRAINT barcode_pkey PRIMARY KEY (hash);
+CREATE INDEX barcode_hash_idx ON barcode USING hash (hash);
+COMMIT;
+ANALYZE barcode;
+EOF
+echo "Barcode hashes converted."
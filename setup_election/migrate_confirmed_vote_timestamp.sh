@@ -0,0 +1,82 @@
+#! /bin/sh
+
+# This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+# Convert the <electorate>_confirmed_vote tables of an existing
+# database from the old text time_stamp to a timestamp, add the
+# polling_place_code column (kept up to date from the batch by a
+# trigger) and index both, as setup_phase1.sh now creates them.
+# Time stamps which aren't a date and time become NULL.  Safe to run
+# more than once.
+
+DATABASE=${1:-evacs}
+
+bailout()
+{
+    echo "$@" >&2
+    exit 1
+}
+
+tables=`su postgres -c "psql -At $DATABASE" <<EOF
+SELECT table_name FROM information_schema.columns
+ WHERE table_name LIKE '%_confirmed_vote'
+   AND column_name = 'time_stamp' AND data_type = 'text';
+EOF`
+if [ -z "$tables" ]; then
+    echo "Confirmed votes in $DATABASE already have typed time stamps."
+    exit 0
+fi
+
+SQL="BEGIN;
+CREATE OR REPLACE FUNCTION confirmed_vote_polling_place() RETURNS trigger AS '
+BEGIN
+    SELECT polling_place_code INTO NEW.polling_place_code
+      FROM batch WHERE number = NEW.batch_number;
+    IF NOT FOUND THEN
+        NEW.polling_place_code := NEW.batch_number / 1000 % 1000;
+    END IF;
+    RETURN NEW;
+END;' LANGUAGE plpgsql;"
+
+for table in $tables; do
+    NAME=${table%_confirmed_vote}
+    SQL="$SQL
+ALTER TABLE $table ALTER COLUMN time_stamp DROP DEFAULT;
+ALTER TABLE $table ALTER COLUMN time_stamp TYPE timestamp(0) without time zone
+  USING CASE WHEN time_stamp ~ '^[0-9]{4}-[0-9]{2}-[0-9]{2} [0-9:]{8}'
+             THEN time_stamp::timestamp(0) END;
+ALTER TABLE $table ADD COLUMN polling_place_code integer;
+UPDATE $table cv SET polling_place_code =
+  COALESCE((SELECT polling_place_code FROM batch
+             WHERE number = cv.batch_number),
+           cv.batch_number / 1000 % 1000);
+CREATE INDEX ${NAME}_cnfrmd_vt_ts_idx ON $table USING btree (time_stamp);
+CREATE INDEX ${NAME}_cnfrmd_vt_pp_idx ON $table
+  USING btree (polling_place_code, time_stamp);
+CREATE TRIGGER ${NAME}_cnfrmd_vt_pp_trg
+    BEFORE INSERT OR UPDATE OF batch_number ON $table
+    FOR EACH ROW EXECUTE PROCEDURE confirmed_vote_polling_place();"
+done
+SQL="$SQL
+COMMIT;"
+
+echo "Converting confirmed vote time stamps in $DATABASE, please wait..."
+echo "$SQL" | su postgres -c "psql -v ON_ERROR_STOP=1 $DATABASE" || bailout "Confirmed vote conversion failed: $DATABASE is unchanged"
+for table in $tables; do
+    echo "ANALYZE $table;"
+done | su postgres -c "psql -q $DATABASE"
+echo "Confirmed vote time stamps converted."
@@ -257,8 +257,9 @@ CREATE TABLE ${NAME}_confirmed_vote (
     id integer DEFAULT nextval('${NAME}_confirmed_id_seq'::text) NOT NULL,
     batch_number integer NOT NULL,
     paper_version integer DEFAULT -1 NOT NULL,
-    time_stamp text,
-    preference_list text
+    time_stamp timestamp(0) without time zone,
+    preference_list text,
+    polling_place_code integer
 );
 
 CREATE SEQUENCE ${NAME}_paper_id_seq
@@ -296,6 +297,24 @@ CREATE TABLE ${NAME}_entry (
 
 CREATE INDEX ${NAME}_cnfrmd_vt_btch_idx ON ${NAME}_confirmed_vote USING btree (batch_number);
 
+CREATE INDEX ${NAME}_cnfrmd_vt_ts_idx ON ${NAME}_confirmed_vote USING btree (time_stamp);
+
+CREATE INDEX ${NAME}_cnfrmd_vt_pp_idx ON ${NAME}_confirmed_vote USING btree (polling_place_code, time_stamp);
+
+CREATE OR REPLACE FUNCTION confirmed_vote_polling_place() RETURNS trigger AS '
+BEGIN
+    SELECT polling_place_code INTO NEW.polling_place_code
+      FROM batch WHERE number = NEW.batch_number;
+    IF NOT FOUND THEN
+        NEW.polling_place_code := NEW.batch_number / 1000 % 1000;
+    END IF;
+    RETURN NEW;
+END;' LANGUAGE plpgsql;
+
+CREATE TRIGGER ${NAME}_cnfrmd_vt_pp_trg
+    BEFORE INSERT OR UPDATE OF batch_number ON ${NAME}_confirmed_vote
+    FOR EACH ROW EXECUTE PROCEDURE confirmed_vote_polling_place();
+
 CREATE INDEX ${NAME}_paper_batch_idx ON ${NAME}_paper USING btree (batch_number);
 
 CREATE INDEX ${NAME}_paper_batchnum_idx ON ${NAME}_paper USING btree (batch_number, "index");
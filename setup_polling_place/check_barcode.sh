@@ -78,7 +78,7 @@ HASH=`./hash_barcode "$BARCODE"`
 if [ $? -ne 0 ]; then
   echo Perhaps you entered the barcode incorrectly.
 else
-  echo "SELECT used FROM barcode WHERE hash='$HASH';" | \
+  echo "SELECT used FROM barcode WHERE hash=decode('$HASH', 'hex');" | \
       su - postgres -c "psql evacs" > /tmp/pp_start.out
   if [ `head -3 /tmp/pp_start.out | tail -1` == "t" ] 2>/dev/null; then
     echo The barcode HAS been used. 
@@ -23,7 +23,8 @@
 
 int main(int argc, char *argv[])
 {
-	char hash1[HASH_BITS + 1];
+	unsigned char hash1[HASH_BYTES];
+	char hex[HASH_HEX_CHARS + 1];
 	struct barcode bc;
 
 	if (argc != 2)
@@ -40,7 +41,8 @@ int main(int argc, char *argv[])
 		bailout("This barcode has been entered incorrectly.\n");
 
 	gen_hash(hash1, bc.data, sizeof(bc.data));
-	printf("%s\n", hash1);
+	hash_to_hex(hex, hash1);
+	printf("%s\n", hex);
 	exit(0);
 }
 
@@ -132,11 +132,11 @@ EOF"`
         # Run four SQL commands in one "here document".
         vote_counts=(`su - postgres -c"psql -A -t evacs <<EOF
 SELECT count(*) FROM ${ELECTORATE_NORMALIZED}_confirmed_vote 
-WHERE to_date(time_stamp,'YYYY-MM-DD HH24:MI:SS') < to_date('${ELECTION_DATE}','YYYY-MM-DD');
+WHERE time_stamp < DATE '${ELECTION_DATE}';
 SELECT count(*) FROM ${ELECTORATE_NORMALIZED}_confirmed_vote 
-WHERE to_date(time_stamp,'YYYY-MM-DD HH24:MI:SS') = to_date('${ELECTION_DATE}','YYYY-MM-DD');
+WHERE time_stamp >= DATE '${ELECTION_DATE}' AND time_stamp < DATE '${ELECTION_DATE}' + 1;
 SELECT count(*) FROM ${ELECTORATE_NORMALIZED}_confirmed_vote 
-WHERE to_date(time_stamp,'YYYY-MM-DD HH24:MI:SS') > to_date('${ELECTION_DATE}','YYYY-MM-DD');
+WHERE time_stamp >= DATE '${ELECTION_DATE}' + 1;
 SELECT count(*) FROM ${ELECTORATE_NORMALIZED}_confirmed_vote;
 EOF"`)
         printf "%-20s  %11d  %11d  %13d  %11d\n\n" "$ELECTORATE" "${vote_counts[0]}" "${vote_counts[1]}" "${vote_counts[2]}" "${vote_counts[3]}"
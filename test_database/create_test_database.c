@@ -20,6 +20,7 @@
 
 #include <common/database.h>
 #include <common/evacs.h>
+#include <common/preference_codec.h>
 #include <common/createtables.h>
 
 /*
@@ -34,69 +35,86 @@
 */ 
 
 const char* electorates_csv_file = "Electorates.txt";
-const char* groups_csv_file      = "Groups.txt";  
-const char* candidates_csv_file  = "Candidates.txt";   
+const char* groups_csv_file      = "Groups.txt";
+const char* candidates_csv_file  = "Candidates.txt";
 const char* csv_files_path;//[1024];
 
+/* Also load the raw rows into csv_pref_entry and csv_batch_pp_entry
+   (--staging).  Nothing reads them, but they are handy for checking
+   the input data with SQL. */
+static bool load_staging_tables = false;
 
-/*! Get the next token from the comma separated (CSV) stream 
+/* A CSV file, read through our own buffer: fgetc() per character
+   was most of the time spent reading the ballot files. */
+#define CSV_BUFFER_SIZE 65536
+
+struct csv_file {
+  FILE *f;
+  size_t pos, len;
+  char buffer[CSV_BUFFER_SIZE];
+};
+
+static int csv_getc(struct csv_file *csvfile)
+{
+  if (csvfile->pos == csvfile->len){
+    csvfile->len = fread(csvfile->buffer, 1, CSV_BUFFER_SIZE, csvfile->f);
+    csvfile->pos = 0;
+    if (csvfile->len == 0) return EOF;
+  }
+  return (unsigned char)csvfile->buffer[csvfile->pos++];
+}
+
+static bool csv_eof(struct csv_file *csvfile)
+{
+  return (csvfile->pos == csvfile->len && feof(csvfile->f));
+}
+
+/*! Get the next token from the comma separated (CSV) stream
     @Pre there must be a valid token
-*/ 
+
+    The token is returned as it appears in the file (less the
+    quotes): everything goes to the database through COPY, so ' needs
+    no escaping.
+*/
 
 /* Modified by AT to take into account quoted texts -- 03 Jun 09 */
-static char* get_csv_token(FILE* csvfile, char* token){
+static char* get_csv_token(struct csv_file* csvfile, char* token){
 
   int index = 0;
   int inchar;
   bool endtoken = false;
   bool inquotes = false;
 
-  inchar = fgetc(csvfile);
+  inchar = csv_getc(csvfile);
 
 
-  while ( !endtoken && (inchar != '\n') && (!feof(csvfile)) ){
+  while ( !endtoken && (inchar != '\n') && (inchar != EOF) ){
     if (inchar == ',' && !inquotes) endtoken = true;
 
     /* Skip over the <CR> for a DOS EOL */
     else if (inchar == '\r'){
-      inchar = fgetc(csvfile);
+      inchar = csv_getc(csvfile);
     }
 
     else if (inchar == '\"') {
       if (inquotes) inquotes = false;
       else inquotes = true;
-      inchar = fgetc(csvfile);
+      inchar = csv_getc(csvfile);
     }
-    else { 
-      /* Cope with ' in names etc by doubling them */
-      if (inchar == '\''){
-	token[index++] = '\'';
-      }
+    else {
       token[index++] = inchar;
-      inchar = fgetc(csvfile);
+      inchar = csv_getc(csvfile);
     }
   }
-  token[index] = (char)NULL;
+  token[index] = '\0';
   //printf("Token read: %s\n", token);
 
   return token;
 }
 
-/* 
-   Skip the rest of the current CSV record (read to EOL)
-*/
-static void ignore_rest_of_csv_record(FILE* csvfile){
-  int inchar;
-  inchar = fgetc(csvfile);
-  while ((inchar != '\n') && (!feof(csvfile)) ){
-    inchar = fgetc(csvfile);
-  }
-}
-
-
-static FILE* fopen_csv_file(const char *csv_file_name)
+static struct csv_file* fopen_csv_file(const char *csv_file_name)
 {
-  FILE *f;
+  struct csv_file *csvfile;
   char *path_and_name;
   int inchar;
 
@@ -104,22 +122,50 @@ static FILE* fopen_csv_file(const char *csv_file_name)
 
   strcpy(path_and_name,csv_files_path);
   strcat(path_and_name,csv_file_name);
-  
-  f = fopen(path_and_name,"r");
-  if (f == NULL)bailout("Can't open file:%s\n",path_and_name);
+
+  csvfile = malloc(sizeof(*csvfile));
+  csvfile->f = fopen(path_and_name,"r");
+  if (csvfile->f == NULL)bailout("Can't open file:%s\n",path_and_name);
+  csvfile->pos = csvfile->len = 0;
+  free(path_and_name);
 
   /* strip first line */
-  inchar = fgetc(f);
-  //printf("%c",inchar);
-  while ((inchar != '\n') && (!feof(f)) ){
-    inchar = fgetc(f);
-    //printf("%c",inchar);
+  inchar = csv_getc(csvfile);
+  while ((inchar != '\n') && (inchar != EOF) ){
+    inchar = csv_getc(csvfile);
   }
 
-  return f;
+  return csvfile;
+}
+
+static void fclose_csv_file(struct csv_file *csvfile)
+{
+  fclose(csvfile->f);
+  free(csvfile);
 }
 
-/* 
+/*
+   Copy a string into buffer escaped for COPY text format: backslash,
+   tab and newline are the only special characters.
+*/
+static char *copy_escape(char *buffer, const char *text)
+{
+  char *p = buffer;
+
+  for (; *text; text++){
+    switch (*text){
+    case '\\': *p++ = '\\'; *p++ = '\\'; break;
+    case '\t': *p++ = '\\'; *p++ = 't'; break;
+    case '\n': *p++ = '\\'; *p++ = 'n'; break;
+    case '\r': *p++ = '\\'; *p++ = 'r'; break;
+    default: *p++ = *text;
+    }
+  }
+  *p = '\0';
+  return buffer;
+}
+
+/*
    [AT 03 Jun 09] Description from Electorates.txt:
 
 "ecode", "electorate"
@@ -136,47 +182,40 @@ static void load_electorates(PGconn *conn)
   int record_count = 0;
 
   int  ecode = 0;
-  char name[255];
+  char name[1024];
   int  num_electors = 0;
 
-  FILE* f = fopen_csv_file(electorates_csv_file);
+  struct csv_file* f = fopen_csv_file(electorates_csv_file);
 
-  while (!feof(f)){
+  SQL_copy_in(conn,"COPY electorate (code, name, seat_count) FROM STDIN;");
+  while (!csv_eof(f)){
     get_csv_token(f,buff);
-    if (buff[0]!= (char)NULL){
+    if (buff[0]!= '\0'){
       ecode = atoi(buff);
-      strcpy(name,get_csv_token(f,buff));
+      copy_escape(name,get_csv_token(f,buff));
       get_csv_token(f,buff);
       num_electors = atoi(buff);
-      
+
       /* seat_count = atoi(get_csv_token(f,buff));
 	 strcpy(colour, get_csv_token(f,buff)); */
       record_count++;
-      /* SQL_command(conn,"INSERT INTO electorate"
-		  "(code, name, seat_count, number_of_electors,colour) "
-		  "VALUES(%u,'%s', %u, %u, '%s');",
-		  ecode,name,seat_count,num_electors,colour
-		  ); */
-
-      SQL_command(conn,"INSERT INTO electorate"
-		  "(code, name, seat_count) "
-		  "VALUES(%u,'%s',%u);",
-		  ecode,name,num_electors
-	);
-    }    
+
+      SQL_copy_row(conn,"%u\t%s\t%u\n",ecode,name,num_electors);
+    }
   }
+  SQL_copy_end(conn);
   printf("Loaded %d electorates.\n",record_count);
-  fclose(f);
+  fclose_csv_file(f);
 }
 
-/* 
+/*
 [AT 03 Jun 09]
-Description for Groups.txt: 
+Description for Groups.txt:
 
 "ecode","pcode","pname","pabbrev","cands"
 INTEGER, INTEGER, TEXT, TEXT, INTEGER
 
-"cands" is not used apparently. 
+"cands" is not used apparently.
 
 */
 
@@ -185,39 +224,35 @@ static void load_groups(PGconn *conn)
   char buff[512];
   int  record_count = 0;
 
-  int  index = 0;
   int  ecode = 0;
   int  pcode = 0;
-  char name[255];
-  char abbrev[255];
-  int num_cands = 0;
+  char name[1024];
+  char abbrev[1024];
 
-  FILE* f = fopen_csv_file(groups_csv_file);
+  struct csv_file* f = fopen_csv_file(groups_csv_file);
 
-  while (!feof(f)){
+  SQL_copy_in(conn,"COPY party (electorate_code, index, name, abbreviation) "
+	      "FROM STDIN;");
+  while (!csv_eof(f)){
     get_csv_token(f,buff);
 
-    if (buff[0]!= (char)NULL){
-      /* index = atoi(buff); */
-      ecode = atoi(buff); 
-      /* ecode = atoi(get_csv_token(f,buff)); */
+    if (buff[0]!= '\0'){
+      ecode = atoi(buff);
       pcode = atoi(get_csv_token(f,buff));
-      strcpy(name,get_csv_token(f,buff));
-      strcpy(abbrev,get_csv_token(f,buff));
-      num_cands = atoi(get_csv_token(f,buff));
-      record_count++;      
-      SQL_command(conn,"INSERT INTO party"
-		  "(electorate_code, index, name, abbreviation) "
-		  "VALUES(%u, %u, '%s', '%s');",
-		  ecode, pcode, name,abbrev
-	);
-    }    
+      copy_escape(name,get_csv_token(f,buff));
+      copy_escape(abbrev,get_csv_token(f,buff));
+      /* num_cands */
+      get_csv_token(f,buff);
+      record_count++;
+      SQL_copy_row(conn,"%u\t%u\t%s\t%s\n",ecode,pcode,name,abbrev);
+    }
   }
+  SQL_copy_end(conn);
   printf("Loaded %d groups (parties).\n",record_count);
-  fclose(f);
+  fclose_csv_file(f);
 }
 
-/* 
+/*
 [AT 03 Jun 09]
 Description for Candidates.txt:
 
@@ -231,84 +266,30 @@ static void load_candidates(PGconn *conn)
   char buff[512];
   int record_count = 0;
 
-  int  index = 0;
   int  ecode = 0;
   int  pcode = 0;
   int  ccode = 0;
-  char name[255];
+  char name[1024];
 
-  FILE* f = fopen_csv_file(candidates_csv_file);
+  struct csv_file* f = fopen_csv_file(candidates_csv_file);
 
-  while (!feof(f)){
+  SQL_copy_in(conn,"COPY candidate (electorate_code, party_index, index, name) "
+	      "FROM STDIN;");
+  while (!csv_eof(f)){
     get_csv_token(f,buff);
-    if (buff[0]!= (char)NULL){
-      /* index = atoi(buff); */
+    if (buff[0]!= '\0'){
       ecode = atoi(buff);
-      /* ecode = atoi(get_csv_token(f,buff)); */
       pcode = atoi(get_csv_token(f,buff));
       ccode = atoi(get_csv_token(f,buff));
-      strcpy(name,get_csv_token(f,buff));
-      /*ignore_rest_of_csv_record(f);*/
-
-      record_count++;      
-      SQL_command(conn,"INSERT INTO candidate"
-		  "(electorate_code, party_index, index, name) "
-		  "VALUES(%u, %u, %u, '%s');",
-		  ecode,pcode,ccode,name
-	);
-    }    
-  }
-  printf("Loaded %d candidates.\n",record_count);
-  fclose(f);
-}
-
-static void load_ballots_for_electorate(PGconn *conn, int electorate_code, const char *filename)
-{
-  
-  char buff[512];
-  int  record_count = 0;
-  int  primary_count = 0;
-
-  int  batch = 0;
-  int  bindex = 0;
-  int  pref = 0;
-  int  ccode = 0;
-  int  pcode = 0;
-  int  rcand = 0;
-
-  FILE* f = fopen_csv_file(filename);
-
-  printf("Loading Electorate(%u)",electorate_code);  fflush(stdout);
-  while (!feof(f)){
-    get_csv_token(f,buff);
-    if (buff[0]!= (char)NULL){
-      //batch,pindex,pref,pcode,ccode,rcand
-      batch  = atoi(buff);
-      bindex = atoi(get_csv_token(f,buff));
-      pref   = atoi(get_csv_token(f,buff));
-      pcode  = atoi(get_csv_token(f,buff));
-      ccode  = atoi(get_csv_token(f,buff));
-      rcand  = atoi(get_csv_token(f,buff));
-
-      if (pref == 1) {
-	primary_count++;
-	if ((primary_count % 1000) == 0)
-	  printf(".");fflush(stdout);
-      }
+      copy_escape(name,get_csv_token(f,buff));
 
       record_count++;
-            
-      SQL_command(conn,"INSERT INTO csv_pref_entry"
-		  "(electorate_code, batch, batch_index,"
-		  " pref_num, candidate_index, party_index)"
-		  "VALUES(%u, %u, %u, %u, %u, %u);",
-		  electorate_code,batch,bindex,pref,ccode,pcode
-		  );
-      
+      SQL_copy_row(conn,"%u\t%u\t%u\t%s\n",ecode,pcode,ccode,name);
     }
-  }//endwhile
-  printf("\n");
-  printf("Loaded %d primary votes and a total of %d preference records from file %s.\n",primary_count,record_count, filename);
+  }
+  SQL_copy_end(conn);
+  printf("Loaded %d candidates.\n",record_count);
+  fclose_csv_file(f);
 }
 
 //======================================================================
@@ -325,6 +306,15 @@ typedef struct csv_pref_record_TAG {
   int  is_null_record;
 } csv_pref_record;
 
+/* All the preference records for one electorate, held in memory in
+   the order they are turned into votes. */
+struct csv_prefs {
+  int ecode;
+  int num_records;
+  int max_records;
+  csv_pref_record *records;
+};
+
 static void set_null_csv_pref_record(csv_pref_record *record)
 {
   memset(record,0,sizeof(csv_pref_record));
@@ -336,83 +326,147 @@ static int is_null_csv_pref_record(csv_pref_record *record)
   return(record->is_null_record);
 }
 
-static void get_csv_pref_record(PGresult *result, int record_num, csv_pref_record *record)
+static void get_csv_pref_record(const struct csv_prefs *prefs, int record_num, csv_pref_record *record)
 {
-  if (record_num < (PQntuples(result))){
-    record->ecode  = atoi(PQgetvalue(result, record_num, 0));
-    record->batch  = atoi(PQgetvalue(result, record_num, 1));
-    record->bindex = atoi(PQgetvalue(result, record_num, 2));
-    record->pref   = atoi(PQgetvalue(result, record_num, 3));
-    record->pcode  = atoi(PQgetvalue(result, record_num, 4));
-    record->ccode  = atoi(PQgetvalue(result, record_num, 5));
-    record->is_null_record = 0;
+  if (record_num < prefs->num_records){
+    *record = prefs->records[record_num];
   }
   else {
     set_null_csv_pref_record(record);
   }
 }
 
-static void copy_csv_pref_record(csv_pref_record *src,csv_pref_record *dest)
+/* The order the staging table used to be read in: electorate_code,
+   batch, batch_index, pref_num, candidate_index, party_index. */
+static int compare_csv_pref_records(const void *a, const void *b)
 {
-  dest->ecode  =   src->ecode;
-  dest->batch  =   src->batch; 
-  dest->bindex =   src->bindex; 
-  dest->pref   =   src->pref; 
-  dest->pcode  =   src->pcode;
-  dest->ccode  =   src->ccode; 
-  dest->is_null_record = src->is_null_record; 
+  const csv_pref_record *x = a, *y = b;
+
+  if (x->batch != y->batch) return (x->batch < y->batch ? -1 : 1);
+  if (x->bindex != y->bindex) return (x->bindex < y->bindex ? -1 : 1);
+  if (x->pref != y->pref) return (x->pref < y->pref ? -1 : 1);
+  if (x->ccode != y->ccode) return (x->ccode < y->ccode ? -1 : 1);
+  if (x->pcode != y->pcode) return (x->pcode < y->pcode ? -1 : 1);
+  return 0;
+}
+
+static void load_ballots_for_electorate(PGconn *conn, struct csv_prefs *prefs,
+					int electorate_code, const char *filename)
+{
+
+  char buff[512];
+  int  primary_count = 0;
+  csv_pref_record *record;
+
+  struct csv_file* f = fopen_csv_file(filename);
+
+  prefs->ecode = electorate_code;
+  prefs->num_records = 0;
+  prefs->max_records = 65536;
+  prefs->records = malloc(prefs->max_records * sizeof(csv_pref_record));
+
+  if (load_staging_tables)
+    SQL_copy_in(conn,"COPY csv_pref_entry (electorate_code, batch, batch_index,"
+		" pref_num, candidate_index, party_index) FROM STDIN;");
+
+  printf("Loading Electorate(%u)",electorate_code);  fflush(stdout);
+  while (!csv_eof(f)){
+    get_csv_token(f,buff);
+    if (buff[0]!= '\0'){
+      if (prefs->num_records == prefs->max_records){
+	prefs->max_records *= 2;
+	prefs->records = realloc(prefs->records,
+				 prefs->max_records * sizeof(csv_pref_record));
+	if (prefs->records == NULL)
+	  bailout("Out of memory loading %s\n", filename);
+      }
+      record = &prefs->records[prefs->num_records++];
+
+      //batch,pindex,pref,pcode,ccode,rcand
+      record->ecode  = electorate_code;
+      record->batch  = atoi(buff);
+      record->bindex = atoi(get_csv_token(f,buff));
+      record->pref   = atoi(get_csv_token(f,buff));
+      record->pcode  = atoi(get_csv_token(f,buff));
+      record->ccode  = atoi(get_csv_token(f,buff));
+      /* rcand */
+      get_csv_token(f,buff);
+      record->is_null_record = 0;
+
+      if (record->pref == 1) {
+	primary_count++;
+	if ((primary_count % 1000) == 0)
+	  printf(".");fflush(stdout);
+      }
+
+      if (load_staging_tables)
+	SQL_copy_row(conn,"%u\t%u\t%u\t%u\t%u\t%u\n",
+		     electorate_code,record->batch,record->bindex,
+		     record->pref,record->ccode,record->pcode);
+    }
+  }//endwhile
+  if (load_staging_tables)
+    SQL_copy_end(conn);
+  fclose_csv_file(f);
+
+  qsort(prefs->records, prefs->num_records, sizeof(csv_pref_record),
+	compare_csv_pref_records);
+
+  printf("\n");
+  printf("Loaded %d primary votes and a total of %d preference records from file %s.\n",primary_count,prefs->num_records, filename);
 }
 
-static int next_record_is_same_vote(PGresult *result, int record_num)
+static int next_record_is_same_vote(const struct csv_prefs *prefs, int record_num)
 {
   csv_pref_record x,y;
 
-  get_csv_pref_record(result, record_num, &x);
-  get_csv_pref_record(result, record_num+1, &y);
+  get_csv_pref_record(prefs, record_num, &x);
+  get_csv_pref_record(prefs, record_num+1, &y);
 
   if (is_null_csv_pref_record(&x) || is_null_csv_pref_record(&y))
     return 0;
   else
-    return(   (x.ecode == y.ecode) 
-	      && (x.batch == y.batch) 
+    return(   (x.ecode == y.ecode)
+	      && (x.batch == y.batch)
 	      && (x.bindex == y.bindex)
 	      );
 }
 
-static char* get_csv_pref_string(PGresult *result, int *record_num)
+static void get_csv_pref_string(const struct csv_prefs *prefs, int *record_num,
+				char *pref_string)
 {
-  /* 
-     Pre: record_num is the first preference of a vote.
+  /*
+     Pre: record_num is the first preference of a vote, pref_string
+     has room for PREFNUM_MAX * DIGITS_PER_PREF + 1 characters.
 
      There are two cases for a vote to be partially discarded: (1) It
      contains a duplicate preference number whose value is greater than 1, or
      (2) It contains a non-contiguous sequence of preference numbers
-     
+
      Solutions: (1) The duplicate preference entries and all following
      (greater in value) preferences are discarded (2) All preference entries
      after the gap are discarded
-     
+
      Assume record at record_num is a primary preference, and is part of a
      formal vote.  The records are in order of preferences.
   */
-  #define DIGITS_PER_PREF 6
-  char pref_string[PREFNUM_MAX * DIGITS_PER_PREF];
-  char *return_string, *pref_ptr;
+  char *pref_ptr;
   int last_pref = 0;
   int disregard_remainder = 0;
   csv_pref_record record;
 
+  pref_string[0] = '\0';
   do {
-    get_csv_pref_record(result, *record_num, &record);
+    get_csv_pref_record(prefs, *record_num, &record);
     /* Is this preference 1 greater than the last given? */
     if ((last_pref+1) != record.pref){
       disregard_remainder = 1;
     }
     /* Is there a next preference with the same number? */
     /* Note we assume the informal case of 2 "1"'s has already been checked. */
-    if (next_record_is_same_vote(result, (*record_num))){
+    if (next_record_is_same_vote(prefs, (*record_num))){
       csv_pref_record next_record;
-      get_csv_pref_record(result, (*record_num+1), &next_record);
+      get_csv_pref_record(prefs, (*record_num+1), &next_record);
       if (record.pref == next_record.pref){
 	assert(next_record.pref != 1);
 	disregard_remainder = 1;
@@ -420,27 +474,31 @@ static char* get_csv_pref_string(PGresult *result, int *record_num)
     }
 
     if (!disregard_remainder){
+      /* Two digits each, as encode_preference writes them */
+      if ((unsigned int)record.pref > 99 || (unsigned int)record.pcode > 99
+	  || (unsigned int)record.ccode > 99)
+	bailout("Preference %d (group %d, candidate %d) does not fit "
+		"in a preference list\n",
+		record.pref, record.pcode, record.ccode);
       pref_ptr=&pref_string[0]+sizeof(char)*((last_pref)*DIGITS_PER_PREF);
-      sprintf(pref_ptr,"%02u%02u%02u",
-	      record.pref,record.pcode,record.ccode);
+      *encode_preference(pref_ptr,
+			 record.pref,record.pcode,record.ccode) = '\0';
       last_pref++;
     }
-  }while(next_record_is_same_vote(result, (*record_num)++));
-
-  return_string = malloc(sizeof(char) * (strlen(pref_string) + 1));
-  strcpy(return_string,pref_string);  
-  return return_string;
+  }while(next_record_is_same_vote(prefs, (*record_num)++));
 }
 
 
 /*
   Assumes no informals.
 
+  The votes are built in memory and streamed into the confirmed vote
+  table with a single COPY.
 */
-static void insert_confirmed_csv_ballots(PGconn *conn, int electorate_code)
+static void insert_confirmed_csv_ballots(PGconn *conn, const struct csv_prefs *prefs)
 {
   PGresult *result_electorate_name;
-  PGresult *result;
+  char pref_string[PREFNUM_MAX * DIGITS_PER_PREF + 1];
   int record_count=0;
   int primary_count = 0;
 
@@ -448,55 +506,49 @@ static void insert_confirmed_csv_ballots(PGconn *conn, int electorate_code)
 		     "SELECT name "
 		     "FROM electorate "
 		     "WHERE code = %u "
-		     ,electorate_code
+		     ,prefs->ecode
 		     );
   assert(PQntuples(result_electorate_name) == 1);
 
-  result = SQL_query(conn,
-		     "SELECT * "
-		     "FROM csv_pref_entry "
-		     "WHERE electorate_code = %u "
-		     "ORDER BY electorate_code, batch, batch_index, "
-		     "pref_num, candidate_index, party_index"
-		     ,electorate_code
-		     );
+  printf("Found %u preferences for electorate %u\n", prefs->num_records, prefs->ecode);
 
-  printf("Found %u preferences for electorate %u\n", PQntuples(result), electorate_code);
+  SQL_copy_in(conn,
+	      "COPY %s_confirmed_vote (batch_number, preference_list) "
+	      "FROM STDIN;",
+	      PQgetvalue(result_electorate_name, 0, 0));
 
-  while (record_count < PQntuples(result)){
-    char *pref_string;
+  while (record_count < prefs->num_records){
     /* INFORMAL VOTE CHECKING */
     csv_pref_record pref_record;
-    get_csv_pref_record(result,record_count,&pref_record); 
+    get_csv_pref_record(prefs,record_count,&pref_record);
     /* The first record MUST be 1 to be formal*/
     assert(pref_record.pref == 1);
     /* If the following record is part of the same vote, then the preference
        given MUST NOT be 1 for the vote to be to be formal*/
-    if (next_record_is_same_vote(result, record_count)) {
-      get_csv_pref_record(result,record_count+1,&pref_record); 
+    if (next_record_is_same_vote(prefs, record_count)) {
+      get_csv_pref_record(prefs,record_count+1,&pref_record);
       assert(pref_record.pref != 1);
     }
 
     /* READ AND LOAD THE VOTE */
-    pref_string = get_csv_pref_string(result,&record_count);
-    SQL_command(conn,
-		"INSERT INTO %s_confirmed_vote"
-		"(batch_number, preference_list) "
-		"VALUES(%u,'%s');",
-		PQgetvalue(result_electorate_name, 0, 0),
-		pref_record.batch,
-		pref_string);
-    free(pref_string);
+    get_csv_pref_string(prefs,&record_count,pref_string);
+    SQL_copy_row(conn,"%u\t%s\n",pref_record.batch,pref_string);
     ++primary_count;
   }
+  SQL_copy_end(conn);
 
   printf("Confirmed %u primary prefs from %u pref records.\n",
-	 primary_count,PQntuples(result));
-  
-  PQclear(result);
+	 primary_count,prefs->num_records);
+
   PQclear(result_electorate_name);
 }
 
+static void free_csv_prefs(struct csv_prefs *prefs)
+{
+  free(prefs->records);
+  prefs->records = NULL;
+  prefs->num_records = prefs->max_records = 0;
+}
 
 
 static void create_csv_batch_pp_table(PGconn *conn)
@@ -507,75 +559,182 @@ static void create_csv_batch_pp_table(PGconn *conn)
   create_table(conn,"csv_batch_pp_entry",
 	       "ppn INTEGER NOT NULL, "
 	       "batch_number INTEGER NOT NULL,"
-	       "pollingplace TEXT NOT NULL," 
+	       "pollingplace TEXT NOT NULL,"
 	       "PRIMARY KEY (ppn, batch_number, pollingplace)"
 	       );
 
 
 }
 
-static void load_csv_batch_pp_entry(PGconn *conn, const char *filename)
+/* One line of PollingPlaceBatchNumbers.txt */
+struct csv_batch_pp_record {
+  int ppn;
+  int batch;
+  char *pollingplace;
+};
+
+struct batch_electorate {
+  int batch;
+  int ecode;
+};
+
+static int compare_batch_pp_by_polling_place(const void *a, const void *b)
 {
-  
-  char buff[512];
+  const struct csv_batch_pp_record *x = a, *y = b;
+
+  if (x->ppn != y->ppn) return (x->ppn < y->ppn ? -1 : 1);
+  return strcmp(x->pollingplace, y->pollingplace);
+}
+
+static int compare_batch_pp_by_batch(const void *a, const void *b)
+{
+  const struct csv_batch_pp_record *x = a, *y = b;
+
+  if (x->batch != y->batch) return (x->batch < y->batch ? -1 : 1);
+  return (x->ppn < y->ppn ? -1 : x->ppn > y->ppn);
+}
+
+static int compare_batch_electorates(const void *a, const void *b)
+{
+  const struct batch_electorate *x = a, *y = b;
+
+  if (x->batch != y->batch) return (x->batch < y->batch ? -1 : 1);
+  return (x->ecode < y->ecode ? -1 : x->ecode > y->ecode);
+}
+
+static struct csv_batch_pp_record *load_csv_batch_pp_entry(PGconn *conn, const char *filename, int *num_records)
+{
+
+  char buff[1024];
+  char escaped[2048];
   int  record_count = 0;
-  int  batch = 0;
-  int  ppn = 0;
-  char pollingplace[512] = "";
+  int  max_records = 1024;
+  struct csv_batch_pp_record *records;
+
+  struct csv_file* f = fopen_csv_file(filename);
 
-  FILE* f = fopen_csv_file(filename);
+  records = malloc(max_records * sizeof(*records));
+  if (load_staging_tables)
+    SQL_copy_in(conn,"COPY csv_batch_pp_entry (ppn, batch_number, pollingplace) "
+		"FROM STDIN;");
 
   printf("Loading polling place and batch numbers");  fflush(stdout);
-  while (!feof(f)){
+  while (!csv_eof(f)){
     get_csv_token(f,buff);
-    if (buff[0]!= (char)NULL){
-      ppn  = atoi(buff);
-      batch = atoi(get_csv_token(f,buff));
-      strcpy(pollingplace, get_csv_token(f,buff));
-
+    if (buff[0]!= '\0'){
+      if (record_count == max_records){
+	max_records *= 2;
+	records = realloc(records, max_records * sizeof(*records));
+	if (records == NULL)
+	  bailout("Out of memory loading %s\n", filename);
+      }
+      records[record_count].ppn  = atoi(buff);
+      records[record_count].batch = atoi(get_csv_token(f,buff));
+      records[record_count].pollingplace = strdup(get_csv_token(f,buff));
+
+      if (load_staging_tables)
+	SQL_copy_row(conn,"%u\t%u\t%s\n",
+		     records[record_count].ppn, records[record_count].batch,
+		     copy_escape(escaped, records[record_count].pollingplace));
       record_count++;
-            
-      SQL_command(conn,"INSERT INTO csv_batch_pp_entry"
-		  "(ppn, batch_number, pollingplace)"
-		  "VALUES(%u, %u, '%s');",
-		  ppn, batch, pollingplace
-		  );
-      
     }
   }//endwhile
+  if (load_staging_tables)
+    SQL_copy_end(conn);
+  fclose_csv_file(f);
   printf("\n");
   printf("Loaded %d records from file %s.\n", record_count, filename);
+
+  *num_records = record_count;
+  return records;
 }
 
-static void load_polling_place_and_batch(PGconn *conn)
+static void load_polling_place_and_batch(PGconn *conn,
+					 const struct csv_prefs *prefs,
+					 int num_electorates)
 {
-  load_csv_batch_pp_entry(conn, "PollingPlaceBatchNumbers.txt");
+  struct csv_batch_pp_record *pp;
+  struct batch_electorate *batches;
+  char escaped[2048];
+  int num_pp, num_batches = 0, max_batches = 0;
+  int i, j, e, count;
 
-  /* Insert into polling place table */
+  pp = load_csv_batch_pp_entry(conn, "PollingPlaceBatchNumbers.txt", &num_pp);
+
+  /* Insert into polling place table: one row for each distinct
+     (ppn, pollingplace) */
 
   printf("Inserting entries into polling_place table ...");
-  SQL_command(conn,
-		"INSERT INTO polling_place (code, name) "
-		"SELECT DISTINCT ON (ppn, pollingplace) ppn, pollingplace "
-  	        "FROM csv_batch_pp_entry;");
+  qsort(pp, num_pp, sizeof(*pp), compare_batch_pp_by_polling_place);
+  SQL_copy_in(conn,"COPY polling_place (code, name) FROM STDIN;");
+  for (i = 0; i < num_pp; i++) {
+    if (i > 0 && compare_batch_pp_by_polling_place(&pp[i-1], &pp[i]) == 0)
+      continue;
+    SQL_copy_row(conn,"%u\t%s\n",pp[i].ppn,
+		 copy_escape(escaped,pp[i].pollingplace));
+  }
+  SQL_copy_end(conn);
   printf("done.\n");
 
+  /* Insert into batch table: each distinct (batch, ppn, electorate)
+     for batches that appear in both the polling place file and the
+     ballot files.  The ballots are sorted by batch, so each
+     electorate's batches are found in one pass. */
+
   printf("Inserting entries into batch table ...");
-  SQL_command(conn,
-	      "INSERT INTO batch (number, polling_place_code, electorate_code) "
-	      "SELECT DISTINCT ON (batch, ppn, electorate_code) batch, ppn, electorate_code "
-	      "FROM csv_pref_entry, csv_batch_pp_entry WHERE batch = batch_number;");
-  printf("done.\n");
+  for (e = 0; e < num_electorates; e++)
+    max_batches += prefs[e].num_records;
+  batches = malloc((max_batches + 1) * sizeof(*batches));
+  for (e = 0; e < num_electorates; e++) {
+    for (i = 0; i < prefs[e].num_records; i++) {
+      if (i > 0 && prefs[e].records[i].batch == prefs[e].records[i-1].batch)
+	continue;
+      batches[num_batches].batch = prefs[e].records[i].batch;
+      batches[num_batches].ecode = prefs[e].ecode;
+      num_batches++;
+    }
+  }
+  qsort(batches, num_batches, sizeof(*batches), compare_batch_electorates);
+  qsort(pp, num_pp, sizeof(*pp), compare_batch_pp_by_batch);
+
+  SQL_copy_in(conn,"COPY batch (number, polling_place_code, electorate_code) "
+	      "FROM STDIN;");
+  count = 0;
+  for (i = 0, j = 0; i < num_pp && j < num_batches;) {
+    if (pp[i].batch < batches[j].batch)
+      i++;
+    else if (pp[i].batch > batches[j].batch)
+      j++;
+    else {
+      int k;
+
+      /* Same batch: pair this polling place with every electorate
+	 the batch turns up in, skipping repeated polling places. */
+      if (i == 0 || pp[i-1].batch != pp[i].batch || pp[i-1].ppn != pp[i].ppn)
+	for (k = j; k < num_batches && batches[k].batch == pp[i].batch; k++) {
+	  SQL_copy_row(conn,"%u\t%u\t%u\n",
+		       batches[k].batch,pp[i].ppn,batches[k].ecode);
+	  count++;
+	}
+      i++;
+    }
+  }
+  SQL_copy_end(conn);
+  printf("done (%d batches).\n", count);
 
+  for (i = 0; i < num_pp; i++)
+    free(pp[i].pollingplace);
+  free(pp);
+  free(batches);
 }
 
 /*
 [AT 03 Jun 09]
 Changed the names of the text files to conform with the ones used
-by the ACT Electoral Comission. There's no separate paper version. Both 
+by the ACT Electoral Comission. There's no separate paper version. Both
 paper and electronic versions are given in a single file.
 
-BrindabellaTotal.txt 
+BrindabellaTotal.txt
 GinninderraTotal.txt
 MolongloTotal.txt
 
@@ -586,32 +745,38 @@ static void load_act_ballots(PGconn *conn)
     Loading electorate data is hard wired since the input data specifies the
     electorate by the name of the file.
     The (fixed) index codes as defined in the data 'electorates.txt' are
-    Brindabella = 1, Ginninderra = 2, Kurrajong = 3, 
+    Brindabella = 1, Ginninderra = 2, Kurrajong = 3,
     Murrumbidgee = 4, Yerrabi = 5, Test = 6
   */
-
-
-  load_ballots_for_electorate(conn, 1, "BrindabellaTotal.txt");  
-  load_ballots_for_electorate(conn, 2, "GinninderraTotal.txt");  
-  load_ballots_for_electorate(conn, 3, "KurrajongTotal.txt");  
-  load_ballots_for_electorate(conn, 4, "MurrumbidgeeTotal.txt");  
-  load_ballots_for_electorate(conn, 5, "YerrabiTotal.txt");  
-
-  /* load_csv_batch_pp_entry(conn, "PollingPlaceBatchNumbers.txt"); */
-  load_polling_place_and_batch(conn); 
-  
-  insert_confirmed_csv_ballots(conn, 1);  
-  insert_confirmed_csv_ballots(conn, 2);
-  insert_confirmed_csv_ballots(conn, 3);  
-  insert_confirmed_csv_ballots(conn, 4);
-  insert_confirmed_csv_ballots(conn, 5);  
-
+  static const char *ballot_files[] = {
+    "BrindabellaTotal.txt",
+    "GinninderraTotal.txt",
+    "KurrajongTotal.txt",
+    "MurrumbidgeeTotal.txt",
+    "YerrabiTotal.txt",
+  };
+#define NUM_ACT_ELECTORATES (sizeof(ballot_files)/sizeof(ballot_files[0]))
+  struct csv_prefs prefs[NUM_ACT_ELECTORATES];
+  unsigned int i;
+
+  for (i = 0; i < NUM_ACT_ELECTORATES; i++)
+    load_ballots_for_electorate(conn, &prefs[i], i + 1, ballot_files[i]);
+
+  load_polling_place_and_batch(conn, prefs, NUM_ACT_ELECTORATES);
+
+  for (i = 0; i < NUM_ACT_ELECTORATES; i++) {
+    insert_confirmed_csv_ballots(conn, &prefs[i]);
+    free_csv_prefs(&prefs[i]);
+  }
 }
 
 static void load_test_ballots(PGconn *conn)
 {
-  load_ballots_for_electorate(conn, 6, "tblTestPaper.txt");  
-  insert_confirmed_csv_ballots(conn, 6);  
+  struct csv_prefs prefs;
+
+  load_ballots_for_electorate(conn, &prefs, 6, "tblTestPaper.txt");
+  insert_confirmed_csv_ballots(conn, &prefs);
+  free_csv_prefs(&prefs);
 }
 
 
@@ -619,10 +784,10 @@ static void create_csv_pref_entry_table(PGconn *conn)
 {
   /*
     Create csv_pref_entry table.
-    
+
     NOTE: Ignore failure of DROP TABLE commands.
-  
-  
+
+
     The primary key has to be generated as we have to cope with bogus votes
     (e.g. doubled up preference recordings) -- darn!
 
@@ -686,7 +851,8 @@ static void create_and_load_evacs_tables(PGconn *conn)
   create_electorate_table(conn);
   create_party_table(conn);
   create_candidate_table(conn);
-  create_csv_pref_entry_table(conn);
+  if (load_staging_tables)
+    create_csv_pref_entry_table(conn);
 
 
 
@@ -697,16 +863,20 @@ static void create_and_load_evacs_tables(PGconn *conn)
   load_electorates(conn);
 
   create_polling_place_table(conn);
-  create_batch_table(conn); 
+  create_batch_table(conn);
   create_confirmed_vote_tables(conn);
-  create_csv_batch_pp_table(conn);
-
+  if (load_staging_tables)
+    create_csv_batch_pp_table(conn);
 
 
 
+  /* One transaction for the bulk load, so a bad input file leaves
+     nothing half loaded. */
+  begin(conn);
   load_groups(conn);
   load_candidates(conn);
-  load_act_ballots(conn); 
+  load_act_ballots(conn);
+  commit(conn);
 
 
   //load_test_ballots(conn);
@@ -754,6 +924,12 @@ int main(int argc, char *argv[])
   //conn = create_first_time_database(DATABASE_NAME);  
   //exit(0);
 
+  if (argc > 1 && strcmp(argv[1], "--staging") == 0) {
+    load_staging_tables = true;
+    argc--;
+    argv++;
+  }
+
   if (argc == 1) {
     csv_files_path = null_path;
     printf("Using csv files from local dir\n");
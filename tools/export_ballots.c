@@ -40,6 +40,7 @@
 #define DEFINE_SQL_SINGLETON
 #define DEFINE_PRODUCE_COLLAPSED_MAP
 #include "export_ballots.h"
+#include <common/preference_codec.h>
 
 
 #define OUTPUTROOT "/tmp/evacs_export"
@@ -633,27 +634,28 @@ static bool is_formal(struct preference_set *vote)
 struct preference_set *unpack_preferences(const char *preference_list)
 {
 	struct preference_set *vote;
-	char *pref_ptr;   
-	unsigned int num_preferences=0,i;
+	const char *pref_ptr;
+	size_t len = strlen(preference_list);
+	unsigned int num_preferences,i;
 	unsigned int pref_number, group_index, db_cand_index;
 
-	for (pref_ptr=(char *)preference_list;
-	     strlen(pref_ptr)>=DIGITS_PER_PREF;
-	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_preferences++);
-	
-	if ( strlen(pref_ptr)) 
+	if (len % DIGITS_PER_PREF)
 		bailout("Malformed preference list: '%s'\n",preference_list);
+	num_preferences = len / DIGITS_PER_PREF;
 	
 	vote = malloc(sizeof(*vote)
 			+ sizeof( vote->candidates[0]) * num_preferences);
 	vote->num_preferences = num_preferences;
 	
 	/* They may not be in order */
-	for (pref_ptr=(char *)preference_list, i = 0;
-	     i < vote->num_preferences; 
-	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
+	for (pref_ptr=preference_list, i = 0;
+	     i < num_preferences; 
+	     i++,pref_ptr += DIGITS_PER_PREF)
 	{
-		sscanf(pref_ptr,"%2u%2u%2u",&pref_number,&group_index,&db_cand_index);
+		if (!decode_preference(pref_ptr, &pref_number,
+				       &group_index, &db_cand_index))
+			bailout("Malformed preference list: '%s'\n",
+				preference_list);
 	
 		vote->candidates[i].prefnum=pref_number;
 		vote->candidates[i]
@@ -0,0 +1,189 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <common/evacs.h>
+#include <common/http.h>
+#include <common/asset_bundle.h>
+#include "voting_client.h"
+#include "message.h"
+#include "assets.h"
+
+/* Room for the server's index: a line for each electorate's bundle */
+#define ASSET_INDEX_SIZE 8192
+
+static struct asset_bundle **bundles = NULL;
+static unsigned int num_bundles = 0;
+
+/* Write the downloaded bundle into the cache */
+static bool save_bundle(const char *path, const char *data, size_t size)
+{
+	char *tmp_path;
+	size_t written;
+	int fd;
+
+	/* Beside the old copy, so a crash never leaves half of one */
+	tmp_path = sprintf_malloc("%s.tmp", path);
+	fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd < 0) {
+		free(tmp_path);
+		return false;
+	}
+
+	/* Beware partial writes */
+	for (written = 0; written < size; ) {
+		ssize_t res = write(fd, data + written, size - written);
+
+		if (res <= 0)
+			break;
+		written += res;
+	}
+	if (close(fd) != 0 || written != size
+	    || rename(tmp_path, path) != 0) {
+		unlink(tmp_path);
+		free(tmp_path);
+		return false;
+	}
+	free(tmp_path);
+	return true;
+}
+
+static void add_bundle(struct asset_bundle *bundle)
+{
+	bundles = realloc(bundles, (num_bundles + 1) * sizeof(*bundles));
+	if (!bundles)
+		display_error(ERR_INTERNAL);
+	bundles[num_bundles++] = bundle;
+}
+
+/* A bundle we don't have a current copy of */
+struct download
+{
+	char *name;
+	char *path;
+};
+
+/* A bundle has arrived: save it in the cache and map it */
+static void bundle_downloaded(void *arg, unsigned int i,
+			      char *data, size_t size)
+{
+	const struct download *d = (const struct download *)arg + i;
+	struct asset_bundle *bundle = NULL;
+
+	if (data && save_bundle(d->path, data, size))
+		bundle = asset_bundle_map(d->path);
+	free(data);
+
+	if (bundle)
+		add_bundle(bundle);
+	else
+		fprintf(stderr, "Could not load asset bundle %s\n", d->name);
+}
+
+/* Map every bundle in the server's index, fetching those we don't
+   already have in one pipeline */
+void load_assets(void)
+{
+	struct http_connection *server;
+	struct download *downloads = NULL;
+	const char **urls = NULL;
+	unsigned int num_downloads = 0, i;
+	char index[ASSET_INDEX_SIZE], *line, *next;
+	ssize_t len;
+
+	if (mkdir(ASSET_CACHE_DIR, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create %s: %s\n",
+			ASSET_CACHE_DIR, strerror(errno));
+		return;
+	}
+
+	server = http_connection(SERVER_ADDRESS, SERVER_PORT);
+	len = server ? http_conn_read(server, ASSET_BUNDLE_INDEX,
+				      index, sizeof(index) - 1) : -1;
+	if (len < 0) {
+		fprintf(stderr, "No asset bundles on the server\n");
+		return;
+	}
+	index[len] = '\0';
+
+	for (line = index; *line; line = next) {
+		struct asset_bundle *bundle;
+		unsigned long long stamp;
+		char name[64], *path;
+
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		/* The name becomes a local path: keep it in the cache */
+		if (sscanf(line, "%63s %llx", name, &stamp) != 2
+		    || strchr(name, '/') || name[0] == '.')
+			continue;
+
+		path = sprintf_malloc("%s/%s", ASSET_CACHE_DIR, name);
+		bundle = asset_bundle_map(path);
+		if (bundle && asset_bundle_stamp(bundle) == stamp) {
+			add_bundle(bundle);
+			free(path);
+			continue;
+		}
+		if (bundle)
+			asset_bundle_unmap(bundle);
+
+		downloads = realloc(downloads,
+				    (num_downloads + 1) * sizeof(*downloads));
+		urls = realloc(urls, (num_downloads + 1) * sizeof(*urls));
+		if (!downloads || !urls)
+			display_error(ERR_INTERNAL);
+		downloads[num_downloads].name = strdup(name);
+		downloads[num_downloads].path = path;
+		urls[num_downloads] = sprintf_malloc("%s%s", ASSET_BUNDLE_DIR,
+						     name);
+		num_downloads++;
+	}
+
+	if (num_downloads)
+		http_conn_get_pipelined(server, urls, num_downloads,
+					bundle_downloaded, downloads);
+
+	for (i = 0; i < num_downloads; i++) {
+		free(downloads[i].name);
+		free(downloads[i].path);
+		free((char *)urls[i]);
+	}
+	free(downloads);
+	free(urls);
+}
+
+const void *find_asset(const char *url, size_t *size)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_bundles; i++) {
+		const void *data = asset_bundle_find(bundles[i], url, size);
+
+		if (data)
+			return data;
+	}
+	return NULL;
+}
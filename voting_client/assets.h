@@ -0,0 +1,32 @@
+#ifndef _ASSETS_H
+#define _ASSETS_H
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* The booth's local copy of the server's asset bundles */
+#include <stddef.h>
+
+/* Where the booth keeps the bundles between boots */
+#define ASSET_CACHE_DIR "/tmp/evacs-assets"
+
+/* Fetch any bundles we don't already have from the server, and map
+   them all.  Assets not found this way are fetched one at a time. */
+extern void load_assets(void);
+
+/* The contents of the asset at this URL, or NULL if it wasn't
+   bundled.  Do not free. */
+extern const void *find_asset(const char *url, size_t *size);
+#endif /*_ASSETS_H*/
@@ -22,23 +22,26 @@
 #include <sys/wait.h>
 #include <common/evacs.h>
 #include <common/http.h>
+#include <common/asset_bundle.h>
 #include "message.h"
+#include "assets.h"
 #include "audio.h"
 #include "child_audio.h"
 
 static pid_t child = 0;
 static int pipe_to_child;
 
-/* Simple linked list of samples (we don't have that many) */
+/* Samples already fetched, hashed by URL */
+#define AUDIO_CACHE_BUCKETS 256
 struct audio
 {
 	struct audio *next;
 	size_t size;
-	unsigned char *sample;
+	const unsigned char *sample;
 	/* Name hangs off end of structure */
 	char name[0];
 };
-static struct audio *audio_cache = NULL;
+static struct audio *audio_cache[AUDIO_CACHE_BUCKETS];
 
 /* Initialize the audio */
 void audio_init(void)
@@ -92,7 +95,7 @@ struct audio *get_audio(const char *fmt, ...)
 {
 	char *tmp;
 	char *url;
-	struct audio *i;
+	struct audio *i, **bucket;
 
 	va_list arglist;
 	assert(child);
@@ -104,7 +107,8 @@ struct audio *get_audio(const char *fmt, ...)
 	url = sprintf_malloc("%s%s", AUDIO_BASE, tmp);
 	free(tmp);
 
-	for (i = audio_cache; i; i=i->next) {
+	bucket = &audio_cache[asset_hash(url) % AUDIO_CACHE_BUCKETS];
+	for (i = *bucket; i; i=i->next) {
 		if (strcmp(i->name, url) == 0) {
 			free(url);
 			return i;
@@ -116,12 +120,17 @@ struct audio *get_audio(const char *fmt, ...)
 	if (!i) display_error(ERR_INTERNAL);
 	sprintf(i->name, "%s", url);
 
+	/* Use the bundle fetched at boot, otherwise ask the server */
+	i->sample = find_asset(i->name, &i->size);
 	/* SIPL 2011: Added cast to match
 	 *   defined type of sample. */
-	/* i->sample = http_get(SERVER_ADDRESS, SERVER_PORT, i->name, &i->size); */
-	i->sample = (unsigned char *)http_get(SERVER_ADDRESS, SERVER_PORT, i->name, &i->size);
+	if (!i->sample)
+		i->sample = (unsigned char *)http_get(SERVER_ADDRESS,
+						      SERVER_PORT, i->name,
+						      &i->size);
 	if (!i->sample) {
 		free(i);
+		free(url);
 #if 0
 		display_error(ERR_SERVER_UNREACHABLE);
 #else
@@ -129,9 +138,9 @@ struct audio *get_audio(const char *fmt, ...)
 #endif
 	}
 
-	/* Sew it into head of list */
-	i->next = audio_cache;
-	audio_cache = i;
+	/* Sew it into head of its bucket */
+	i->next = *bucket;
+	*bucket = i;
 
 	free(url);
 	return i;
@@ -148,7 +157,7 @@ static void send_header(size_t size, enum command command)
 }
 
 /* Send the sample contents */
-static void send_sample(unsigned char *sample, size_t size)
+static void send_sample(const unsigned char *sample, size_t size)
 {
 	unsigned int written;
 
@@ -164,7 +173,8 @@ static void send_sample(unsigned char *sample, size_t size)
 }
 
 /* Actually tell the child to do something. */
-static void play(unsigned char *sample, size_t size, enum command command)
+static void play(const unsigned char *sample, size_t size,
+		 enum command command)
 {
 	/* First send header */
 	send_header(size, command);
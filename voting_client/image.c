@@ -14,6 +14,7 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <unistd.h>
 #include <stdint.h>
@@ -21,9 +22,11 @@
 #include <errno.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
-#include <png.h>
 #include <common/http.h>
+#include <common/asset_bundle.h>
+#include <common/rgb565.h>
 #include "image.h"
+#include "assets.h"
 #include "voting_client.h"
 
 #define USB_SERIAL_DEVICE "/dev/usb/ttyUSB0"
@@ -38,7 +41,8 @@ struct image {
 	struct image *highlighted_image;
 };
 
-/* Simple linked list of images (we don't have that many) */
+/* Images already decoded, hashed by URL */
+#define IMAGE_CACHE_BUCKETS 256
 struct image_list
 {
 	struct image_list *next;
@@ -47,7 +51,7 @@ struct image_list
 	char name[0];
 };
 
-static struct image_list *image_cache = NULL;
+static struct image_list *image_cache[IMAGE_CACHE_BUCKETS];
 static Display *x_display;
 static Window x_window;
 static bool upside_down;
@@ -151,181 +155,149 @@ bool clear_screen(void)
 	return true;
 }
 
-/* The colour of gray (in 5 bits) */
-/* SIPL 2014-05-23 Increased from 20 to 25.
-   NB Since it is a five-bit value, 31 is the maximum, which corresponds
-   to white.
- */
-#define HIGHLIGHT_GRAY 25
-static struct image *create_highlight(XImage *oldimage,
-				      unsigned int width,
-				      unsigned int height)
+/* An X image of these 16-bit pixels, which it uses where they are */
+static XImage *create_ximage(unsigned int width, unsigned int height,
+			     const uint16_t *pixels)
+{
+	int screen = DefaultScreen(x_display);
+
+	/* XPutImage only reads the data, so it can be a bundle's
+	   read-only map */
+	return XCreateImage(x_display, DefaultVisual(x_display, screen),
+			    DefaultDepth(x_display, screen), ZPixmap, 0,
+			    (char *)pixels, width, height, 8, 0);
+}
+
+/* The highlighted version of an image: from these highlighted pixels
+   if we have them, otherwise highlight a copy of its own. */
+static struct image *create_highlight(const struct image *oldimage,
+				      const uint16_t *highlighted)
 {
-	unsigned int x, y;
+	size_t num = (size_t)oldimage->width * oldimage->height;
 	struct image *newimage;
+	uint16_t *pixels = NULL;
 
 	newimage = malloc(sizeof(*newimage));
 	if (!newimage) return NULL;
-	newimage->width = width;
-	newimage->height = height;
-
-	newimage->image = XCreateImage(x_display,
-				       DefaultVisual(x_display,
-						     DefaultScreen(x_display)),
-				       oldimage->depth,
-				       oldimage->format, 0, NULL,
-				       width, height,
-				       oldimage->bitmap_pad,
-				       oldimage->bytes_per_line);
-	if (!newimage->image) {
-		free(newimage);
-		return NULL;
+	newimage->width = oldimage->width;
+	newimage->height = oldimage->height;
+	newimage->highlighted_image = NULL;
+
+	if (!highlighted) {
+		pixels = malloc(num * sizeof(*pixels));
+		if (!pixels) {
+			free(newimage);
+			return NULL;
+		}
+		rgb565_highlight(pixels,
+				 (const uint16_t *)oldimage->image->data, num);
+		highlighted = pixels;
 	}
-	newimage->image->data = malloc(newimage->image->bytes_per_line
-				       * height);
-	if (!newimage->image->data) {
-		XDestroyImage(newimage->image);
+
+	newimage->image = create_ximage(newimage->width, newimage->height,
+					highlighted);
+	if (!newimage->image) {
+		free(pixels);
 		free(newimage);
 		return NULL;
 	}
-	/* Copy data across */
-	memcpy(newimage->image->data, oldimage->data,
-	       newimage->image->bytes_per_line * height);
-	
-	for (x = 0; x < width; x++) {
-		for (y = 0; y < height;y++) {
-			uint16_t *ptr;
-
-			ptr = (uint16_t *)newimage->image->data
-				+ x + y*width;
-			/* If any color brighter than grey, all grey */
-			if (((*ptr >> 11) & 0x1f) > HIGHLIGHT_GRAY
-			    || ((*ptr >> 6) & 0x1f) > HIGHLIGHT_GRAY
-			    || (*ptr & 0x1f) > HIGHLIGHT_GRAY) {
-				*ptr = (HIGHLIGHT_GRAY << 11)
-					| (HIGHLIGHT_GRAY << 6)
-					| (HIGHLIGHT_GRAY);
-			}
-		}
-	}
 	return newimage;
 }
 
-/* Function to "read" from the memory area */
-static void my_read(png_structp png_ptr, png_bytep data, png_size_t length)
+/* A frame's pixels the right way up: in place in the bundle if we're
+   upright, otherwise our own rotated copy. */
+static const uint16_t *frame_pixels(const uint16_t *pixels, size_t num)
 {
-	void *ptr = png_get_io_ptr(png_ptr);
+	uint16_t *rotated;
+
+	if (!upside_down)
+		return pixels;
 
-	memcpy(data, ptr, length);
-	/* Reset read function with updated pointer */
-	png_set_read_fn(png_ptr, ptr + length, my_read);
+	rotated = malloc(num * sizeof(*rotated));
+	if (!rotated)
+		return NULL;
+	rgb565_rotate(rotated, pixels, num);
+	return rotated;
 }
 
-static XImage *png_to_ximage(void *buf, size_t size,
-			     unsigned int *width, unsigned int *height)
+/* Find the bundled, pre-decoded version of an image.  False if there
+   isn't one (or it isn't usable). */
+static bool get_frame(const char *url, bool with_highlight,
+		      struct image *image, const uint16_t **highlighted)
 {
-	int bit_depth, color_type;
-	png_structp png_ptr;
-	png_infop info_ptr;
-	unsigned int row;
-	uint16_t *image_data;
-	XImage *image;
-	png_uint_32 w, h;
-	int screen;
-
-	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-					 (png_voidp)NULL, NULL, NULL);
-	info_ptr = png_create_info_struct(png_ptr);
-
-	png_set_read_fn(png_ptr, buf, my_read);
-	png_read_info(png_ptr, info_ptr);
-	png_get_IHDR(png_ptr, info_ptr, &w, &h, &bit_depth, &color_type,
-		     NULL, NULL, NULL);
-	if (color_type != PNG_COLOR_TYPE_RGB
-	    && color_type != PNG_COLOR_TYPE_RGB_ALPHA) {
-		fprintf(stderr, "PNG must be RGB or RGBA!\n");
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		return NULL;
-	}
-		
-	if (bit_depth != 8) {
-		fprintf(stderr, "PNG bit depth %i not 24!\n", bit_depth);
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		return NULL;
-	}
+	char frame_url[strlen(url) + sizeof(ASSET_FRAME_SUFFIX)];
+	const struct asset_frame *frame;
+	const uint16_t *pixels;
+	size_t size, num;
+
+	sprintf(frame_url, "%s%s", url, ASSET_FRAME_SUFFIX);
+	frame = find_asset(frame_url, &size);
+	if (!frame || size < sizeof(*frame))
+		return false;
+	num = (size_t)frame->width * frame->height;
+	if (size != sizeof(*frame) + 2 * num * sizeof(*pixels))
+		return false;
 
-	/* Discard any alpha channels */
-	if (color_type & PNG_COLOR_MASK_ALPHA)
-		png_set_strip_alpha(png_ptr);
-
-	/* Create an X Image */
-	screen = DefaultScreen(x_display);
-	image = XCreateImage(x_display,
-			     DefaultVisual(x_display, screen),
-			     DefaultDepth(x_display, screen),
-			     ZPixmap, 0, NULL,
-			     w, h,
-			     8, 0);
-	if (!image) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		return NULL;
-	}
+	pixels = frame_pixels((const uint16_t *)(frame + 1), num);
+	if (!pixels)
+		return false;
+	image->width = frame->width;
+	image->height = frame->height;
+	image->image = create_ximage(image->width, image->height, pixels);
+	if (!image->image)
+		return false;
 
-	/* Now allocate space for it (16-bit == 2 bytes). */
-	image_data = malloc(w * h * 2);
-	if (!image_data) {
-		XDestroyImage(image);
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		return NULL;
-	}
+	*highlighted = NULL;
+	if (with_highlight)
+		*highlighted = frame_pixels((const uint16_t *)(frame + 1)
+					    + num, num);
+	return true;
+}
 
-	/* Do depth conversion on the fly as we read it. */
-	for (row = 0; row < h; row++) {
-		png_byte rowptr[w * 3];
-		unsigned int x, real_x;
-		unsigned int real_row;
-
-		/* If they want it upside down, simply fill from the bottom */
-		if (upside_down) real_row = h - row - 1;
-		else real_row = row;
-
-		png_read_row(png_ptr, rowptr, NULL);
-		for (x = 0; x < w; x++) {
-			unsigned int old_r, old_g, old_b;
-
-			/* We want rotated, not mirror image! */
-			if (upside_down) real_x = w - x - 1;
-			else real_x = x;
-
-			old_r = rowptr[x * 3];
-			old_g = rowptr[x * 3 + 1];
-			old_b = rowptr[x * 3 + 2];
-
-			/* Five bits red, six green, five blue. */
-			image_data[real_row * w + real_x] 
-				= ((old_r >> 3) << 11)
-				| ((old_g >> 2) << 5)
-				| (old_b >> 3);
-		}
+/* Decode the image from its PNG, bundled or from the server */
+static bool get_png(const char *url, struct image *image)
+{
+	char *buf = NULL;
+	const void *data;
+	uint16_t *pixels;
+	size_t size;
+
+	/* Use the bundle fetched at boot, otherwise ask server for image */
+	data = find_asset(url, &size);
+	if (!data) {
+		buf = http_get(SERVER_ADDRESS, SERVER_PORT, url, &size);
+		if (!buf)
+			return false;
+		data = buf;
 	}
-	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-	image->data = (void *)image_data;
 
-	*width = w;
-	*height = h;
+	pixels = rgb565_decode_png(data, size, &image->width, &image->height);
+	free(buf);
+	if (!pixels)
+		return false;
+
+	/* If they want it upside down, rotate it (not mirror image!) */
+	if (upside_down)
+		rgb565_rotate(pixels, pixels,
+			      (size_t)image->width * image->height);
 
-	return image;
+	image->image = create_ximage(image->width, image->height, pixels);
+	if (!image->image) {
+		free(pixels);
+		return false;
+	}
+	return true;
 }
 
 /* Given a URL, return the image or (or data = NULL for error). */
 struct image *get_image(const char *url, bool with_highlight)
 {
-	char *buf;
-	struct image_list *i;
-	size_t size;
+	const uint16_t *highlighted = NULL;
+	struct image_list *i, **bucket;
 
 	/* If it's in the cache, return that */
-	for (i = image_cache; i; i=i->next) 
+	bucket = &image_cache[asset_hash(url) % IMAGE_CACHE_BUCKETS];
+	for (i = *bucket; i; i=i->next) 
 		if (strcmp(i->name, url) == 0) return &i->image;
 
 	/* Otherwise, create new cache entry. */
@@ -333,26 +305,16 @@ struct image *get_image(const char *url, bool with_highlight)
 	if (!i) return NULL;
 	strcpy(i->name, url);
 
-	/* Ask server for image */
-	buf = http_get(SERVER_ADDRESS, SERVER_PORT, url, &size);
-	if (!buf) {
+	/* Ready to display if it's bundled, otherwise decode it */
+	if (!get_frame(url, with_highlight, &i->image, &highlighted)
+	    && !get_png(url, &i->image)) {
 		free(i);
 		return NULL;
 	}
 
-	i->image.image = png_to_ximage(buf, size,
-				       &i->image.width, &i->image.height);
-	if (!i->image.image) {
-		free(buf);
-		free(i);
-		return NULL;
-	}
-	free(buf);
-
 	if (with_highlight) {
 		i->image.highlighted_image
-			= create_highlight(i->image.image,
-					   i->image.width, i->image.height);
+			= create_highlight(&i->image, highlighted);
 		if (!i->image.highlighted_image) {
 			free(i);
 			return NULL;
@@ -361,9 +323,9 @@ struct image *get_image(const char *url, bool with_highlight)
 		i->image.highlighted_image = NULL;
 	}
 
-	/* Sew it into head of list */
-	i->next = image_cache;
-	image_cache = i;
+	/* Sew it into head of its bucket */
+	i->next = *bucket;
+	*bucket = i;
 	return &i->image;
 }
 
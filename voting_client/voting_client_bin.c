@@ -18,6 +18,7 @@
 #include "message.h"
 #include "input.h"
 #include "audio.h"
+#include "assets.h"
 #include "initiate_session.h"
 #include "accumulate_preferences.h"
 
@@ -33,6 +34,8 @@ int main(int argc, char *argv[])
 	}
 	/* If we have an argument, monitor is upside down */
 	initialise_display(atoi(argv[1]), atoi(argv[2]), (argc == 4));
+	/* Everything the voters will see and hear, before the first one */
+	load_assets();
 	audio_init();
 	if (!initialize_input())
 		display_error(ERR_INTERNAL);
@@ -27,6 +27,7 @@
 #include <common/database.h>
 #include <common/http.h>
 #include "voting_server.h"
+#include "voting_daemon.h"
 #include "cgi.h"
 
 struct barcode_hash_entry
@@ -34,33 +35,38 @@ struct barcode_hash_entry
 	unsigned int ecode;
 	unsigned int ppcode;
 	bool used;
-	char barcodehash[HASH_BITS + 1];
+	unsigned char barcodehash[HASH_BYTES];
 };
 
 /* DDS3.2.4: Get Barcode Hash Table */
-/* Returns electorate code, or NULL if not found */
-static struct barcode_hash_entry *get_bhash_table(PGconn *conn,
-						  const char *barcodehash)
+/* Fills in entry, or returns false if not found */
+static bool get_bhash_table(PGconn *conn,
+			    const unsigned char barcodehash[HASH_BYTES],
+			    struct barcode_hash_entry *entry)
 {
-	struct barcode_hash_entry *ret=NULL;
 	PGresult *result=NULL;
+	bool found = false;
+	/* The hash goes as a binary (bytea) parameter */
+	const char *param = (const char *)barcodehash;
+	static const int length = HASH_BYTES, format = 1;
+
+	/* Looked up for every voter, so prepared once per connection */
+	result = SQL_prepared(conn, "get_bhash_table",
+			      "SELECT electorate_code,polling_place_code, used "
+			      "FROM barcode "
+			      "WHERE hash = $1;", 1, &param, &length, &format);
 
-	result = SQL_query(conn,
-			   "SELECT electorate_code,polling_place_code, used "
-			   "FROM barcode "
-			   "WHERE hash = '%s';",barcodehash);
-	
 	if (PQntuples(result) >= 1) {
-	  ret = malloc(sizeof(*ret));
-	  ret->ecode = atoi(PQgetvalue(result,0,0));
-	  ret->ppcode = atoi(PQgetvalue(result,0,1));
+	  entry->ecode = atoi(PQgetvalue(result,0,0));
+	  entry->ppcode = atoi(PQgetvalue(result,0,1));
 	  /* Booleans are either "t" or "f" */
-	  ret->used = (PQgetvalue(result,0,2)[0] == 't');
-	  strcpy(ret->barcodehash,barcodehash);
+	  entry->used = (PQgetvalue(result,0,2)[0] == 't');
+	  memcpy(entry->barcodehash,barcodehash,HASH_BYTES);
+	  found = true;
 	}
 	PQclear(result);
 
-	return ret;
+	return found;
 }
 
 /* SIPL 2011-06-22: Support split groups.*/
@@ -166,11 +172,27 @@ static struct http_vars *get_ballot_contents(PGconn *conn,unsigned int ecode,
 	return vars;
 }
 
+/* Responses already built, one per electorate: the ballot contents
+   don't change while polling, so a long-lived process builds each one
+   once. */
+struct cached_response {
+	struct cached_response *next;
+	unsigned int code;
+	struct http_vars *vars;
+};
+
 /* Send the electorate and ballot contents */
-static struct http_vars *create_response(PGconn *conn, struct electorate *elec)
+static const struct http_vars *create_response(PGconn *conn,
+					       const struct electorate *elec)
 {
+	static struct cached_response *cache = NULL;
+	struct cached_response *i;
 	struct http_vars *vars;
 
+	for (i = cache; i; i = i->next)
+		if (i->code == elec->code)
+			return i->vars;
+
 	/* Start with the electorate information */
 	vars = malloc(sizeof(*vars) * 3);
 	vars[0].name = strdup("electorate_name");
@@ -181,86 +203,94 @@ static struct http_vars *create_response(PGconn *conn, struct electorate *elec)
 	vars[2].value = sprintf_malloc("%u", elec->num_seats);
 
 	/* Get the ballot contents stuff. */
-	return get_ballot_contents(conn, elec->code,vars);
+	i = malloc(sizeof(*i));
+	i->code = elec->code;
+	i->vars = get_ballot_contents(conn, elec->code,vars);
+	i->next = cache;
+	cache = i;
+	return i->vars;
 }
 
 /* DDS3.2.3: Authenticate */
-int main(int argc, char *argv[])
+enum error check_barcode(PGconn *conn, const struct barcode *bc,
+			 const struct http_vars **response)
 {
-	struct http_vars *vars;
-	struct barcode_hash_entry *bcentry;
-	struct barcode bc;
-	char bchash[HASH_BITS+1];
-	struct electorate *elecs, *i;
-	PGconn *conn;
+	struct barcode_hash_entry bcentry;
+	unsigned char bchash[HASH_BYTES];
+	const struct electorate *elec;
 	int ppcode;
-	
-	fprintf(stderr,"authenticate: running as %s\n",getlogin());
-	fprintf(stderr,"authenticate: Starting authentication\n");
 
-	/* Our own failure function */
-	set_cgi_bailout();
-	fprintf(stderr,"authenticate: set bailout\n");
-	fprintf(stderr,"authenticate: get_database_port() will return %s\n",get_database_port());
+	/* Hash the barcode to look up in the table */
+	gen_hash(bchash, bc->data, sizeof(bc->data));
 
-	/* Can be called on slave as well as master */
-	conn = connect_db_port("evacs", get_database_port());
-	if (!conn) bailout("authenticate:Could not open database connection:\n%s\n",PQerrorMessage(conn));
+	if (!get_bhash_table(conn, bchash, &bcentry)) {
+		fprintf(stderr, "Barcode `%s' not found\n", bc->ascii);
+		return ERR_BARCODE_AUTHENTICATION_FAILED;
+	}
+
+	/* DDS3.2.4: Check Unused */
+	if (bcentry.used) {
+		fprintf(stderr, "Barcode `%s' already used\n", bc->ascii);
+		return ERR_BARCODE_USED;
+	}
+
+	ppcode = server_polling_place(conn);
+	if (ppcode < 0)
+		return ERR_SERVER_INTERNAL;
+	/* SIPL 2013-03-24 Fix typo "pooling" -> "polling". */
+	fprintf(stderr,"polling place code, %i\n",bcentry.ppcode);
+	if (ppcode != bcentry.ppcode)
+		return ERR_BARCODE_PP_INCORRECT;
+
+	elec = lookup_electorate(conn, bcentry.ecode);
+	if (!elec)
+		/* Should never happen */
+		bailout("Barcode electorate %u not found\n", bcentry.ecode);
+
+	*response = create_response(conn, elec);
+	return ERR_OK;
+}
+
+void authenticate_request(PGconn *conn, const struct http_vars *vars)
+{
+	const struct http_vars *response;
+	struct barcode bc;
+	enum error err;
 
 	/* Copy barcode ascii code from POST arguments */
-	vars = cgi_get_arguments();
 	strncpy(bc.ascii, http_string(vars, "barcode"), sizeof(bc.ascii)-1);
 	bc.ascii[sizeof(bc.ascii)-1] = '\0';
-	http_free(vars);
 
 	/* Extract data and checksum from ascii */
 	if (!bar_decode_ascii(&bc))
 		cgi_error_response(ERR_BARCODE_MISREAD);
 
-	/* Hash the barcode to look up in the table */
-	gen_hash(bchash, bc.data, sizeof(bc.data));
+	err = check_barcode(conn, &bc, &response);
+	if (err != ERR_OK)
+		cgi_error_response(err);
 
-	bcentry = get_bhash_table(conn, bchash);
-	if (!bcentry) {
-		PQfinish(conn);
-		fprintf(stderr, "Barcode `%s' not found\n", bc.ascii);
-		cgi_error_response(ERR_BARCODE_AUTHENTICATION_FAILED);
-	}
+	cgi_good_response(response);
+}
 
-	/* DDS3.2.4: Check Unused */
-	if (bcentry->used) {
-		PQfinish(conn);
-		fprintf(stderr, "Barcode `%s' already used\n", bc.ascii);
-		cgi_error_response(ERR_BARCODE_USED);
-	}
+#ifndef VOTING_DAEMON
+int main(int argc, char *argv[])
+{
+	struct http_vars *vars;
+	PGconn *conn;
+	
+	fprintf(stderr,"authenticate: running as %s\n",getlogin());
+	fprintf(stderr,"authenticate: Starting authentication\n");
 
-	ppcode = SQL_singleton_int(conn,"SELECT polling_place_code "
-				   "FROM server_parameter;");
-	if (ppcode < 0) {
-		PQfinish(conn);
-		cgi_error_response(ERR_SERVER_INTERNAL);
-	}
-	/* SIPL 2013-03-24 Fix typo "pooling" -> "polling". */
-	fprintf(stderr,"polling place code, %i\n",bcentry->ppcode);
-	if (ppcode != bcentry->ppcode) {
-		PQfinish(conn);
-		cgi_error_response(ERR_BARCODE_PP_INCORRECT);
-	}
+	/* Our own failure function */
+	set_cgi_bailout();
+	fprintf(stderr,"authenticate: set bailout\n");
+	fprintf(stderr,"authenticate: get_database_port() will return %s\n",get_database_port());
 
-	elecs = get_electorates(conn);
-	for (i = elecs; i; i = i->next) {
-		if (i->code == bcentry->ecode) {
-			/* Found it! */
-			vars = create_response(conn, i);
-			free_electorates(elecs);
-			PQfinish(conn);
-			cgi_good_response(vars);
-		}
-	}
+	/* Can be called on slave as well as master */
+	conn = connect_db_port("evacs", get_database_port());
+	if (!conn) bailout("authenticate:Could not open database connection:\n%s\n",PQerrorMessage(conn));
 
-	/* Should never happen */
-	free_electorates(elecs);
-	PQfinish(conn);
-	bailout("Barcode electorate %u not found\n", bcentry->ecode);
+	vars = cgi_get_arguments();
+	authenticate_request(conn, vars);
 }
-
+#endif /* VOTING_DAEMON */
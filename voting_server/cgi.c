@@ -18,10 +18,25 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <setjmp.h>
 #include <common/evacs.h>
 #include <common/socket.h>
 #include "cgi.h"
 
+/* Where the response goes: stdout under httpd, or the client's socket
+   when the daemon is serving the request itself. */
+static int response_fd = STDOUT_FILENO;
+
+/* Set while the daemon is serving a request: responding jumps back
+   here instead of exiting. */
+static jmp_buf *request_done = NULL;
+
+/* Whether the daemon keeps the client's connection open afterwards */
+static bool keep_alive = false;
+
+/* Prevent recursion in cgi_bailout */
+static int bailing_out = 0;
+
 /* Get cgi variables (must be a POST).  Caller must free variables. */
 struct http_vars *cgi_get_arguments(void)
 {
@@ -58,27 +73,45 @@ struct http_vars *cgi_get_arguments(void)
 /* Actually do the CGI response */
 static void cgi_respond(enum error err, const struct http_vars *vars)
 {
-	char *str, errcode[sizeof("error=%u&") + INT_CHARS];
+	char *str, *response, errcode[sizeof("error=%u&") + INT_CHARS];
 
 	sprintf(errcode, "error=%u", (unsigned int)err);
 	str = http_urlencode(vars);
 	if (!str) bailout("Could not encode response\n");
 	if (strlen(str) != 0) strcat(errcode, "&");
 
-	sock_printf(STDOUT_FILENO,
-		    "Content-type: application/x-www-form-urlencoded\r\n");
-	sock_printf(STDOUT_FILENO, "Content-length: %u\r\n\r\n",
-		    strlen(errcode) + strlen(str));
-
-	sock_printf(STDOUT_FILENO, "%s%s", errcode, str);
+	/* httpd adds the status line for CGIs; the daemon must send
+	   its own.  All in one write: the daemon's client may be
+	   waiting on a kept-alive connection. */
+	response = sprintf_malloc("%s%s"
+				  "Content-type: application/x-www-form-urlencoded\r\n"
+				  "Content-length: %u\r\n\r\n%s%s",
+				  request_done ? "HTTP/1.1 200 OK\r\n" : "",
+				  request_done && !keep_alive
+				  ? "Connection: close\r\n" : "",
+				  (unsigned int)(strlen(errcode) + strlen(str)),
+				  errcode, str);
+	sock_write(response_fd, response, strlen(response));
+	free(response);
 	free(str);
 }
 
+/* The response has been sent: finish the request */
+static void cgi_finish(void)
+__attribute__((noreturn));
+
+static void cgi_finish(void)
+{
+	if (request_done)
+		longjmp(*request_done, 1);
+	exit(0);
+}
+
 /* Provide a positive http response. */
 void cgi_good_response(const struct http_vars *vars)
 {
 	cgi_respond(ERR_OK, vars);
-	exit(0);
+	cgi_finish();
 }
 
 
@@ -93,7 +126,7 @@ void cgi_error_response(enum error err)
 	struct http_vars var = { NULL, NULL };
 
 	cgi_respond(err, &var);
-	exit(0);
+	cgi_finish();
 }
 
 static void cgi_bailout(const char *fmt, va_list arglist)
@@ -101,8 +134,6 @@ __attribute__((noreturn));
 
 static void cgi_bailout(const char *fmt, va_list arglist)
 {
-	static int bailing_out = 0;
-  
 	/* Prevent recursion */
 	if (bailing_out) exit(1);
 
@@ -121,3 +152,27 @@ void set_cgi_bailout(void)
 	/* Use our bailout function, which attempts to return an error */
 	set_bailout(&cgi_bailout);
 }
+
+/* Serve one request from within a long-lived server: the response
+   (or error, if the handler bails out) goes to fd as a complete HTTP
+   reply, and we return here rather than exiting.  The caller still
+   owns vars. */
+void cgi_serve_request(int fd, bool keep, cgi_handler handler, PGconn *conn,
+		       const struct http_vars *vars)
+{
+	jmp_buf done;
+
+	response_fd = fd;
+	keep_alive = keep;
+	request_done = &done;
+	bailing_out = 0;
+
+	if (setjmp(done) == 0) {
+		handler(conn, vars);
+		/* Handlers always respond, but just in case */
+		cgi_error_response(ERR_SERVER_INTERNAL);
+	}
+
+	request_done = NULL;
+	response_fd = STDOUT_FILENO;
+}
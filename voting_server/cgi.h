@@ -17,8 +17,14 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
 /* This file covers the server's http interactions */
+#include <stdbool.h>
+#include <libpq-fe.h>
 #include <common/http.h>
 
+/* Answer one request: must finish with cgi_good_response or
+   cgi_error_response. */
+typedef void (*cgi_handler)(PGconn *conn, const struct http_vars *vars);
+
 /* Get cgi variables (must be a POST).  Caller must free variables. */
 extern struct http_vars *cgi_get_arguments(void);
 
@@ -30,4 +36,10 @@ extern void cgi_error_response(enum error err);
 
 /* Set up own bailout function */
 extern void set_cgi_bailout(void);
+
+/* Run a handler for the daemon, responding on fd (returns after the
+   response has been sent).  Unless keep_alive, the response tells the
+   client the connection is closing. */
+extern void cgi_serve_request(int fd, bool keep_alive, cgi_handler handler,
+			      PGconn *conn, const struct http_vars *vars);
 #endif /*_EXAMPLE_H*/
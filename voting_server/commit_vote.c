@@ -23,19 +23,26 @@
 #include <common/authenticate.h>
 #include <common/rotation.h>
 #include <common/cursor.h>
+#include <common/ballot_contents.h>
 #include "voting_server.h"
+#include "voting_daemon.h"
 #include "reconstruct.h"
 #include "cgi.h"
 #include "save_and_verify.h"
 
 /* This does the authenticate step as well (we need the ballot details
-   anyway) */
-static struct electorate *find_electorate(const struct barcode *barcode)
+   anyway).  It is checked on our own connection: asking this server
+   over HTTP would tie up a second daemon worker for every commit. */
+static struct electorate *find_electorate(PGconn *conn,
+					  const struct barcode *barcode)
 {
+	const struct http_vars *response;
 	enum error err;
 	struct electorate *elec;
 	fprintf(stderr,"commit_vote:find_electorate: authenticating barcode:%s\n",barcode->ascii);
-	err = authenticate(barcode, &elec);
+	err = check_barcode(conn, barcode, &response);
+	if (err == ERR_OK)
+		err = unpack_authentication(response, &elec);
 	fprintf(stderr,"commit_vote:find_electorate: authenticate returned error %i%s\n",err,err?"...this is bad..":"");
 	
 	if (err != ERR_OK)
@@ -133,9 +140,8 @@ static struct preference_set unwrap_vote(const char *vote)
 /* This commits a vote.  It operates in two modes: master and
    slave. */
 /* DDS3.2.26: Commit Vote */
-int main(int argc, char *argv[])
+void commit_vote_request(PGconn *conn, const struct http_vars *vars)
 {
-	struct http_vars *vars;
 	const char *keystrokes;
 	/* SIPL 2011-09-23 Addressed potential for buffer overflow.
 	   The array size was 10.  Now increased to 26,
@@ -149,22 +155,7 @@ int main(int argc, char *argv[])
 	int c;
 	enum error err;
 	unsigned int i;
-	PGconn *conn;
-	
 
-	fprintf(stderr,"commit_vote:Starting commit\n");
-	/* Tell the other functions to use our bailout code */
-	set_cgi_bailout();
-	fprintf(stderr,"commit_vote:Set bailout\n");
-	fprintf(stderr,"commit_vote:get_database_port() will return %s\n",get_database_port());
-	
-	conn = connect_db_port("evacs", get_database_port());
-	
-	fprintf(stderr,"commit_vote:Got port: %s\n",get_database_port());
-	/* Don't free this: we keep pointers into it */
-	vars = cgi_get_arguments();
-	fprintf(stderr,"commit_vote:Got args\n");
-	
 	/* Unwrap CGI variables */
 	strncpy(bc.ascii, http_string(vars, "barcode"), sizeof(bc.ascii)-1);
 	bc.ascii[sizeof(bc.ascii)-1] = '\0';
@@ -173,7 +164,10 @@ int main(int argc, char *argv[])
 
 	fprintf(stderr,"commit_vote:unwrapped CGI vars\n");
 	
-	elec = find_electorate(&bc);
+	/* The ballot contents are set once per authentication: drop
+	   any left from the last vote this process committed */
+	free_ballot_contents();
+	elec = find_electorate(conn, &bc);
 	fprintf(stderr,"commit_vote:found electorate\n");
 
 	keystrokes = http_string(vars, "keystrokes");
@@ -224,13 +218,34 @@ int main(int argc, char *argv[])
 	err = save_and_verify(conn, &prefs, &bc, elec, vars);
 	fprintf(stderr,"commit_vote:commit complete\n");
 
-	
 	/* Cleanup */
-	http_free(vars);
-	PQfinish(conn);
+	free(elec);
 
 	/* This will be an OK response if err = ERR_OK */
 	cgi_error_response(err);
+}
 
+#ifndef VOTING_DAEMON
+int main(int argc, char *argv[])
+{
+	struct http_vars *vars;
+	PGconn *conn;
+	
+
+	fprintf(stderr,"commit_vote:Starting commit\n");
+	/* Tell the other functions to use our bailout code */
+	set_cgi_bailout();
+	fprintf(stderr,"commit_vote:Set bailout\n");
+	fprintf(stderr,"commit_vote:get_database_port() will return %s\n",get_database_port());
+	
+	conn = connect_db_port("evacs", get_database_port());
+	
+	fprintf(stderr,"commit_vote:Got port: %s\n",get_database_port());
+	/* Don't free this: we keep pointers into it */
+	vars = cgi_get_arguments();
+	fprintf(stderr,"commit_vote:Got args\n");
+	
+	commit_vote_request(conn, vars);
 	return(0);
 }
+#endif /* VOTING_DAEMON */
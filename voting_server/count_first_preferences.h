@@ -25,18 +25,9 @@
  */
 /* Count the first preferences for each candidate in e, printing results
    to the screen */
-void do_count(struct election *e,
-	      struct ballot_list *ballots,
-	      struct candidate *vacating,
-	      const int qualification);
-
-/* These are used by casual vacancy module */
-/* Reset count number */
-void reset_count(void);
-
-/* Routine to sum all the vote values in a pile, and return the
-   truncated total */
-unsigned int truncated_vote_sum(struct ballot_list *ballots);
+void print_first_preferences(struct election *e,
+			     struct ballot_list *ballots,
+			     const int qualification);
 
 #endif /* _COUNT_FIRST_PREFERENCES_H */
 
@@ -23,7 +23,9 @@
 #include <common/database.h>
 #include <common/evacs.h>
 #include <counting/ballot_iterators.h>
+#include <counting/ballot_store.h>
 #include <counting/candidate_iterators.h>
+#include <counting/fetch.h>
 #include <counting/report.h>
 #include "count_first_preferences.h"
 #include "display_first_preferences.h"
@@ -77,11 +79,7 @@ static char *prompt_for_password()
 
 static bool free_piles(struct candidate *cand, void *unused)
 {
-  unsigned int i;
-
-  for (i = 0; i < 1; i++)
-    if (cand->c[i].pile)
-      free_ballot_list(cand->c[i].pile);
+  free_history(&cand->history);
 
   return false;
 }
@@ -101,148 +99,57 @@ static void free_group_names(struct group *groups, unsigned int num_groups)
     free(groups[i].name);
 }
 
-/* Given the non-NULL electorate, fill in all the groups, return number. */
-static unsigned int fetch_groups(PGconn *conn, 
-			  const struct electorate *elec,
-			  struct group *groups)
-{
-  PGresult *result;
-  unsigned int i;
-
-  result = SQL_query(conn,
-		     "SELECT name, abbreviation, index FROM party "
-		     "WHERE electorate_code = %u "
-		     "ORDER by index;", elec->code);
-  for (i = 0; i < PQntuples(result); i++) {
-    groups[i].name = strdup(PQgetvalue(result, i, 0));
-    groups[i].abbrev = strdup(PQgetvalue(result, i, 1));
-    groups[i].group_index = atoi(PQgetvalue(result, i, 2));
-  }
-  PQclear(result);
-  return i;
-}
-
-/* Find a group by index */
-static struct group *find_group(struct group *groups, unsigned int index)
-{
-	while (groups->group_index != index)
-		groups++;
-	return groups;
-}
-
-/* Given the group information, return the candidate list */
-static struct cand_list *fetch_candidates(PGconn *conn, 
-				   const struct electorate *elec,
-				   struct group *groups)
-{
-  struct cand_list *list = NULL;
-  unsigned int i;
-  PGresult *result;
-
-  /* By returning them in order, we help the scrutiny sheet generation */
-  result = SQL_query(conn,
-		     "SELECT name, index, party_index FROM candidate "
-		     "WHERE electorate_code = %u "
-		     "ORDER BY party_index DESC, name DESC;", elec->code);
-  for (i = 0; i < PQntuples(result); i++) {
-    list = new_cand_list(malloc(sizeof(struct candidate)), list);
-    list->cand->name = strdup(PQgetvalue(result, i, 0));
-    list->cand->db_candidate_index
-      = atoi(PQgetvalue(result, i, 1));
-    list->cand->group = find_group(groups,
-				   atoi(PQgetvalue(result, i, 2)));
-    list->cand->count_when_quota_reached = 0;
-    /* We are PREpending to list, so count is backwards */
-    list->cand->scrutiny_pos = PQntuples(result) - i - 1;
-    /* All piles empty, all totals 0 */
-    memset(list->cand->c, 0, sizeof(list->cand->c));
-    /* surplus distributed flag: init false */
-    list->cand->surplus_distributed=false;
-  }
-  PQclear(result);
-  return list;
-}
-
-/* Load a single vote */
-static struct ballot *load_vote(PGconn *conn, const char *preference_list)
-{
-	struct ballot *ballot;
-	char *pref_ptr;   
-	unsigned int num_preferences=0,i;
-	unsigned int pref_number, group_index, db_cand_index;
-
-	for (pref_ptr=(char *)preference_list;
-	     strlen(pref_ptr)>=DIGITS_PER_PREF;
-	     pref_ptr += DIGITS_PER_PREF*sizeof(char),num_preferences++);
-	
-	if ( strlen(pref_ptr)) 
-		bailout("Malformed preference list: '%s'\n",preference_list);
-	
-	ballot = malloc(sizeof(*ballot)
-			+ sizeof(ballot->prefs[0])*num_preferences);
-	ballot->num_preferences = num_preferences;
-	ballot->count_transferred = 0;
-	
-	/* They many not be in order */
-	for (pref_ptr=(char *)preference_list, i = 0;
-	     i < ballot->num_preferences; 
-	     i++,pref_ptr += DIGITS_PER_PREF*sizeof(char) )
-	{
-		sscanf(pref_ptr,"%2u%2u%2u",&pref_number,&group_index,&db_cand_index);
-		
-		ballot->prefs[pref_number-1]
-			.group_index = group_index;
-		ballot->prefs[pref_number-1]
-			.db_candidate_index = db_cand_index;
-	}
-	
-	return ballot;
-	
-}
-
 /* SIPL 2011: Two parameters added: the election date,
               and the qualification (pre-poll or polling day). */
 /* Get all the ballots for this electorate */
-static struct ballot_list *fetch_ballots(PGconn *conn, 
-                                         const struct electorate *elec, 
-                                         const char *elec_date, 
-                                         const int qualification)
+static struct ballot_store *fetch_qualified_ballots(PGconn *conn, 
+                                                   const struct electorate *elec, 
+                                                   const char *elec_date, 
+                                                   const int qualification)
 {
-  struct ballot_list *list = NULL;
+  struct ballot_store *store;
   PGresult *result;
-  unsigned int i,num_votes;
+  unsigned int i,num_votes,num_prefs;
 
   /* SIPL 2014-05-20 Support electorate names with spaces. */
   char elec_name_normalized[strlen(elec->name) + 1];
 
   normalize_electorate_name(elec_name_normalized, elec->name);
 
+  /* Ranges of the indexed time_stamp, rather than parsing every
+     vote's */
   if (qualification == PRE_POLL)
     result = SQL_query(conn,
                        "SELECT preference_list " 
                        "FROM %s_confirmed_vote "
-                       "WHERE to_date(time_stamp, 'YYYY-MM-DD HH24:MI:SS') < to_date('%s', 'YYYY-MM-DD'); "
+                       "WHERE time_stamp < DATE '%s';"
                        , elec_name_normalized, elec_date);
   else if (qualification == POLLING_DAY)
     result = SQL_query(conn,
                        "SELECT preference_list " 
                        "FROM %s_confirmed_vote "
-                       "WHERE to_date(time_stamp, 'YYYY-MM-DD HH24:MI:SS') = to_date('%s','YYYY-MM-DD'); "
-                       , elec_name_normalized, elec_date);
+                       "WHERE time_stamp >= DATE '%s' "
+                       "AND time_stamp < DATE '%s' + 1;"
+                       , elec_name_normalized, elec_date, elec_date);
   else
     bailout("Wrong option: %d. It must be either 0 (pre-poll) or 1 (polling day).\n", qualification);
   
   num_votes =  PQntuples(result);
 
+  for (i = 0, num_prefs = 0; i < num_votes; i++)
+    num_prefs += PQgetlength(result, i, 0) / DIGITS_PER_PREF;
+  store = new_ballot_store(num_votes, num_prefs);
+
   for (i = 0; i < num_votes; i++) {
-    list = new_ballot_list( load_vote(conn,PQgetvalue(result, i, 0)),list);
+    load_vote(store, PQgetvalue(result, i, 0), PQgetlength(result, i, 0));
   }
   PQclear(result);
-  return list;
+  return store;
 }
 
 int main(int argc, char *argv[])
 {
+  struct ballot_store *store;
   struct ballot_list *ballots;
   PGconn *conn;
   struct election e;
@@ -285,7 +192,7 @@ int main(int argc, char *argv[])
   free(password_hash);
   free(valid_password_hash);
 
-  /* For each electorate, do_count. do_count will print information to the
+  /* For each electorate, print_first_preferences will print information to the
      screen */
   initial = get_electorates(conn);
   
@@ -296,17 +203,23 @@ int main(int argc, char *argv[])
   for(e.electorate = initial; e.electorate; e.electorate=e.electorate->next) {
     e.num_groups = fetch_groups(conn, e.electorate, e.groups);
     e.candidates = fetch_candidates(conn, e.electorate, e.groups);
+    e.cand_index = new_cand_index(e.candidates);
     /* SIPL 2011: Get ballots according to Election Date 
               and Pre-poll or Polling day option */
-    ballots = fetch_ballots(conn, e.electorate, argv[1], qualification);
+    store = fetch_qualified_ballots(conn, e.electorate, argv[1],
+                                    qualification);
+    ballots = all_ballots(store);
 
-    do_count(&e, ballots, NULL, qualification);
+    print_first_preferences(&e, ballots, qualification);
       
     /* free allocated memory */
     for_each_candidate(e.candidates, &free_piles, NULL);
     for_each_candidate(e.candidates, &free_candidate, NULL);
     free_group_names(e.groups, e.num_groups);
     free_cand_list(e.candidates);
+    free_cand_index(e.cand_index);
+    free_ballot_list(ballots);
+    free_ballot_store(store);
   }
 
   free_electorates(initial);
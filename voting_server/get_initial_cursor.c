@@ -20,31 +20,28 @@
 #include <string.h>
 #include <common/database.h>
 #include <common/evacs.h>
+#include "voting_server.h"
+#include "voting_daemon.h"
 #include "cgi.h"
 
 static int fetch_next_cursor(PGconn *conn,unsigned int ecode)
 {
-  char *name;
+  const struct electorate *elec;
   char *sn;
-  PGresult *result;
   int cursor;
 
   /* SIPL 2014-05-20 Support electorate names with spaces. */
   char *electorate_name_normalized;
 
-  /* Get seat count for this electorate */
-  result = SQL_query(conn,
-		     "SELECT name "
-		     "FROM electorate "
-		     "WHERE code = %u;",ecode);
-  if (PQntuples(result) == 0)
+  /* Get the name of this electorate */
+  elec = lookup_electorate(conn, ecode);
+  if (!elec)
     bailout("Could not get name for electorate %u.\n",
 	    ecode);
-  name = PQgetvalue(result, 0, 0);
 
-  electorate_name_normalized = malloc(strlen(name) + 1);
+  electorate_name_normalized = malloc(strlen(elec->name) + 1);
   normalize_electorate_name(electorate_name_normalized,
-			    name);
+			    elec->name);
 
   cursor = get_seq_nextval(conn,sn=sprintf_malloc("%s_cursor_seq",
 						  electorate_name_normalized));
@@ -52,8 +49,6 @@ static int fetch_next_cursor(PGconn *conn,unsigned int ecode)
 
   free(electorate_name_normalized);
 
-  PQclear(result);
-
   return cursor;
 }
 
@@ -71,7 +66,8 @@ static void send_cursor(const int *cursor)
   /* SIPL 2011-09-26 Added one to length of array.  There was
      no chance of a buffer overflow, but do this to make it consistent
      with all other uses of INT_CHARS. */
-  vars[0].value = malloc(INT_CHARS + 1);
+  char cursor_value[INT_CHARS + 1];
+  vars[0].value = cursor_value;
   sprintf(vars[0].value, "%u", *cursor);
   vars[1].name = NULL;
   vars[1].value = NULL;
@@ -79,10 +75,21 @@ static void send_cursor(const int *cursor)
   cgi_good_response(vars);
 }
 
+void get_initial_cursor_request(PGconn *conn, const struct http_vars *vars)
+{
+  int cursor;
+
+  /* Get next rotation and update count here... */
+  cursor = fetch_next_cursor(conn,atoi(http_string(vars, "ecode")));
+
+  /* Encode to return */
+  send_cursor(&cursor);
+}
+
+#ifndef VOTING_DAEMON
 int main(int argc, char *argv[])
 {
   struct http_vars *vars;
-  int cursor;
   PGconn *conn;
 
   /* Our own failure function */
@@ -95,13 +102,7 @@ int main(int argc, char *argv[])
   if (!conn || PQstatus(conn) == CONNECTION_BAD)
     bailout("Could not open database\n");
 
-  /* Get next rotation and update count here... */
-  cursor = fetch_next_cursor(conn,atoi(http_string(vars, "ecode")));
-  http_free(vars);
-
-  /* Encode to return */
-  send_cursor(&cursor);
-
-  PQfinish(conn);
+  get_initial_cursor_request(conn, vars);
   return 0;
 }
+#endif /* VOTING_DAEMON */
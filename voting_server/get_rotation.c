@@ -21,22 +21,23 @@
 #include <common/rotation.h>
 #include <common/database.h>
 #include "fetch_rotation.h"
+#include "voting_server.h"
+#include "voting_daemon.h"
 #include "cgi.h"
 
 static struct rotation fetch_next_rotation(PGconn *conn,unsigned int ecode)
 {
+	const struct electorate *elec;
 	int seat_count,rotation_num;
 	struct rotation *rotation, rot;
 	char *sn;
 
 	/* Get seat count for this electorate */
-	seat_count = SQL_singleton_int(conn,
-				       "SELECT seat_count "
-				       "FROM electorate "
-				       "WHERE code = %u;",ecode);
-	if (seat_count == -1)
+	elec = lookup_electorate(conn, ecode);
+	if (!elec)
 	  bailout("Could not get number of seats for electorate %u.\n",
 		      ecode);
+	seat_count = elec->num_seats;
 
 	/* Get next robson rotation number */
 	/* DDS3.2.5: Update Rotation Indices */
@@ -78,10 +79,21 @@ static void send_rotation(const struct rotation *rot)
 	cgi_good_response(vars);
 }
 
+void get_rotation_request(PGconn *conn, const struct http_vars *vars)
+{
+	struct rotation rot;
+
+	/* Get next rotation and update count here... */
+	rot = fetch_next_rotation(conn,atoi(http_string(vars, "ecode")));
+
+	/* Encode to return */
+	send_rotation(&rot);
+}
+
+#ifndef VOTING_DAEMON
 int main(int argc, char *argv[])
 {
 	struct http_vars *vars;
-	struct rotation rot;
 	PGconn *conn;
 
 	/* Our own failure function */
@@ -94,14 +106,7 @@ int main(int argc, char *argv[])
 	if (!conn || PQstatus(conn) == CONNECTION_BAD)
 		bailout("Could not open database\n");
 
-	/* Get next rotation and update count here... */
-	rot = fetch_next_rotation(conn,atoi(http_string(vars, "ecode")));
-	http_free(vars);
-
-	/* Encode to return */
-	send_rotation(&rot);
-
-	PQfinish(conn);
+	get_rotation_request(conn, vars);
 	return 0;
 }
-
+#endif /* VOTING_DAEMON */
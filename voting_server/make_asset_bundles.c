@@ -0,0 +1,432 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Bundle up the booth's images and audio.
+
+   make_asset_bundles [document-root]
+
+   Every .png under images/ and .raw under audio/ goes into a bundle
+   under bundles/: those belonging to one electorate (its candidate
+   and group images and audio, and its numbers) into
+   electorate-<code>.bundle, the rest into common.bundle.  The
+   electorates' images go in decoded and highlighted, ready for the
+   booth to display; the rest (mostly full-screen messages, each
+   shown once a session) stay PNGs, to keep the bundles a size the
+   booth can hold in its /tmp.  The index
+   lists each bundle with its stamp, so a booth can tell whether the
+   copy it already has is current.  Run it whenever the images or
+   audio change. */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <common/evacs.h>
+#include <common/asset_bundle.h>
+#include <common/rgb565.h>
+
+/* Where httpd served the booth's files from */
+#define DOCUMENT_ROOT "/var/www/html"
+
+/* The bundle of assets not belonging to any one electorate */
+#define COMMON_BUNDLE (-1)
+
+struct asset
+{
+	char *url;
+	char *path;
+	uint64_t size;
+	uint32_t hash;
+	/* Decoded from the PNG at path */
+	bool frame;
+};
+
+struct bundle
+{
+	int electorate;
+	unsigned int num_assets;
+	struct asset *assets;
+};
+
+static struct bundle *bundles = NULL;
+static unsigned int num_bundles = 0;
+
+/* Which electorate's bundle this URL belongs in */
+static int electorate_of(const char *url)
+{
+	unsigned int code;
+	int n;
+
+	n = 0;
+	if (sscanf(url, "/images/electorates/%u%n", &code, &n) == 1
+	    && url[n] == '/')
+		return code;
+	n = 0;
+	if (sscanf(url, "/audio/electorates/%u%n", &code, &n) == 1
+	    && (url[n] == '/' || strcmp(url + n, ".raw") == 0))
+		return code;
+	n = 0;
+	if (sscanf(url, "/images/%u/numbers/%n", &code, &n) == 1 && n > 0)
+		return code;
+	return COMMON_BUNDLE;
+}
+
+static struct bundle *get_bundle(int electorate)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_bundles; i++)
+		if (bundles[i].electorate == electorate)
+			return &bundles[i];
+
+	bundles = realloc(bundles, (num_bundles + 1) * sizeof(*bundles));
+	if (!bundles)
+		bailout("Out of memory\n");
+	bundles[num_bundles].electorate = electorate;
+	bundles[num_bundles].num_assets = 0;
+	bundles[num_bundles].assets = NULL;
+	return &bundles[num_bundles++];
+}
+
+/* The contents of a file (to be freed by caller) */
+static char *read_file(const char *path, uint64_t size)
+{
+	char *data;
+	FILE *in;
+
+	data = malloc(size + 1);
+	in = fopen(path, "r");
+	if (!data || !in || fread(data, 1, size, in) != size)
+		bailout("Could not read %s\n", path);
+	fclose(in);
+	return data;
+}
+
+/* Decode a PNG into a frame (to be freed by caller), or NULL if the
+   booth couldn't show it either */
+static char *make_frame(const char *path, uint64_t png_size, uint64_t *size)
+{
+	struct asset_frame header;
+	uint16_t *pixels;
+	char *png, *frame;
+	size_t num;
+
+	png = read_file(path, png_size);
+	pixels = rgb565_decode_png(png, png_size,
+				   &header.width, &header.height);
+	free(png);
+	if (!pixels)
+		return NULL;
+	header.reserved = 0;
+
+	num = (size_t)header.width * header.height;
+	*size = sizeof(header) + 2 * num * sizeof(*pixels);
+	frame = malloc(*size);
+	if (!frame)
+		bailout("Out of memory\n");
+	memcpy(frame, &header, sizeof(header));
+	memcpy(frame + sizeof(header), pixels, num * sizeof(*pixels));
+	rgb565_highlight((uint16_t *)(frame + sizeof(header)) + num,
+			 pixels, num);
+	free(pixels);
+	return frame;
+}
+
+static bool has_suffix(const char *name, const char *suffix)
+{
+	size_t len = strlen(name), slen = strlen(suffix);
+
+	return len > slen && strcmp(name + len - slen, suffix) == 0;
+}
+
+static void add_asset(char *url, char *path, uint64_t size)
+{
+	int electorate = electorate_of(url);
+	struct bundle *b = get_bundle(electorate);
+	struct asset *a;
+	bool frame = false;
+
+	/* Decoded here only to size the frame: it's decoded again
+	   when written, rather than held in memory until then */
+	if (electorate != COMMON_BUNDLE && has_suffix(url, ".png")) {
+		uint64_t frame_size;
+		char *data = make_frame(path, size, &frame_size);
+
+		if (data) {
+			char *frame_url;
+
+			frame_url = sprintf_malloc("%s%s", url,
+						   ASSET_FRAME_SUFFIX);
+			free(url);
+			url = frame_url;
+			size = frame_size;
+			frame = true;
+			free(data);
+		} else
+			fprintf(stderr, "Could not decode %s: "
+				"bundled as it is\n", path);
+	}
+
+	b->assets = realloc(b->assets, (b->num_assets + 1)*sizeof(*b->assets));
+	if (!b->assets)
+		bailout("Out of memory\n");
+	a = &b->assets[b->num_assets++];
+	a->url = url;
+	a->path = path;
+	a->size = size;
+	a->hash = asset_hash(url);
+	a->frame = frame;
+}
+
+/* Find every asset under this URL directory */
+static void find_assets(const char *docroot, const char *dir_url,
+			const char *suffix)
+{
+	char *dir_path;
+	struct dirent *d;
+	DIR *dir;
+
+	dir_path = sprintf_malloc("%s%s", docroot, dir_url);
+	dir = opendir(dir_path);
+	if (!dir)
+		bailout("Could not read %s: %s\n", dir_path, strerror(errno));
+
+	while ((d = readdir(dir)) != NULL) {
+		char *url, *path;
+		struct stat st;
+
+		if (d->d_name[0] == '.')
+			continue;
+		url = sprintf_malloc("%s/%s", dir_url, d->d_name);
+		path = sprintf_malloc("%s%s", docroot, url);
+		if (stat(path, &st) != 0)
+			bailout("Could not stat %s: %s\n",
+				path, strerror(errno));
+
+		if (S_ISDIR(st.st_mode)) {
+			find_assets(docroot, url, suffix);
+		} else if (S_ISREG(st.st_mode)
+			   && has_suffix(d->d_name, suffix)) {
+			add_asset(url, path, st.st_size);
+			continue;
+		}
+		free(url);
+		free(path);
+	}
+	closedir(dir);
+	free(dir_path);
+}
+
+static int compare_assets(const void *a, const void *b)
+{
+	return strcmp(((const struct asset *)a)->url,
+		      ((const struct asset *)b)->url);
+}
+
+/* Reorder the assets by bucket, and fill in where each bucket starts */
+static void sort_into_buckets(struct bundle *b,
+			      uint32_t bucket[], uint32_t num_buckets)
+{
+	struct asset *sorted;
+	uint32_t *next, i;
+
+	sorted = malloc(b->num_assets * sizeof(*sorted) + 1);
+	next = malloc(num_buckets * sizeof(*next));
+	if (!sorted || !next)
+		bailout("Out of memory\n");
+
+	/* Count each bucket, then turn the counts into starts */
+	for (i = 0; i < b->num_assets; i++)
+		bucket[(b->assets[i].hash & (num_buckets - 1)) + 1]++;
+	for (i = 0; i < num_buckets; i++)
+		bucket[i+1] += bucket[i];
+
+	memcpy(next, bucket, num_buckets * sizeof(*next));
+	for (i = 0; i < b->num_assets; i++)
+		sorted[next[b->assets[i].hash & (num_buckets - 1)]++]
+			= b->assets[i];
+
+	free(next);
+	free(b->assets);
+	b->assets = sorted;
+}
+
+static void write_or_die(FILE *f, const void *data, size_t len,
+			 const char *path)
+{
+	if (len && fwrite(data, len, 1, f) != 1)
+		bailout("Could not write %s: %s\n", path, strerror(errno));
+}
+
+/* Write one bundle, returning its stamp */
+static uint64_t write_bundle(const char *path, struct bundle *b)
+{
+	struct asset_bundle_header header;
+	struct asset_entry *entry;
+	uint32_t *bucket, num_buckets, i;
+	uint64_t names, offset, stamp;
+	char *tmp_path;
+	FILE *f;
+
+	/* Sorted first, so the same assets give the same file */
+	qsort(b->assets, b->num_assets, sizeof(*b->assets), compare_assets);
+
+	for (num_buckets = 1; num_buckets < b->num_assets; num_buckets *= 2);
+	/* Zeroed, padding included */
+	bucket = calloc(1, ASSET_BUCKETS_SIZE(num_buckets));
+	entry = malloc(b->num_assets * sizeof(*entry) + 1);
+	if (!bucket || !entry)
+		bailout("Out of memory\n");
+
+	sort_into_buckets(b, bucket, num_buckets);
+
+	/* Names follow the entries; contents follow the names */
+	names = sizeof(header) + ASSET_BUCKETS_SIZE(num_buckets)
+		+ b->num_assets * sizeof(*entry);
+	offset = names;
+	for (i = 0; i < b->num_assets; i++)
+		offset += strlen(b->assets[i].url);
+	for (i = 0; i < b->num_assets; i++) {
+		offset = (offset + ASSET_ALIGN - 1)
+			& ~(uint64_t)(ASSET_ALIGN - 1);
+		entry[i].hash = b->assets[i].hash;
+		entry[i].name_length = strlen(b->assets[i].url);
+		entry[i].name_offset = names;
+		entry[i].offset = offset;
+		entry[i].size = b->assets[i].size;
+		names += entry[i].name_length;
+		offset += entry[i].size;
+	}
+
+	/* Write it beside the old one, so booths never see half of it */
+	tmp_path = sprintf_malloc("%s.tmp", path);
+	f = fopen(tmp_path, "w");
+	if (!f)
+		bailout("Could not create %s: %s\n", tmp_path, strerror(errno));
+
+	/* The header goes in last, when we know the stamp */
+	memset(&header, 0, sizeof(header));
+	write_or_die(f, &header, sizeof(header), tmp_path);
+	write_or_die(f, bucket, ASSET_BUCKETS_SIZE(num_buckets), tmp_path);
+	write_or_die(f, entry, b->num_assets * sizeof(*entry), tmp_path);
+
+	stamp = ASSET_STAMP_INIT;
+	for (i = 0; i < b->num_assets; i++) {
+		write_or_die(f, b->assets[i].url, entry[i].name_length,
+			     tmp_path);
+		stamp = asset_stamp(stamp, b->assets[i].url,
+				    entry[i].name_length + 1);
+	}
+
+	for (i = 0; i < b->num_assets; i++) {
+		static const char padding[ASSET_ALIGN];
+		uint64_t size;
+		char *data;
+
+		write_or_die(f, padding, entry[i].offset - ftell(f), tmp_path);
+
+		if (b->assets[i].frame) {
+			struct stat st;
+
+			if (stat(b->assets[i].path, &st) != 0
+			    || !(data = make_frame(b->assets[i].path,
+						   st.st_size, &size))
+			    || size != entry[i].size)
+				bailout("%s changed while bundling\n",
+					b->assets[i].path);
+		} else
+			data = read_file(b->assets[i].path, entry[i].size);
+
+		write_or_die(f, data, entry[i].size, tmp_path);
+		stamp = asset_stamp(stamp, &entry[i].size,
+				    sizeof(entry[i].size));
+		stamp = asset_stamp(stamp, data, entry[i].size);
+		free(data);
+	}
+
+	memcpy(header.magic, ASSET_BUNDLE_MAGIC, sizeof(header.magic));
+	header.stamp = stamp;
+	header.num_assets = b->num_assets;
+	header.num_buckets = num_buckets;
+	if (fseek(f, 0, SEEK_SET) != 0)
+		bailout("Could not write %s: %s\n", tmp_path, strerror(errno));
+	write_or_die(f, &header, sizeof(header), tmp_path);
+	if (fclose(f) != 0)
+		bailout("Could not write %s: %s\n", tmp_path, strerror(errno));
+
+	if (rename(tmp_path, path) != 0)
+		bailout("Could not rename %s: %s\n", tmp_path, strerror(errno));
+
+	free(tmp_path);
+	free(entry);
+	free(bucket);
+	return stamp;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *docroot = DOCUMENT_ROOT;
+	char *dir, *index_path, *tmp_path;
+	unsigned int i;
+	FILE *index;
+
+	if (argc > 2)
+		bailout("Usage: %s [document-root]\n", argv[0]);
+	if (argc == 2)
+		docroot = argv[1];
+
+	find_assets(docroot, "/images", ".png");
+	find_assets(docroot, "/audio", ".raw");
+
+	dir = sprintf_malloc("%s%s", docroot, ASSET_BUNDLE_DIR);
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+		bailout("Could not create %s: %s\n", dir, strerror(errno));
+
+	index_path = sprintf_malloc("%s%s", docroot, ASSET_BUNDLE_INDEX);
+	tmp_path = sprintf_malloc("%s.tmp", index_path);
+	index = fopen(tmp_path, "w");
+	if (!index)
+		bailout("Could not create %s: %s\n", tmp_path, strerror(errno));
+
+	for (i = 0; i < num_bundles; i++) {
+		char *name, *path;
+		uint64_t stamp;
+
+		if (bundles[i].electorate == COMMON_BUNDLE)
+			name = sprintf_malloc("common.bundle");
+		else
+			name = sprintf_malloc("electorate-%d.bundle",
+					      bundles[i].electorate);
+		path = sprintf_malloc("%s%s", dir, name);
+		stamp = write_bundle(path, &bundles[i]);
+		fprintf(index, "%s %016llx\n", name, (unsigned long long)stamp);
+		printf("%s: %u assets\n", name, bundles[i].num_assets);
+		free(path);
+		free(name);
+	}
+
+	if (fclose(index) != 0 || rename(tmp_path, index_path) != 0)
+		bailout("Could not write %s: %s\n", index_path,
+			strerror(errno));
+
+	free(tmp_path);
+	free(index_path);
+	free(dir);
+	return 0;
+}
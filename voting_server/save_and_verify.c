@@ -16,87 +16,207 @@
 */
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
 #include <common/barcode_hash.h>
 #include "voting_server.h"
 #include "save_and_verify.h"
 
+/* Parameter types for PQprepare (from pg_type) */
+#define BYTEAOID 17
+#define INT4OID 23
+#define TEXTOID 25
+#define TIMESTAMPOID 1114
+
+/* Statements we have prepared on the current database session, one
+   per electorate (the vote INSERT names the electorate's table) */
+struct prepared_insert {
+	struct prepared_insert *next;
+	unsigned int code;
+};
+
+/* Prepare the statements for storing a vote in this electorate,
+   unless this database session already has them.  A long-lived
+   server keeps its connection, so this is once per electorate; a
+   reconnect gets a new backend, which needs them again. */
+static void prepare_statements(PGconn *conn, const struct electorate *elec)
+{
+	static int prepared_backend = 0;
+	static struct prepared_insert *prepared = NULL;
+	static const Oid update_types[] = { BYTEAOID };
+	static const Oid insert_types[] = { INT4OID, INT4OID, TIMESTAMPOID,
+					    TEXTOID };
+	struct prepared_insert *i;
+	PGresult *result;
+	char *name, *sql;
+
+	/* SIPL 2014-05-20 Support electorate names with spaces. */
+	char elec_name_normalized[strlen(elec->name) + 1];
+
+	if (PQbackendPID(conn) != prepared_backend) {
+		while (prepared) {
+			i = prepared->next;
+			free(prepared);
+			prepared = i;
+		}
+		result = PQprepare(conn, "use_barcode",
+				   "UPDATE barcode "
+				   "SET used = true "
+				   "WHERE hash = $1 "
+				   "AND used = false;", 1, update_types);
+		if (PQresultStatus(result) != PGRES_COMMAND_OK)
+			bailout("Preparing barcode update failed: %s\n",
+				PQresultErrorMessage(result));
+		PQclear(result);
+		prepared_backend = PQbackendPID(conn);
+	}
+
+	for (i = prepared; i; i = i->next)
+		if (i->code == elec->code)
+			return;
+
+	normalize_electorate_name(elec_name_normalized, elec->name);
+	name = sprintf_malloc("insert_vote_%u", elec->code);
+	sql = sprintf_malloc("INSERT INTO %s_confirmed_vote"
+			     "(batch_number, paper_version, time_stamp, "
+			     "preference_list) "
+			     "VALUES($1,$2,$3,$4);", elec_name_normalized);
+	result = PQprepare(conn, name, sql, 4, insert_types);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+		bailout("Preparing %s failed: %s\n",
+			sql, PQresultErrorMessage(result));
+	PQclear(result);
+	free(sql);
+	free(name);
+
+	i = malloc(sizeof(*i));
+	if (!i)
+		bailout("Out of memory preparing statements\n");
+	i->code = elec->code;
+	i->next = prepared;
+	prepared = i;
+}
+
 /* DDS3.2.22: Primary Store */
+/* This sends the transaction (BEGIN, mark the barcode used, store
+   the vote) as one pipeline, and returns without waiting for it:
+   primary_store_finish() collects the results. */
 static enum error primary_store_start(PGconn *conn,
 				      const struct preference_set *vote,
 				      const struct barcode *bc,
 				      const struct electorate *elec)
 {
-	char hash[HASH_BITS + 1];
+	unsigned char hash[HASH_BYTES];
 	int pp_code;
-	unsigned int num_rows;
-	char *preference_list, *timestamp;
+	char preference_list[PREFNUM_MAX * DIGITS_PER_PREF + 1];
+	char *timestamp;
 	char *batch_number_string;
-
-	/* SIPL 2014-05-20 Support electorate names with spaces. */
-	char elec_name_normalized[strlen(elec->name) + 1];
-
-	normalize_electorate_name(elec_name_normalized, elec->name);
+	uint32_t batch_number, paper_version;
+	const char *hash_param = (const char *)hash;
+	static const int hash_length = HASH_BYTES, hash_format = 1;
+	const char *values[4];
+	char insert_name[sizeof("insert_vote_") + INT_CHARS];
+	static const int lengths[4] = { sizeof(uint32_t), sizeof(uint32_t), 0, 0 };
+	static const int formats[4] = { 1, 1, 0, 0 };
 
 	fprintf(stderr,"s&v:PstoreStart: generating hash\n");
 	gen_hash(hash, bc->data, sizeof(bc->data));
 	/* Get polling_place_code */
 	fprintf(stderr,"s&v:PstoreStart: getting ppcode\n");
-	pp_code = (unsigned int)SQL_singleton_int(conn,
-						  "SELECT polling_place_code "
-						  "FROM server_parameter;");
+	pp_code = server_polling_place(conn);
 	if (pp_code < 0)
 		bailout("Primary store failed. Polling Place code not "
 			"found in server_parameter table.");
 	fprintf(stderr,"s&v:PstoreStart: ppcode: %u\n",pp_code);
 
-	/* begin transaction */
-	begin(conn);
-
-
-	fprintf(stderr,"s&v:PstoreStart: updating barcode\n");
-		
-	/* Mark barcode as used */
-	num_rows = SQL_command(conn,
-			       "UPDATE barcode "
-			       "SET used = true "
-			       "WHERE hash = '%s' "
-			       "AND used = false;",hash);
+	prepare_statements(conn, elec);
 
-	/* Check barcode exists and has not been used */
-	if (num_rows != 1 )
-		return(ERR_COMMIT_FAILED);
-	
 	fprintf(stderr,"s&v:PstoreStart: generating pref_string&timestamp\n");
 
 	/* accumulate the preferences for the vote */
-	preference_list=  preference_string((struct preference_set *) vote);
+	encode_preferences(preference_list, vote->candidates,
+			   vote->num_preferences);
 	timestamp=generate_sortable_timestamp();
 
-	fprintf(stderr,"s&v:PstoreStart: inserting vote\n");
-
 	/* convention for electronic batches is EPPP000*/
 	batch_number_string=sprintf_malloc("%u%03u000",elec->code,pp_code);
 
-	/* Store the vote */
-	num_rows = SQL_command(conn,
-			       "INSERT INTO %s_confirmed_vote"
-			       "(batch_number, paper_version, time_stamp, preference_list) "
-			       "VALUES(%u,%u,'%s','%s');",
-			       elec_name_normalized,
-			       atoi(batch_number_string),
-			       vote->paper_version, 
-			       timestamp,
-			       preference_list);
+	/* The integers go in binary, network byte order */
+	batch_number = htonl(atoi(batch_number_string));
+	paper_version = htonl(vote->paper_version);
+	values[0] = (const char *)&batch_number;
+	values[1] = (const char *)&paper_version;
+	values[2] = timestamp;
+	values[3] = preference_list;
 	free(batch_number_string);
+	sprintf(insert_name, "insert_vote_%u", elec->code);
+
+	fprintf(stderr,"s&v:PstoreStart: sending transaction\n");
+
+	if (!PQenterPipelineMode(conn))
+		bailout("Primary store failed: %s\n", PQerrorMessage(conn));
+
+	/* begin transaction, mark barcode as used and store the vote */
+	if (!PQsendQueryParams(conn, "BEGIN;", 0, NULL, NULL, NULL, NULL, 0)
+	    || !PQsendQueryPrepared(conn, "use_barcode", 1, &hash_param,
+				    &hash_length, &hash_format, 0)
+	    || !PQsendQueryPrepared(conn, insert_name,
+				    4, values, lengths, formats, 0)
+	    || !PQpipelineSync(conn))
+		bailout("Primary store failed: %s\n", PQerrorMessage(conn));
 
 	fprintf(stderr,"s&v:PstoreStart: freeing mem\n");
-	free(preference_list);
 	free(timestamp);
-	
-	fprintf(stderr,"s&v:PstoreStart: returning %u\n",(num_rows==1)?ERR_OK:ERR_COMMIT_FAILED);
+
+	return ERR_OK;
+}
+
+/* Rows changed by the next statement in the pipeline, or -1 if it
+   failed */
+static int pipeline_rows(PGconn *conn)
+{
+	PGresult *result;
+	int rows = -1;
+
+	result = PQgetResult(conn);
+	if (PQresultStatus(result) == PGRES_COMMAND_OK)
+		rows = atoi(PQcmdTuples(result));
+	else if (PQresultStatus(result) != PGRES_PIPELINE_ABORTED)
+		fprintf(stderr, "s&v: %s", PQresultErrorMessage(result));
+	PQclear(result);
+
+	/* Each statement's results end with a NULL */
+	while ((result = PQgetResult(conn)) != NULL)
+		PQclear(result);
+	return rows;
+}
+
+/* Wait for the transaction primary_store_start() sent.  The
+   transaction is left open, for primary_store_commit() or
+   primary_store_abort(). */
+static enum error primary_store_finish(PGconn *conn)
+{
+	PGresult *result;
+	int begun, barcode_rows, vote_rows;
+
+	begun = pipeline_rows(conn);
+	/* Check barcode exists and has not been used */
+	barcode_rows = pipeline_rows(conn);
+	vote_rows = pipeline_rows(conn);
+
+	result = PQgetResult(conn);
+	if (PQresultStatus(result) != PGRES_PIPELINE_SYNC)
+		bailout("Primary store failed: pipeline out of step\n");
+	PQclear(result);
+	PQexitPipelineMode(conn);
+
+	fprintf(stderr,"s&v:PstoreFinish: barcode %i, vote %i\n",
+		barcode_rows, vote_rows);
 
 	/* Error if not EXACTLY one row updated */
-	return ((num_rows==1)?ERR_OK:ERR_COMMIT_FAILED);
+	if (begun < 0 || barcode_rows != 1 || vote_rows != 1)
+		return ERR_COMMIT_FAILED;
+	return ERR_OK;
 }
 
 static enum error primary_store_commit(PGconn *conn)
@@ -113,6 +233,7 @@ static void primary_store_abort(PGconn *conn)
 /* DDS3.2.22: Secondary Store */
 static enum error secondary_store(const struct http_vars *vars)
 {
+	struct http_connection *slave;
 	struct http_vars *retvars;
 	enum error ret;
 
@@ -120,9 +241,15 @@ static enum error secondary_store(const struct http_vars *vars)
 		/* I am the slave, so this is the secondary store */
 		return ERR_OK;
 
-	/* Send to slave for secondary store */
-	retvars = http_exchange(SLAVE_SERVER_ADDRESS, SLAVE_SERVER_PORT,
-				"/cgi-bin/commit_vote", vars);
+	/* Send to slave for secondary store (its latencies are logged
+	   with the shared connection).  Close it again straight away:
+	   kept open, it would hold one of the slave daemon's workers
+	   waiting for a next request until it timed out. */
+	slave = http_connection(SLAVE_SERVER_ADDRESS, SLAVE_SERVER_PORT);
+	retvars = slave ? http_conn_exchange(slave, "/cgi-bin/commit_vote",
+					     vars) : NULL;
+	if (slave)
+		http_conn_close(slave);
 	if (!retvars)
 		ret = ERR_SERVER_UNREACHABLE;
 	else {
@@ -133,7 +260,38 @@ static enum error secondary_store(const struct http_vars *vars)
 	return ret;
 }
 
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Log how long committing this vote took, and the running average
+   for this process */
+static void report_latency(enum error err, double start, double secondary,
+			   double end)
+{
+	static unsigned int num_votes = 0;
+	static double total_ms = 0, max_ms = 0;
+
+	num_votes++;
+	total_ms += end - start;
+	if (end - start > max_ms)
+		max_ms = end - start;
+
+	fprintf(stderr, "s&v: commit %s in %.2f ms (secondary store %.2f ms);"
+		" %u votes, mean %.2f ms, max %.2f ms\n",
+		err == ERR_OK ? "succeeded" : "failed", end - start, secondary,
+		num_votes, total_ms / num_votes, max_ms);
+}
+
 /* DDS3.2.22: Save And Verify Vote */
+/* The slave is only written once our own barcode update and vote
+   insert have succeeded (the transaction is still open), so a vote
+   the primary rejects never reaches the slave.  If the slave then
+   fails, the primary rolls back. */
 enum error save_and_verify(PGconn *conn,
 			   const struct preference_set *vote,
 			   const struct barcode *bc,
@@ -141,16 +299,31 @@ enum error save_and_verify(PGconn *conn,
 			   const struct http_vars *vars)
 {
 	enum error err;
+	double start, secondary_start, secondary_end;
+
+	start = now_ms();
 
 	fprintf(stderr,"starting primary store\n");
 	err = primary_store_start(conn, vote, bc, elec);
 	if (err != ERR_OK) return err;
 
+	err = primary_store_finish(conn);
+	if (err != ERR_OK) {
+		primary_store_abort(conn);
+		report_latency(err, start, 0, now_ms());
+		return err;
+	}
+
 	fprintf(stderr,"starting secondary store\n");
+	secondary_start = now_ms();
 	err = secondary_store(vars);
+	secondary_end = now_ms();
+
 	if (err != ERR_OK)
 		primary_store_abort(conn);
 	else
 		err = primary_store_commit(conn);
+
+	report_latency(err, start, secondary_end - secondary_start, now_ms());
 	return err;
 }
@@ -0,0 +1,529 @@
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* The voting server as one long-lived program, in place of httpd
+   running a CGI per request.
+
+   voting_daemon [port [document-root]]
+
+   It listens on the port the booths already use (8080, or 8081 for
+   the slave) and pre-forks a pool of workers.  Each worker keeps its
+   database connection open between requests, along with what the
+   CGIs look up on every run (electorates, ballot contents, the
+   polling place), and answers the same POSTs to /cgi-bin/... as the
+   CGIs did, in the same urlencoded form.  Other GETs are files under
+   the document root (the ballot images and audio), as httpd served
+   them, so the booths don't change.  Connections are kept open
+   between requests (HTTP/1.1), so a booth's run of requests doesn't
+   pay for a new one each time.  The daemon itself never keeps a
+   connection open (to itself or the slave): a worker waiting on an
+   idle connection can't answer anyone else. */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <common/evacs.h>
+#include <common/database.h>
+#include <common/authenticate.h>
+#include <common/socket.h>
+#include "voting_server.h"
+#include "voting_daemon.h"
+#include "cgi.h"
+
+/* Where httpd served the booth's files from */
+#define DOCUMENT_ROOT "/var/www/html"
+
+/* Largest request we accept (headers and body) */
+#define MAX_REQUEST_SIZE (1024*1024)
+
+static const struct {
+	const char *url;
+	cgi_handler handler;
+} handlers[] = {
+	{ AUTHENTICATE_CGI, authenticate_request },
+	{ "/cgi-bin/get_rotation", get_rotation_request },
+	{ "/cgi-bin/get_initial_cursor", get_initial_cursor_request },
+	{ "/cgi-bin/commit_vote", commit_vote_request },
+};
+#define NUM_HANDLERS (sizeof(handlers)/sizeof(handlers[0]))
+
+/* Set by SIGTERM/SIGINT in the parent */
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_sig(int signum)
+{
+	stopping = 1;
+}
+
+/* A connection from a booth (or the master), and what has been read
+   from it but not yet answered: the next request or two, if it is
+   pipelining them */
+struct client
+{
+	int fd;
+	char *buf;
+	size_t len, size;
+};
+
+/* Read some more into the client's buffer (growing it if need be),
+   waiting at most timeout ms.  False on EOF, error or timeout. */
+static bool read_more(struct client *c, int timeout)
+{
+	ssize_t r;
+
+	if (c->len == c->size) {
+		char *newbuf;
+
+		if (c->size >= MAX_REQUEST_SIZE)
+			return false;
+		newbuf = realloc(c->buf, c->size * 2 + 1);
+		if (!newbuf)
+			return false;
+		c->buf = newbuf;
+		c->size *= 2;
+	}
+	r = sock_read(c->fd, c->buf + c->len, c->size - c->len, timeout);
+	if (r <= 0)
+		return false;
+	c->len += r;
+	c->buf[c->len] = '\0';
+	return true;
+}
+
+/* Read a request's headers and body, waiting at most timeout ms for
+   it to start.  Returns the request (to be freed by the caller) with
+   *body pointing at the nul-terminated body, or NULL on error or if
+   the client has gone. */
+static char *read_request(struct client *c, char **body, int timeout)
+{
+	size_t header_len, content_length = 0, request_len;
+	char *request, *end, *p;
+
+	if (c->len == 0 && !read_more(c, timeout))
+		return NULL;
+
+	/* Read until the end of the headers */
+	while ((end = strstr(c->buf, "\r\n\r\n")) == NULL)
+		if (!read_more(c, SOCKET_TIMEOUT * 1000))
+			return NULL;
+	header_len = end + 4 - c->buf;
+
+	/* Find out how much body follows */
+	for (p = c->buf; p && p < end; p = strchr(p, '\n')) {
+		if (*p == '\n')
+			p++;
+		if (strncasecmp(p, "Content-length:", 15) == 0)
+			content_length = strtoul(p + 15, NULL, 10);
+	}
+	if (content_length > MAX_REQUEST_SIZE)
+		return NULL;
+	request_len = header_len + content_length;
+
+	while (c->len < request_len)
+		if (!read_more(c, SOCKET_TIMEOUT * 1000))
+			return NULL;
+
+	/* Take it out of the buffer, leaving any request after it */
+	request = malloc(request_len + 1);
+	if (!request)
+		return NULL;
+	memcpy(request, c->buf, request_len);
+	request[request_len] = '\0';
+	c->len -= request_len;
+	memmove(c->buf, c->buf + request_len, c->len + 1);
+
+	*body = request + header_len;
+	return request;
+}
+
+/* Whether the client wants the connection kept open after this
+   request: HTTP/1.1 does unless it says otherwise */
+static bool wants_keep_alive(const char *request)
+{
+	const char *end = strstr(request, "\r\n\r\n");
+	const char *p;
+	bool keep_alive;
+
+	p = strchr(request, '\n');
+	if (!p)
+		return false;
+	keep_alive = (p - request >= 9 && strncmp(p - 9, "HTTP/1.1\r", 9) == 0);
+
+	for (; p && p < end; p = strchr(p, '\n')) {
+		p++;
+		if (strncasecmp(p, "Connection:", 11) != 0)
+			continue;
+		p += 11 + strspn(p + 11, " \t");
+		if (strncasecmp(p, "close", 5) == 0)
+			keep_alive = false;
+		else if (strncasecmp(p, "keep-alive", 10) == 0)
+			keep_alive = true;
+	}
+	return keep_alive;
+}
+
+/* The header ending a response which closes the connection */
+#define CLOSE_HEADER(keep_alive) ((keep_alive) ? "" : "Connection: close\r\n")
+
+/* An HTTP response with no body */
+static void send_status(int fd, const char *status, bool keep_alive)
+{
+	sock_printf(fd, "HTTP/1.1 %s\r\n%sContent-length: 0\r\n\r\n",
+		    status, CLOSE_HEADER(keep_alive));
+}
+
+/* Send a file from under the document root */
+static void send_file(int fd, const char *docroot, const char *url,
+		      bool keep_alive)
+{
+	char *path, *query;
+	struct stat st;
+	char *data;
+	int file;
+
+	if (url[0] != '/' || strstr(url, "..")) {
+		send_status(fd, "403 Forbidden", keep_alive);
+		return;
+	}
+
+	path = sprintf_malloc("%s%s", docroot, url);
+	/* Ignore any query string */
+	query = strchr(path, '?');
+	if (query)
+		*query = '\0';
+
+	file = open(path, O_RDONLY);
+	free(path);
+	if (file < 0 || fstat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+		if (file >= 0)
+			close(file);
+		send_status(fd, "404 Not Found", keep_alive);
+		return;
+	}
+
+	/* Mapped rather than read: asset bundles run to megabytes */
+	data = NULL;
+	if (st.st_size > 0) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, file, 0);
+		if (data == MAP_FAILED) {
+			close(file);
+			send_status(fd, "500 Internal Server Error", keep_alive);
+			return;
+		}
+	}
+	close(file);
+
+	sock_printf(fd, "HTTP/1.1 200 OK\r\n%sContent-length: %lu\r\n\r\n",
+		    CLOSE_HEADER(keep_alive), (unsigned long)st.st_size);
+	if (data) {
+		sock_write(fd, data, st.st_size);
+		munmap(data, st.st_size);
+	}
+}
+
+/* Answer requests when we can't reach the database */
+static void unavailable_request(PGconn *conn, const struct http_vars *vars)
+{
+	cgi_error_response(ERR_SERVER_INTERNAL);
+}
+
+/* The worker's database connection, (re)connecting if needed.  NULL
+   if the database can't be reached. */
+static PGconn *get_connection(PGconn *conn)
+{
+	if (conn && PQstatus(conn) == CONNECTION_OK)
+		return conn;
+
+	if (conn) {
+		PQreset(conn);
+		if (PQstatus(conn) == CONNECTION_OK)
+			return conn;
+		PQfinish(conn);
+	}
+
+	/* Can be the master or the slave */
+	conn = connect_db_port("evacs", get_database_port());
+	if (conn && PQstatus(conn) != CONNECTION_OK) {
+		fprintf(stderr, "voting_daemon: %s", PQerrorMessage(conn));
+		PQfinish(conn);
+		conn = NULL;
+	}
+	return conn;
+}
+
+/* Answer one request on fd */
+static void serve_request(int fd, PGconn **conn, const char *docroot,
+			  const char *request, const char *body,
+			  bool keep_alive)
+{
+	char method[8], url[256];
+	struct http_vars *vars;
+	unsigned int i;
+
+	if (sscanf(request, "%7s %255s", method, url) != 2) {
+		send_status(fd, "400 Bad Request", keep_alive);
+		return;
+	}
+
+	if (strcmp(method, "POST") == 0) {
+		for (i = 0; i < NUM_HANDLERS; i++) {
+			if (strcmp(url, handlers[i].url) != 0)
+				continue;
+
+			vars = http_urldecode(body);
+			if (!vars) {
+				send_status(fd, "500 Internal Server Error",
+					    keep_alive);
+				break;
+			}
+			*conn = get_connection(*conn);
+			cgi_serve_request(fd, keep_alive,
+					  *conn ? handlers[i].handler
+					  : unavailable_request,
+					  *conn, vars);
+			http_free(vars);
+
+			/* A handler which bailed out may have left a
+			   transaction (or a pipeline) open */
+			if (*conn && PQpipelineStatus(*conn) != PQ_PIPELINE_OFF) {
+				PQfinish(*conn);
+				*conn = NULL;
+			} else if (*conn
+				   && PQtransactionStatus(*conn) != PQTRANS_IDLE)
+				PQclear(PQexec(*conn, "ROLLBACK;"));
+			break;
+		}
+		if (i == NUM_HANDLERS)
+			send_status(fd, "404 Not Found", keep_alive);
+	} else if (strcmp(method, "GET") == 0)
+		send_file(fd, docroot, url, keep_alive);
+	else
+		send_status(fd, "501 Not Implemented", keep_alive);
+}
+
+/* Answer requests on fd until the client closes it, goes quiet for
+   HTTP_KEEPALIVE_TIMEOUT, or this worker has served its share.  The
+   timeout is short: a booth keeping a connection open ties up a whole
+   worker, so it only pays while a booth is making a run of requests. */
+static void serve_connection(int fd, PGconn **conn, const char *docroot,
+			     unsigned int *served)
+{
+	struct client client;
+	bool keep_alive = true;
+	unsigned int requests = 0;
+	int one = 1;
+
+	/* Responses are written in pieces: don't hold any back */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	client.fd = fd;
+	client.len = 0;
+	client.size = 4096;
+	client.buf = malloc(client.size + 1);
+	if (!client.buf)
+		return;
+	client.buf[0] = '\0';
+
+	while (keep_alive) {
+		char *request, *body;
+
+		request = read_request(&client, &body, requests
+				       ? HTTP_KEEPALIVE_TIMEOUT * 1000
+				       : SOCKET_TIMEOUT * 1000);
+		if (!request)
+			break;
+
+		requests++;
+		(*served)++;
+		keep_alive = wants_keep_alive(request)
+			&& *served < VOTING_DAEMON_MAX_REQUESTS;
+		serve_request(fd, conn, docroot, request, body, keep_alive);
+		free(request);
+	}
+	free(client.buf);
+}
+
+/* Serve requests until it's time to be replaced */
+static void worker(int listen_fd, const char *docroot)
+__attribute__((noreturn));
+
+static void worker(int listen_fd, const char *docroot)
+{
+	PGconn *conn = NULL;
+	unsigned int served = 0;
+
+	set_cgi_bailout();
+
+	while (served < VOTING_DAEMON_MAX_REQUESTS) {
+		int fd;
+
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "voting_daemon: accept: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+
+		serve_connection(fd, &conn, docroot, &served);
+		close(fd);
+	}
+
+	if (conn)
+		PQfinish(conn);
+	exit(0);
+}
+
+static pid_t start_worker(int listen_fd, const char *docroot)
+{
+	sigset_t stop_signals, old;
+	pid_t pid;
+
+	/* Hold off SIGTERM until the child has dropped our handler */
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGTERM);
+	sigaddset(&stop_signals, SIGINT);
+	sigprocmask(SIG_BLOCK, &stop_signals, &old);
+
+	pid = fork();
+	if (pid == 0) {
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		worker(listen_fd, docroot);
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	if (pid < 0)
+		fprintf(stderr, "voting_daemon: fork: %s\n", strerror(errno));
+	return pid;
+}
+
+int main(int argc, char *argv[])
+{
+	pid_t workers[VOTING_DAEMON_WORKERS];
+	unsigned int port = SERVER_PORT, i;
+	const char *docroot = DOCUMENT_ROOT;
+	char port_string[INT_CHARS + 1];
+	struct sigaction sa;
+	unsigned int backoff = 0;
+	int listen_fd, ret = 0;
+
+	if (argc > 1)
+		port = atoi(argv[1]);
+	if (argc > 2)
+		docroot = argv[2];
+
+	/* The handlers tell whether they're the master or the slave from
+	   the port, as httpd told the CGIs */
+	sprintf(port_string, "%u", port);
+	setenv("SERVER_PORT", port_string, 1);
+
+	listen_fd = open_socket_in(port);
+	if (listen_fd < 0)
+		bailout("Could not listen on port %u: %s\n",
+			port, strerror(errno));
+
+	/* A booth hanging up mustn't kill the worker answering it */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* No SA_RESTART: stopping must interrupt the wait() below */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop_sig;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	for (i = 0; i < VOTING_DAEMON_WORKERS; i++)
+		workers[i] = -1;
+
+	/* Keep every slot filled, replacing workers as they retire or
+	   die */
+	while (!stopping) {
+		unsigned int running = 0, empty = 0;
+		int status, options = 0;
+		pid_t pid;
+
+		for (i = 0; i < VOTING_DAEMON_WORKERS; i++) {
+			if (workers[i] < 0)
+				workers[i] = start_worker(listen_fd, docroot);
+			if (workers[i] < 0)
+				empty++;
+			else
+				running++;
+		}
+		if (empty) {
+			if (backoff == 0)
+				backoff = VOTING_DAEMON_MIN_BACKOFF;
+			else
+				backoff *= 2;
+			if (backoff > VOTING_DAEMON_MAX_BACKOFF)
+				backoff = VOTING_DAEMON_MAX_BACKOFF;
+			fprintf(stderr, "voting_daemon: %u of %u workers not "
+				"running: retrying in %u seconds\n",
+				empty, VOTING_DAEMON_WORKERS, backoff);
+			sleep(backoff);
+			/* Reap any that exited meanwhile, but don't wait */
+			options = WNOHANG;
+		} else
+			backoff = 0;
+		if (running == 0)
+			continue;
+
+		pid = waitpid(-1, &status, options);
+		if (pid == 0)
+			continue;
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			/* Including ECHILD: our workers have gone */
+			fprintf(stderr, "voting_daemon: wait: %s\n",
+				strerror(errno));
+			ret = 1;
+			break;
+		}
+		if (stopping)
+			break;
+		for (i = 0; i < VOTING_DAEMON_WORKERS; i++) {
+			if (workers[i] != pid)
+				continue;
+			/* Don't spin if workers are failing at once */
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				sleep(1);
+			workers[i] = -1;
+		}
+	}
+
+	for (i = 0; i < VOTING_DAEMON_WORKERS; i++)
+		if (workers[i] > 0)
+			kill(workers[i], SIGTERM);
+	while (wait(NULL) > 0);
+
+	close(listen_fd);
+	return ret;
+}
@@ -0,0 +1,57 @@
+#ifndef _VOTING_DAEMON_H
+#define _VOTING_DAEMON_H
+/* This file is (C) copyright 2001-2004 Software Improvements, Pty Ltd */
+
+/* This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* The request handlers of the CGI programs, which the voting daemon
+   calls directly.  The CGIs are compiled again with VOTING_DAEMON
+   defined to leave out their main(). */
+#include <libpq-fe.h>
+#include <common/http.h>
+#include <common/barcode.h>
+
+/* Number of worker processes the daemon keeps running */
+#define VOTING_DAEMON_WORKERS 16
+
+/* A worker exits (and is replaced) after this many requests, so
+   anything a request leaks is bounded */
+#define VOTING_DAEMON_MAX_REQUESTS 1000
+
+/* If a worker can't be started, try again after this many seconds,
+   doubling each time it fails up to VOTING_DAEMON_MAX_BACKOFF */
+#define VOTING_DAEMON_MIN_BACKOFF 1
+#define VOTING_DAEMON_MAX_BACKOFF 32
+
+/* DDS3.2.3: Authenticate */
+extern void authenticate_request(PGconn *conn, const struct http_vars *vars);
+
+/* The checks authenticate_request() makes, for commit_vote to make
+   on its own connection: fills in the response it would send (the
+   electorate and ballot contents, not to be freed), or returns the
+   error. */
+extern enum error check_barcode(PGconn *conn, const struct barcode *bc,
+				const struct http_vars **response);
+
+/* Next Robson rotation for an electorate */
+extern void get_rotation_request(PGconn *conn, const struct http_vars *vars);
+
+/* Next initial cursor position for an electorate */
+extern void get_initial_cursor_request(PGconn *conn,
+				       const struct http_vars *vars);
+
+/* DDS3.2.26: Commit Vote */
+extern void commit_vote_request(PGconn *conn, const struct http_vars *vars);
+#endif /*_VOTING_DAEMON_H*/
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <common/authenticate.h>
+#include <common/database.h>
 #include "voting_server.h"
 
 /* Slave is on different port */
@@ -52,3 +53,30 @@ uint16_t get_port(void)
 	else return SLAVE_SERVER_PORT;
 }
 
+/* The electorates don't change while polling is open, so each process
+   fetches them once.  NULL if there is no such electorate. */
+const struct electorate *lookup_electorate(PGconn *conn, unsigned int code)
+{
+	static struct electorate *electorates = NULL;
+	const struct electorate *i;
+
+	if (!electorates)
+		electorates = get_electorates(conn);
+
+	for (i = electorates; i; i = i->next)
+		if (i->code == code)
+			return i;
+	return NULL;
+}
+
+/* The polling place this server is in.  It is set up before polling,
+   so each process reads it once.  -1 if not set. */
+int server_polling_place(PGconn *conn)
+{
+	static int ppcode = -1;
+
+	if (ppcode < 0)
+		ppcode = SQL_singleton_int(conn,"SELECT polling_place_code "
+					   "FROM server_parameter;");
+	return ppcode;
+}
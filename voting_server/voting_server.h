@@ -18,6 +18,8 @@
 
 /* Common routines and definitions for Voting Server */
 #include <stdbool.h>
+#include <libpq-fe.h>
+#include <common/evacs.h>
 #include <common/voting_errors.h>
 
 /* Location of the slave web server */
@@ -29,4 +31,11 @@ extern bool am_i_master(void);
 
 /* Function for CGI scripts to get database server, port. */
 extern const char *get_database_port(void);
+
+/* Find an electorate (fetched from the database once per process) */
+extern const struct electorate *lookup_electorate(PGconn *conn,
+						  unsigned int code);
+
+/* This server's polling place code (read once per process), or -1 */
+extern int server_polling_place(PGconn *conn);
 #endif /*_VOTING_SERVER_H*/